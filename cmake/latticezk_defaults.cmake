@@ -1,5 +1,7 @@
 if(NOT DEFINED LATTICEZK_MACHINE_COMPILE_FLAGS)
-	set(LATTICEZK_MACHINE_COMPILE_FLAGS "-march=native -msse -msse2 -maes -mfma -O3")
+	# ISA-specific code is selected at run time (see include/latticezk/util/cpu.hpp), so the default
+	# build does not depend on the build machine
+	set(LATTICEZK_MACHINE_COMPILE_FLAGS "-O3")
 endif()
 
 set(LATTICEZK_DEFAULT_FILE_COMPILE_FLAGS "${LATTICEZK_MACHINE_COMPILE_FLAGS}")
@@ -0,0 +1,135 @@
+#ifndef __LATTICEZK_ALLOCATOR_HPP_
+#define __LATTICEZK_ALLOCATOR_HPP_
+
+// Allocation of matrix storage
+//   - MatrixAllocator allocates aligned buffers directly, and is the base of other allocators
+//   - MatrixArena keeps the buffers freed to it by size and hands them out again, so that matrices of
+//     the same dimensions, as in repeated proofs, are allocated once
+//   - HugePageAllocator maps large matrices in huge pages placed on NUMA nodes (see hugepage.hpp)
+//   - MatrixInit selects whether a new matrix is zeroed, or left uninitialized for a first operation
+//     that overwrites every entry anyway, such as a multiplication into it
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "latticezk/common.hpp"
+
+// Bytes that the shares of the storage of a matrix, which each thread first touches (see hugepage.hpp), zeroes
+// and copies, are aligned to, those of a 2MB huge page
+#define LATTICEZK_SHARE_ALIGN_BYTES (1 << 21)
+
+namespace LatticeZK {
+
+enum class MatrixInit
+{
+	Zero,
+	Uninitialized
+};
+
+class MatrixAllocator
+{
+public:
+	virtual ~MatrixAllocator()
+	{
+	}
+public:
+	// Returns a buffer of at least the given bytes aligned to LATTICEZK_ALIGNMENT, or nullptr
+	virtual void * Allocate(size_t bytes)
+	{
+		return LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, RoundUp(bytes));
+	}
+	// Frees a buffer returned by Allocate for the same bytes
+	virtual void Free(void * p, size_t bytes)
+	{
+		LATTICEZK_UNUSED(bytes);
+		LATTICEZK_ALIGNED_FREE(p);
+	}
+public:
+	// The allocator of matrices not given one
+	static MatrixAllocator & Default()
+	{
+		static MatrixAllocator allocator;
+		return allocator;
+	}
+	// Rounds up to a whole number of alignments, as aligned_alloc requires, and to at least one
+	static size_t RoundUp(size_t bytes)
+	{
+		return bytes > 0 ? (bytes + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT * LATTICEZK_ALIGNMENT : LATTICEZK_ALIGNMENT;
+	}
+};
+
+// Recycles freed buffers of the same (rounded) size, which come from an upstream allocator, and is safe to
+// share between threads
+// The arena must outlive the matrices allocated from it, and frees its buffers when destroyed or released
+class MatrixArena : public MatrixAllocator
+{
+private:
+	MatrixAllocator & upstream;
+	std::mutex mutex;
+	std::unordered_map<size_t, std::vector<void *>> pool;
+	size_t n_allocated, n_reused;
+private:
+	MatrixArena(const MatrixArena & other) = delete;
+	MatrixArena(const MatrixArena && other) = delete;
+public:
+	MatrixArena(MatrixAllocator & upstream = MatrixAllocator::Default()) :
+		upstream(upstream), n_allocated(0), n_reused(0)
+	{
+	}
+	~MatrixArena()
+	{
+		Release();
+	}
+public:
+	void * Allocate(size_t bytes) override
+	{
+		bytes = RoundUp(bytes);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::vector<void *> & buffers = pool[bytes];
+			if (!buffers.empty()) {
+				void * p = buffers.back();
+				buffers.pop_back();
+				n_reused++;
+				return p;
+			}
+			n_allocated++;
+		}
+		return upstream.Allocate(bytes);
+	}
+	void Free(void * p, size_t bytes) override
+	{
+		if (p == nullptr) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		pool[RoundUp(bytes)].push_back(p);
+	}
+	// Frees the buffers kept for reuse
+	void Release()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & sized : pool) {
+			for (void * p : sized.second) {
+				upstream.Free(p, sized.first);
+			}
+		}
+		pool.clear();
+	}
+public:
+	// Numbers of buffers allocated anew and handed out again
+	size_t NumAllocated() const
+	{
+		return n_allocated;
+	}
+	size_t NumReused() const
+	{
+		return n_reused;
+	}
+};
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_ALLOCATOR_HPP_
@@ -0,0 +1,393 @@
+#ifndef __LATTICEZK_BITMATRIX_HPP_
+#define __LATTICEZK_BITMATRIX_HPP_
+
+// Bit-packed matrices of entries in {0,1}, such as the challenge matrix of the protocol, supporting
+//   - CMO (column-major-order) packing into 64-bit words, bit i of column j being bit i%64 of word i/64
+//     of the column, whose padding bits beyond the rows are kept zero
+//   - conversion from and to matrices
+//   - matrix multiplication in the forms (RMO,bits) -> CMO and (CMO,bits) -> CMO, and of views, which only adds
+//     (see gemm/bitgemm.hpp), where the left operand may have narrower entries than the result
+//   - batched multiplication (RMO,bits) -> CMO of one left operand by several bit matrices
+//   - checking A*Z = T*C + W for a bit matrix C, without forming the products
+//   - computing B = S*C and Z = B + Y with the statistics of rejection sampling, in one pass over the output
+//   - counting bits and transposing 64-by-64 blocks of bits, for multiplying bit matrices by bit matrices
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/matrix.hpp"
+#include "latticezk/gemm/bitgemm.hpp"
+
+namespace LatticeZK {
+
+// Number of set bits of x
+inline int BitCount(uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ull);
+	x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (int)((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Transposes in place the 64-by-64 bit matrix whose entry (i, j) is bit j of w[i], by swapping ever smaller blocks
+inline void BitTranspose64(uint64_t w[64])
+{
+	uint64_t m = 0x00000000ffffffffull;
+	for (int s = 32; s != 0; s >>= 1, m ^= m << s) {
+		for (int k = 0; k < 64; k = (k + s + 1) & ~s) {
+			const uint64_t t = ((w[k] >> s) ^ w[k + s]) & m;
+			w[k] ^= t << s;
+			w[k + s] ^= t;
+		}
+	}
+}
+
+class BitMatrix
+{
+public:
+	typedef uint64_t word_t;
+private:
+	const matdim_t n_rows, n_cols, n_words;
+	word_t *data;
+	MatrixAllocator & allocator;
+private:
+	BitMatrix(const BitMatrix & other) = delete;
+	BitMatrix(const BitMatrix && other) = delete;
+public:
+	// The storage is zeroed, as the padding bits must be, unless init is MatrixInit::Uninitialized for storage
+	// that is about to be overwritten in full
+	BitMatrix(matdim_t n_rows, matdim_t n_cols, MatrixInit init = MatrixInit::Zero, MatrixAllocator & allocator = MatrixAllocator::Default()) :
+		n_rows(n_rows), n_cols(n_cols), n_words((n_rows + 63) / 64), allocator(allocator)
+	{
+		data = (word_t *)allocator.Allocate(NumWords() * sizeof(word_t));
+		if (init == MatrixInit::Zero) {
+			Zero();
+		}
+	}
+	~BitMatrix()
+	{
+		allocator.Free(data, NumWords() * sizeof(word_t));
+	}
+public:
+	matdim_t NumRows() const
+	{
+		return n_rows;
+	}
+	matdim_t NumCols() const
+	{
+		return n_cols;
+	}
+	matdim_t NumCells() const
+	{
+		return n_rows * n_cols;
+	}
+	// Number of words per column
+	matdim_t ColumnWords() const
+	{
+		return n_words;
+	}
+	matdim_t NumWords() const
+	{
+		return n_words * n_cols;
+	}
+public:
+	word_t * Data()
+	{
+		return data;
+	}
+	const word_t * Data() const
+	{
+		return data;
+	}
+	word_t * Column(matdim_t j)
+	{
+		return data + j * n_words;
+	}
+	const word_t * Column(matdim_t j) const
+	{
+		return data + j * n_words;
+	}
+	// The words of columns [j0, j0+n), as read a block at a time by MatrixCheckProductsOf
+	const word_t * Columns(matdim_t j0, matdim_t n) const
+	{
+		LATTICEZK_UNUSED(n);
+		return Column(j0);
+	}
+	void Zero()
+	{
+		memset(data, 0, NumWords() * sizeof(word_t));
+	}
+	inline int operator()(matdim_t i, matdim_t j) const
+	{
+		return (int)((Column(j)[i >> 6] >> (i & 63)) & 1);
+	}
+	inline void Set(matdim_t i, matdim_t j, int bit)
+	{
+		word_t & w = Column(j)[i >> 6];
+		w = (w & ~((word_t)1 << (i & 63))) | ((word_t)(bit & 1) << (i & 63));
+	}
+public:
+	bool operator==(const BitMatrix & mat) const
+	{
+		return n_rows == mat.NumRows() && n_cols == mat.NumCols() && memcmp(data, mat.Data(), NumWords() * sizeof(word_t)) == 0;
+	}
+	bool operator!=(const BitMatrix & mat) const
+	{
+		return !(*this == mat);
+	}
+public:
+	// Copies from a matrix, returning false if it has an entry other than 0 or 1
+	template<typename T, typename Order>
+	bool FromMatrix(const Matrix<T, Order> & mat)
+	{
+		if (n_rows != mat.NumRows() || n_cols != mat.NumCols()) {
+			return false;
+		}
+		for (matdim_t j = 0; j < n_cols; j++) {
+			for (matdim_t i = 0; i < n_rows; i++) {
+				T e = mat(i, j);
+				if (e != 0 && e != 1) {
+					return false;
+				}
+				Set(i, j, (int)e);
+			}
+		}
+		return true;
+	}
+	template<typename T, typename Order>
+	bool ToMatrix(Matrix<T, Order> & mat) const
+	{
+		if (n_rows != mat.NumRows() || n_cols != mat.NumCols()) {
+			return false;
+		}
+		for (matdim_t j = 0; j < n_cols; j++) {
+			for (matdim_t i = 0; i < n_rows; i++) {
+				mat(i, j) = (T)this->operator()(i, j);
+			}
+		}
+		return true;
+	}
+};
+
+template<typename A, typename T>
+bool MatrixMultiply(MatrixView<A> a, const BitMatrix &b, MatrixView<T> c)
+{
+	typedef typename std::remove_const<A>::type S;
+	if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+		return false;
+	}
+	LATTICEZK_LOG("bit-matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols());
+	GemmStridedSource<S> asrc(a.Data(), a.RowStride(), a.ColStride());
+	return BitGemm<T>(c.NumRows(), c.NumCols(), a.NumCols(), asrc, b.Data(), b.ColumnWords(), c.Data(), c.RowStride(), c.ColStride());
+}
+
+template<typename T, typename S, typename Order>
+bool MatrixMultiply(const Matrix<S, Order> &a, const BitMatrix &b, Matrix<T, ColumnMajorOrder> &c)
+{
+	return MatrixMultiply(a.View(), b, c.View());
+}
+
+// Computes C_i = A*B_i for each bit matrix B_i, building the subset-sum tables of each block of A once for the whole batch
+template<typename T, typename S>
+bool MatrixMultiplyBatch(const Matrix<S, RowMajorOrder> &a, const std::vector<const BitMatrix *> &b, const std::vector<Matrix<T, ColumnMajorOrder> *> &c)
+{
+	if (b.size() != c.size()) {
+		return false;
+	}
+	GemmBatchOperands<T, BitGemmColumns> batch;
+	for (size_t i = 0; i < b.size(); i++) {
+		if (a.NumRows() != c[i]->NumRows() || b[i]->NumCols() != c[i]->NumCols() || a.NumCols() != b[i]->NumRows()) {
+			return false;
+		}
+		batch.Add(c[i]->NumCols(), BitGemmColumns(b[i]->Data(), b[i]->ColumnWords()), c[i]->Data(), 1, c[i]->NumRows());
+	}
+	LATTICEZK_LOG("bit-matrix batch mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.size() << " items");
+	GemmStridedSource<S> asrc(a.Data(), a.NumCols(), 1);
+	return BitGemmBatch<T>(a.NumRows(), a.NumCols(), asrc, batch);
+}
+
+// Bit-matrix multiplication epilogue storing B and Z = B + Y, and accumulating <Z,B> and ||B||^2 per row
+// The sums of a tile are added to those of its rows under a lock, as tiles of other columns of the same rows may be
+// passed on other threads; the sums are exact, so their total does not depend on how the product is split
+template<typename T>
+class BitGemmAddStats
+{
+private:
+	T * b, * z;
+	const T * y;
+	const matdim_t ld;
+	std::vector<MatrixDotSum<T>> zb, bb;
+	std::mutex mutex;
+public:
+	BitGemmAddStats(T * b, T * z, const T * y, matdim_t m) :
+		b(b), z(z), y(y), ld(m), zb(m), bb(m)
+	{
+	}
+public:
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n)
+	{
+		typedef gemm_uint_t<T> U;
+		std::vector<MatrixDotSum<T>> tile_zb(m), tile_bb(m);
+		for (matdim_t j = 0; j < n; j++) {
+			const T * t = tile + j * MR;
+			const matdim_t o = (j0 + j) * ld + i0;
+			for (matdim_t i = 0; i < m; i++) {
+				T bi = t[i], zi = (T)((U)bi + (U)y[o + i]);
+				b[o + i] = bi;
+				z[o + i] = zi;
+				tile_zb[i].AddProduct(zi, bi);
+				tile_bb[i].AddProduct(bi, bi);
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		for (matdim_t i = 0; i < m; i++) {
+			zb[i0 + i] += tile_zb[i];
+			bb[i0 + i] += tile_bb[i];
+		}
+	}
+	// Adds the sums of the rows, exactly, as when combining the epilogues of parts of the columns
+	void AddStats(MatrixDotSum<T> & zbsum, MatrixDotSum<T> & bbsum) const
+	{
+		for (matdim_t i = 0; i < ld; i++) {
+			zbsum += zb[i];
+			bbsum += bb[i];
+		}
+	}
+	// Sums the rows
+	void Stats(double & ZB, double & BB) const
+	{
+		MatrixDotSum<T> zbsum, bbsum;
+		AddStats(zbsum, bbsum);
+		ZB = zbsum.ToDouble();
+		BB = bbsum.ToDouble();
+	}
+};
+
+// Computes B = S*C and Z = B + Y for a bit matrix C, along with <Z,B> and ||B||^2 (squared Frobenius norm)
+template<typename T, typename S>
+bool MatrixMultiplyAdd(const Matrix<S, RowMajorOrder> &s, const BitMatrix &c, const Matrix<T, ColumnMajorOrder> &y,
+	Matrix<T, ColumnMajorOrder> &b, Matrix<T, ColumnMajorOrder> &z, double &ZB, double &BB)
+{
+	const matdim_t m = b.NumRows(), n = b.NumCols();
+	if (s.NumRows() != m || s.NumCols() != c.NumRows() || c.NumCols() != n
+			|| y.NumRows() != m || y.NumCols() != n || z.NumRows() != m || z.NumCols() != n) {
+		return false;
+	}
+	LATTICEZK_LOG("bit-matrix mult-add size: " << m << " | " << s.NumCols() << " | " << n);
+	GemmStridedSource<S> ssrc(s.Data(), s.NumCols(), 1);
+	BitGemmAddStats<T> epilogue(b.Data(), z.Data(), y.Data(), m);
+	if (!BitGemm<T>(m, n, s.NumCols(), ssrc, c.Data(), c.ColumnWords(), epilogue)) {
+		return false;
+	}
+	epilogue.Stats(ZB, BB);
+	return true;
+}
+
+// Checks A*Z = T*C + W, setting equal accordingly, where A, of a_cols columns, is read through a source of the
+// blocked engine (see gemm/gemm.hpp), and the bit matrix C via its Columns method (see BitMatrix), a block of
+// columns at a time, so that a C generated as it is read need only hold a block; the dimensions are not checked
+// The products are computed a block of columns at a time into scratch that stays in cache, W is subtracted
+// in the epilogue and the check stops at the first block with a nonzero difference
+template<typename T, typename ASource, typename CBlocks>
+bool MatrixCheckProductsBlocks(const ASource &asrc, matdim_t a_cols, ConstMatrixView<T> z, ConstMatrixView<T> t,
+	CBlocks &c, ConstMatrixView<T> w, bool &equal)
+{
+	typedef gemm_uint_t<T> U;
+	const matdim_t m = w.NumRows(), n = w.NumCols();
+	// the two products of a block fill half of L2
+	const matdim_t nb = std::max<matdim_t>(1, std::min<matdim_t>(n, (TuningProfile::Current().gemm_l2_bytes / 4 / (std::max<matdim_t>(m, 1) * sizeof(T))) & ~7));
+	const size_t bytes = ((m * nb * sizeof(T) + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT) * LATTICEZK_ALIGNMENT;
+	T * az = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, bytes > 0 ? bytes : LATTICEZK_ALIGNMENT);
+	T * tc = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, bytes > 0 ? bytes : LATTICEZK_ALIGNMENT);
+	if (az == nullptr || tc == nullptr) {
+		LATTICEZK_ALIGNED_FREE(az);
+		LATTICEZK_ALIGNED_FREE(tc);
+		return false;
+	}
+	GemmStridedSource<T> zsrc(z.Data(), z.RowStride(), z.ColStride()), tsrc(t.Data(), t.RowStride(), t.ColStride());
+	bool success = true;
+	equal = true;
+	for (matdim_t j0 = 0; success && equal && j0 < n; j0 += nb) {
+		const matdim_t nb1 = std::min(nb, n - j0);
+		const uint64_t * cj = c.Columns(j0, nb1);
+		success = cj != nullptr
+			&& Gemm<T>(m, nb1, a_cols, asrc, zsrc.Block(0, j0), az, 1, m)
+			&& BitGemm<T>(m, nb1, t.NumCols(), tsrc, cj, c.ColumnWords(), tc, 1, m);
+		U d = 0;
+		for (matdim_t j = 0; j < nb1; j++) {
+			const T * wj = &w(0, j0 + j);
+			for (matdim_t i = 0; i < m; i++) {
+				// narrow entries are compared in their own width, not that of U
+				d |= (U)(T)((U)az[j * m + i] - (U)tc[j * m + i] - (U)wj[i * w.RowStride()]);
+			}
+		}
+		equal = d == 0;
+	}
+	LATTICEZK_ALIGNED_FREE(az);
+	LATTICEZK_ALIGNED_FREE(tc);
+	return success;
+}
+
+// Checks A*Z = T*C + W as above, where A has a_rows rows, after checking the dimensions
+template<typename T, typename ASource, typename CBlocks>
+bool MatrixCheckProductsOf(const ASource &asrc, matdim_t a_rows, matdim_t a_cols, const Matrix<T, ColumnMajorOrder> &z,
+	const Matrix<T, RowMajorOrder> &t, CBlocks &c, const Matrix<T, ColumnMajorOrder> &w, bool &equal)
+{
+	const matdim_t m = w.NumRows(), n = w.NumCols();
+	if (a_rows != m || a_cols != z.NumRows() || z.NumCols() != n
+			|| t.NumRows() != m || t.NumCols() != c.NumRows() || c.NumCols() != n) {
+		return false;
+	}
+	LATTICEZK_LOG("check products size: " << m << " | " << a_cols << " + " << t.NumCols() << " | " << n);
+	return MatrixCheckProductsBlocks(asrc, a_cols, z.View(), t.View(), c, w.View(), equal);
+}
+
+// The columns [j0, j0+n) of bit-matrix columns read a block at a time, as by MatrixCheckProductsOf
+template<typename CBlocks>
+class BitColumnsFrom
+{
+private:
+	CBlocks & c;
+	const matdim_t j0, n;
+public:
+	BitColumnsFrom(CBlocks & c, matdim_t j0, matdim_t n) :
+		c(c), j0(j0), n(n)
+	{
+	}
+public:
+	inline matdim_t NumRows() const
+	{
+		return c.NumRows();
+	}
+	inline matdim_t NumCols() const
+	{
+		return n;
+	}
+	inline matdim_t ColumnWords() const
+	{
+		return c.ColumnWords();
+	}
+	const uint64_t * Columns(matdim_t j1, matdim_t n1)
+	{
+		return c.Columns(j0 + j1, n1);
+	}
+};
+
+// Checks A*Z = T*C + W as above, for an in-memory A
+template<typename T>
+bool MatrixCheckProducts(const Matrix<T, RowMajorOrder> &a, const Matrix<T, ColumnMajorOrder> &z, const Matrix<T, RowMajorOrder> &t,
+	const BitMatrix &c, const Matrix<T, ColumnMajorOrder> &w, bool &equal)
+{
+	return MatrixCheckProductsOf(GemmStridedSource<T>(a.Data(), a.NumCols(), 1), a.NumRows(), a.NumCols(), z, t, c, w, equal);
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_BITMATRIX_HPP_
@@ -0,0 +1,75 @@
+// Column squared-norm kernels, see MatrixColumnsWithinNorm in matrixexpr.hpp
+// This file is built once per ISA level via util/multiversion.inl. ColumnNormKernel<T>::Run adds the squares of
+// n contiguous entries to limbs, such that the sum is limbs[0] + limbs[1]*2^32 + limbs[2]*2^64 + limbs[3]*2^96.
+// A square |x|^2 = (h*2^32 + l)^2 adds less than 2^34 to each limb, so limbs below 2^62 take 2^28 squares
+
+// Portable loop, which the compiler may vectorize for the level
+template<typename T>
+inline void ColumnNormLoop(const T * z, matdim_t n, uint64_t limbs[4])
+{
+	const uint64_t low = 0xffffffffull;
+	uint64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	for (matdim_t i = 0; i < n; i++) {
+		const int64_t x = (int64_t)z[i];
+		// |x| is exact as unsigned, INT64_MIN included
+		const uint64_t a = x < 0 ? 0 - (uint64_t)x : (uint64_t)x;
+		const uint64_t h = a >> 32, l = a & low;
+		const uint64_t ll = l * l, hl = h * l, hh = h * h;
+		a0 += ll & low;
+		a1 += (ll >> 32) + ((hl & low) << 1);
+		a2 += ((hl >> 32) << 1) + (hh & low);
+		a3 += hh >> 32;
+	}
+	limbs[0] += a0;
+	limbs[1] += a1;
+	limbs[2] += a2;
+	limbs[3] += a3;
+}
+
+template<typename T>
+class ColumnNormKernel
+{
+public:
+	static inline void Run(const T * z, matdim_t n, uint64_t limbs[4])
+	{
+		ColumnNormLoop(z, n, limbs);
+	}
+};
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
+
+// 64-bit entries: four at a time, the 32-bit halves of their absolute values multiplied into 64-bit lanes
+template<>
+class ColumnNormKernel<int64_t>
+{
+public:
+	static inline void Run(const int64_t * z, matdim_t n, uint64_t limbs[4])
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i low = _mm256_set1_epi64x(0xffffffffll);
+		__m256i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+		matdim_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(z + i));
+			const __m256i s = _mm256_cmpgt_epi64(zero, x);
+			x = _mm256_sub_epi64(_mm256_xor_si256(x, s), s);
+			const __m256i h = _mm256_srli_epi64(x, 32);
+			const __m256i ll = _mm256_mul_epu32(x, x);
+			const __m256i hl = _mm256_mul_epu32(h, x);
+			const __m256i hh = _mm256_mul_epu32(h, h);
+			a0 = _mm256_add_epi64(a0, _mm256_and_si256(ll, low));
+			a1 = _mm256_add_epi64(a1, _mm256_add_epi64(_mm256_srli_epi64(ll, 32), _mm256_slli_epi64(_mm256_and_si256(hl, low), 1)));
+			a2 = _mm256_add_epi64(a2, _mm256_add_epi64(_mm256_slli_epi64(_mm256_srli_epi64(hl, 32), 1), _mm256_and_si256(hh, low)));
+			a3 = _mm256_add_epi64(a3, _mm256_srli_epi64(hh, 32));
+		}
+		const __m256i * acc[4] = { &a0, &a1, &a2, &a3 };
+		for (int k = 0; k < 4; k++) {
+			alignas(32) uint64_t lanes[4];
+			_mm256_store_si256((__m256i *)lanes, *acc[k]);
+			limbs[k] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+		ColumnNormLoop(z + i, n - i, limbs);
+	}
+};
+
+#endif
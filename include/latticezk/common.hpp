@@ -3,6 +3,8 @@
 
 // Common definitions
 
+#include <stdint.h>
+
 #define LATTICEZK_UNUSED(expr) { (void)(expr); }
 
 #define LATTICEZK_ALIGNMENT 64
@@ -36,6 +38,13 @@ __pragma(warning(pop))
 	#define LATTICEZK_M256D(v1, v2, v3, v4) {v1, v2, v3, v4}
 #endif
 
+// Requests full unrolling of the following constant-trip-count loop, e.g. in register-blocked kernels
+#if defined(__GNUC__)
+	#define LATTICEZK_UNROLL _Pragma("GCC unroll 16")
+#else
+	#define LATTICEZK_UNROLL
+#endif
+
 #ifdef _WIN32
 	#define LATTICEZK_ALIGNED_ALLOC(a, size) _aligned_malloc(size, a)
 	#define LATTICEZK_ALIGNED_FREE(p) _aligned_free(p)
@@ -44,4 +53,10 @@ __pragma(warning(pop))
 	#define LATTICEZK_ALIGNED_FREE(p) free(p)
 #endif
 
+namespace LatticeZK {
+
+typedef int32_t matdim_t;
+
+} // namespace LatticeZK
+
 #endif // __LATTICEZK_COMMON_HPP_
@@ -4,6 +4,7 @@
 // Extending matrices to the GPU
 // An extended matrix is placed in CPU and GPU memory
 // Syncing to the GPU is needed after the CPU copy is modified
+// Extended matrices are not movable, as their GPU counterparts reference the CPU storage
 
 #include "latticezk/matrix.hpp"
 #include "latticezk/matrixops.hpp"
@@ -25,6 +26,10 @@ public:
 		Matrix<T, ColumnMajorOrder>(n_rows, n_cols), mv_vec(memory_model, n_rows, n_cols, Data())
 	{
 	}
+	CudaVector(matdim_t n_rows, matdim_t n_cols, MatrixInit init, MatrixAllocator & allocator, cuda_memory_model memory_model = DEFAULT_CUDA_MEMORY_MODEL) :
+		Matrix<T, ColumnMajorOrder>(n_rows, n_cols, init, allocator), mv_vec(memory_model, n_rows, n_cols, Data())
+	{
+	}
 public:
 	mv_vector<T> & GetMvVector()
 	{
@@ -50,6 +55,10 @@ public:
 		Matrix<T, RowMajorOrder>(n_rows, n_cols), mv_mat(Data(), n_rows, n_cols)
 	{
 	}
+	CudaMatrix(matdim_t n_rows, matdim_t n_cols, MatrixInit init, MatrixAllocator & allocator) :
+		Matrix<T, RowMajorOrder>(n_rows, n_cols, init, allocator), mv_mat(Data(), n_rows, n_cols)
+	{
+	}
 public:
 	mv_matrix_tex<T> & GetMvMatrix()
 	{
@@ -87,6 +96,10 @@ public:
 	{
 		return matops.Copy(dst, src) && Sync(dst);
 	}
+	bool Copy(BitMatrix& dst, const BitMatrix& src)
+	{
+		return matops.Copy(dst, src);
+	}
 	bool Sync(RowMajorMatrix & mat)
 	{
 		return mat.GetMvMatrix().toDevice(stream_set);
@@ -95,10 +108,89 @@ public:
 	{
 		return mat.GetMvVector().toDevice(stream_set);
 	}
+	// bit matrices stay on the host
+	bool Sync(BitMatrix & mat)
+	{
+		return matops.Sync(mat);
+	}
+	// so do matrices of narrow entries
+	template<typename S>
+	bool Sync(Matrix<S, RowMajorOrder> & mat)
+	{
+		return matops.Sync(mat);
+	}
 	bool Multiply(const RowMajorMatrix &a, const ColumnMajorMatrix &b, ColumnMajorMatrix &c)
 	{
 		return a.GetMvMatrix().multiply(stream_set, &c.GetMvVector(), &b.GetMvVector()) && c.GetMvVector().toHost(stream_set);
 	}
+	// matrices of narrow entries stay on the host, so the multiplication runs there, from the host copy of a
+	template<typename S>
+	bool Multiply(const RowMajorMatrix &a, const Matrix<S, RowMajorOrder> &b, ColumnMajorMatrix &c)
+	{
+		return matops.Multiply(a, b, c) && Sync(c);
+	}
+	template<typename S>
+	bool Multiply(const RowMajorMatrix &a, const Matrix<S, RowMajorOrder> &b, RowMajorMatrix &c)
+	{
+		return matops.Multiply(a, b, c) && Sync(c);
+	}
+	// multiplication by bits only adds, so it runs on the host, from the host copy of a
+	template<typename S>
+	bool Multiply(const Matrix<S, RowMajorOrder> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return matops.Multiply(a, b, c) && Sync(c);
+	}
+	template<typename S>
+	bool Multiply(const Matrix<S, ColumnMajorOrder> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return matops.Multiply(a, b, c) && Sync(c);
+	}
+	// so does C*X for a seeded challenge C, whose columns are generated on the host
+	bool Multiply(const SeededBitMatrix &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return matops.Multiply(a, b, c) && Sync(c);
+	}
+	// the GPU multiplies one right-hand side at a time
+	bool MultiplyBatch(const RowMajorMatrix &a, const std::vector<const ColumnMajorMatrix *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		if (b.size() != c.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < b.size(); i++) {
+			if (!Multiply(a, *b[i], *c[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+	template<typename S>
+	bool MultiplyBatch(const Matrix<S, RowMajorOrder> &a, const std::vector<const BitMatrix *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		std::vector<Matrix<T, ColumnMajorOrder> *> hc(c.begin(), c.end());
+		if (!MatrixMultiplyBatch(a, b, hc)) {
+			return false;
+		}
+		for (ColumnMajorMatrix * ci : c) {
+			if (!Sync(*ci)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	template<typename S>
+	bool MultiplyAdd(const Matrix<S, RowMajorOrder> &s, const BitMatrix &c, const ColumnMajorMatrix &y, ColumnMajorMatrix &b, ColumnMajorMatrix &z, double &ZB, double &BB)
+	{
+		return matops.MultiplyAdd(s, c, y, b, z, ZB, BB) && Sync(b) && Sync(z);
+	}
+	// the check runs on the host, from the host copies, where the products by bits are computed anyway
+	bool CheckProducts(const RowMajorMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const BitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		return matops.CheckProducts(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const RowMajorMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const SeededBitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		return matops.CheckProducts(a, z, t, c, w, equal);
+	}
 };
 
 } // namespace LatticeZK
@@ -0,0 +1,504 @@
+#ifndef __LATTICEZK_FILEMATRIX_HPP_
+#define __LATTICEZK_FILEMATRIX_HPP_
+
+// Matrices kept in files rather than in memory, for secrets S and products T too large for RAM
+//   - an r-by-c FileMatrix is the RMO storage of its entries as is, r*c entries in the byte order of the host
+//     and nothing else, so that a row tile is one contiguous read
+//   - its rows are read and written in tiles by pread and pwrite, at any offset and from any thread
+//   - a product by it streams its row tiles through two buffers: while one tile is multiplied on the executor,
+//     the next is read into the other buffer by a reader thread kept for the whole stream (see
+//     FileMatrixStreamRows), as mv_vector streams chunks to the GPU in cudamv/mv.inl
+//   - A*S for a file-backed S takes a tile of S as a block of the depth, accumulating the products of the
+//     tiles into the in-memory result, and X*C for a file-backed X, such as S or T, takes a tile of X as a
+//     block of the rows of the result
+// Elsewhere than Linux, the file is read and written through a stream instead
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/log.hpp"
+#include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/gemm/gemm.hpp"
+#include "latticezk/gemm/bitgemm.hpp"
+#include "latticezk/util/executor.hpp"
+#if defined(__linux__)
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// Bytes of a row tile read from a file matrix at a time, of which two are in memory while streaming
+#define LATTICEZK_FILE_TILE_BYTES (64 << 20)
+
+namespace LatticeZK {
+
+template<typename T>
+class FileMatrix
+{
+	static_assert(std::is_trivially_copyable<T>::value, "storing non-trivial entries");
+private:
+	matdim_t n_rows, n_cols;
+#if defined(__linux__)
+	int fd;
+#else
+	mutable std::fstream stream;
+#endif
+private:
+	FileMatrix(const FileMatrix & other) = delete;
+	FileMatrix(const FileMatrix && other) = delete;
+public:
+	FileMatrix() :
+		n_rows(0), n_cols(0)
+#if defined(__linux__)
+		, fd(-1)
+#endif
+	{
+	}
+	~FileMatrix()
+	{
+		Close();
+	}
+public:
+	// Creates, or truncates, a file of r-by-c zero entries, returning false if it cannot be written
+	bool Create(const std::string & path, matdim_t r, matdim_t c)
+	{
+		Close();
+		if (r < 0 || c < 0) {
+			return false;
+		}
+		const uint64_t bytes = (uint64_t)r * c * sizeof(T);
+#if defined(__linux__)
+		fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			return false;
+		}
+		if (ftruncate(fd, (off_t)bytes) != 0) {
+			Close();
+			return false;
+		}
+#else
+		stream.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!stream) {
+			return false;
+		}
+		if (bytes > 0) {
+			stream.seekp((std::streamoff)bytes - 1);
+			stream.put(0);
+		}
+		if (!stream) {
+			Close();
+			return false;
+		}
+#endif
+		n_rows = r;
+		n_cols = c;
+		return true;
+	}
+	// Opens a file of r-by-c entries, for writing too if writable, returning false if it is unreadable or of
+	// another size
+	bool Open(const std::string & path, matdim_t r, matdim_t c, bool writable = false)
+	{
+		Close();
+		if (r < 0 || c < 0) {
+			return false;
+		}
+		const uint64_t bytes = (uint64_t)r * c * sizeof(T);
+#if defined(__linux__)
+		fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != bytes) {
+			Close();
+			return false;
+		}
+		// the tiles are read in order, so the kernel may read ahead of them
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+		stream.open(path, writable ? std::ios::in | std::ios::out | std::ios::binary : std::ios::in | std::ios::binary);
+		if (!stream || !stream.seekg(0, std::ios::end) || (uint64_t)stream.tellg() != bytes) {
+			Close();
+			return false;
+		}
+#endif
+		n_rows = r;
+		n_cols = c;
+		return true;
+	}
+	void Close()
+	{
+#if defined(__linux__)
+		if (fd >= 0) {
+			close(fd);
+			fd = -1;
+		}
+#else
+		if (stream.is_open()) {
+			stream.close();
+		}
+		stream.clear();
+#endif
+		n_rows = 0;
+		n_cols = 0;
+	}
+	bool IsOpen() const
+	{
+#if defined(__linux__)
+		return fd >= 0;
+#else
+		return stream.is_open();
+#endif
+	}
+public:
+	matdim_t NumRows() const
+	{
+		return n_rows;
+	}
+	matdim_t NumCols() const
+	{
+		return n_cols;
+	}
+	// Entries of the file, which may exceed those that matdim_t counts
+	int64_t NumCells() const
+	{
+		return (int64_t)n_rows * n_cols;
+	}
+	// Rows of a tile of the given bytes, at least one
+	matdim_t TileRows(size_t tile_bytes = LATTICEZK_FILE_TILE_BYTES) const
+	{
+		const size_t row_bytes = std::max<size_t>(1, (size_t)n_cols * sizeof(T));
+		return (matdim_t)std::max<size_t>(1, std::min<size_t>((size_t)std::max<matdim_t>(1, n_rows), tile_bytes / row_bytes));
+	}
+public:
+	// Reads rows [i0, i0+m) into dst, returning false if they are out of the matrix or the file fails
+	bool ReadRows(matdim_t i0, matdim_t m, T * dst) const
+	{
+		if (i0 < 0 || m < 0 || i0 > n_rows - m || !IsOpen()) {
+			return false;
+		}
+		return Transfer(dst, (uint64_t)m * n_cols * sizeof(T), (uint64_t)i0 * n_cols * sizeof(T), false);
+	}
+	// Writes rows [i0, i0+m) from src, returning false if they are out of the matrix or the file fails
+	bool WriteRows(matdim_t i0, matdim_t m, const T * src)
+	{
+		if (i0 < 0 || m < 0 || i0 > n_rows - m || !IsOpen()) {
+			return false;
+		}
+		return Transfer((T *)src, (uint64_t)m * n_cols * sizeof(T), (uint64_t)i0 * n_cols * sizeof(T), true);
+	}
+	// The maximum over the rows of the sums of the absolute values of their entries, as in Matrix, read a tile
+	// at a time, or infinity if a read fails
+	double UpperBoundOnOperatorNorm() const
+	{
+		const matdim_t tile_rows = TileRows();
+		std::vector<T> tile((size_t)std::min(tile_rows, n_rows) * n_cols);
+		double r = 0;
+		for (matdim_t i0 = 0; i0 < n_rows; i0 += tile_rows) {
+			const matdim_t m = std::min(tile_rows, n_rows - i0);
+			if (!ReadRows(i0, m, tile.data())) {
+				return INFINITY;
+			}
+			r = std::max(r, Executor::Current().ParallelReduce(0, m, 1, 0.0, [&](int64_t i1, int64_t i2) {
+				double ri = 0;
+				for (int64_t i = i1; i < i2; i++) {
+					double s = 0;
+					for (matdim_t j = 0; j < n_cols; j++) {
+						const double v = (double)tile[(size_t)i * n_cols + j];
+						s += v < 0 ? -v : v;
+					}
+					ri = std::max(ri, s);
+				}
+				return ri;
+			}, [](double x, double y) { return x < y ? y : x; }));
+		}
+		return r;
+	}
+private:
+	bool Transfer(T * p, uint64_t bytes, uint64_t offset, bool write) const
+	{
+#if defined(__linux__)
+		uint8_t * q = (uint8_t *)p;
+		// a call may transfer fewer bytes than asked, at most some 2GB on Linux
+		while (bytes > 0) {
+			const ssize_t done = write ? pwrite(fd, q, (size_t)bytes, (off_t)offset) : pread(fd, q, (size_t)bytes, (off_t)offset);
+			if (done < 0 && errno == EINTR) {
+				continue;
+			}
+			if (done <= 0) {
+				return false;
+			}
+			q += done;
+			bytes -= (uint64_t)done;
+			offset += (uint64_t)done;
+		}
+		return true;
+#else
+		stream.clear();
+		if (write) {
+			stream.seekp((std::streamoff)offset);
+			stream.write((const char *)p, (std::streamsize)bytes);
+		} else {
+			stream.seekg((std::streamoff)offset);
+			stream.read((char *)p, (std::streamsize)bytes);
+		}
+		return !!stream;
+#endif
+	}
+};
+
+// Runs f(i0, m, tile) over the row tiles of x in order, tile holding rows [i0, i0+m) in RMO, while the next tile
+// is read into the other of two buffers by a single reader thread, which waits for each tile to read in turn,
+// and returns false if a read or f fails
+template<typename T, typename Function>
+bool FileMatrixStreamRows(const FileMatrix<T> & x, matdim_t tile_rows, Function f)
+{
+	const matdim_t r = x.NumRows();
+	if (tile_rows < 1) {
+		return false;
+	}
+	if (r == 0) {
+		return true;
+	}
+	tile_rows = std::min(tile_rows, r);
+	const size_t bytes = ((size_t)tile_rows * x.NumCols() * sizeof(T) + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT * LATTICEZK_ALIGNMENT;
+	T * buffers[2] = {
+		(T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, std::max<size_t>(bytes, LATTICEZK_ALIGNMENT)),
+		(T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, std::max<size_t>(bytes, LATTICEZK_ALIGNMENT)) };
+	bool success = buffers[0] != nullptr && buffers[1] != nullptr;
+	if (success) {
+		success = x.ReadRows(0, tile_rows, buffers[0]);
+	}
+	// the tile the reader is handed, by its first row and buffer, and whether it is read yet and was read whole
+	std::mutex mutex;
+	std::condition_variable handed;
+	matdim_t read_i0 = 0;
+	T * read_buffer = nullptr;
+	bool reading = false, read = true, stopping = false;
+	std::thread reader;
+	if (success && tile_rows < r) {
+		reader = std::thread([&]() {
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;) {
+				handed.wait(lock, [&]() { return reading || stopping; });
+				if (!reading) {
+					return;
+				}
+				const matdim_t i0 = read_i0;
+				T * buffer = read_buffer;
+				lock.unlock();
+				const bool ok = x.ReadRows(i0, std::min(tile_rows, r - i0), buffer);
+				lock.lock();
+				read = ok;
+				reading = false;
+				handed.notify_all();
+			}
+		});
+	}
+	for (matdim_t i0 = 0, t = 0; success && i0 < r; i0 += tile_rows, t ^= 1) {
+		const matdim_t m = std::min(tile_rows, r - i0), i1 = i0 + m;
+		if (i1 < r) {
+			std::lock_guard<std::mutex> lock(mutex);
+			read_i0 = i1;
+			read_buffer = buffers[t ^ 1];
+			reading = true;
+			handed.notify_all();
+		}
+		success = f(i0, m, (const T *)buffers[t]);
+		if (i1 < r) {
+			std::unique_lock<std::mutex> lock(mutex);
+			handed.wait(lock, [&]() { return !reading; });
+			success = success && read;
+		}
+	}
+	if (reader.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			handed.notify_all();
+		}
+		reader.join();
+	}
+	LATTICEZK_ALIGNED_FREE(buffers[0]);
+	LATTICEZK_ALIGNED_FREE(buffers[1]);
+	return success;
+}
+
+// Narrows a matrix into a file-backed matrix of its dimensions, a tile of rows at a time, returning false if an
+// entry does not fit or a write fails
+template<typename S, typename T, typename Order>
+bool MatrixNarrowToFile(const Matrix<T, Order> & a, FileMatrix<S> & file)
+{
+	const matdim_t r = a.NumRows(), c = a.NumCols();
+	if (file.NumRows() != r || file.NumCols() != c) {
+		return false;
+	}
+	const matdim_t tile_rows = file.TileRows();
+	std::vector<S> tile((size_t)std::min(tile_rows, r) * c);
+	for (matdim_t i0 = 0; i0 < r; i0 += tile_rows) {
+		const matdim_t m = std::min(tile_rows, r - i0);
+		const bool fits = Executor::Current().ParallelReduce(0, m, 1, true, [&](int64_t i1, int64_t i2) {
+			bool tile_fits = true;
+			for (int64_t i = i1; i < i2; i++) {
+				for (matdim_t j = 0; j < c; j++) {
+					const T e = a(i0 + (matdim_t)i, j);
+					tile[(size_t)i * c + j] = (S)e;
+					tile_fits = tile_fits && (T)(S)e == e;
+				}
+			}
+			return tile_fits;
+		}, [](bool x, bool y) { return x && y; });
+		if (!fits || !file.WriteRows(i0, m, tile.data())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The output of the engine into a strided C summed over blocks of the depth: unless first, a block adds to C
+template<typename T>
+class GemmStridedUpdate
+{
+private:
+	GemmStridedOutput<T> out;
+	bool first;
+public:
+	GemmStridedUpdate(T * c, ptrdiff_t rsc, ptrdiff_t csc, bool first) :
+		out(c, rsc, csc), first(first)
+	{
+	}
+public:
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n, bool accumulate)
+	{
+		out(tile, MR, i0, m, j0, n, accumulate || !first);
+	}
+};
+
+// A bit-matrix multiplication epilogue receiving the rows of a block from row i_base of the whole product
+template<typename Epilogue>
+class BitGemmRowsAt
+{
+private:
+	Epilogue & epilogue;
+	const matdim_t i_base;
+public:
+	BitGemmRowsAt(Epilogue & epilogue, matdim_t i_base) :
+		epilogue(epilogue), i_base(i_base)
+	{
+	}
+public:
+	template<typename T>
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n)
+	{
+		epilogue(tile, MR, i_base + i0, m, j0, n);
+	}
+};
+
+// Computes C = A*B for a file-backed B, where the a_rows-by-a_cols A is read through a source of the blocked
+// engine, each tile of the rows of B being multiplied by the columns of A it meets
+template<typename T, typename ASource, typename S>
+bool MatrixMultiplyStreamedOf(const ASource & asrc, matdim_t a_rows, matdim_t a_cols, const FileMatrix<S> & b, MatrixView<T> c,
+	matdim_t tile_rows)
+{
+	if (a_rows != c.NumRows() || b.NumCols() != c.NumCols() || a_cols != b.NumRows()) {
+		return false;
+	}
+	LATTICEZK_LOG("file matrix mult size: " << a_rows << " | " << a_cols << " | " << b.NumCols());
+	if (a_cols == 0) {
+		GemmStridedSource<S> none(nullptr, 0, 0);
+		return Gemm<T>(c.NumRows(), c.NumCols(), 0, asrc, none, c.Data(), c.RowStride(), c.ColStride());
+	}
+	return FileMatrixStreamRows(b, tile_rows, [&](matdim_t k0, matdim_t kt, const S * tile) {
+		GemmStridedSource<S> bsrc(tile, b.NumCols(), 1);
+		GemmStridedUpdate<T> out(c.Data(), c.RowStride(), c.ColStride(), k0 == 0);
+		return Gemm<T>(c.NumRows(), c.NumCols(), kt, asrc.Block(0, k0), bsrc, out);
+	});
+}
+
+// Multiplication of a matrix of any strides by a file-backed matrix, such as A*S for a secret S on disk
+template<typename A, typename S, typename T>
+bool MatrixMultiply(MatrixView<A> a, const FileMatrix<S> & b, MatrixView<T> c, matdim_t tile_rows)
+{
+	static_assert(std::is_same<typename std::remove_const<A>::type, T>::value, "the left operand must have the entries of the result");
+	GemmStridedSource<T> asrc(a.Data(), a.RowStride(), a.ColStride());
+	return MatrixMultiplyStreamedOf(asrc, a.NumRows(), a.NumCols(), b, c, tile_rows);
+}
+
+template<typename T, typename S, typename OrderA, typename OrderC>
+bool MatrixMultiply(const Matrix<T, OrderA> & a, const FileMatrix<S> & b, Matrix<T, OrderC> & c)
+{
+	return MatrixMultiply(a.View(), b, c.View(), b.TileRows());
+}
+
+// The same for a seeded A, each tile of B meeting the columns of A regenerated for it
+template<typename T, typename S, typename OrderC>
+bool MatrixMultiply(const SeededMatrix<T> & a, const FileMatrix<S> & b, Matrix<T, OrderC> & c)
+{
+	GemmSeededSource<T> asrc(a);
+	return MatrixMultiplyStreamedOf(asrc, a.NumRows(), a.NumCols(), b, c.View(), b.TileRows());
+}
+
+// Multiplication of a file-backed matrix by a bit matrix, such as S*C or T*C, each tile of the rows of A giving
+// the same rows of C
+template<typename S, typename T>
+bool MatrixMultiply(const FileMatrix<S> & a, const BitMatrix & b, MatrixView<T> c, matdim_t tile_rows)
+{
+	if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+		return false;
+	}
+	LATTICEZK_LOG("file bit-matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols());
+	BitGemmStore<T> store(c.Data(), c.RowStride(), c.ColStride());
+	BitGemmColumns bcols(b.Data(), b.ColumnWords());
+	return FileMatrixStreamRows(a, tile_rows, [&](matdim_t i0, matdim_t m, const S * tile) {
+		GemmStridedSource<S> asrc(tile, a.NumCols(), 1);
+		BitGemmRowsAt<BitGemmStore<T>> rows(store, i0);
+		return BitGemm<T>(m, c.NumCols(), a.NumCols(), asrc, bcols, rows);
+	});
+}
+
+template<typename T, typename S>
+bool MatrixMultiply(const FileMatrix<S> & a, const BitMatrix & b, Matrix<T, ColumnMajorOrder> & c)
+{
+	return MatrixMultiply(a, b, c.View(), a.TileRows());
+}
+
+// Computes B = S*C and Z = B + Y with <Z,B> and ||B||^2, as MatrixMultiplyAdd in bitmatrix.hpp, for a file-backed S
+template<typename T, typename S>
+bool MatrixMultiplyAdd(const FileMatrix<S> & s, const BitMatrix & c, const Matrix<T, ColumnMajorOrder> & y,
+	Matrix<T, ColumnMajorOrder> & b, Matrix<T, ColumnMajorOrder> & z, double & ZB, double & BB)
+{
+	const matdim_t m = b.NumRows(), n = b.NumCols();
+	if (s.NumRows() != m || s.NumCols() != c.NumRows() || c.NumCols() != n
+			|| y.NumRows() != m || y.NumCols() != n || z.NumRows() != m || z.NumCols() != n) {
+		return false;
+	}
+	LATTICEZK_LOG("file bit-matrix mult-add size: " << m << " | " << s.NumCols() << " | " << n);
+	BitGemmAddStats<T> epilogue(b.Data(), z.Data(), y.Data(), m);
+	BitGemmColumns bcols(c.Data(), c.ColumnWords());
+	const bool success = FileMatrixStreamRows(s, s.TileRows(), [&](matdim_t i0, matdim_t mt, const S * tile) {
+		GemmStridedSource<S> ssrc(tile, s.NumCols(), 1);
+		BitGemmRowsAt<BitGemmAddStats<T>> rows(epilogue, i0);
+		return BitGemm<T>(mt, n, s.NumCols(), ssrc, bcols, rows);
+	});
+	if (!success) {
+		return false;
+	}
+	epilogue.Stats(ZB, BB);
+	return true;
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_FILEMATRIX_HPP_
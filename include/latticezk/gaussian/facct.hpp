@@ -2,10 +2,68 @@
 #define __LATTICEZK_GAUSSIAN_FACCT_HPP_
 
 // Include code required by Facct code in CPU mode
+#include <stdint.h>
+#include <math.h>
+#include <immintrin.h>
+// gcem is used for compile-time computation of constants depending on
+// the Gaussian's standard deviation parameter
+#include "gcem.hpp"
 #include "latticezk/common.hpp"
+#include "latticezk/util/cpu.hpp"
 #include "latticezk/uniform/usampler.hpp"
 
-// Include Facct code in CPU mode
-#include "facct.inl"
+// Include Facct code in CPU mode, built for the scalar and AVX2 levels
+#define LATTICEZK_MULTIVERSION_INCLUDE "latticezk/gaussian/facct.inl"
+#define LATTICEZK_MULTIVERSION_MAX LATTICEZK_ISA_AVX2
+#include "latticezk/util/multiversion.inl"
+
+namespace LatticeZK
+{
+
+// Facct Gaussian sampler, using the build for the CPU's instruction set selected at construction
+template<uint32_t Sigma, int nsamples = 256, class BSampler = BytesSampler>
+class FacctGaussianSampler
+{
+public:
+	static constexpr double sigma = Sigma;
+	static constexpr int BitsPerSample = (int)gcem::ceil(gcem::log(sigma) / gcem::log(2)) + 1 + 2; // 4*sigma in bits
+	static constexpr int NSAMPLES = nsamples;
+private:
+	typedef uint32_t (*sample_t)(BSampler &, int64_t *, uint32_t);
+	static sample_t SelectSample()
+	{
+#define LATTICEZK_FACCT_CASE(ns) return &ns::facct_sample<BSampler, Sigma>;
+		LATTICEZK_ISA_SWITCH_AVX2(LATTICEZK_FACCT_CASE)
+#undef LATTICEZK_FACCT_CASE
+	}
+private:
+	BSampler& bytes_sampler;
+	sample_t sample;
+	int64_t samples[NSAMPLES] = { 0 };
+	int cursor, nsampled;
+private:
+	inline void fill()
+	{
+		nsampled = sample(bytes_sampler, samples, NSAMPLES);
+		cursor = 0;
+	}
+public:
+	FacctGaussianSampler(BSampler & bytes_sampler) :
+		bytes_sampler(bytes_sampler), sample(SelectSample())
+	{
+		cursor = nsampled = 0;
+	}
+public:
+	inline int64_t operator()()
+	{
+		if (cursor == nsampled) fill();
+		return samples[cursor++];
+	}
+	inline uint64_t get_rejections() const {
+		return 0;
+	}
+};
+
+} // namespace LatticeZK
 
 #endif // __LATTICEZK_GAUSSIAN_FACCT_HPP_
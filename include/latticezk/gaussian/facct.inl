@@ -6,16 +6,17 @@
  * Discrete Gaussian Sampler      *
  * ****************************** */
 
-#include <stdint.h>
-// gcem is used for compile-time computation of constants depending on
-// the Gaussian's standard deviation parameter
-#include "gcem.hpp"
-
-// By default, this code compiles in CPU mode into namespace LatticeZK
+// In CPU mode, this code is built once per ISA level by facct.hpp (see util/multiversion.inl)
+// into namespace LatticeZK::<level>, where the levels without AVX2 use an emulation of AVX2
 // CUDA mode is enabled when LATTICEZK_GAUSSIAN_FACCT_CUDA is defined
 // In CUDA mode, this code compiles into namespace LatticeZK::Cuda
 // A Windows environment is assumed in CUDA mode
 #ifdef LATTICEZK_GAUSSIAN_FACCT_CUDA
+	#include <stdint.h>
+	// gcem is used for compile-time computation of constants depending on
+	// the Gaussian's standard deviation parameter
+	#include "gcem.hpp"
+
 	#define LATTICEZK_CUDA_DEVICE __device__
 	// pull-in CUDA implementations of AVX functions needed here
 	#include "latticezk/cuda/cuavx.cuh"
@@ -34,16 +35,20 @@
 	#ifndef LATTICEZK_GAUSSIAN_FACCT_ALIGNMENT
 		#define	LATTICEZK_GAUSSIAN_FACCT_ALIGNMENT sizeof(uint64_t)
 	#endif
-#else
-	#define LATTICEZK_CUDA_DEVICE
-	#include <immintrin.h>
-#endif
 
 namespace LatticeZK
 {
-#ifdef LATTICEZK_GAUSSIAN_FACCT_CUDA
 	namespace Cuda
 	{
+#else
+	#if !defined(LATTICEZK_ISA)
+		#error "facct.inl must be included via facct.hpp in CPU mode"
+	#endif
+	#define LATTICEZK_CUDA_DEVICE
+	#if LATTICEZK_ISA < LATTICEZK_ISA_AVX2
+		// pull-in portable implementations of AVX functions needed here
+		#include "latticezk/util/avxemu.inl"
+	#endif
 #endif
 
 #ifdef LATTICEZK_GAUSSIAN_FACCT_ALIGNMENT
@@ -276,9 +281,8 @@ LATTICEZK_CUDA_DEVICE static inline void bernoulli_sampler(uint64_t* b, __m256i
 }
 
 /* make sure that Pr(rerun the PRG)<=2^(-64) */
-LATTICEZK_CUDA_DEVICE static inline void uniform_sampler(unsigned char* r, __m256i y[2])
+LATTICEZK_CUDA_DEVICE static inline void uniform_sampler(unsigned char* r, uint64_t sample[8])
 {
-	uint64_t * sample = (uint64_t *)y;
 	uint32_t i = 0, j = 0;
 	uint64_t x = 0;
 
@@ -341,6 +345,7 @@ private:
 LATTICEZK_CUDA_DEVICE unsigned char * sample_round(uint64_t * z, uint64_t * b, unsigned char * r)
 {
 	// r is modified in CUDA mode only, and returned in both CUDA and CPU modes
+	LATTICEZK_ALIGN_DECLARATION(32, uint64_t y[8]);
 	__m256i v_x, v_y[2], v_z, v_b_in;
 	unsigned char *r1;
 
@@ -350,7 +355,9 @@ LATTICEZK_CUDA_DEVICE unsigned char * sample_round(uint64_t * z, uint64_t * b, u
 		return nullptr;
 	}
 
-	uniform_sampler(r + TABLES_SAMPLE_BLOCK_BYTES, v_y);
+	uniform_sampler(r + TABLES_SAMPLE_BLOCK_BYTES, y);
+	v_y[0] = _mm256_load_si256((__m256i*)(y));
+	v_y[1] = _mm256_load_si256((__m256i*)(y + 4));
 
 	r1 = r;
 	v_x = cdt_sampler(r1);
@@ -378,6 +385,8 @@ LATTICEZK_CUDA_DEVICE unsigned char * sample_round(uint64_t * z, uint64_t * b, u
 
 } // anonymous namespace
 
+#ifdef LATTICEZK_GAUSSIAN_FACCT_CUDA
+
 template<uint32_t Sigma, int nsamples = 256, class BSampler = BytesSampler>
 class FacctGaussianSampler
 {
@@ -415,11 +424,25 @@ public:
 	}
 };
 
-#ifdef LATTICEZK_GAUSSIAN_FACCT_CUDA
 	} // namespace Cuda
-#endif
 } // namespace LatticeZK
 
+#else
+
+namespace {
+
+// Samples into the given buffer as a BatchFacctGaussianSampler, for dispatch by FacctGaussianSampler
+template<class BSampler, uint32_t Sigma>
+uint32_t facct_sample(BSampler & bytes_sampler, int64_t * samples, uint32_t slen)
+{
+	BatchFacctGaussianSampler<BSampler, Sigma> gsampler(bytes_sampler);
+	return gsampler.sample(samples, slen);
+}
+
+} // anonymous namespace
+
+#endif
+
 #ifdef LATTICEZK_GAUSSIAN_FACCT_CUDA
 	#undef LATTICEZK_CUDA_DEVICE
 	#undef LATTICEZK_ALIGN_DECLARATION
@@ -431,4 +454,7 @@ public:
 	#undef LATTICEZK_GAUSSIAN_FACCT_ALIGNMENT
 #else
 	#undef LATTICEZK_CUDA_DEVICE
-#endif
\ No newline at end of file
+	#if LATTICEZK_ISA < LATTICEZK_ISA_AVX2
+		#pragma pop_macro("_mm256_floor_pd")
+	#endif
+#endif
@@ -13,6 +13,7 @@
 #include <inttypes.h>
 #include "latticezk/common.hpp"
 #include "latticezk/util/aes_rnd.hpp"
+#include "latticezk/util/cpu.hpp"
 #include "latticezk/uniform/usampler.hpp"
 
 namespace LatticeZK
@@ -226,19 +227,18 @@ public:
 	}
 };
 
-// Include code-generated bit-slicing half-Gaussian sampler with sigma=2 and n_out=5
-#define HGSAMPLER_CLASS_SUFFIX() _S2_N5
-#define HGSAMPLER_INCLUDE "gaussian_s2_n5.inl"
-#define HGSAMPLER_SIGMA 2
-#define HGSAMPLER_N_OUT 5
-#include "hgsampler.inl"
+} // namespace LatticeZK
 
-// Include code-generated bit-slicing half-Gaussian sampler with sigma=215 and n_out=10
-#define HGSAMPLER_CLASS_SUFFIX() _S215_N10
-#define HGSAMPLER_INCLUDE "gaussian_s215_n10.inl"
-#define HGSAMPLER_SIGMA 215
-#define HGSAMPLER_N_OUT 10
-#include "hgsampler.inl"
+// Include code-generated bit-slicing half-Gaussian samplers, built for the scalar and AVX2 levels
+#define LATTICEZK_MULTIVERSION_INCLUDE "latticezk/gaussian/hgsamplers.inl"
+#define LATTICEZK_MULTIVERSION_MAX LATTICEZK_ISA_AVX2
+#include "latticezk/util/multiversion.inl"
+
+namespace LatticeZK
+{
+
+// Include the half-Gaussian samplers, dispatching to the build for the CPU's instruction set
+#include "hgsamplers.inl"
 
 // Adapts a half-Gaussian sampler to a full-Gaussian sampler 
 template<typename HGSampler>
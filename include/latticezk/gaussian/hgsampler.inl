@@ -8,7 +8,12 @@
 // This file can be included more than once to generate multiple half-Gaussian samplers
 // The generated class name (due to HGSAMPLER_CLASS_SUFFIX or a namespace) must be different each time
 //
-// The generated half-Guassian sampler code uses AVX if enabled at compile-time
+// The file is included in two modes (see gsampler.hpp):
+//   - once per ISA level (see util/multiversion.inl), generating a class with a static Fill function for the level
+//   - then into namespace LatticeZK, generating the sampler class, which calls the Fill function of the CPU's level
+//
+// The generated half-Guassian sampler code uses GCC vector extensions, with the same vector size for all levels
+// so that the samples do not depend on the level
 
 #if !defined(HGSAMPLER_CLASS_SUFFIX) || !defined(HGSAMPLER_INCLUDE) || !defined(HGSAMPLER_SIGMA) || !defined(HGSAMPLER_N_OUT)
 	#error "HGSAMPLER_CLASS_SUFFIX, HGSAMPLER_INCLUDE and HGSAMPLER_SIGMA and HGSAMPLER_N_OUT macros must be defined"
@@ -19,15 +24,13 @@
 #define HGSAMPLER_CONCAT2(x,y) HGSAMPLER_CONCAT(x,y)
 #define HGSAMPLER_CLASS_NAME HGSAMPLER_CONCAT2(HalfGaussianSampler,HGSAMPLER_CLASS_SUFFIX())
 
-#ifdef __AVX__
-	#include <immintrin.h>
-#endif
+#if defined(LATTICEZK_ISA)
 
 class HGSAMPLER_CLASS_NAME
 {
 private:
 
-#ifdef __AVX__
+#ifdef __GNUC__
 	#define ALIGNMENT 32
 	#define ALIGN __attribute__ ((aligned(ALIGNMENT)))
 	#if HGSAMPLER_N_OUT <= 8
@@ -44,7 +47,6 @@ private:
 	#define BZERO BCONST(0)
 	#define BONES BCONST(-1)
 	#define BMASK BCONST(1)
-	#define BTEST_NOT_ONES(x) (!_mm256_testz_si256(~((__m256i)x),~((__m256i)x)))
 #else
 	#define ALIGNMENT 0
 	#define ALIGN
@@ -53,53 +55,43 @@ private:
 	#define BZERO 0
 	#define BONES 0xffffffffffffffff
 	#define BMASK 0x0101010101010101
-	#define BTEST_NOT_ONES(x) (x!=BONES)
 #endif
 
 public:
 	static constexpr int NSAMPLES = ((int)(sizeof(Bvec)*8));
-	static constexpr double Sigma = HGSAMPLER_SIGMA;
-	static constexpr int BitsPerSample = BITS_PER_SAMPLE;
-private:
-	AES_Random & aes_rnd;
-private:
+public:
+// Fills NSAMPLES samples
+static void Fill(AES_Random & aes_rnd, int * sample)
+{
+	long int j,k;
 	Bvec bit[128];// to hold the bits
 	Bvec out[BITS_PER_SAMPLE], out_t[BITS_PER_SAMPLE];
-	int sample[NSAMPLES];
-	int cursor;
-private:
 	Bsingle sample_o[NSAMPLES] ALIGN;
- 	Bvec *sample_n = (Bvec*) ((void*) sample_o);
+	Bvec *sample_n = (Bvec*) ((void*) sample_o);
 	Bvec sample_t;
 	Bvec mask = BMASK;
 	Bvec bzero = BZERO;
 	Bvec bones = BONES;
 	long int nrotate = sizeof(Bsingle)*8;
-private:
-void fill()
-{
-	long int j,k;
 	Bvec disable_update,control;
-	
-	for(j=0;j<(int)sizeof(bit);j+=16){
-		aes_rnd.random_bytes(((uint8_t *)bit) + j);
-	}
+
+	aes_rnd.random_blocks((uint8_t *)bit, sizeof(bit) / 16);
 
 	disable_update=bzero; //0-> to update every time. 1-> don't update anymore. Once switched to 1 stays at 1
 	control=bones; //used to control the disable_update properly
 
 #include HGSAMPLER_INCLUDE
 
-		for(k=0;k<nrotate;k++){//if sample_o is 8 bits it should rotate 8 times if sample_o is 16 bit then the loop should rotate 16 times 	
+		for(k=0;k<nrotate;k++){//if sample_o is 8 bits it should rotate 8 times if sample_o is 16 bit then the loop should rotate 16 times
 				  //At a time 8 samples will be filled up. So we need the loop to iterate 8 times to fill all the 64 samples.
-			
+
 				sample_t=bzero;
 				for(j=BITS_PER_SAMPLE-1;j>=0;j--) {
 					sample_t=(sample_t<<1) | (out[j]&mask);
 				}
 				sample_n[k]=sample_t;
-				
-								
+
+
 
 				for(j=BITS_PER_SAMPLE-1;j>=0;j--) {
 					out[j]=out[j]>>1;
@@ -110,12 +102,47 @@ void fill()
 		for(k=0;k<NSAMPLES;k++){
 			sample[k]=(int)sample_o[k];
 		}
+}
 
+#undef ALIGNMENT
+#undef ALIGN
+#undef BCONST
+#undef BZERO
+#undef BONES
+#undef BMASK
+
+};
+
+#else // !defined(LATTICEZK_ISA)
+
+class HGSAMPLER_CLASS_NAME
+{
+public:
+	static constexpr int NSAMPLES = Scalar::HGSAMPLER_CLASS_NAME::NSAMPLES;
+	static constexpr double Sigma = HGSAMPLER_SIGMA;
+	static constexpr int BitsPerSample = BITS_PER_SAMPLE;
+private:
+	typedef void (*fill_t)(AES_Random &, int *);
+	static fill_t SelectFill()
+	{
+#define HGSAMPLER_CASE(ns) return &ns::HGSAMPLER_CLASS_NAME::Fill;
+		LATTICEZK_ISA_SWITCH_AVX2(HGSAMPLER_CASE)
+#undef HGSAMPLER_CASE
+	}
+private:
+	AES_Random & aes_rnd;
+	fill_t fill_samples;
+	int sample[NSAMPLES];
+	int cursor;
+private:
+void fill()
+{
+	fill_samples(aes_rnd, sample);
 	cursor = 0;
 }
 public:
 	HGSAMPLER_CLASS_NAME(AES_Random & aes_rnd) :
-		aes_rnd(aes_rnd)
+		aes_rnd(aes_rnd), fill_samples(SelectFill())
 	{
 		fill();
 	}
@@ -135,17 +162,10 @@ public:
 	{
 		return BitsPerSample;
 	}
-
-#undef ALIGNMENT
-#undef ALIGN
-#undef BCONST
-#undef BZERO
-#undef BONES
-#undef BMASK
-#undef BTEST_NOT_ONES
-
 };
 
+#endif // defined(LATTICEZK_ISA)
+
 #undef BITS_PER_SAMPLE
 #undef HGSAMPLER_CONCAT
 #undef HGSAMPLER_CONCAT2
@@ -0,0 +1,15 @@
+// The code-generated half-Gaussian samplers (see hgsampler.inl), included per ISA level and then for dispatch
+
+// Include code-generated bit-slicing half-Gaussian sampler with sigma=2 and n_out=5
+#define HGSAMPLER_CLASS_SUFFIX() _S2_N5
+#define HGSAMPLER_INCLUDE "gaussian_s2_n5.inl"
+#define HGSAMPLER_SIGMA 2
+#define HGSAMPLER_N_OUT 5
+#include "hgsampler.inl"
+
+// Include code-generated bit-slicing half-Gaussian sampler with sigma=215 and n_out=10
+#define HGSAMPLER_CLASS_SUFFIX() _S215_N10
+#define HGSAMPLER_INCLUDE "gaussian_s215_n10.inl"
+#define HGSAMPLER_SIGMA 215
+#define HGSAMPLER_N_OUT 10
+#include "hgsampler.inl"
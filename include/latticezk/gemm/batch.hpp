@@ -0,0 +1,130 @@
+#ifndef __LATTICEZK_GEMM_BATCH_HPP_
+#define __LATTICEZK_GEMM_BATCH_HPP_
+
+// Batched multiplication C_i = A*B_i of one left operand by several right-hand sides
+//
+// The batch is laid out as the columns of one logical wide right-hand side and product, item i starting
+// at column Offset(i) and padded to a multiple of the engine's column panel, so that every panel belongs
+// to a single item. The engines (see gemm.hpp and bitgemm.hpp) then pack each block of A once for all the
+// items and spread the tiles of the whole batch over the threads, rather than one item at a time.
+
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/gemm/gemm.hpp"
+#include "latticezk/gemm/bitgemm.hpp"
+
+namespace LatticeZK {
+
+// The right-hand sides B_i, read via BSource, and the products C_i with entry (i, j) at c[i*rsc + j*csc]
+// This is both the right operand and the output of the engine
+template<typename T, typename BSource>
+class GemmBatchOperands
+{
+private:
+	struct Item
+	{
+		matdim_t n;
+		BSource b;
+		T * c;
+		ptrdiff_t rsc, csc;
+	};
+	std::vector<Item> items;
+	std::vector<matdim_t> offsets;
+public:
+	void Add(matdim_t n, const BSource & b, T * c, ptrdiff_t rsc, ptrdiff_t csc)
+	{
+		items.push_back(Item { n, b, c, rsc, csc });
+	}
+	size_t NumItems() const
+	{
+		return items.size();
+	}
+	// Lays the items out with each padded to a multiple of p columns
+	void Layout(matdim_t p)
+	{
+		offsets.assign(1, 0);
+		for (const Item & item : items) {
+			offsets.push_back(offsets.back() + (item.n + p - 1) / p * p);
+		}
+	}
+	matdim_t Offset(size_t i) const
+	{
+		return offsets[i];
+	}
+	// Number of logical columns, including padding
+	matdim_t NumCols() const
+	{
+		return offsets.back();
+	}
+public:
+	// Packs logical columns [j0, j0+n), which lie in one item, as GemmStridedSource does
+	template<matdim_t KU, typename U>
+	void PackCols(matdim_t j0, matdim_t n, matdim_t NR, matdim_t i0, matdim_t kc, U * dst) const
+	{
+		const size_t i = Find(j0);
+		const matdim_t lj = j0 - offsets[i];
+		items[i].b.template PackCols<KU>(lj, std::min(n, items[i].n - lj), NR, i0, kc, dst);
+	}
+	// Column j of the logical bit matrix, as BitGemmColumns does
+	inline const uint64_t * Column(matdim_t j) const
+	{
+		const size_t i = Find(j);
+		return items[i].b.Column(j - offsets[i]);
+	}
+	// Stores (or adds, if accumulate) a tile over logical columns [j0, j0+n), dropping the padding
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n, bool accumulate)
+	{
+		for (size_t i = Find(j0); n > 0; i++) {
+			const matdim_t lj = j0 - offsets[i], n1 = std::min(n, offsets[i + 1] - j0);
+			const matdim_t nw = std::min(n1, items[i].n - lj);
+			if (nw > 0) {
+				GemmUpdateTile(tile, MR, m, nw, items[i].c + i0 * items[i].rsc + lj * items[i].csc, items[i].rsc, items[i].csc, accumulate);
+			}
+			tile += n1 * MR;
+			j0 += n1;
+			n -= n1;
+		}
+	}
+	// Stores a tile, as BitGemmStore does
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n)
+	{
+		(*this)(tile, MR, i0, m, j0, n, false);
+	}
+private:
+	// The item of logical column j, skipping empty items
+	inline size_t Find(matdim_t j) const
+	{
+		return std::upper_bound(offsets.begin(), offsets.end() - 1, j) - offsets.begin() - 1;
+	}
+};
+
+// Computes C_i = A*B_i for the batch, where A is m-by-k and read via its PackRows method
+template<typename T, typename Kernel, typename ASource, typename BSource>
+bool GemmBatchWithKernel(matdim_t m, matdim_t k, const ASource & a, GemmBatchOperands<T, BSource> & batch)
+{
+	batch.Layout(Kernel::NR);
+	return GemmWithKernel<T, Kernel>(m, batch.NumCols(), k, a, batch, batch);
+}
+
+// Computes C_i = A*B_i as above, using the best kernel for the CPU's instruction set
+template<typename T, typename ASource, typename BSource>
+bool GemmBatch(matdim_t m, matdim_t k, const ASource & a, GemmBatchOperands<T, BSource> & batch)
+{
+#define LATTICEZK_GEMM_BATCH_CASE(ns) return GemmBatchWithKernel<T, ns::GemmKernel<T>>(m, k, a, batch);
+	LATTICEZK_ISA_SWITCH(LATTICEZK_GEMM_BATCH_CASE)
+#undef LATTICEZK_GEMM_BATCH_CASE
+}
+
+// Computes C_i = A*B_i for a batch of bit matrices B_i, read via BitGemmColumns
+template<typename T, typename ASource>
+bool BitGemmBatch(matdim_t m, matdim_t k, const ASource & a, GemmBatchOperands<T, BitGemmColumns> & batch)
+{
+	batch.Layout(1);
+	return BitGemm<T>(m, batch.NumCols(), k, a, batch, batch);
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_GEMM_BATCH_HPP_
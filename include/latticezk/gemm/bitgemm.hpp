@@ -0,0 +1,191 @@
+#ifndef __LATTICEZK_GEMM_BITGEMM_HPP_
+#define __LATTICEZK_GEMM_BITGEMM_HPP_
+
+// Matrix multiplication over Z_{2^w} by a matrix of bits, using the Four-Russians method
+//
+// A product A*B with B in {0,1}^{k x n} only sums subsets of the columns of A. The rows of A are processed
+// in blocks of MR (see bitgemm.inl), and the depth in groups of G bits: the 2^G subset sums of the G
+// columns of a group are tabulated once per block, and each column of B then adds one table row per group.
+// This costs about (2^G + n)/G row-additions per bit of depth instead of the n multiply-adds of a GEMM,
+// hence G = 4 for few columns, as with a challenge matrix, and G = 8 for many.
+//
+// The threads compute the row panels, and when there are fewer panels than threads, as in T*C with the r rows of
+// T, parts of the columns of each panel too. Each part tabulates the subset sums of its panel anew, so G is
+// chosen for the columns of a part, not of the whole product.
+//
+// The bit matrix is given as packed columns of 64-bit words, bit i of a column being bit i%64 of its
+// word i/64, and the padding bits beyond the k rows must be zero (see BitMatrix)
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "latticezk/common.hpp"
+#include "latticezk/gemm/gemm.hpp"
+
+// Bytes in a row of a subset-sum table, i.e. MR entries of A
+#define LATTICEZK_BITGEMM_ROW_BYTES 256
+// Columns below which a part of the product is not split further, as a part costs a table build
+#define LATTICEZK_BITGEMM_MIN_PART_COLUMNS 32
+
+#define LATTICEZK_MULTIVERSION_INCLUDE "latticezk/gemm/bitgemm.inl"
+#include "latticezk/util/multiversion.inl"
+
+namespace LatticeZK {
+
+// A bit matrix with column j at words b[j*bws, (j+1)*bws)
+class BitGemmColumns
+{
+private:
+	const uint64_t * b;
+	ptrdiff_t bws;
+public:
+	BitGemmColumns(const uint64_t * b, ptrdiff_t bws) :
+		b(b), bws(bws)
+	{
+	}
+public:
+	inline const uint64_t * Column(matdim_t j) const
+	{
+		return b + j * bws;
+	}
+};
+
+// Stores each finished tile of the product into C with entry (i, j) at c[i*rsc + j*csc]
+template<typename T>
+class BitGemmStore
+{
+private:
+	T * c;
+	ptrdiff_t rsc, csc;
+public:
+	BitGemmStore(T * c, ptrdiff_t rsc, ptrdiff_t csc) :
+		c(c), rsc(rsc), csc(csc)
+	{
+	}
+public:
+	// Receives rows [i0, i0+m) and columns [j0, j0+n) of the product as a column-major tile with leading dimension MR
+	// Each tile is passed once, but calls on other threads may pass other columns of the same rows
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n)
+	{
+		GemmUpdateTile(tile, MR, m, n, c + i0 * rsc + j0 * csc, rsc, csc, false);
+	}
+};
+
+// Columns of the parts of an m-by-n product of entries T that the threads compute, n unless there are fewer row
+// panels than threads, in which case enough parts to occupy the threads, of no fewer columns than the minimum
+template<typename T>
+matdim_t BitGemmPartColumns(matdim_t m, matdim_t n)
+{
+	constexpr matdim_t MR = LATTICEZK_BITGEMM_ROW_BYTES / sizeof(T);
+	const int64_t n_threads = (int64_t)Executor::Current().NumThreads(), mpanels = (m + MR - 1) / MR;
+	if (mpanels <= 0 || mpanels >= n_threads) {
+		return n;
+	}
+	const int64_t parts = std::min<int64_t>((n_threads + mpanels - 1) / mpanels, std::max<int64_t>(1, n / LATTICEZK_BITGEMM_MIN_PART_COLUMNS));
+	return (matdim_t)((n + parts - 1) / parts);
+}
+
+// Computes the product A*B where A is m-by-k and B is a k-by-n bit matrix, passing each finished tile of it to
+// the epilogue (see BitGemmStore)
+// The source a is read via its PackRows method (see gemm.hpp), and the columns of b via its Column method
+// (see BitGemmColumns), each of which must hold at least k bits
+template<typename T, typename Kernel, typename ASource, typename BColumns, typename Epilogue>
+bool BitGemmWithKernel(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BColumns & b, Epilogue & epilogue)
+{
+	constexpr matdim_t MR = Kernel::MR, KB = Kernel::KB;
+	static_assert(MR == LATTICEZK_BITGEMM_ROW_BYTES / sizeof(T), "the parts are split for panels of MR rows");
+	if (m < 0 || n < 0 || k < 0) {
+		return false;
+	}
+	if (m == 0 || n == 0) {
+		return true;
+	}
+	const matdim_t pc = BitGemmPartColumns<T>(m, n), nparts = (n + pc - 1) / pc;
+	// the accumulated block of C fills half of L2
+	const matdim_t nc = std::min<matdim_t>(pc, std::max<matdim_t>(1, TuningProfile::Current().gemm_l2_bytes / 2 / (MR * sizeof(T))));
+	const size_t abytes = MR * KB * sizeof(T);
+	const size_t tbytes = Kernel::NG * Kernel::TABLE * MR * sizeof(T);
+	const size_t cbytes = ((nc * MR * sizeof(T) + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT) * LATTICEZK_ALIGNMENT;
+	const matdim_t mpanels = (m + MR - 1) / MR;
+	// a chunk of the parts of the row panels is computed by one thread into its own buffers, a part costing some
+	// MR*k*pc/16 additions
+	std::atomic<bool> success(true);
+	Executor::Current().ParallelFor(0, (int64_t)mpanels * nparts, TuningProfile::Current().gemm_chunk_work / ((int64_t)MR * k * pc / 16 + 1), [&](int64_t p0, int64_t p1) {
+		T * apack = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, abytes);
+		T * table = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, tbytes);
+		T * acc = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, cbytes);
+		if (apack == nullptr || table == nullptr || acc == nullptr) {
+			success = false;
+		} else {
+			for (int64_t p = p0; p < p1; p++) {
+				const matdim_t i0 = (matdim_t)(p / nparts) * MR, mr = std::min(MR, m - i0);
+				const matdim_t j0 = (matdim_t)(p % nparts) * pc, j1 = std::min(n, j0 + pc);
+				for (matdim_t jc = j0; jc < j1; jc += nc) {
+					const matdim_t nc1 = std::min(nc, j1 - jc);
+					memset(acc, 0, nc1 * MR * sizeof(T));
+					for (matdim_t k0 = 0; k0 < k; k0 += KB) {
+						const matdim_t kb = std::min(KB, k - k0);
+						a.template PackRows<1>(i0, mr, MR, k0, kb, apack);
+						memset(apack + kb * MR, 0, (KB - kb) * MR * sizeof(T));
+						Kernel::Build(apack, table);
+						Kernel::Accumulate(table, b, jc, k0, nc1, acc);
+					}
+					epilogue(acc, MR, i0, mr, jc, nc1);
+				}
+			}
+		}
+		LATTICEZK_ALIGNED_FREE(apack);
+		LATTICEZK_ALIGNED_FREE(table);
+		LATTICEZK_ALIGNED_FREE(acc);
+	});
+	return success;
+}
+
+// Computes C = A*B where B has column j at words b[j*bws, (j+1)*bws) and C has entry (i, j) at c[i*rsc + j*csc]
+template<typename T, typename Kernel, typename ASource>
+bool BitGemmWithKernel(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const uint64_t * b, ptrdiff_t bws, T * c, ptrdiff_t rsc, ptrdiff_t csc)
+{
+	if (bws * 64 < k) {
+		return false;
+	}
+	BitGemmColumns bcols(b, bws);
+	BitGemmStore<T> store(c, rsc, csc);
+	return BitGemmWithKernel<T, Kernel>(m, n, k, a, bcols, store);
+}
+
+// Computes A*B as above into the epilogue, using the kernel for the CPU's instruction set, and groups of 8 bits if
+// the columns of a part exceed the wide columns of the tuning profile and of 4 otherwise
+template<typename T, typename ASource, typename BColumns, typename Epilogue>
+bool BitGemm(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BColumns & b, Epilogue & epilogue)
+{
+#define LATTICEZK_BITGEMM_CASE(ns) \
+	return BitGemmPartColumns<T>(m, n) > TuningProfile::Current().bitgemm_wide_columns \
+		? BitGemmWithKernel<T, ns::BitGemmKernel<T, 8>>(m, n, k, a, b, epilogue) \
+		: BitGemmWithKernel<T, ns::BitGemmKernel<T, 4>>(m, n, k, a, b, epilogue);
+	LATTICEZK_ISA_SWITCH(LATTICEZK_BITGEMM_CASE)
+#undef LATTICEZK_BITGEMM_CASE
+}
+
+// Computes A*B as above into the epilogue, where B has column j at words b[j*bws, (j+1)*bws)
+template<typename T, typename ASource, typename Epilogue>
+bool BitGemm(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const uint64_t * b, ptrdiff_t bws, Epilogue & epilogue)
+{
+	if (bws * 64 < k) {
+		return false;
+	}
+	BitGemmColumns bcols(b, bws);
+	return BitGemm<T>(m, n, k, a, bcols, epilogue);
+}
+
+// Computes C = A*B as above, where C has entry (i, j) at c[i*rsc + j*csc]
+template<typename T, typename ASource>
+bool BitGemm(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const uint64_t * b, ptrdiff_t bws, T * c, ptrdiff_t rsc, ptrdiff_t csc)
+{
+	BitGemmStore<T> store(c, rsc, csc);
+	return BitGemm<T>(m, n, k, a, b, bws, store);
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_GEMM_BITGEMM_HPP_
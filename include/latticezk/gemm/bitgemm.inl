@@ -0,0 +1,64 @@
+// Four-Russians kernels for multiplication by a bit matrix, see bitgemm.hpp
+// This file is built once per ISA level via util/multiversion.inl. The kernels only add rows of MR entries,
+// in plain loops that the compiler vectorizes for the level
+
+// Multiplies an MR-row panel of A by a bit matrix in passes of KB = NG*G bits, where each group of G bits
+// selects one of the 2^G subset sums of the corresponding G columns of the panel
+template<typename T, int G>
+class BitGemmKernel
+{
+public:
+	typedef T data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = LATTICEZK_BITGEMM_ROW_BYTES / sizeof(T);
+	LATTICEZK_CLASS_STATIC_CONSTEXPR int NG = G <= 4 ? 8 : 2;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KB = G * NG;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t TABLE = (matdim_t)1 << G;
+	static_assert(64 % KB == 0, "a pass must not straddle words of the bit matrix");
+public:
+	// Builds the NG tables of subset sums of the packed MR-by-KB panel a[k*MR + i] = A(i, k), such that
+	// table[((g << G) + x)*MR + i] is the sum of A(i, g*G + t) over the bits t set in x
+	static inline void Build(const T * a, T * table)
+	{
+		typedef gemm_uint_t<T> U;
+		for (int g = 0; g < NG; g++) {
+			T * tg = table + g * TABLE * MR;
+			memset(tg, 0, MR * sizeof(T));
+			// entries [2^t, 2^(t+1)) add column t to entries [0, 2^t)
+			for (int t = 0; t < G; t++) {
+				const T * col = a + (g * G + t) * MR;
+				for (matdim_t x = 0; x < ((matdim_t)1 << t); x++) {
+					const T * src = tg + x * MR;
+					T * dst = tg + (x + ((matdim_t)1 << t)) * MR;
+					for (matdim_t i = 0; i < MR; i++) {
+						dst[i] = (T)((U)src[i] + (U)col[i]);
+					}
+				}
+			}
+		}
+	}
+	// Adds to column j < n of the column-major MR-by-n acc the subset sums selected by bits [k0, k0+KB)
+	// of column j0 + j of the bit matrix, read via its Column method (see bitgemm.hpp)
+	template<typename BColumns>
+	static inline void Accumulate(const T * table, const BColumns & b, matdim_t j0, matdim_t k0, matdim_t n, T * acc)
+	{
+		typedef gemm_uint_t<T> U;
+		for (matdim_t j = 0; j < n; j++) {
+			uint64_t bits = b.Column(j0 + j)[k0 >> 6] >> (k0 & 63);
+			T * cj = acc + j * MR;
+			U s[MR];
+			for (matdim_t i = 0; i < MR; i++) {
+				s[i] = (U)cj[i];
+			}
+			LATTICEZK_UNROLL
+			for (int g = 0; g < NG; g++) {
+				const T * tg = table + ((g << G) + ((bits >> (g * G)) & (TABLE - 1))) * MR;
+				for (matdim_t i = 0; i < MR; i++) {
+					s[i] += (U)tg[i];
+				}
+			}
+			for (matdim_t i = 0; i < MR; i++) {
+				cj[i] = (T)s[i];
+			}
+		}
+	}
+};
@@ -0,0 +1,292 @@
+#ifndef __LATTICEZK_GEMM_GEMM_HPP_
+#define __LATTICEZK_GEMM_GEMM_HPP_
+
+// Cache-blocked matrix multiplication engine over Z_{2^w}
+//   - operands are packed into contiguous panels that match the micro-kernel's register tile
+//   - the k-dimension is blocked for L1 (kc), the rows of A for L2 (mc) and the columns of B for L3 (nc)
+//   - the panels and tiles of each block are packed and computed in parallel on the executor (see util/executor.hpp)
+//   - the micro-kernel is selected at run-time for the CPU's instruction set
+//
+// The loop structure follows the well-known BLIS/GotoBLAS design:
+//   for jc in columns of B/C, step nc       -- B block of kc x nc resides in L3
+//     for pc in depth, step kc              -- pack B block into NR-column panels
+//       for ic in rows of A/C, step mc      -- pack A block of mc x kc into MR-row panels, resides in L2
+//         for each (MR x NR) tile           -- micro-kernel, A and B micro-panels reside in L1
+//
+// Operands are read through source objects that know how to pack a panel of themselves.
+// GemmStridedSource covers in-memory matrices of any (row, column) stride, hence both RMO and CMO.
+
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include "latticezk/common.hpp"
+#include "latticezk/gemm/kernels.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/util/tuning.hpp"
+
+namespace LatticeZK {
+
+// Block sizes of the multiplication engine, in matrix entries
+class GemmBlocking
+{
+public:
+	matdim_t mc, kc, nc;
+public:
+	GemmBlocking(matdim_t mc, matdim_t kc, matdim_t nc) :
+		mc(mc), kc(kc), nc(nc)
+	{
+	}
+public:
+	// Default block sizes derived from the cache budgets of the tuning profile and the micro-kernel's register tile:
+	//   - the A and B micro-panels (MR x kc and kc x NR) fill half of L1
+	//   - the packed A block (mc x kc) fills half of L2
+	//   - the packed B block (kc x nc) fills half of L3
+	template<typename Kernel>
+	static GemmBlocking Default()
+	{
+		typedef typename Kernel::data_t T;
+		const TuningProfile & profile = TuningProfile::Current();
+		matdim_t kc = (matdim_t)(profile.gemm_l1_bytes / 2 / ((Kernel::MR + Kernel::NR) * sizeof(T)));
+		kc = std::max<matdim_t>(8, kc & ~7);
+		matdim_t mc = (matdim_t)(profile.gemm_l2_bytes / 2 / (kc * sizeof(T)));
+		mc = std::max<matdim_t>(Kernel::MR, mc - mc % Kernel::MR);
+		matdim_t nc = (matdim_t)(profile.gemm_l3_bytes / 2 / (kc * sizeof(T)));
+		nc = std::max<matdim_t>(Kernel::NR, nc - nc % Kernel::NR);
+		return GemmBlocking(mc, kc, nc);
+	}
+};
+
+// An in-memory operand with arbitrary strides: entry (i, j) is at data[i*rs + j*cs]
+// An RMO matrix has (rs, cs) = (n_cols, 1) and a CMO matrix has (rs, cs) = (1, n_rows)
+template<typename S>
+class GemmStridedSource
+{
+public:
+	typedef S source_t;
+private:
+	const S * data;
+	ptrdiff_t rs, cs;
+public:
+	GemmStridedSource(const S * data, ptrdiff_t rs, ptrdiff_t cs) :
+		data(data), rs(rs), cs(cs)
+	{
+	}
+public:
+	inline S operator()(matdim_t i, matdim_t j) const
+	{
+		return data[i * rs + j * cs];
+	}
+	// The submatrix whose entry (0, 0) is entry (i0, j0)
+	GemmStridedSource Block(matdim_t i0, matdim_t j0) const
+	{
+		return GemmStridedSource(data + i0 * rs + j0 * cs, rs, cs);
+	}
+	// Packs rows [i0, i0+m) and columns [j0, j0+kc) into MR-row panels, zero-padding rows [m, MR)
+	// This is the panel layout of the left operand, see kernels.hpp
+	template<matdim_t KU, typename T>
+	void PackRows(matdim_t i0, matdim_t m, matdim_t MR, matdim_t j0, matdim_t kc, T * dst) const
+	{
+		PackPanel<KU>(data + i0 * rs + j0 * cs, rs, cs, m, MR, kc, dst);
+	}
+	// Packs columns [j0, j0+n) and rows [i0, i0+kc) into NR-column panels, zero-padding columns [n, NR)
+	// This is the panel layout of the right operand, see kernels.hpp
+	template<matdim_t KU, typename T>
+	void PackCols(matdim_t j0, matdim_t n, matdim_t NR, matdim_t i0, matdim_t kc, T * dst) const
+	{
+		PackPanel<KU>(data + i0 * rs + j0 * cs, cs, rs, n, NR, kc, dst);
+	}
+private:
+	// dst[(k/KU)*P*KU + p*KU + k%KU] = src[p*ps + k*ks] for p < np, k < kc
+	// and zero for p in [np, P) or k in [kc, roundup(kc, KU))
+	template<matdim_t KU, typename T>
+	static void PackPanel(const S * src, ptrdiff_t ps, ptrdiff_t ks, matdim_t np, matdim_t P, matdim_t kc, T * dst)
+	{
+		if (KU > 1) {
+			for (matdim_t k = 0; k < kc; k += KU) {
+				T * d = dst + k * P;
+				for (matdim_t p = 0; p < np; p++) {
+					for (matdim_t u = 0; u < KU; u++) {
+						d[p * KU + u] = k + u < kc ? (T)src[p * ps + (k + u) * ks] : 0;
+					}
+				}
+				memset(d + np * KU, 0, (P - np) * KU * sizeof(T));
+			}
+		} else if (ps == 1) {
+			for (matdim_t k = 0; k < kc; k++) {
+				const S * s = src + k * ks;
+				T * d = dst + k * P;
+				for (matdim_t p = 0; p < np; p++) {
+					d[p] = (T)s[p];
+				}
+				for (matdim_t p = np; p < P; p++) {
+					d[p] = 0;
+				}
+			}
+		} else {
+			// reading np sequential streams while writing contiguously is friendlier to the caches
+			// than writing with stride P
+			for (matdim_t k = 0; k < kc; k++) {
+				const S * s = src + k * ks;
+				T * d = dst + k * P;
+				for (matdim_t p = 0; p < np; p++) {
+					d[p] = (T)s[p * ps];
+				}
+				for (matdim_t p = np; p < P; p++) {
+					d[p] = 0;
+				}
+			}
+		}
+	}
+};
+
+// Adds (or stores, if !accumulate) an m-by-n corner of a column-major MR-tile into a strided C
+template<typename T>
+inline void GemmUpdateTile(const T * tile, matdim_t MR, matdim_t m, matdim_t n, T * c, ptrdiff_t rsc, ptrdiff_t csc, bool accumulate)
+{
+	typedef gemm_uint_t<T> U;
+	for (matdim_t j = 0; j < n; j++) {
+		const T * t = tile + j * MR;
+		T * cj = c + j * csc;
+		if (rsc == 1) {
+			if (accumulate) {
+				for (matdim_t i = 0; i < m; i++) {
+					cj[i] = (T)((U)cj[i] + (U)t[i]);
+				}
+			} else {
+				memcpy(cj, t, m * sizeof(T));
+			}
+		} else {
+			for (matdim_t i = 0; i < m; i++) {
+				cj[i * rsc] = accumulate ? (T)((U)cj[i * rsc] + (U)t[i]) : t[i];
+			}
+		}
+	}
+}
+
+// The output of the engine: C with entry (i, j) at c[i*rsc + j*csc]
+template<typename T>
+class GemmStridedOutput
+{
+private:
+	T * c;
+	ptrdiff_t rsc, csc;
+public:
+	GemmStridedOutput(T * c, ptrdiff_t rsc, ptrdiff_t csc) :
+		c(c), rsc(rsc), csc(csc)
+	{
+	}
+public:
+	// Stores (or adds, if accumulate) the m-by-n corner of a column-major MR-tile at rows [i0, i0+m) and columns [j0, j0+n)
+	inline void operator()(const T * tile, matdim_t MR, matdim_t i0, matdim_t m, matdim_t j0, matdim_t n, bool accumulate)
+	{
+		GemmUpdateTile(tile, MR, m, n, c + i0 * rsc + j0 * csc, rsc, csc, accumulate);
+	}
+};
+
+// Computes C = A*B where A is m-by-k, B is k-by-n and C is m-by-n, given as an output object (see GemmStridedOutput)
+// The sources a and b are read via their PackRows and PackCols methods, respectively
+// The depth of each block is padded with zeros to a multiple of the kernel's KU
+template<typename T, typename Kernel, typename ASource, typename BSource, typename Output>
+bool GemmWithKernel(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BSource & b, Output & c,
+	const GemmBlocking & blocking = GemmBlocking::Default<Kernel>())
+{
+	constexpr matdim_t MR = Kernel::MR, NR = Kernel::NR, KU = Kernel::KU;
+	if (m < 0 || n < 0 || k < 0 || blocking.mc < MR || blocking.kc < 1 || blocking.nc < NR) {
+		return false;
+	}
+	if (k == 0) {
+		const T zero[MR * NR] = {};
+		for (matdim_t j0 = 0; j0 < n; j0 += NR) {
+			for (matdim_t i0 = 0; i0 < m; i0 += MR) {
+				c(zero, MR, i0, std::min(MR, m - i0), j0, std::min(NR, n - j0), false);
+			}
+		}
+		return true;
+	}
+	if (m == 0 || n == 0) {
+		return true;
+	}
+	const matdim_t mc = std::min(blocking.mc - blocking.mc % MR, ((m + MR - 1) / MR) * MR);
+	const matdim_t kc = std::min(blocking.kc, k);
+	const matdim_t kcp = ((kc + KU - 1) / KU) * KU;
+	const matdim_t nc = std::min(blocking.nc - blocking.nc % NR, ((n + NR - 1) / NR) * NR);
+	const size_t abytes = ((mc * kcp * sizeof(T) + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT) * LATTICEZK_ALIGNMENT;
+	const size_t bbytes = ((kcp * nc * sizeof(T) + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT) * LATTICEZK_ALIGNMENT;
+	T * apack = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, abytes);
+	T * bpack = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, bbytes);
+	if (apack == nullptr || bpack == nullptr) {
+		LATTICEZK_ALIGNED_FREE(apack);
+		LATTICEZK_ALIGNED_FREE(bpack);
+		return false;
+	}
+	// each loop over panels or tiles is split among the threads of the executor, and joined before the next
+	Executor & executor = Executor::Current();
+	const int64_t chunk_work = TuningProfile::Current().gemm_chunk_work, chunk_pack = TuningProfile::Current().gemm_chunk_pack;
+	for (matdim_t jc = 0; jc < n; jc += nc) {
+		const matdim_t nc1 = std::min(nc, n - jc);
+		const matdim_t npanels = (nc1 + NR - 1) / NR;
+		for (matdim_t pc = 0; pc < k; pc += kc) {
+			const matdim_t kc1 = std::min(kc, k - pc);
+			const matdim_t kc1p = ((kc1 + KU - 1) / KU) * KU;
+			executor.ParallelFor(0, npanels, chunk_pack / (NR * kc1p), [&](int64_t jr0, int64_t jr1) {
+				for (matdim_t jr = (matdim_t)jr0; jr < jr1; jr++) {
+					matdim_t j0 = jc + jr * NR;
+					b.template PackCols<KU>(j0, std::min(NR, n - j0), NR, pc, kc1, bpack + jr * NR * kc1p);
+				}
+			});
+			for (matdim_t ic = 0; ic < m; ic += mc) {
+				const matdim_t mc1 = std::min(mc, m - ic);
+				const matdim_t mpanels = (mc1 + MR - 1) / MR;
+				executor.ParallelFor(0, mpanels, chunk_pack / (MR * kc1p), [&](int64_t ir0, int64_t ir1) {
+					for (matdim_t ir = (matdim_t)ir0; ir < ir1; ir++) {
+						matdim_t i0 = ic + ir * MR;
+						a.template PackRows<KU>(i0, std::min(MR, m - i0), MR, pc, kc1, apack + ir * MR * kc1p);
+					}
+				});
+				executor.ParallelFor(0, (int64_t)mpanels * npanels, chunk_work / (MR * NR * kc1p), [&](int64_t t0, int64_t t1) {
+					LATTICEZK_ALIGN_DECLARATION(LATTICEZK_ALIGNMENT, T tile[MR * NR]);
+					for (matdim_t t = (matdim_t)t0; t < t1; t++) {
+						matdim_t jt = t / mpanels, it = t - jt * mpanels;
+						matdim_t i0 = ic + it * MR, j0 = jc + jt * NR;
+						Kernel::Run(kc1p, apack + it * MR * kc1p, bpack + jt * NR * kc1p, tile);
+						c(tile, MR, i0, std::min(MR, m - i0), j0, std::min(NR, n - j0), pc > 0);
+					}
+				});
+			}
+		}
+	}
+	LATTICEZK_ALIGNED_FREE(apack);
+	LATTICEZK_ALIGNED_FREE(bpack);
+	return true;
+}
+
+// Computes C = A*B as above, where C has entry (i, j) at c[i*rsc + j*csc]
+template<typename T, typename Kernel, typename ASource, typename BSource>
+bool GemmWithKernel(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BSource & b, T * c, ptrdiff_t rsc, ptrdiff_t csc,
+	const GemmBlocking & blocking = GemmBlocking::Default<Kernel>())
+{
+	GemmStridedOutput<T> out(c, rsc, csc);
+	return GemmWithKernel<T, Kernel>(m, n, k, a, b, out, blocking);
+}
+
+// Computes C = A*B as above, using the best kernel for the CPU's instruction set
+template<typename T, typename ASource, typename BSource>
+bool Gemm(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BSource & b, T * c, ptrdiff_t rsc, ptrdiff_t csc)
+{
+#define LATTICEZK_GEMM_CASE(ns) return GemmWithKernel<T, ns::GemmKernel<T>>(m, n, k, a, b, c, rsc, csc);
+	LATTICEZK_ISA_SWITCH(LATTICEZK_GEMM_CASE)
+#undef LATTICEZK_GEMM_CASE
+}
+
+// Computes C = A*B as above into an output object, using the best kernel for the CPU's instruction set
+template<typename T, typename ASource, typename BSource, typename Output>
+bool Gemm(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BSource & b, Output & c)
+{
+#define LATTICEZK_GEMM_CASE(ns) return GemmWithKernel<T, ns::GemmKernel<T>>(m, n, k, a, b, c);
+	LATTICEZK_ISA_SWITCH(LATTICEZK_GEMM_CASE)
+#undef LATTICEZK_GEMM_CASE
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_GEMM_GEMM_HPP_
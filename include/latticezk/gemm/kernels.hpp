@@ -0,0 +1,67 @@
+#ifndef __LATTICEZK_GEMM_KERNELS_HPP_
+#define __LATTICEZK_GEMM_KERNELS_HPP_
+
+// Register-blocked micro-kernels for matrix multiplication over Z_{2^w}
+//
+// A micro-kernel computes an MR-by-NR tile of C from a packed MR-row panel of A and a packed NR-column
+// panel of B, both of depth kc, where the k-dimension is grouped into runs of KU consecutive entries:
+//   - the A panel holds a[(k/KU)*MR*KU + i*KU + k%KU] = A(i, k)
+//   - the B panel holds b[(k/KU)*NR*KU + j*KU + k%KU] = B(k, j)
+//   - kc is a multiple of KU (the packing zero-pads the last group)
+//   - the tile is written (not accumulated) in column-major order, c[j*MR + i] = C(i, j)
+// With KU = 1 this is the plain layout a[k*MR + i] and b[k*NR + j]. Kernels with KU > 1 use instructions
+// that multiply-and-sum KU adjacent products into one wider lane, such as AVX512-VNNI.
+//
+// All arithmetic wraps around modulo 2^w, where w is the bit-width of the entry type, so the results
+// match the naive loop exactly for int8_t, int16_t, int32_t and int64_t entries.
+//
+// The vectorized kernels are in kernels.inl, which is built once per ISA level (see util/multiversion.inl).
+// <level>::GemmKernel<T> is the best kernel of each level, e.g. Avx2::GemmKernel<int16_t>.
+
+#include <string.h>
+#include <type_traits>
+#include <immintrin.h>
+#include "latticezk/common.hpp"
+#include "latticezk/util/cpu.hpp"
+
+namespace LatticeZK {
+
+// Unsigned type in which the products and sums of T-entries wrap around modulo 2^w without
+// undefined behavior (narrow types would otherwise be promoted to a signed int)
+template<typename T>
+using gemm_uint_t = typename std::conditional<(sizeof(T) < sizeof(unsigned)), unsigned, typename std::make_unsigned<T>::type>::type;
+
+// Portable micro-kernel, also serving as the reference for the vectorized ones
+template<typename T>
+class GemmPortableKernel
+{
+public:
+	typedef T data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 4;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 4;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const T * a, const T * b, T * c)
+	{
+		typedef gemm_uint_t<T> U;
+		U acc[MR * NR] = { 0 };
+		for (matdim_t k = 0; k < kc; k++) {
+			for (matdim_t j = 0; j < NR; j++) {
+				U bkj = (U)b[k * NR + j];
+				for (matdim_t i = 0; i < MR; i++) {
+					acc[j * MR + i] += (U)a[k * MR + i] * bkj;
+				}
+			}
+		}
+		for (matdim_t i = 0; i < MR * NR; i++) {
+			c[i] = (T)acc[i];
+		}
+	}
+};
+
+} // namespace LatticeZK
+
+#define LATTICEZK_MULTIVERSION_INCLUDE "latticezk/gemm/kernels.inl"
+#include "latticezk/util/multiversion.inl"
+
+#endif // __LATTICEZK_GEMM_KERNELS_HPP_
@@ -0,0 +1,203 @@
+// Vectorized micro-kernels for matrix multiplication, see kernels.hpp
+// This file is built once per ISA level via util/multiversion.inl, and GemmKernel<T> selects the best
+// kernel of the level: VNNI, then AVX-512, then AVX2, then portable
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
+
+template<typename T>
+class GemmAvx2Kernel;
+
+// 8-bit entries: AVX2 has no byte multiplication, so even and odd bytes are multiplied in separate
+// 16-bit lanes, whose low bytes are exact modulo 2^8, and are merged back after the k-loop
+template<>
+class GemmAvx2Kernel<int8_t>
+{
+public:
+	typedef int8_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 32;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 4;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int8_t * a, const int8_t * b, int8_t * c)
+	{
+		__m256i e0 = _mm256_setzero_si256(), e1 = e0, e2 = e0, e3 = e0;
+		__m256i o0 = e0, o1 = e0, o2 = e0, o3 = e0;
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m256i ae = _mm256_loadu_si256((const __m256i *)a);
+			__m256i ao = _mm256_srli_epi16(ae, 8);
+			__m256i bj;
+			bj = _mm256_set1_epi8(b[0]);
+			e0 = _mm256_add_epi16(e0, _mm256_mullo_epi16(ae, bj));
+			o0 = _mm256_add_epi16(o0, _mm256_mullo_epi16(ao, bj));
+			bj = _mm256_set1_epi8(b[1]);
+			e1 = _mm256_add_epi16(e1, _mm256_mullo_epi16(ae, bj));
+			o1 = _mm256_add_epi16(o1, _mm256_mullo_epi16(ao, bj));
+			bj = _mm256_set1_epi8(b[2]);
+			e2 = _mm256_add_epi16(e2, _mm256_mullo_epi16(ae, bj));
+			o2 = _mm256_add_epi16(o2, _mm256_mullo_epi16(ao, bj));
+			bj = _mm256_set1_epi8(b[3]);
+			e3 = _mm256_add_epi16(e3, _mm256_mullo_epi16(ae, bj));
+			o3 = _mm256_add_epi16(o3, _mm256_mullo_epi16(ao, bj));
+		}
+		const __m256i low = _mm256_set1_epi16(0x00ff);
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR), _mm256_or_si256(_mm256_and_si256(e0, low), _mm256_slli_epi16(o0, 8)));
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR), _mm256_or_si256(_mm256_and_si256(e1, low), _mm256_slli_epi16(o1, 8)));
+		_mm256_storeu_si256((__m256i *)(c + 2 * MR), _mm256_or_si256(_mm256_and_si256(e2, low), _mm256_slli_epi16(o2, 8)));
+		_mm256_storeu_si256((__m256i *)(c + 3 * MR), _mm256_or_si256(_mm256_and_si256(e3, low), _mm256_slli_epi16(o3, 8)));
+	}
+};
+
+// 16-bit entries: a 32x4 tile in eight accumulators using the low-half 16-bit multiplication
+template<>
+class GemmAvx2Kernel<int16_t>
+{
+public:
+	typedef int16_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 32;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 4;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int16_t * a, const int16_t * b, int16_t * c)
+	{
+		__m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00;
+		__m256i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m256i a0 = _mm256_loadu_si256((const __m256i *)a);
+			__m256i a1 = _mm256_loadu_si256((const __m256i *)(a + 16));
+			__m256i bj;
+			bj = _mm256_set1_epi16(b[0]);
+			c00 = _mm256_add_epi16(c00, _mm256_mullo_epi16(a0, bj));
+			c10 = _mm256_add_epi16(c10, _mm256_mullo_epi16(a1, bj));
+			bj = _mm256_set1_epi16(b[1]);
+			c01 = _mm256_add_epi16(c01, _mm256_mullo_epi16(a0, bj));
+			c11 = _mm256_add_epi16(c11, _mm256_mullo_epi16(a1, bj));
+			bj = _mm256_set1_epi16(b[2]);
+			c02 = _mm256_add_epi16(c02, _mm256_mullo_epi16(a0, bj));
+			c12 = _mm256_add_epi16(c12, _mm256_mullo_epi16(a1, bj));
+			bj = _mm256_set1_epi16(b[3]);
+			c03 = _mm256_add_epi16(c03, _mm256_mullo_epi16(a0, bj));
+			c13 = _mm256_add_epi16(c13, _mm256_mullo_epi16(a1, bj));
+		}
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR), c00);
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR + 16), c10);
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR), c01);
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR + 16), c11);
+		_mm256_storeu_si256((__m256i *)(c + 2 * MR), c02);
+		_mm256_storeu_si256((__m256i *)(c + 2 * MR + 16), c12);
+		_mm256_storeu_si256((__m256i *)(c + 3 * MR), c03);
+		_mm256_storeu_si256((__m256i *)(c + 3 * MR + 16), c13);
+	}
+};
+
+// 32-bit entries: a 16x4 tile in eight accumulators using the low-half 32-bit multiplication
+template<>
+class GemmAvx2Kernel<int32_t>
+{
+public:
+	typedef int32_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 16;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 4;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int32_t * a, const int32_t * b, int32_t * c)
+	{
+		__m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00;
+		__m256i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m256i a0 = _mm256_loadu_si256((const __m256i *)a);
+			__m256i a1 = _mm256_loadu_si256((const __m256i *)(a + 8));
+			__m256i bj;
+			bj = _mm256_set1_epi32(b[0]);
+			c00 = _mm256_add_epi32(c00, _mm256_mullo_epi32(a0, bj));
+			c10 = _mm256_add_epi32(c10, _mm256_mullo_epi32(a1, bj));
+			bj = _mm256_set1_epi32(b[1]);
+			c01 = _mm256_add_epi32(c01, _mm256_mullo_epi32(a0, bj));
+			c11 = _mm256_add_epi32(c11, _mm256_mullo_epi32(a1, bj));
+			bj = _mm256_set1_epi32(b[2]);
+			c02 = _mm256_add_epi32(c02, _mm256_mullo_epi32(a0, bj));
+			c12 = _mm256_add_epi32(c12, _mm256_mullo_epi32(a1, bj));
+			bj = _mm256_set1_epi32(b[3]);
+			c03 = _mm256_add_epi32(c03, _mm256_mullo_epi32(a0, bj));
+			c13 = _mm256_add_epi32(c13, _mm256_mullo_epi32(a1, bj));
+		}
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR), c00);
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR + 8), c10);
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR), c01);
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR + 8), c11);
+		_mm256_storeu_si256((__m256i *)(c + 2 * MR), c02);
+		_mm256_storeu_si256((__m256i *)(c + 2 * MR + 8), c12);
+		_mm256_storeu_si256((__m256i *)(c + 3 * MR), c03);
+		_mm256_storeu_si256((__m256i *)(c + 3 * MR + 8), c13);
+	}
+};
+
+// 64-bit entries: AVX2 has no 64-bit low-half multiplication, so it is composed of 32-bit ones as
+//   a*b mod 2^64 = lo(a)*lo(b) + ((hi(a)*lo(b) + lo(a)*hi(b)) << 32)
+// The cross terms are accumulated separately and shifted once after the k-loop
+template<>
+class GemmAvx2Kernel<int64_t>
+{
+public:
+	typedef int64_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 2;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int64_t * a, const int64_t * b, int64_t * c)
+	{
+		__m256i l00 = _mm256_setzero_si256(), l01 = l00, l10 = l00, l11 = l00;
+		__m256i x00 = l00, x01 = l00, x10 = l00, x11 = l00;
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m256i a0 = _mm256_loadu_si256((const __m256i *)a);
+			__m256i a1 = _mm256_loadu_si256((const __m256i *)(a + 4));
+			__m256i a0h = _mm256_srli_epi64(a0, 32);
+			__m256i a1h = _mm256_srli_epi64(a1, 32);
+			__m256i bj, bjh;
+			bj = _mm256_set1_epi64x(b[0]);
+			bjh = _mm256_srli_epi64(bj, 32);
+			l00 = _mm256_add_epi64(l00, _mm256_mul_epu32(a0, bj));
+			l10 = _mm256_add_epi64(l10, _mm256_mul_epu32(a1, bj));
+			x00 = _mm256_add_epi64(x00, _mm256_add_epi64(_mm256_mul_epu32(a0h, bj), _mm256_mul_epu32(a0, bjh)));
+			x10 = _mm256_add_epi64(x10, _mm256_add_epi64(_mm256_mul_epu32(a1h, bj), _mm256_mul_epu32(a1, bjh)));
+			bj = _mm256_set1_epi64x(b[1]);
+			bjh = _mm256_srli_epi64(bj, 32);
+			l01 = _mm256_add_epi64(l01, _mm256_mul_epu32(a0, bj));
+			l11 = _mm256_add_epi64(l11, _mm256_mul_epu32(a1, bj));
+			x01 = _mm256_add_epi64(x01, _mm256_add_epi64(_mm256_mul_epu32(a0h, bj), _mm256_mul_epu32(a0, bjh)));
+			x11 = _mm256_add_epi64(x11, _mm256_add_epi64(_mm256_mul_epu32(a1h, bj), _mm256_mul_epu32(a1, bjh)));
+		}
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR), _mm256_add_epi64(l00, _mm256_slli_epi64(x00, 32)));
+		_mm256_storeu_si256((__m256i *)(c + 0 * MR + 4), _mm256_add_epi64(l10, _mm256_slli_epi64(x10, 32)));
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR), _mm256_add_epi64(l01, _mm256_slli_epi64(x01, 32)));
+		_mm256_storeu_si256((__m256i *)(c + 1 * MR + 4), _mm256_add_epi64(l11, _mm256_slli_epi64(x11, 32)));
+	}
+};
+
+#endif // LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX512
+	#include "latticezk/gemm/kernels_avx512.inl"
+#endif
+
+template<typename T>
+class GemmKernel : public GemmPortableKernel<T>
+{
+};
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX512VNNI
+template<> class GemmKernel<int8_t> : public GemmVnniKernel<int8_t> {};
+template<> class GemmKernel<int16_t> : public GemmVnniKernel<int16_t> {};
+#elif LATTICEZK_ISA >= LATTICEZK_ISA_AVX512
+template<> class GemmKernel<int8_t> : public GemmAvx512Kernel<int8_t> {};
+template<> class GemmKernel<int16_t> : public GemmAvx512Kernel<int16_t> {};
+#elif LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
+template<> class GemmKernel<int8_t> : public GemmAvx2Kernel<int8_t> {};
+template<> class GemmKernel<int16_t> : public GemmAvx2Kernel<int16_t> {};
+#endif
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX512
+template<> class GemmKernel<int32_t> : public GemmAvx512Kernel<int32_t> {};
+template<> class GemmKernel<int64_t> : public GemmAvx512Kernel<int64_t> {};
+#elif LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
+template<> class GemmKernel<int32_t> : public GemmAvx2Kernel<int32_t> {};
+template<> class GemmKernel<int64_t> : public GemmAvx2Kernel<int64_t> {};
+#endif
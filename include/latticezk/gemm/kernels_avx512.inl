@@ -0,0 +1,241 @@
+// AVX-512 micro-kernels, see kernels.hpp for the packed panel layout
+// This file is included by kernels.inl for the AVX-512 levels
+//
+// GemmAvx512Kernel uses the low-half multiplication of the entry width, except for 8-bit entries.
+// Only the low w bits of a sum of products matter modulo 2^w, so the 8- and 16-bit kernels may compute in
+// wider lanes and truncate at the end:
+//   - GemmAvx512Kernel uses 16-bit low-half multiplication for 8-bit entries, as the AVX2 kernel does
+//   - GemmVnniKernel uses AVX512-VNNI dot-product instructions accumulating into 32-bit lanes:
+//       vpdpwssd sums 2 adjacent int16*int16 products, so A and B are packed with KU = 2
+//       vpdpbusd sums 4 adjacent uint8*int8 products, so A and B are packed with KU = 4
+//     A is read as unsigned by vpdpbusd, which changes each product by a multiple of 256 and so does
+//     not change the result modulo 2^8
+//     The 32-bit sums are truncated to w bits with vpmovdw/vpmovdb
+
+template<typename T>
+class GemmAvx512Kernel;
+
+// 8-bit entries: even and odd bytes are multiplied in separate 16-bit lanes, as in the AVX2 kernel
+template<>
+class GemmAvx512Kernel<int8_t>
+{
+public:
+	typedef int8_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 64;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int8_t * a, const int8_t * b, int8_t * c)
+	{
+		__m512i e[NR], o[NR];
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			e[j] = o[j] = _mm512_setzero_si512();
+		}
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m512i ae = _mm512_loadu_si512(a);
+			__m512i ao = _mm512_srli_epi16(ae, 8);
+			LATTICEZK_UNROLL
+			for (matdim_t j = 0; j < NR; j++) {
+				__m512i bj = _mm512_set1_epi8(b[j]);
+				e[j] = _mm512_add_epi16(e[j], _mm512_mullo_epi16(ae, bj));
+				o[j] = _mm512_add_epi16(o[j], _mm512_mullo_epi16(ao, bj));
+			}
+		}
+		const __m512i low = _mm512_set1_epi16(0x00ff);
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			_mm512_storeu_si512(c + j * MR, _mm512_or_si512(_mm512_and_si512(e[j], low), _mm512_slli_epi16(o[j], 8)));
+		}
+	}
+};
+
+// 16-bit entries: a 64x8 tile in sixteen accumulators using the low-half 16-bit multiplication
+template<>
+class GemmAvx512Kernel<int16_t>
+{
+public:
+	typedef int16_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 64;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int16_t * a, const int16_t * b, int16_t * c)
+	{
+		__m512i c0[NR], c1[NR];
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			c0[j] = c1[j] = _mm512_setzero_si512();
+		}
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m512i a0 = _mm512_loadu_si512(a);
+			__m512i a1 = _mm512_loadu_si512(a + 32);
+			LATTICEZK_UNROLL
+			for (matdim_t j = 0; j < NR; j++) {
+				__m512i bj = _mm512_set1_epi16(b[j]);
+				c0[j] = _mm512_add_epi16(c0[j], _mm512_mullo_epi16(a0, bj));
+				c1[j] = _mm512_add_epi16(c1[j], _mm512_mullo_epi16(a1, bj));
+			}
+		}
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			_mm512_storeu_si512(c + j * MR, c0[j]);
+			_mm512_storeu_si512(c + j * MR + 32, c1[j]);
+		}
+	}
+};
+
+// 32-bit entries: a 32x8 tile in sixteen accumulators using the low-half 32-bit multiplication
+template<>
+class GemmAvx512Kernel<int32_t>
+{
+public:
+	typedef int32_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 32;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int32_t * a, const int32_t * b, int32_t * c)
+	{
+		__m512i c0[NR], c1[NR];
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			c0[j] = c1[j] = _mm512_setzero_si512();
+		}
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m512i a0 = _mm512_loadu_si512(a);
+			__m512i a1 = _mm512_loadu_si512(a + 16);
+			LATTICEZK_UNROLL
+			for (matdim_t j = 0; j < NR; j++) {
+				__m512i bj = _mm512_set1_epi32(b[j]);
+				c0[j] = _mm512_add_epi32(c0[j], _mm512_mullo_epi32(a0, bj));
+				c1[j] = _mm512_add_epi32(c1[j], _mm512_mullo_epi32(a1, bj));
+			}
+		}
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			_mm512_storeu_si512(c + j * MR, c0[j]);
+			_mm512_storeu_si512(c + j * MR + 16, c1[j]);
+		}
+	}
+};
+
+// 64-bit entries: a 16x8 tile in sixteen accumulators using the AVX-512DQ low-half 64-bit multiplication
+template<>
+class GemmAvx512Kernel<int64_t>
+{
+public:
+	typedef int64_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 16;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 1;
+public:
+	static inline void Run(matdim_t kc, const int64_t * a, const int64_t * b, int64_t * c)
+	{
+		__m512i c0[NR], c1[NR];
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			c0[j] = c1[j] = _mm512_setzero_si512();
+		}
+		for (matdim_t k = 0; k < kc; k++, a += MR, b += NR) {
+			__m512i a0 = _mm512_loadu_si512(a);
+			__m512i a1 = _mm512_loadu_si512(a + 8);
+			LATTICEZK_UNROLL
+			for (matdim_t j = 0; j < NR; j++) {
+				__m512i bj = _mm512_set1_epi64(b[j]);
+				c0[j] = _mm512_add_epi64(c0[j], _mm512_mullo_epi64(a0, bj));
+				c1[j] = _mm512_add_epi64(c1[j], _mm512_mullo_epi64(a1, bj));
+			}
+		}
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			_mm512_storeu_si512(c + j * MR, c0[j]);
+			_mm512_storeu_si512(c + j * MR + 8, c1[j]);
+		}
+	}
+};
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX512VNNI
+
+// Broadcasts the KU packed entries B(k..k+KU-1, j) as one 32-bit lane
+inline __m512i gemm_broadcast32(const void * p)
+{
+	int32_t v;
+	memcpy(&v, p, sizeof(v));
+	return _mm512_set1_epi32(v);
+}
+
+template<typename T>
+class GemmVnniKernel;
+
+// 8-bit entries: a 32x8 tile in sixteen 32-bit accumulators using vpdpbusd
+template<>
+class GemmVnniKernel<int8_t>
+{
+public:
+	typedef int8_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 32;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 4;
+public:
+	static inline void Run(matdim_t kc, const int8_t * a, const int8_t * b, int8_t * c)
+	{
+		__m512i c0[NR], c1[NR];
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			c0[j] = c1[j] = _mm512_setzero_si512();
+		}
+		for (matdim_t k = 0; k < kc; k += KU, a += MR * KU, b += NR * KU) {
+			__m512i a0 = _mm512_loadu_si512(a);
+			__m512i a1 = _mm512_loadu_si512(a + 64);
+			LATTICEZK_UNROLL
+			for (matdim_t j = 0; j < NR; j++) {
+				__m512i bj = gemm_broadcast32(b + j * KU);
+				c0[j] = _mm512_dpbusd_epi32(c0[j], a0, bj);
+				c1[j] = _mm512_dpbusd_epi32(c1[j], a1, bj);
+			}
+		}
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			_mm512_mask_cvtepi32_storeu_epi8(c + j * MR, 0xffff, c0[j]);
+			_mm512_mask_cvtepi32_storeu_epi8(c + j * MR + 16, 0xffff, c1[j]);
+		}
+	}
+};
+
+// 16-bit entries: a 32x8 tile in sixteen 32-bit accumulators using vpdpwssd
+template<>
+class GemmVnniKernel<int16_t>
+{
+public:
+	typedef int16_t data_t;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t MR = 32;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t NR = 8;
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t KU = 2;
+public:
+	static inline void Run(matdim_t kc, const int16_t * a, const int16_t * b, int16_t * c)
+	{
+		__m512i c0[NR], c1[NR];
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			c0[j] = c1[j] = _mm512_setzero_si512();
+		}
+		for (matdim_t k = 0; k < kc; k += KU, a += MR * KU, b += NR * KU) {
+			__m512i a0 = _mm512_loadu_si512(a);
+			__m512i a1 = _mm512_loadu_si512(a + 32);
+			LATTICEZK_UNROLL
+			for (matdim_t j = 0; j < NR; j++) {
+				__m512i bj = gemm_broadcast32(b + j * KU);
+				c0[j] = _mm512_dpwssd_epi32(c0[j], a0, bj);
+				c1[j] = _mm512_dpwssd_epi32(c1[j], a1, bj);
+			}
+		}
+		LATTICEZK_UNROLL
+		for (matdim_t j = 0; j < NR; j++) {
+			_mm512_mask_cvtepi32_storeu_epi16(c + j * MR, 0xffff, c0[j]);
+			_mm512_mask_cvtepi32_storeu_epi16(c + j * MR + 16, 0xffff, c1[j]);
+		}
+	}
+};
+
+#endif // LATTICEZK_ISA >= LATTICEZK_ISA_AVX512VNNI
@@ -0,0 +1,258 @@
+#ifndef __LATTICEZK_GEMM_STRASSEN_HPP_
+#define __LATTICEZK_GEMM_STRASSEN_HPP_
+
+// Strassen-Winograd matrix multiplication over Z_{2^w}, in front of the blocked engine in gemm.hpp
+//
+// Each level splits A, B and C into 2x2 blocks and computes C with 7 block products and 15 block
+// additions instead of 8 products. It only adds and subtracts, hence is exact in wraparound arithmetic.
+// Levels recurse while all of m, n and k exceed a cutoff, below which the blocked engine is used.
+// Odd dimensions are peeled: the even part goes through the level and the last row, column or
+// depth is fixed up with thin products.
+//
+// The block sums and one block product of each level are kept in scratch memory taken from a
+// GemmWorkspace, reserved once for the whole recursion and reused across multiplications, up to
+// LATTICEZK_GEMM_WORKSPACE_KEEP bytes; a larger reservation is freed once the multiplication is done.
+// If the scratch cannot be reserved, as while the workspace is in use, the blocked engine computes C alone.
+// The schedule (see StrassenGemmLevel) uses the blocks of C for the other products.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include "latticezk/common.hpp"
+#include "latticezk/gemm/gemm.hpp"
+
+// Bytes of scratch that a workspace keeps between multiplications
+#define LATTICEZK_GEMM_WORKSPACE_KEEP (64 << 20)
+
+namespace LatticeZK {
+
+// Aligned scratch memory that is taken and released in stack order, and kept across uses
+class GemmWorkspace
+{
+private:
+	char * data;
+	size_t size, used;
+private:
+	GemmWorkspace(const GemmWorkspace & other) = delete;
+	GemmWorkspace(const GemmWorkspace && other) = delete;
+public:
+	GemmWorkspace() :
+		data(nullptr), size(0), used(0)
+	{
+	}
+	~GemmWorkspace()
+	{
+		LATTICEZK_ALIGNED_FREE(data);
+	}
+public:
+	static size_t Round(size_t bytes)
+	{
+		return ((bytes + LATTICEZK_ALIGNMENT - 1) / LATTICEZK_ALIGNMENT) * LATTICEZK_ALIGNMENT;
+	}
+	// Ensures the given number of bytes can be taken, growing the memory only while nothing is taken
+	bool Reserve(size_t bytes)
+	{
+		bytes = Round(bytes);
+		if (used + bytes <= size) {
+			return true;
+		}
+		if (used > 0) {
+			return false;
+		}
+		char * grown = (char *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, bytes);
+		if (grown == nullptr) {
+			return false;
+		}
+		LATTICEZK_ALIGNED_FREE(data);
+		data = grown;
+		size = bytes;
+		return true;
+	}
+	// Takes memory for n entries, or returns nullptr if not enough is reserved
+	template<typename T>
+	T * Take(size_t n)
+	{
+		size_t bytes = Round(n * sizeof(T));
+		if (used + bytes > size) {
+			return nullptr;
+		}
+		T * p = (T *)(data + used);
+		used += bytes;
+		return p;
+	}
+	// Releases the given memory and all memory taken after it
+	void Release(void * p)
+	{
+		used = (size_t)((char *)p - data);
+	}
+	// Frees the memory if nothing is taken and more than keep bytes are reserved, returning whether it did
+	bool Trim(size_t keep = 0)
+	{
+		if (used > 0 || size <= keep) {
+			return false;
+		}
+		LATTICEZK_ALIGNED_FREE(data);
+		data = nullptr;
+		size = 0;
+		return true;
+	}
+	// Bytes reserved
+	size_t Reserved() const
+	{
+		return size;
+	}
+	// The workspace of the calling thread
+	static GemmWorkspace & ThreadLocal()
+	{
+		static thread_local GemmWorkspace ws;
+		return ws;
+	}
+};
+
+// The default cutoff for entries of type T, from that of the tuning profile for 64-bit entries
+// Narrower entries have proportionally faster kernels, against which the block additions pay off later
+template<typename T>
+inline matdim_t StrassenCutoff()
+{
+	return (matdim_t)std::min<int64_t>(INT32_MAX, TuningProfile::Current().strassen_cutoff * 8 / sizeof(T));
+}
+
+// Computes the CMO m-by-n dst = x - y, or x + y if !subtract, widening entries to T
+template<typename T, typename XSource, typename YSource>
+void StrassenCombine(matdim_t m, matdim_t n, const XSource & x, const YSource & y, bool subtract, T * dst)
+{
+	typedef gemm_uint_t<T> U;
+	Executor::Current().ParallelFor(0, n, TuningProfile::Current().gemm_chunk_pack / std::max<matdim_t>(1, m), [&](int64_t j0, int64_t j1) {
+		for (matdim_t j = (matdim_t)j0; j < j1; j++) {
+			T * d = dst + j * m;
+			for (matdim_t i = 0; i < m; i++) {
+				U xi = (U)(T)x(i, j), yi = (U)(T)y(i, j);
+				d[i] = (T)(subtract ? xi - yi : xi + yi);
+			}
+		}
+	});
+}
+
+// Computes C -= Q, or C += Q if !subtract, over an m-by-n block of C with entry (i, j) at c[i*rsc + j*csc]
+template<typename T, typename QSource>
+void StrassenUpdate(matdim_t m, matdim_t n, const QSource & q, bool subtract, T * c, ptrdiff_t rsc, ptrdiff_t csc)
+{
+	typedef gemm_uint_t<T> U;
+	Executor::Current().ParallelFor(0, n, TuningProfile::Current().gemm_chunk_pack / std::max<matdim_t>(1, m), [&](int64_t j0, int64_t j1) {
+		for (matdim_t j = (matdim_t)j0; j < j1; j++) {
+			T * cj = c + j * csc;
+			for (matdim_t i = 0; i < m; i++) {
+				U ci = (U)cj[i * rsc], qi = (U)(T)q(i, j);
+				cj[i * rsc] = (T)(subtract ? ci - qi : ci + qi);
+			}
+		}
+	});
+}
+
+// Bytes of workspace needed by the levels of an m-by-n-by-k multiplication
+template<typename T>
+size_t StrassenWorkspaceBytes(matdim_t m, matdim_t n, matdim_t k, matdim_t cutoff)
+{
+	if (std::min(std::min(m, n), k) <= cutoff) {
+		return 0;
+	}
+	matdim_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+	return GemmWorkspace::Round(m2 * k2 * sizeof(T)) + GemmWorkspace::Round(k2 * n2 * sizeof(T)) + GemmWorkspace::Round(m2 * n2 * sizeof(T))
+		+ StrassenWorkspaceBytes<T>(m2, n2, k2, cutoff);
+}
+
+// Computes C = A*B as in Gemm, via one Strassen-Winograd level and recursion if all dimensions exceed the cutoff
+template<typename T, typename ASource, typename BSource>
+bool StrassenGemmLevel(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BSource & b, T * c, ptrdiff_t rsc, ptrdiff_t csc,
+	matdim_t cutoff, GemmWorkspace & ws)
+{
+	if (std::min(std::min(m, n), k) <= cutoff) {
+		return Gemm<T>(m, n, k, a, b, c, rsc, csc);
+	}
+	typedef GemmStridedSource<T> TSource;
+	typedef gemm_uint_t<T> U;
+	const matdim_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+	T * x = ws.Take<T>(m2 * k2);
+	T * y = ws.Take<T>(k2 * n2);
+	T * q = ws.Take<T>(m2 * n2);
+	if (x == nullptr || y == nullptr || q == nullptr) {
+		return false;
+	}
+	const TSource xs(x, 1, m2), ys(y, 1, k2), qs(q, 1, m2);
+	const ASource a11 = a.Block(0, 0), a12 = a.Block(0, k2), a21 = a.Block(m2, 0), a22 = a.Block(m2, k2);
+	const BSource b11 = b.Block(0, 0), b12 = b.Block(0, n2), b21 = b.Block(k2, 0), b22 = b.Block(k2, n2);
+	T * c11 = c, * c12 = c + n2 * csc, * c21 = c + m2 * rsc, * c22 = c + m2 * rsc + n2 * csc;
+	const TSource c11s(c11, rsc, csc), c12s(c12, rsc, csc), c21s(c21, rsc, csc), c22s(c22, rsc, csc);
+	bool success = true;
+	// S3 = A11 - A21, T3 = B22 - B12, C21 = P7 = S3*T3
+	StrassenCombine(m2, k2, a11, a21, true, x);
+	StrassenCombine(k2, n2, b22, b12, true, y);
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, xs, ys, c21, rsc, csc, cutoff, ws);
+	// S1 = A21 + A22, T1 = B12 - B11, C22 = P5 = S1*T1
+	StrassenCombine(m2, k2, a21, a22, false, x);
+	StrassenCombine(k2, n2, b12, b11, true, y);
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, xs, ys, c22, rsc, csc, cutoff, ws);
+	// S2 = S1 - A11, T2 = B22 - T1, C12 = P6 = S2*T2
+	StrassenCombine(m2, k2, xs, a11, true, x);
+	StrassenCombine(k2, n2, b22, ys, true, y);
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, xs, ys, c12, rsc, csc, cutoff, ws);
+	// S4 = A12 - S2, C11 = P3 = S4*B22
+	StrassenCombine(m2, k2, a12, xs, true, x);
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, xs, b22, c11, rsc, csc, cutoff, ws);
+	// Q = P1 = A11*B11
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, a11, b11, q, 1, m2, cutoff, ws);
+	// C12 = U2 = P1 + P6, C21 = U3 = U2 + P7, C12 = U4 = U2 + P5, C22 = U7 = U3 + P5, C12 = U5 = U4 + P3
+	StrassenUpdate(m2, n2, qs, false, c12, rsc, csc);
+	StrassenUpdate(m2, n2, c12s, false, c21, rsc, csc);
+	StrassenUpdate(m2, n2, c22s, false, c12, rsc, csc);
+	StrassenUpdate(m2, n2, c21s, false, c22, rsc, csc);
+	StrassenUpdate(m2, n2, c11s, false, c12, rsc, csc);
+	// T4 = T2 - B21, C11 = P4 = A22*T4, C21 = U6 = U3 - P4
+	StrassenCombine(k2, n2, ys, b21, true, y);
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, a22, ys, c11, rsc, csc, cutoff, ws);
+	StrassenUpdate(m2, n2, c11s, true, c21, rsc, csc);
+	// C11 = P2 = A12*B21, C11 = U1 = P1 + P2
+	success = success && StrassenGemmLevel<T>(m2, n2, k2, a12, b21, c11, rsc, csc, cutoff, ws);
+	StrassenUpdate(m2, n2, qs, false, c11, rsc, csc);
+	ws.Release(x);
+	// peeling: the last depth is a rank-1 update of the even block, the last row and column are thin products
+	if (k > 2 * k2) {
+		Executor::Current().ParallelFor(0, 2 * n2, TuningProfile::Current().gemm_chunk_pack / std::max<matdim_t>(1, 2 * m2), [&](int64_t j0, int64_t j1) {
+			for (matdim_t j = (matdim_t)j0; j < j1; j++) {
+				U bj = (U)(T)b(k - 1, j);
+				T * cj = c + j * csc;
+				for (matdim_t i = 0; i < 2 * m2; i++) {
+					cj[i * rsc] = (T)((U)cj[i * rsc] + (U)(T)a(i, k - 1) * bj);
+				}
+			}
+		});
+	}
+	if (m > 2 * m2) {
+		success = success && Gemm<T>(1, 2 * n2, k, a.Block(m - 1, 0), b, c + (m - 1) * rsc, rsc, csc);
+	}
+	if (n > 2 * n2) {
+		success = success && Gemm<T>(m, 1, k, a, b.Block(0, n - 1), c + (n - 1) * csc, rsc, csc);
+	}
+	return success;
+}
+
+// Computes C = A*B as in Gemm, via Strassen-Winograd levels while all dimensions exceed the cutoff
+// The scratch memory is taken from the given workspace, by default the calling thread's, and trimmed after
+template<typename T, typename ASource, typename BSource>
+bool StrassenGemm(matdim_t m, matdim_t n, matdim_t k, const ASource & a, const BSource & b, T * c, ptrdiff_t rsc, ptrdiff_t csc,
+	matdim_t cutoff = StrassenCutoff<T>(), GemmWorkspace & ws = GemmWorkspace::ThreadLocal())
+{
+	if (m < 0 || n < 0 || k < 0 || cutoff < 1) {
+		return false;
+	}
+	if (!ws.Reserve(StrassenWorkspaceBytes<T>(m, n, k, cutoff))) {
+		return Gemm<T>(m, n, k, a, b, c, rsc, csc);
+	}
+	const bool success = StrassenGemmLevel<T>(m, n, k, a, b, c, rsc, csc, cutoff, ws);
+	ws.Trim(LATTICEZK_GEMM_WORKSPACE_KEEP);
+	return success;
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_GEMM_STRASSEN_HPP_
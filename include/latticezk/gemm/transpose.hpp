@@ -0,0 +1,158 @@
+#ifndef __LATTICEZK_GEMM_TRANSPOSE_HPP_
+#define __LATTICEZK_GEMM_TRANSPOSE_HPP_
+
+// Matrix transposition, i.e. reordering between RMO and CMO
+//   - the matrix is split into tiles that the threads of the executor transpose in parallel
+//   - a tile is halved along its longer side until it fits in L1, which is cache-oblivious in that both
+//     the reads and the writes stay within a few cache lines per row at every level of the cache
+//   - a leaf is transposed in B-by-B blocks held in registers (see transpose.inl), selected at run-time
+//     for the CPU's instruction set, and entries may be narrowed to another type on the way, with a check
+//     that they fit
+//   - square matrices may be transposed in place, swapping pairs of tiles through a buffer
+
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include <immintrin.h>
+#include "latticezk/common.hpp"
+#include "latticezk/util/cpu.hpp"
+#include "latticezk/util/executor.hpp"
+
+// Side of the tiles that the threads transpose, in entries
+#define LATTICEZK_TRANSPOSE_TILE 256
+// Bytes of a leaf of the recursion, which stays in L1 along with its transpose
+#define LATTICEZK_TRANSPOSE_LEAF_BYTES (1 << 12)
+
+#define LATTICEZK_MULTIVERSION_INCLUDE "latticezk/gemm/transpose.inl"
+#include "latticezk/util/multiversion.inl"
+
+namespace LatticeZK {
+
+// Transposes the m-by-n src into dst, dst[j*ds + i] = src[i*ss + j], converting S-entries to T
+// Returns false if an entry does not fit in T, but transposes all the same
+template<typename Kernel, typename S, typename T>
+bool TransposeRecursive(matdim_t m, matdim_t n, const S * src, ptrdiff_t ss, T * dst, ptrdiff_t ds)
+{
+	constexpr matdim_t B = Kernel::B;
+	if (m * n * (matdim_t)sizeof(T) > LATTICEZK_TRANSPOSE_LEAF_BYTES && (m > B || n > B)) {
+		bool fits0, fits1;
+		if (m >= n) {
+			const matdim_t m1 = (m / 2 + B - 1) / B * B;
+			fits0 = TransposeRecursive<Kernel>(m1, n, src, ss, dst, ds);
+			fits1 = TransposeRecursive<Kernel>(m - m1, n, src + m1 * ss, ss, dst + m1, ds);
+		} else {
+			const matdim_t n1 = (n / 2 + B - 1) / B * B;
+			fits0 = TransposeRecursive<Kernel>(m, n1, src, ss, dst, ds);
+			fits1 = TransposeRecursive<Kernel>(m, n - n1, src + n1, ss, dst + n1 * ds, ds);
+		}
+		return fits0 && fits1;
+	}
+	if constexpr (std::is_same<S, T>::value) {
+		const matdim_t mb = m - m % B, nb = n - n % B;
+		for (matdim_t i0 = 0; i0 < mb; i0 += B) {
+			for (matdim_t j0 = 0; j0 < nb; j0 += B) {
+				Kernel::Run(src + i0 * ss + j0, ss, dst + j0 * ds + i0, ds);
+			}
+		}
+		// the partial blocks at the right and bottom edges
+		for (matdim_t j = nb; j < n; j++) {
+			for (matdim_t i = 0; i < m; i++) {
+				dst[j * ds + i] = src[i * ss + j];
+			}
+		}
+		for (matdim_t j = 0; j < nb; j++) {
+			for (matdim_t i = mb; i < m; i++) {
+				dst[j * ds + i] = src[i * ss + j];
+			}
+		}
+		return true;
+	} else {
+		// the leaf is small enough to be converted a row of dst at a time
+		bool fits = true;
+		for (matdim_t j = 0; j < n; j++) {
+			for (matdim_t i = 0; i < m; i++) {
+				S e = src[i * ss + j];
+				dst[j * ds + i] = (T)e;
+				fits &= (S)(T)e == e;
+			}
+		}
+		return fits;
+	}
+}
+
+// Transposes as above, a tile per thread at a time
+template<typename Kernel, typename S, typename T>
+bool TransposeWithKernel(matdim_t m, matdim_t n, const S * src, ptrdiff_t ss, T * dst, ptrdiff_t ds)
+{
+	constexpr matdim_t TILE = LATTICEZK_TRANSPOSE_TILE;
+	const matdim_t mtiles = (m + TILE - 1) / TILE, ntiles = (n + TILE - 1) / TILE;
+	return Executor::Current().ParallelReduce(0, (int64_t)mtiles * ntiles, 1, true, [&](int64_t t0, int64_t t1) {
+		bool fits = true;
+		for (matdim_t t = (matdim_t)t0; t < t1; t++) {
+			const matdim_t i0 = (t / ntiles) * TILE, j0 = (t % ntiles) * TILE;
+			fits = TransposeRecursive<Kernel>(std::min(TILE, m - i0), std::min(TILE, n - j0), src + i0 * ss + j0, ss, dst + j0 * ds + i0, ds) && fits;
+		}
+		return fits;
+	}, [](bool x, bool y) { return x && y; });
+}
+
+// Transposes the m-by-n src into dst as above, using the kernel for the CPU's instruction set
+// Returns false if an entry does not fit in T
+template<typename S, typename T>
+bool Transpose(matdim_t m, matdim_t n, const S * src, ptrdiff_t ss, T * dst, ptrdiff_t ds)
+{
+	if (m < 0 || n < 0) {
+		return false;
+	}
+#define LATTICEZK_TRANSPOSE_CASE(ns) return TransposeWithKernel<ns::TransposeKernel<T>>(m, n, src, ss, dst, ds);
+	LATTICEZK_ISA_SWITCH(LATTICEZK_TRANSPOSE_CASE)
+#undef LATTICEZK_TRANSPOSE_CASE
+}
+
+// Transposes the n-by-n a in place, a[j*as + i] becoming a[i*as + j]
+template<typename Kernel, typename T>
+bool TransposeInPlaceWithKernel(matdim_t n, T * a, ptrdiff_t as)
+{
+	// a pair of tiles and the buffer stay in L2
+	constexpr matdim_t TILE = 64;
+	const matdim_t ntiles = (n + TILE - 1) / TILE;
+	return Executor::Current().ParallelReduce(0, ntiles, 1, true, [&](int64_t it0, int64_t it1) {
+		T * buf = (T *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, TILE * TILE * sizeof(T));
+		if (buf == nullptr) {
+			return false;
+		}
+		for (matdim_t it = (matdim_t)it0; it < it1; it++) {
+			const matdim_t i0 = it * TILE, mi = std::min(TILE, n - i0);
+			for (matdim_t j0 = i0; j0 < n; j0 += TILE) {
+				const matdim_t nj = std::min(TILE, n - j0);
+				T * aij = a + i0 * as + j0, * aji = a + j0 * as + i0;
+				// the transpose of tile (i, j) waits in the buffer while tile (j, i) is transposed into its place
+				TransposeRecursive<Kernel>(mi, nj, aij, as, buf, TILE);
+				if (j0 != i0) {
+					TransposeRecursive<Kernel>(nj, mi, aji, as, aij, as);
+				}
+				for (matdim_t j = 0; j < nj; j++) {
+					memcpy(aji + j * as, buf + j * TILE, mi * sizeof(T));
+				}
+			}
+		}
+		LATTICEZK_ALIGNED_FREE(buf);
+		return true;
+	}, [](bool x, bool y) { return x && y; });
+}
+
+// Transposes the n-by-n a in place as above, using the kernel for the CPU's instruction set
+template<typename T>
+bool TransposeInPlace(matdim_t n, T * a, ptrdiff_t as)
+{
+	if (n < 0 || as < n) {
+		return false;
+	}
+#define LATTICEZK_TRANSPOSE_CASE(ns) return TransposeInPlaceWithKernel<ns::TransposeKernel<T>>(n, a, as);
+	LATTICEZK_ISA_SWITCH(LATTICEZK_TRANSPOSE_CASE)
+#undef LATTICEZK_TRANSPOSE_CASE
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_GEMM_TRANSPOSE_HPP_
@@ -0,0 +1,269 @@
+// In-register transpose kernels, see transpose.hpp
+// This file is built once per ISA level via util/multiversion.inl. TransposeKernel<T> transposes a B-by-B
+// block, dst[j*ds + i] = src[i*ss + j] for i, j < B, with the best shuffles of the level for the width of T
+
+// Portable kernel, which the compiler may vectorize for the level
+template<typename T>
+class TransposeKernel
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 8;
+public:
+	static inline void Run(const T * src, ptrdiff_t ss, T * dst, ptrdiff_t ds)
+	{
+		for (matdim_t j = 0; j < B; j++) {
+			for (matdim_t i = 0; i < B; i++) {
+				dst[j * ds + i] = src[i * ss + j];
+			}
+		}
+	}
+};
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
+
+// 8-bit entries: a 16x16 block in 128-bit registers, at AVX-512 too, which has no byte permute without VBMI
+// Each round interleaves the bytes of rows i and i+8 into rows 2i and 2i+1, which rotates the bits of
+// (row, column) left by one, so that four rounds swap the row and the column
+template<>
+class TransposeKernel<int8_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 16;
+public:
+	static inline void Run(const int8_t * src, ptrdiff_t ss, int8_t * dst, ptrdiff_t ds)
+	{
+		__m128i r[16], s[16];
+		for (int i = 0; i < 16; i++) {
+			r[i] = _mm_loadu_si128((const __m128i *)(src + i * ss));
+		}
+		for (int round = 0; round < 4; round += 2) {
+			for (int i = 0; i < 8; i++) {
+				s[2 * i] = _mm_unpacklo_epi8(r[i], r[i + 8]);
+				s[2 * i + 1] = _mm_unpackhi_epi8(r[i], r[i + 8]);
+			}
+			for (int i = 0; i < 8; i++) {
+				r[2 * i] = _mm_unpacklo_epi8(s[i], s[i + 8]);
+				r[2 * i + 1] = _mm_unpackhi_epi8(s[i], s[i + 8]);
+			}
+		}
+		for (int j = 0; j < 16; j++) {
+			_mm_storeu_si128((__m128i *)(dst + j * ds), r[j]);
+		}
+	}
+};
+
+#if LATTICEZK_ISA < LATTICEZK_ISA_AVX512
+
+// 16-bit entries: an 8x8 block in 128-bit registers, interleaving 16-, 32- and then 64-bit pairs
+template<>
+class TransposeKernel<int16_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 8;
+public:
+	static inline void Run(const int16_t * src, ptrdiff_t ss, int16_t * dst, ptrdiff_t ds)
+	{
+		__m128i r[8], s[8], t[8];
+		for (int i = 0; i < 8; i++) {
+			r[i] = _mm_loadu_si128((const __m128i *)(src + i * ss));
+		}
+		for (int i = 0; i < 8; i += 2) {
+			s[i / 2] = _mm_unpacklo_epi16(r[i], r[i + 1]);
+			s[i / 2 + 4] = _mm_unpackhi_epi16(r[i], r[i + 1]);
+		}
+		// s[q] interleaves rows 2q and 2q+1 in columns 0..3, and s[q+4] in columns 4..7
+		for (int h = 0; h < 8; h += 4) {
+			t[h + 0] = _mm_unpacklo_epi32(s[h + 0], s[h + 1]);
+			t[h + 1] = _mm_unpackhi_epi32(s[h + 0], s[h + 1]);
+			t[h + 2] = _mm_unpacklo_epi32(s[h + 2], s[h + 3]);
+			t[h + 3] = _mm_unpackhi_epi32(s[h + 2], s[h + 3]);
+		}
+		for (int h = 0; h < 8; h += 4) {
+			_mm_storeu_si128((__m128i *)(dst + (h + 0) * ds), _mm_unpacklo_epi64(t[h + 0], t[h + 2]));
+			_mm_storeu_si128((__m128i *)(dst + (h + 1) * ds), _mm_unpackhi_epi64(t[h + 0], t[h + 2]));
+			_mm_storeu_si128((__m128i *)(dst + (h + 2) * ds), _mm_unpacklo_epi64(t[h + 1], t[h + 3]));
+			_mm_storeu_si128((__m128i *)(dst + (h + 3) * ds), _mm_unpackhi_epi64(t[h + 1], t[h + 3]));
+		}
+	}
+};
+
+// 32-bit entries: an 8x8 block, interleaving 32- and 64-bit pairs within lanes and then swapping lanes
+template<>
+class TransposeKernel<int32_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 8;
+public:
+	static inline void Run(const int32_t * src, ptrdiff_t ss, int32_t * dst, ptrdiff_t ds)
+	{
+		__m256i r[8], s[8], t[8];
+		for (int i = 0; i < 8; i++) {
+			r[i] = _mm256_loadu_si256((const __m256i *)(src + i * ss));
+		}
+		for (int i = 0; i < 8; i += 2) {
+			s[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+			s[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+		}
+		for (int i = 0; i < 8; i += 4) {
+			t[i + 0] = _mm256_unpacklo_epi64(s[i + 0], s[i + 2]);
+			t[i + 1] = _mm256_unpackhi_epi64(s[i + 0], s[i + 2]);
+			t[i + 2] = _mm256_unpacklo_epi64(s[i + 1], s[i + 3]);
+			t[i + 3] = _mm256_unpackhi_epi64(s[i + 1], s[i + 3]);
+		}
+		for (int j = 0; j < 4; j++) {
+			_mm256_storeu_si256((__m256i *)(dst + j * ds), _mm256_permute2x128_si256(t[j], t[j + 4], 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + (j + 4) * ds), _mm256_permute2x128_si256(t[j], t[j + 4], 0x31));
+		}
+	}
+};
+
+#endif // LATTICEZK_ISA < LATTICEZK_ISA_AVX512
+
+#if LATTICEZK_ISA >= LATTICEZK_ISA_AVX512
+
+// Indices of the two-source permutes that swap the off-diagonal d-by-d blocks of each 2d-by-2d block of an
+// N-by-N block of entries U, rows i and i+d, for i & d == 0, taking the entries lo and hi of the pair
+template<typename U, int N>
+struct TransposeSwapIndices
+{
+	alignas(64) U lo[N];
+	alignas(64) U hi[N];
+	constexpr TransposeSwapIndices(int d) :
+		lo(), hi()
+	{
+		for (int e = 0; e < N; e++) {
+			lo[e] = (U)((e & d) == 0 ? e : N + e - d);
+			hi[e] = (U)((e & d) == 0 ? e + d : N + e);
+		}
+	}
+};
+
+// Swaps the blocks as above in the N rows r, which transposes them once done for d = N/2, ..., 2, 1
+template<typename U, int N>
+static inline void TransposeSwapBlocks(__m512i * r, const TransposeSwapIndices<U, N> & indices, int d)
+{
+	const __m512i lo = _mm512_load_si512((const void *)indices.lo), hi = _mm512_load_si512((const void *)indices.hi);
+	for (int i = 0; i < N; i++) {
+		if ((i & d) == 0) {
+			const __m512i a = r[i], b = r[i + d];
+			if constexpr (sizeof(U) == 2) {
+				r[i] = _mm512_permutex2var_epi16(a, lo, b);
+				r[i + d] = _mm512_permutex2var_epi16(a, hi, b);
+			} else {
+				r[i] = _mm512_permutex2var_epi32(a, lo, b);
+				r[i + d] = _mm512_permutex2var_epi32(a, hi, b);
+			}
+		}
+	}
+}
+
+// 16-bit entries: a 32x32 block, swapping blocks of 16, 8, 4, 2 and 1 entries
+template<>
+class TransposeKernel<int16_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 32;
+public:
+	static inline void Run(const int16_t * src, ptrdiff_t ss, int16_t * dst, ptrdiff_t ds)
+	{
+		static constexpr TransposeSwapIndices<int16_t, 32> d16(16), d8(8), d4(4), d2(2), d1(1);
+		__m512i r[32];
+		for (int i = 0; i < 32; i++) {
+			r[i] = _mm512_loadu_si512((const void *)(src + i * ss));
+		}
+		TransposeSwapBlocks(r, d16, 16);
+		TransposeSwapBlocks(r, d8, 8);
+		TransposeSwapBlocks(r, d4, 4);
+		TransposeSwapBlocks(r, d2, 2);
+		TransposeSwapBlocks(r, d1, 1);
+		for (int j = 0; j < 32; j++) {
+			_mm512_storeu_si512((void *)(dst + j * ds), r[j]);
+		}
+	}
+};
+
+// 32-bit entries: a 16x16 block, swapping blocks of 8, 4, 2 and 1 entries
+template<>
+class TransposeKernel<int32_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 16;
+public:
+	static inline void Run(const int32_t * src, ptrdiff_t ss, int32_t * dst, ptrdiff_t ds)
+	{
+		static constexpr TransposeSwapIndices<int32_t, 16> d8(8), d4(4), d2(2), d1(1);
+		__m512i r[16];
+		for (int i = 0; i < 16; i++) {
+			r[i] = _mm512_loadu_si512((const void *)(src + i * ss));
+		}
+		TransposeSwapBlocks(r, d8, 8);
+		TransposeSwapBlocks(r, d4, 4);
+		TransposeSwapBlocks(r, d2, 2);
+		TransposeSwapBlocks(r, d1, 1);
+		for (int j = 0; j < 16; j++) {
+			_mm512_storeu_si512((void *)(dst + j * ds), r[j]);
+		}
+	}
+};
+
+// 64-bit entries: an 8x8 block, interleaving 64-bit pairs and then 128-bit lanes in two rounds, each via
+// two-source permutes (which, unlike unpack and shuffle, GCC does not build on an undefined register)
+template<>
+class TransposeKernel<int64_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 8;
+public:
+	static inline void Run(const int64_t * src, ptrdiff_t ss, int64_t * dst, ptrdiff_t ds)
+	{
+		const __m512i lo = _mm512_set_epi64(14, 6, 12, 4, 10, 2, 8, 0), hi = _mm512_set_epi64(15, 7, 13, 5, 11, 3, 9, 1);
+		const __m512i even = _mm512_set_epi64(13, 12, 9, 8, 5, 4, 1, 0), odd = _mm512_set_epi64(15, 14, 11, 10, 7, 6, 3, 2);
+		__m512i r[8], t[8], u[8];
+		for (int i = 0; i < 8; i++) {
+			r[i] = _mm512_loadu_si512((const void *)(src + i * ss));
+		}
+		// t[2p] and t[2p+1] hold the even and odd columns of rows 2p..2p+1, one column pair per lane
+		for (int p = 0; p < 4; p++) {
+			t[2 * p] = _mm512_permutex2var_epi64(r[2 * p], lo, r[2 * p + 1]);
+			t[2 * p + 1] = _mm512_permutex2var_epi64(r[2 * p], hi, r[2 * p + 1]);
+		}
+		for (int o = 0; o < 2; o++) {
+			u[o + 0] = _mm512_permutex2var_epi64(t[o + 0], even, t[o + 2]);
+			u[o + 2] = _mm512_permutex2var_epi64(t[o + 0], odd, t[o + 2]);
+			u[o + 4] = _mm512_permutex2var_epi64(t[o + 4], even, t[o + 6]);
+			u[o + 6] = _mm512_permutex2var_epi64(t[o + 4], odd, t[o + 6]);
+			_mm512_storeu_si512((void *)(dst + (o + 0) * ds), _mm512_permutex2var_epi64(u[o + 0], even, u[o + 4]));
+			_mm512_storeu_si512((void *)(dst + (o + 4) * ds), _mm512_permutex2var_epi64(u[o + 0], odd, u[o + 4]));
+			_mm512_storeu_si512((void *)(dst + (o + 2) * ds), _mm512_permutex2var_epi64(u[o + 2], even, u[o + 6]));
+			_mm512_storeu_si512((void *)(dst + (o + 6) * ds), _mm512_permutex2var_epi64(u[o + 2], odd, u[o + 6]));
+		}
+	}
+};
+
+#else
+
+// 64-bit entries: a 4x4 block, interleaving 64-bit pairs within lanes and then swapping lanes
+template<>
+class TransposeKernel<int64_t>
+{
+public:
+	LATTICEZK_CLASS_STATIC_CONSTEXPR matdim_t B = 4;
+public:
+	static inline void Run(const int64_t * src, ptrdiff_t ss, int64_t * dst, ptrdiff_t ds)
+	{
+		__m256i r0 = _mm256_loadu_si256((const __m256i *)(src + 0 * ss));
+		__m256i r1 = _mm256_loadu_si256((const __m256i *)(src + 1 * ss));
+		__m256i r2 = _mm256_loadu_si256((const __m256i *)(src + 2 * ss));
+		__m256i r3 = _mm256_loadu_si256((const __m256i *)(src + 3 * ss));
+		__m256i t0 = _mm256_unpacklo_epi64(r0, r1), t1 = _mm256_unpackhi_epi64(r0, r1);
+		__m256i t2 = _mm256_unpacklo_epi64(r2, r3), t3 = _mm256_unpackhi_epi64(r2, r3);
+		_mm256_storeu_si256((__m256i *)(dst + 0 * ds), _mm256_permute2x128_si256(t0, t2, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 1 * ds), _mm256_permute2x128_si256(t1, t3, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 2 * ds), _mm256_permute2x128_si256(t0, t2, 0x31));
+		_mm256_storeu_si256((__m256i *)(dst + 3 * ds), _mm256_permute2x128_si256(t1, t3, 0x31));
+	}
+};
+
+#endif // LATTICEZK_ISA >= LATTICEZK_ISA_AVX512
+
+#endif // LATTICEZK_ISA >= LATTICEZK_ISA_AVX2
@@ -0,0 +1,150 @@
+#ifndef __LATTICEZK_HUGEPAGE_HPP_
+#define __LATTICEZK_HUGEPAGE_HPP_
+
+// Allocation of large matrices in huge pages, placed on NUMA nodes
+//   - a matrix of at least LATTICEZK_HUGE_PAGE_THRESHOLD bytes is mapped on its own, in explicit huge pages
+//     (MAP_HUGETLB of 2MB or 1GB) if requested and available, and otherwise in transparent huge pages
+//     (madvise(MADV_HUGEPAGE)), which cut the TLB misses of streaming through it
+//   - its pages are touched first by the threads of the executor of the allocating thread, thread t touching
+//     the t-th of as many contiguous chunks of whole huge pages, so that each share of the columns of a CMO
+//     matrix is placed on the node of its thread, or are interleaved over, or bound to, given NUMA nodes;
+//     Matrix::Zero and MatrixOps::Copy split the storage over the threads the same way, for 2MB pages
+//   - a matrix that cannot be placed as asked, or whose pages cannot all be allocated when first touched, as
+//     when the nodes it is bound to are exhausted, is unmapped and its allocation returns nullptr, rather than
+//     taking another policy; the pages are faulted in by MADV_POPULATE_WRITE, which fails instead of raising
+//     SIGBUS or invoking the OOM killer, on kernels that support it (5.14 on)
+//   - smaller matrices are allocated as by MatrixAllocator
+// Elsewhere than Linux, all matrices are allocated as by MatrixAllocator
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "latticezk/common.hpp"
+#include "latticezk/allocator.hpp"
+#include "latticezk/util/executor.hpp"
+#if defined(__linux__)
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+	#include <linux/mempolicy.h>
+#endif
+
+// Bytes from which a matrix is mapped in huge pages
+#define LATTICEZK_HUGE_PAGE_THRESHOLD (1 << 21)
+// Bytes of a base page, which first touch writes one byte of
+#define LATTICEZK_BASE_PAGE_BYTES 4096
+
+#if defined(__linux__) && !defined(MAP_HUGE_SHIFT)
+	#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace LatticeZK {
+
+enum class NumaPolicy
+{
+	FirstTouch, // each page on the node of the thread that first touches it
+	Interleave, // pages round-robin over the nodes of the mask
+	Bind // pages on the nodes of the mask only
+};
+
+class HugePageAllocator : public MatrixAllocator
+{
+private:
+	size_t page_bytes;
+	bool explicit_pages;
+	NumaPolicy policy;
+	unsigned long nodemask;
+public:
+	// Maps large matrices in pages of page_bytes, either 2MB or 1GB, which must have been reserved by the system
+	// if explicit_pages, and places them per policy over the NUMA nodes of the bits of nodemask
+	HugePageAllocator(size_t page_bytes = 1 << 21, bool explicit_pages = false, NumaPolicy policy = NumaPolicy::FirstTouch, unsigned long nodemask = 0) :
+		page_bytes(page_bytes), explicit_pages(explicit_pages), policy(policy), nodemask(nodemask)
+	{
+	}
+public:
+	void * Allocate(size_t bytes) override
+	{
+#if defined(__linux__)
+		if (bytes >= LATTICEZK_HUGE_PAGE_THRESHOLD) {
+			const size_t mapped = Mapped(bytes);
+			void * p = MAP_FAILED;
+			if (explicit_pages) {
+				const int log_page = page_bytes >= ((size_t)1 << 30) ? 30 : 21;
+				p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log_page << MAP_HUGE_SHIFT), -1, 0);
+			}
+			if (p == MAP_FAILED) {
+				// no explicit huge pages are reserved, so ask for transparent ones
+				p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (p == MAP_FAILED) {
+					return nullptr;
+				}
+#if defined(MADV_HUGEPAGE)
+				madvise(p, mapped, MADV_HUGEPAGE);
+#endif
+			}
+			if (policy != NumaPolicy::FirstTouch && nodemask != 0) {
+				// via the system call rather than libnuma, which the build does not link
+				const int mode = policy == NumaPolicy::Interleave ? MPOL_INTERLEAVE : MPOL_BIND;
+				if (syscall(SYS_mbind, p, mapped, mode, &nodemask, 8 * sizeof(nodemask), 0) != 0) {
+					munmap(p, mapped);
+					return nullptr;
+				}
+			}
+			if (!FirstTouch((char *)p, mapped)) {
+				munmap(p, mapped);
+				return nullptr;
+			}
+			return p;
+		}
+#endif
+		return MatrixAllocator::Allocate(bytes);
+	}
+	void Free(void * p, size_t bytes) override
+	{
+#if defined(__linux__)
+		if (bytes >= LATTICEZK_HUGE_PAGE_THRESHOLD) {
+			if (p != nullptr) {
+				munmap(p, Mapped(bytes));
+			}
+			return;
+		}
+#endif
+		MatrixAllocator::Free(p, bytes);
+	}
+private:
+	// Bytes mapped for a matrix, a whole number of huge pages
+	size_t Mapped(size_t bytes) const
+	{
+		return (bytes + page_bytes - 1) / page_bytes * page_bytes;
+	}
+	// Writes a byte of each base page, thread t of the executor writing those of the t-th of contiguous chunks of
+	// whole huge pages, split in proportion to the threads as NumaTopology::PartitionStart splits columns over
+	// nodes; a transparent huge page is thus first touched by one thread only. The mapping is zero already, and
+	// so stays. Returns whether every page was allocated, which only a kernel that populates pages on request
+	// can tell
+	bool FirstTouch(char * p, size_t bytes) const
+	{
+		std::atomic<bool> success(true);
+		Executor::Current().ForEachThreadShare((int64_t)bytes, (int64_t)page_bytes, 0, [&](int64_t i0, int64_t i1) {
+#if defined(MADV_POPULATE_WRITE)
+			if (madvise(p + i0, i1 - i0, MADV_POPULATE_WRITE) == 0) {
+				return;
+			}
+			// an older kernel, which does not know the advice
+			if (errno != EINVAL) {
+				success = false;
+				return;
+			}
+#endif
+			for (int64_t i = i0; i < i1; i += LATTICEZK_BASE_PAGE_BYTES) {
+				p[i] = 0;
+			}
+		});
+		return success;
+	}
+};
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_HUGEPAGE_HPP_
@@ -3,10 +3,17 @@
 
 // Matrix classes supporting
 //   - integer-type modular arithmetic operations (e.g., mod 2^16 or mod 2^32)
-//   - parallelization via OpenMP
-//   - RMO (row-major-order) and CMO (column-major-order)
-//   - matrix multiplication in the form (RMO,CMO) -> CMO
-//   - Frobenius inner-product and norm
+//   - parallelization on a persistent pool of threads (see util/executor.hpp)
+//   - block sizes, parallel grains and cutoffs read from a tuning profile measured on the host (see util/tuning.hpp)
+//   - RMO (row-major-order) and CMO (column-major-order), reordered by blocked transposition (see gemm/transpose.hpp)
+//   - matrix multiplication of any combination of RMO and CMO, via the blocked engine in gemm/gemm.hpp, whose
+//     packing reads either order, and, for large products, Strassen-Winograd levels in front of it (see gemm/strassen.hpp)
+//   - batched multiplication of one left operand by several right-hand sides (see gemm/batch.hpp)
+//   - narrow storage of small entries, widened to the ring type as they are multiplied
+//   - elementwise expressions such as (a + b) == c, each evaluated in one parallel loop (see matrixexpr.hpp)
+//   - Frobenius inner-product and norm, summed exactly for integer entries
+//   - storage from a pluggable allocator, such as an arena recycling buffers across proofs (see allocator.hpp)
+//   - non-owning views of matrices and their submatrices, which the operations accept as well (see matrixview.hpp)
 //
 // The set of operations is designed to support the lattice-based NIZK protocol
 //
@@ -15,22 +22,28 @@
 #include <malloc.h>
 #include <string.h>
 #include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "latticezk/common.hpp"
 #include "latticezk/log.hpp"
+#include "latticezk/allocator.hpp"
+#include "latticezk/matrixview.hpp"
+#include "latticezk/matrixexpr.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/gemm/gemm.hpp"
+#include "latticezk/gemm/strassen.hpp"
+#include "latticezk/gemm/batch.hpp"
+#include "latticezk/gemm/transpose.hpp"
 
 #define LATTICEZK_MATDOT_INCREMENT (1 << 10)
-#define LATTICEZK_MATDOT_THRESHOLD (1 << 14)
-#define LATTICEZK_MATMUL_THRESHOLD1 (1 << 5)
-#define LATTICEZK_MATMUL_THRESHOLD2 (1 << 10)
 
 namespace LatticeZK {
 
-typedef int32_t matdim_t;
-
 class RowMajorOrder
 {
 private:
-	const matdim_t n_rows, n_cols;
+	matdim_t n_rows, n_cols;
 public:
 	RowMajorOrder(matdim_t n_rows, matdim_t n_cols) :
 		n_rows(n_rows), n_cols(n_cols)
@@ -45,12 +58,21 @@ public:
 	{
 		return i * n_cols + j;
 	}
+	// Distances between entries of adjacent rows and of adjacent columns
+	inline matdim_t RowStride() const
+	{
+		return n_cols;
+	}
+	inline matdim_t ColStride() const
+	{
+		return 1;
+	}
 };
 
 class ColumnMajorOrder
 {
 private:
-	const matdim_t n_rows, n_cols;
+	matdim_t n_rows, n_cols;
 public:
 	ColumnMajorOrder(matdim_t n_rows, matdim_t n_cols) :
 		n_rows(n_rows), n_cols(n_cols)
@@ -60,12 +82,20 @@ public:
 	inline matdim_t operator()(matdim_t i) const
 	{
 		matdim_t j = i / n_rows;
-		return this->operator()(i - j, j);
+		return this->operator()(i - j * n_rows, j);
 	}
 	inline matdim_t operator()(matdim_t i, matdim_t j) const
 	{
 		return j * n_rows + i;
 	}
+	inline matdim_t RowStride() const
+	{
+		return 1;
+	}
+	inline matdim_t ColStride() const
+	{
+		return n_rows;
+	}
 };
 
 template <typename T, typename Order>
@@ -77,21 +107,8 @@ bool MatrixToRowMajorOrder(const Matrix<T, ColumnMajorOrder> & a, Matrix<T, RowM
 	if (a.NumRows() != t.NumRows() || a.NumCols() != t.NumCols()) {
 		return false;
 	}
-	matdim_t i, j, iend = a.NumRows(), jend = a.NumCols();
-#if defined(_OPENMP)
-	#pragma omp parallel shared(a, t) private(i, j) if (iend*jend > LATTICEZK_MATDOT_THRESHOLD)
-#endif
-  	{
-#if defined(_OPENMP)
-		#pragma omp for schedule(static)
-#endif
-		for (j = 0; j < jend; j++) {
-			for (i = 0; i < iend; i++) {
-				t(i, j) = a(i, j);
-			}
-		}
-	}
-	return true;
+	// the CMO a is its RMO transpose
+	return Transpose(a.NumCols(), a.NumRows(), a.Data(), a.NumRows(), t.Data(), t.NumCols());
 }
 
 template<typename T>
@@ -100,95 +117,206 @@ bool MatrixToColumnMajorOrder(const Matrix<T, RowMajorOrder> & a, Matrix<T, Colu
 	if (a.NumRows() != t.NumRows() || a.NumCols() != t.NumCols()) {
 		return false;
 	}
-	matdim_t i, j, iend = a.NumRows(), jend = a.NumCols();
-#if defined(_OPENMP)
-	#pragma omp parallel shared(a, t) private(i, j) if (iend*jend > LATTICEZK_MATDOT_THRESHOLD)
-#endif
-  	{
-#if defined(_OPENMP)
-		#pragma omp for schedule(static)
-#endif
-		for (i = 0; i < iend; i++) {
-			for (j = 0; j < jend; j++) {
-				t(i, j) = a(i, j);
-			}
-		}
+	return Transpose(a.NumRows(), a.NumCols(), a.Data(), a.NumCols(), t.Data(), t.NumRows());
+}
+
+// Transposes a square matrix in place
+template<typename T, typename Order>
+bool MatrixTransposeInPlace(Matrix<T, Order> & a)
+{
+	if (a.NumRows() != a.NumCols()) {
+		return false;
 	}
-	return true;
+	return TransposeInPlace(a.NumRows(), a.Data(), a.NumRows());
+}
+
+// Narrows a matrix into a RMO matrix of a smaller entry type, returning false if an entry does not fit
+template<typename S, typename T, typename Order>
+bool MatrixNarrowToRowMajorOrder(const Matrix<T, Order> & a, Matrix<S, RowMajorOrder> & t)
+{
+	if (a.NumRows() != t.NumRows() || a.NumCols() != t.NumCols()) {
+		return false;
+	}
+	if (std::is_same<Order, ColumnMajorOrder>::value) {
+		return Transpose(a.NumCols(), a.NumRows(), a.Data(), a.NumRows(), t.Data(), t.NumCols());
+	}
+	const T * data = a.Data();
+	S * tdata = t.Data();
+	return Executor::Current().ParallelReduce(0, a.NumCells(), TuningProfile::Current().matdot_threshold, true, [&](int64_t i0, int64_t i1) {
+		bool fits = true;
+		for (int64_t i = i0; i < i1; i++) {
+			T e = data[i];
+			tdata[i] = (S)e;
+			fits = fits && (T)(S)e == e;
+		}
+		return fits;
+	}, [](bool x, bool y) { return x && y; });
 }
 
-//template <typename T, typename Order1, typename Order2, typename Order3>
-//bool MatrixMultiply(const Matrix<T, Order1> &a, const Matrix<T, Order2> &b, Matrix<T, Order3> &c)
+// Reference matrix multiplication using a naive loop, kept for testing the blocked engine
 template<typename T>
-bool MatrixMultiply(const Matrix<T, RowMajorOrder> &a, const Matrix<T, ColumnMajorOrder> &b, Matrix<T, ColumnMajorOrder> &c)
+bool MatrixMultiplyReference(const Matrix<T, RowMajorOrder> &a, const Matrix<T, ColumnMajorOrder> &b, Matrix<T, ColumnMajorOrder> &c)
 {
 	if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
 		return false;
 	}
-	LATTICEZK_LOG("matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols());
 	c.Zero();
-	matdim_t i, j, k, iend = c.NumRows(), jend = c.NumCols(), kend = a.NumCols();
-#if defined(_OPENMP)
-	#pragma omp parallel shared(a, b, c) private(i, j, k) if (iend > LATTICEZK_MATMUL_THRESHOLD1 && iend*jend > LATTICEZK_MATMUL_THRESHOLD2)
-#endif
-  	{
-#if defined(_OPENMP)
-		#pragma omp for schedule(static)
-#endif
-		for (j = 0; j < jend; j++) {
-			for (i = 0; i < iend; i++) {
+	const matdim_t iend = c.NumRows(), kend = a.NumCols();
+	// a column of C costs some iend*kend multiply-adds
+	Executor::Current().ParallelFor(0, c.NumCols(), TuningProfile::Current().gemm_chunk_work / ((int64_t)iend * kend + 1), [&](int64_t j0, int64_t j1) {
+		for (matdim_t j = (matdim_t)j0; j < (matdim_t)j1; j++) {
+			for (matdim_t i = 0; i < iend; i++) {
 				T s = 0;
 #if defined(_OPENMP)
 	#if !defined(_WIN32)
 				#pragma omp simd reduction(+:s)
 	#endif
 #endif
-				for (k = 0; k < kend; k++) {
+				for (matdim_t k = 0; k < kend; k++) {
 					s += a(i, k) * b(k, j);
 				}
 				c(i, j) += s;
 			}
 		}
-	}
+	});
 	return true;
 }
 
-template <typename T, typename Order>
-bool MatrixAdd(const Matrix<T, Order> &a, const Matrix<T, Order> &b, Matrix<T, Order> &c)
+// Multiplication of matrices of any strides, whose entries the engine reads through their strides as it packs them
+// The right operand may have narrower entries, such as a secret of small entries, which are widened to T as they are packed
+template<typename A, typename B, typename T>
+bool MatrixMultiply(MatrixView<A> a, MatrixView<B> b, MatrixView<T> c)
+{
+	typedef typename std::remove_const<B>::type S;
+	static_assert(std::is_same<typename std::remove_const<A>::type, T>::value, "the left operand must have the entries of the result");
+	if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+		return false;
+	}
+	LATTICEZK_LOG("matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols());
+	GemmStridedSource<T> asrc(a.Data(), a.RowStride(), a.ColStride());
+	GemmStridedSource<S> bsrc(b.Data(), b.RowStride(), b.ColStride());
+	return StrassenGemm<T>(c.NumRows(), c.NumCols(), a.NumCols(), asrc, bsrc, c.Data(), c.RowStride(), c.ColStride());
+}
+
+// Multiplication of matrices of any orders, as above
+template<typename T, typename S, typename OrderA, typename OrderB, typename OrderC>
+bool MatrixMultiply(const Matrix<T, OrderA> &a, const Matrix<S, OrderB> &b, Matrix<T, OrderC> &c)
+{
+	return MatrixMultiply(a.View(), b.View(), c.View());
+}
+
+// Computes C_i = A*B_i for each i, packing each block of A once for the whole batch
+template<typename T, typename Order>
+bool MatrixMultiplyBatch(const Matrix<T, Order> &a, const std::vector<const Matrix<T, ColumnMajorOrder> *> &b,
+	const std::vector<Matrix<T, ColumnMajorOrder> *> &c)
+{
+	if (b.size() != c.size()) {
+		return false;
+	}
+	GemmBatchOperands<T, GemmStridedSource<T>> batch;
+	for (size_t i = 0; i < b.size(); i++) {
+		if (a.NumRows() != c[i]->NumRows() || b[i]->NumCols() != c[i]->NumCols() || a.NumCols() != b[i]->NumRows()) {
+			return false;
+		}
+		batch.Add(c[i]->NumCols(), GemmStridedSource<T>(b[i]->Data(), 1, b[i]->NumRows()), c[i]->Data(), 1, c[i]->NumRows());
+	}
+	LATTICEZK_LOG("matrix batch mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.size() << " items");
+	GemmStridedSource<T> asrc(a.Data(), a.RowStride(), a.ColStride());
+	return GemmBatch<T>(a.NumRows(), a.NumCols(), asrc, batch);
+}
+
+// Applies f(i, j) to every entry of an m-by-n matrix with the given strides, in the order of its storage along each of
+// its lines, the columns if rs <= cs and the rows otherwise, which are split among the threads of the executor
+template<typename F>
+inline void MatrixForEach(matdim_t m, matdim_t n, ptrdiff_t rs, ptrdiff_t cs, F f)
+{
+	const bool columns = rs <= cs;
+	const matdim_t length = columns ? m : n;
+	const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / std::max<matdim_t>(1, length));
+	Executor::Current().ParallelFor(0, columns ? n : m, grain, [&](int64_t l0, int64_t l1) {
+		for (matdim_t l = (matdim_t)l0; l < l1; l++) {
+			if (columns) {
+				for (matdim_t i = 0; i < m; i++) {
+					f(i, l);
+				}
+			} else {
+				for (matdim_t j = 0; j < n; j++) {
+					f(l, j);
+				}
+			}
+		}
+	});
+}
+
+template<typename A, typename B, typename T>
+bool MatrixAdd(MatrixView<A> a, MatrixView<B> b, MatrixView<T> c)
 {
 	if (a.NumRows() != b.NumRows() || a.NumRows() != c.NumRows() || a.NumCols() != b.NumCols() || a.NumCols() != c.NumCols()) {
 		return false;
 	}
-	matdim_t i, iend = c.NumCells();
-	const T * adata = a.Data();
-	const T * bdata = b.Data();
-	T * cdata = c.Data();
-#if defined(_OPENMP)
-	#pragma omp simd
-#endif
-	for (i = 0; i < iend; i++) {
-		cdata[i] = adata[i] + bdata[i];
+	MatrixForEach(c.NumRows(), c.NumCols(), c.RowStride(), c.ColStride(), [&](matdim_t i, matdim_t j) {
+		c(i, j) = MatrixAddOp::Apply<T>(a(i, j), b(i, j));
+	});
+	return true;
+}
+
+template<typename A, typename T>
+bool MatrixCopy(MatrixView<A> a, MatrixView<T> c)
+{
+	if (a.NumRows() != c.NumRows() || a.NumCols() != c.NumCols()) {
+		return false;
 	}
+	MatrixForEach(c.NumRows(), c.NumCols(), c.RowStride(), c.ColStride(), [&](matdim_t i, matdim_t j) {
+		c(i, j) = a(i, j);
+	});
 	return true;
 }
 
-template<typename T, typename Order>
-bool MatrixFrobeniusInnerProduct(const Matrix<T, Order> &a, const Matrix<T, Order> &b, double &c)
+// The lines of a are summed in parallel as in MatrixForEach, exactly for integer entries, so the sum does not
+// depend on how they are split
+template<typename A, typename B>
+bool MatrixFrobeniusInnerProduct(MatrixView<A> a, MatrixView<B> b, double &c)
 {
 	if (a.NumRows() != b.NumRows() || a.NumCols() != b.NumCols()) {
 		return false;
 	}
-	matdim_t i, iend = a.NumCells();
-	const T * adata = a.Data();
-	const T * bdata = b.Data();
-	double r = 0.0;
-#if defined(_OPENMP)
-	#pragma omp parallel for reduction(+:r) if (iend > LATTICEZK_MATDOT_THRESHOLD)
-#endif
-	for (i = 0; i < iend; i++) {
-		r += (double)adata[i] * (double)bdata[i];
+	typedef typename std::remove_const<A>::type T;
+	const matdim_t m = a.NumRows(), n = a.NumCols();
+	const bool columns = a.RowStride() <= a.ColStride();
+	const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / std::max<matdim_t>(1, columns ? m : n));
+	const MatrixDotSum<T> r = Executor::Current().ParallelReduce(0, columns ? n : m, grain, MatrixDotSum<T>(), [&](int64_t l0, int64_t l1) {
+		MatrixDotSum<T> sum;
+		for (matdim_t l = (matdim_t)l0; l < l1; l++) {
+			if (columns) {
+				for (matdim_t i = 0; i < m; i++) {
+					sum.AddProduct(a(i, l), (T)b(i, l));
+				}
+			} else {
+				for (matdim_t j = 0; j < n; j++) {
+					sum.AddProduct(a(l, j), (T)b(l, j));
+				}
+			}
+		}
+		return sum;
+	}, [](MatrixDotSum<T> x, const MatrixDotSum<T> & y) { return x += y; });
+	c = r.ToDouble();
+	return true;
+}
+
+template <typename T, typename Order>
+bool MatrixAdd(const Matrix<T, Order> &a, const Matrix<T, Order> &b, Matrix<T, Order> &c)
+{
+	return MatrixAssign(c, a + b);
+}
+
+template<typename T, typename Order>
+bool MatrixFrobeniusInnerProduct(const Matrix<T, Order> &a, const Matrix<T, Order> &b, double &c)
+{
+	MatrixDotSum<T> r;
+	if (!MatrixDot(a, b, r)) {
+		return false;
 	}
-	c = r;
+	c = r.ToDouble();
 	return true;
 }
 
@@ -208,22 +336,51 @@ class Matrix
 public:
 	typedef T data_t;
 private:
-	const matdim_t n_rows, n_cols;
-	const Order order;
+	matdim_t n_rows, n_cols;
+	Order order;
 	data_t *data;
+	MatrixAllocator *allocator;
 private:
+	// copying is explicit (see MatrixOps::Copy), whereas moving hands over the storage
 	Matrix(const Matrix & other) = delete;
-	Matrix(const Matrix && other) = delete;
+	Matrix & operator=(const Matrix & other) = delete;
 public:
-	Matrix(matdim_t n_rows, matdim_t n_cols) :
-		n_rows(n_rows), n_cols(n_cols), order(n_rows, n_cols)
+	// A matrix whose storage comes from the allocator, zeroed unless init is MatrixInit::Uninitialized
+	Matrix(matdim_t n_rows, matdim_t n_cols, MatrixInit init = MatrixInit::Zero, MatrixAllocator & allocator = MatrixAllocator::Default()) :
+		n_rows(n_rows), n_cols(n_cols), order(n_rows, n_cols), allocator(&allocator)
 	{
-		data = (data_t *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, n_rows * n_cols * sizeof(data_t));
-		Zero();
+		data = (data_t *)allocator.Allocate(Bytes());
+		if (init == MatrixInit::Zero) {
+			Zero();
+		}
+	}
+	// Takes the storage of other, leaving it empty
+	Matrix(Matrix && other) :
+		n_rows(other.n_rows), n_cols(other.n_cols), order(other.order), data(other.data), allocator(other.allocator)
+	{
+		other.n_rows = other.n_cols = 0;
+		other.order = Order(0, 0);
+		other.data = nullptr;
+	}
+	Matrix & operator=(Matrix && other)
+	{
+		std::swap(n_rows, other.n_rows);
+		std::swap(n_cols, other.n_cols);
+		std::swap(order, other.order);
+		std::swap(data, other.data);
+		std::swap(allocator, other.allocator);
+		return *this;
 	}
 	~Matrix()
 	{
-		LATTICEZK_ALIGNED_FREE(data);
+		if (data != nullptr) {
+			allocator->Free(data, Bytes());
+		}
+	}
+private:
+	size_t Bytes() const
+	{
+		return (size_t)n_rows * n_cols * sizeof(data_t);
 	}
 public:
 	matdim_t NumRows() const
@@ -238,6 +395,32 @@ public:
 	{
 		return n_rows * n_cols;
 	}
+	matdim_t RowStride() const
+	{
+		return order.RowStride();
+	}
+	matdim_t ColStride() const
+	{
+		return order.ColStride();
+	}
+public:
+	MatrixView<T> View()
+	{
+		return MatrixView<T>(data, n_rows, n_cols, RowStride(), ColStride());
+	}
+	ConstMatrixView<T> View() const
+	{
+		return ConstMatrixView<T>(data, n_rows, n_cols, RowStride(), ColStride());
+	}
+	// The m-by-n submatrix whose entry (0, 0) is entry (i0, j0)
+	MatrixView<T> Block(matdim_t i0, matdim_t j0, matdim_t m, matdim_t n)
+	{
+		return View().Block(i0, j0, m, n);
+	}
+	ConstMatrixView<T> Block(matdim_t i0, matdim_t j0, matdim_t m, matdim_t n) const
+	{
+		return View().Block(i0, j0, m, n);
+	}
 public:
 	data_t * Data()
 	{
@@ -247,18 +430,14 @@ public:
 	{
 		return data;
 	}
+	// In the shares of the threads that first touched the storage, if it is mapped in huge pages
 	void Zero()
 	{
-#if defined(_OPENMP)
-		matdim_t i, iend = NumCells();
-		if (iend > LATTICEZK_MATDOT_THRESHOLD) {
-			#pragma omp parallel for private(i) schedule(static)
-			for (i = 0; i < iend; i++) {
-				data[i] = 0;
-			}
-		} else
-#endif
-		memset(data, 0, NumCells() * sizeof(data_t));
+		char * bytes = (char *)data;
+		const int64_t grain = TuningProfile::Current().matdot_threshold * (int64_t)sizeof(data_t);
+		Executor::Current().ForEachThreadShare((int64_t)Bytes(), LATTICEZK_SHARE_ALIGN_BYTES, grain, [bytes](int64_t i0, int64_t i1) {
+			memset(bytes + i0, 0, (size_t)(i1 - i0));
+		});
 	}
 	const data_t& operator()(matdim_t i) const
 	{
@@ -276,47 +455,17 @@ public:
 	{
 		return data[order(i, j)];
 	}
-public:
-	bool operator==(const Matrix<T, Order> & mat) const
-	{
-		if (n_rows != mat.NumRows() || n_cols != mat.NumCols()) {
-			return false;
-		}
-		const data_t * matdata = mat.Data();
-		matdim_t n = NumCells();
-		for (matdim_t i=0; i<n; i++) {
-			if (data[i] != matdata[i]) {
-				return false;
-			}
-		}
-		return true;
-	}
-	bool operator!=(const Matrix<T, Order> & mat) const
-	{
-		return !(*this == mat);
-	}
 public:
 	double UpperBoundOnOperatorNorm()
 	{
-		double r = 0;
-#if defined(_OPENMP)
-	#if !defined(_WIN32)
-		#pragma omp parallel
-	#endif
-#endif
-		{
-#if defined(_OPENMP)
-	#if !defined(_WIN32)
-			#pragma omp for simd reduction(max:r)
-	#else
-			#pragma omp parallel for
-	#endif
-#endif
-			for (matdim_t i=0; i<n_rows; i++) {
+		// the maximum over the rows of the sums of the absolute values of their entries
+		return Executor::Current().ParallelReduce(0, n_rows, TuningProfile::Current().matdot_threshold / ((int64_t)n_cols + 1), 0.0, [this](int64_t i0, int64_t i1) {
+			double r = 0;
+			for (matdim_t i = (matdim_t)i0; i < (matdim_t)i1; i++) {
 				double s = 0;
 #if defined(_OPENMP)
 	#if !defined(_WIN32)
-				#pragma omp ordered simd
+				#pragma omp simd reduction(+:s)
 	#endif
 #endif
 				for (matdim_t j=0; j<n_cols; j++) {
@@ -327,8 +476,8 @@ public:
 					r = s;
 				}
 			}
-		}
-		return r;
+			return r;
+		}, [](double x, double y) { return x < y ? y : x; });
 	}
 public:
 	bool Multiply(const Matrix<T, Order> &a, const Matrix<T, Order> &b)
@@ -0,0 +1,548 @@
+#ifndef __LATTICEZK_MATRIXEXPR_HPP_
+#define __LATTICEZK_MATRIXEXPR_HPP_
+
+// Expression templates for elementwise operations on matrices of the same dimensions and order
+//   - a + b and a - b, over matrices and expressions alike, build an expression that is evaluated entry by
+//     entry without temporaries, wrapping around modulo 2^w as the ring operations do
+//   - MatrixAssign(c, e) evaluates e into c, e == f compares, and MatrixDot(e, f) and MatrixSquaredNorm(e)
+//     sum products, each in a single parallel loop over the entries (see util/executor.hpp)
+//   - sums of products of integer entries are exact, in 192-bit accumulators (see MatrixDotSum), and only
+//     rounded when converted to double
+//   - MatrixColumnsWithinNorm(z, bound) checks the squared norms of the columns of a CMO matrix against a bound,
+//     exactly, which may be the exact square of a radius (see MatrixNormBound), streaming each column through a
+//     kernel selected for the CPU (see colnorm.inl)
+// The entries of an expression are indexed as the storage of its matrices, hence their common order
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <immintrin.h>
+#include "latticezk/common.hpp"
+#include "latticezk/gemm/kernels.hpp"
+#include "latticezk/util/cpu.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/util/tuning.hpp"
+
+// Entries of a column that the squared-norm kernel sums before its limbs are normalized
+#define LATTICEZK_COLNORM_BLOCK (1 << 28)
+
+// The squared-norm kernels, built for the scalar and AVX2 levels
+#define LATTICEZK_MULTIVERSION_INCLUDE "latticezk/colnorm.inl"
+#define LATTICEZK_MULTIVERSION_MAX LATTICEZK_ISA_AVX2
+#include "latticezk/util/multiversion.inl"
+
+namespace LatticeZK {
+
+template <typename T, typename Order>
+class Matrix;
+class ColumnMajorOrder;
+
+// An exact sum of products of integer entries, which are taken as signed, as are the entries of the ring
+// A product of 64-bit entries takes up to 127 bits, so the sum is kept in three limbs of 64 bits, the two's
+// complement of a 192-bit integer, which holds the sum of any number of products that matdim_t counts
+template<typename T, bool = std::is_integral<T>::value>
+class MatrixDotSum
+{
+private:
+	uint64_t limbs[3];
+public:
+	MatrixDotSum() :
+		limbs { 0, 0, 0 }
+	{
+	}
+public:
+	inline void AddProduct(T x, T y)
+	{
+		typedef typename std::make_signed<T>::type S;
+		const int64_t sx = (int64_t)(S)x, sy = (int64_t)(S)y;
+		if constexpr (sizeof(T) <= 4) {
+			// the product fits in 63 bits
+			Add(sx * sy);
+		} else {
+#if defined(__SIZEOF_INT128__)
+			__extension__ typedef __int128 int128_t;
+			const int128_t p = (int128_t)sx * sy;
+			const uint64_t lo = (uint64_t)p, hi = (uint64_t)(p >> 64);
+#else
+			// the unsigned product of the halves, made signed by subtracting y*2^64 for a negative x and conversely
+			const uint64_t ux = (uint64_t)sx, uy = (uint64_t)sy;
+			const uint64_t x0 = ux & 0xffffffffull, x1 = ux >> 32, y0 = uy & 0xffffffffull, y1 = uy >> 32;
+			const uint64_t p00 = x0 * y0, p01 = x0 * y1, p10 = x1 * y0, p11 = x1 * y1;
+			const uint64_t mid = (p00 >> 32) + (p01 & 0xffffffffull) + (p10 & 0xffffffffull);
+			const uint64_t lo = (mid << 32) | (p00 & 0xffffffffull);
+			const uint64_t hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32) - (sx < 0 ? uy : 0) - (sy < 0 ? ux : 0);
+#endif
+			Add(lo, hi, (int64_t)hi < 0 ? ~0ull : 0);
+		}
+	}
+	// Adds a partial sum, such as of products of narrow entries, which fit in 64 bits
+	inline void Add(int64_t x)
+	{
+		const uint64_t ext = x < 0 ? ~0ull : 0;
+		Add((uint64_t)x, ext, ext);
+	}
+	MatrixDotSum & operator+=(const MatrixDotSum & other)
+	{
+		Add(other.limbs[0], other.limbs[1], other.limbs[2]);
+		return *this;
+	}
+	double ToDouble() const
+	{
+		// the magnitude, converted a limb at a time
+		uint64_t m[3] = { limbs[0], limbs[1], limbs[2] };
+		const bool negative = (int64_t)m[2] < 0;
+		if (negative) {
+			m[0] = ~m[0] + 1;
+			m[1] = ~m[1] + (m[0] == 0);
+			m[2] = ~m[2] + (m[0] == 0 && m[1] == 0);
+		}
+		const double d = ldexp((double)m[2], 128) + ldexp((double)m[1], 64) + (double)m[0];
+		return negative ? -d : d;
+	}
+private:
+	inline void Add(uint64_t x0, uint64_t x1, uint64_t x2)
+	{
+		limbs[0] += x0;
+		const uint64_t c0 = limbs[0] < x0;
+		limbs[1] += x1;
+		const uint64_t c1 = limbs[1] < x1;
+		limbs[1] += c0;
+		limbs[2] += x2 + c1 + (limbs[1] < c0);
+	}
+};
+
+// A sum of products of floating-point entries
+template<typename T>
+class MatrixDotSum<T, false>
+{
+private:
+	double sum;
+public:
+	MatrixDotSum() :
+		sum(0)
+	{
+	}
+public:
+	inline void AddProduct(T x, T y)
+	{
+		sum += (double)x * (double)y;
+	}
+	MatrixDotSum & operator+=(const MatrixDotSum & other)
+	{
+		sum += other.sum;
+		return *this;
+	}
+	double ToDouble() const
+	{
+		return sum;
+	}
+};
+
+// A matrix as an operand of expressions, valid as long as the matrix
+template<typename T, typename Order>
+class MatrixLeaf
+{
+public:
+	typedef T value_t;
+	typedef Order order_t;
+private:
+	const T * data;
+	matdim_t n_rows, n_cols;
+public:
+	MatrixLeaf(const Matrix<T, Order> & mat) :
+		data(mat.Data()), n_rows(mat.NumRows()), n_cols(mat.NumCols())
+	{
+	}
+public:
+	matdim_t NumRows() const
+	{
+		return n_rows;
+	}
+	matdim_t NumCols() const
+	{
+		return n_cols;
+	}
+	bool Valid() const
+	{
+		return true;
+	}
+	inline T operator[](int64_t i) const
+	{
+		return data[i];
+	}
+};
+
+// The type that entries are operated on in: unsigned for integers, so as to wrap around, and their own otherwise
+template<typename T, bool = std::is_integral<T>::value>
+struct MatrixWrap
+{
+	typedef gemm_uint_t<T> type;
+};
+template<typename T>
+struct MatrixWrap<T, false>
+{
+	typedef T type;
+};
+
+struct MatrixAddOp
+{
+	template<typename T>
+	static inline T Apply(T x, T y)
+	{
+		typedef typename MatrixWrap<T>::type U;
+		return (T)((U)x + (U)y);
+	}
+};
+
+struct MatrixSubtractOp
+{
+	template<typename T>
+	static inline T Apply(T x, T y)
+	{
+		typedef typename MatrixWrap<T>::type U;
+		return (T)((U)x - (U)y);
+	}
+};
+
+// The entrywise Op of two expressions, valid if both are and their dimensions match
+template<typename Op, typename L, typename R>
+class MatrixBinaryExpr
+{
+	static_assert(std::is_same<typename L::value_t, typename R::value_t>::value, "operands of different entry types");
+	static_assert(std::is_same<typename L::order_t, typename R::order_t>::value, "operands of different orders");
+public:
+	typedef typename L::value_t value_t;
+	typedef typename L::order_t order_t;
+private:
+	L l;
+	R r;
+public:
+	MatrixBinaryExpr(const L & l, const R & r) :
+		l(l), r(r)
+	{
+	}
+public:
+	matdim_t NumRows() const
+	{
+		return l.NumRows();
+	}
+	matdim_t NumCols() const
+	{
+		return l.NumCols();
+	}
+	bool Valid() const
+	{
+		return l.Valid() && r.Valid() && l.NumRows() == r.NumRows() && l.NumCols() == r.NumCols();
+	}
+	inline value_t operator[](int64_t i) const
+	{
+		return Op::Apply(l[i], r[i]);
+	}
+};
+
+// The expression of an operand, be it a matrix (or a matrix of a derived class) or an expression
+template<typename T, typename Order>
+inline MatrixLeaf<T, Order> MatrixExprOf(const Matrix<T, Order> & mat)
+{
+	return MatrixLeaf<T, Order>(mat);
+}
+template<typename T, typename Order>
+inline const MatrixLeaf<T, Order> & MatrixExprOf(const MatrixLeaf<T, Order> & e)
+{
+	return e;
+}
+template<typename Op, typename L, typename R>
+inline const MatrixBinaryExpr<Op, L, R> & MatrixExprOf(const MatrixBinaryExpr<Op, L, R> & e)
+{
+	return e;
+}
+
+template<typename X>
+using matrix_expr_t = typename std::decay<decltype(MatrixExprOf(std::declval<const X &>()))>::type;
+
+template<typename X, typename Y>
+inline MatrixBinaryExpr<MatrixAddOp, matrix_expr_t<X>, matrix_expr_t<Y>> operator+(const X & x, const Y & y)
+{
+	return MatrixBinaryExpr<MatrixAddOp, matrix_expr_t<X>, matrix_expr_t<Y>>(MatrixExprOf(x), MatrixExprOf(y));
+}
+
+template<typename X, typename Y>
+inline MatrixBinaryExpr<MatrixSubtractOp, matrix_expr_t<X>, matrix_expr_t<Y>> operator-(const X & x, const Y & y)
+{
+	return MatrixBinaryExpr<MatrixSubtractOp, matrix_expr_t<X>, matrix_expr_t<Y>>(MatrixExprOf(x), MatrixExprOf(y));
+}
+
+// Evaluates an expression into a matrix of its dimensions and order, which it may read from
+template<typename T, typename Order, typename X>
+bool MatrixAssign(Matrix<T, Order> & c, const X & x)
+{
+	const matrix_expr_t<X> e = MatrixExprOf(x);
+	static_assert(std::is_same<typename matrix_expr_t<X>::order_t, Order>::value, "assigning an expression of another order");
+	if (!e.Valid() || e.NumRows() != c.NumRows() || e.NumCols() != c.NumCols()) {
+		return false;
+	}
+	T * data = c.Data();
+	Executor::Current().ParallelFor(0, c.NumCells(), TuningProfile::Current().matdot_threshold, [&](int64_t i0, int64_t i1) {
+		for (int64_t i = i0; i < i1; i++) {
+			data[i] = (T)e[i];
+		}
+	});
+	return true;
+}
+
+// Whether two expressions have the same dimensions and entries
+template<typename X, typename Y>
+bool MatrixEqual(const X & x, const Y & y)
+{
+	typedef matrix_expr_t<X> EX;
+	typedef matrix_expr_t<Y> EY;
+	static_assert(std::is_same<typename EX::order_t, typename EY::order_t>::value, "comparing operands of different orders");
+	typedef typename EX::value_t T;
+	const EX ex = MatrixExprOf(x);
+	const EY ey = MatrixExprOf(y);
+	if (!ex.Valid() || !ey.Valid() || ex.NumRows() != ey.NumRows() || ex.NumCols() != ey.NumCols()) {
+		return false;
+	}
+	return Executor::Current().ParallelReduce(0, (int64_t)ex.NumRows() * ex.NumCols(), TuningProfile::Current().matdot_threshold, true, [&](int64_t i0, int64_t i1) {
+		if constexpr (std::is_integral<T>::value) {
+			// the differences of a chunk are or-ed together, without branches
+			typedef gemm_uint_t<T> U;
+			U d = 0;
+			for (int64_t i = i0; i < i1; i++) {
+				d |= (U)ex[i] ^ (U)ey[i];
+			}
+			return d == 0;
+		} else {
+			bool equal = true;
+			for (int64_t i = i0; i < i1; i++) {
+				equal = equal && ex[i] == ey[i];
+			}
+			return equal;
+		}
+	}, [](bool a, bool b) { return a && b; });
+}
+
+template<typename X, typename Y>
+inline auto operator==(const X & x, const Y & y) -> decltype((void)MatrixExprOf(x), (void)MatrixExprOf(y), true)
+{
+	return MatrixEqual(x, y);
+}
+
+template<typename X, typename Y>
+inline auto operator!=(const X & x, const Y & y) -> decltype((void)MatrixExprOf(x), (void)MatrixExprOf(y), true)
+{
+	return !MatrixEqual(x, y);
+}
+
+// Computes the Frobenius inner-product of two expressions of the same dimensions
+template<typename X, typename Y>
+bool MatrixDot(const X & x, const Y & y, MatrixDotSum<typename matrix_expr_t<X>::value_t> & dot)
+{
+	typedef matrix_expr_t<X> EX;
+	typedef matrix_expr_t<Y> EY;
+	typedef typename EX::value_t T;
+	static_assert(std::is_same<typename EX::order_t, typename EY::order_t>::value, "multiplying operands of different orders");
+	const EX ex = MatrixExprOf(x);
+	const EY ey = MatrixExprOf(y);
+	if (!ex.Valid() || !ey.Valid() || ex.NumRows() != ey.NumRows() || ex.NumCols() != ey.NumCols()) {
+		return false;
+	}
+	dot = Executor::Current().ParallelReduce(0, (int64_t)ex.NumRows() * ex.NumCols(), TuningProfile::Current().matdot_threshold, MatrixDotSum<T>(),
+		[&](int64_t i0, int64_t i1) {
+			MatrixDotSum<T> sum;
+			if constexpr (std::is_integral<T>::value && sizeof(T) <= 2) {
+				// products of 8- and 16-bit entries sum to 64 bits in a vectorizable loop
+				int64_t s = 0;
+				for (int64_t i = i0; i < i1; i++) {
+					s += (int64_t)ex[i] * (int64_t)ey[i];
+				}
+				sum.Add(s);
+			} else {
+				for (int64_t i = i0; i < i1; i++) {
+					sum.AddProduct(ex[i], ey[i]);
+				}
+			}
+			return sum;
+		}, [](MatrixDotSum<T> a, const MatrixDotSum<T> & b) { return a += b; });
+	return true;
+}
+
+// Computes the squared Frobenius norm of an expression
+template<typename X>
+bool MatrixSquaredNorm(const X & x, MatrixDotSum<typename matrix_expr_t<X>::value_t> & dot)
+{
+	return MatrixDot(x, x, dot);
+}
+
+// A bound on squared norms, as the digits of its floor in the limbs of MatrixNormSum, which compare exactly
+class MatrixNormBound
+{
+private:
+	uint64_t digits[4];
+	bool empty;
+	MatrixNormBound() :
+		digits { 0, 0, 0, 0 },
+		empty(false)
+	{
+	}
+public:
+	// The bound itself, rounded as a double
+	static MatrixNormBound Of(double bound)
+	{
+		MatrixNormBound b;
+		if (!(bound >= 0) || bound >= ldexp(1, 160)) {
+			return b.Clamp(bound);
+		}
+		// the digits of floor(bound) in base 2^32, each subtraction exact
+		double rest = floor(bound);
+		for (int k = 3; k >= 0; k--) {
+			const double d = floor(ldexp(rest, -32 * k));
+			b.digits[k] = (uint64_t)d;
+			rest -= ldexp(d, 32 * k);
+		}
+		return b;
+	}
+	// The square of radius, exactly, rather than the square rounded as a double
+	static MatrixNormBound Square(double radius)
+	{
+		MatrixNormBound b;
+		if (!(radius >= 0) || radius >= ldexp(1, 80)) {
+			return b.Clamp(radius);
+		}
+		// radius = mant*2^(e-53), so its square is the 106-bit mant^2 shifted by 2e-106 bits, floored
+		int e = 0;
+		const uint64_t mant = (uint64_t)ldexp(frexp(radius, &e), 53);
+		const uint64_t m0 = mant & 0xffffffffull, m1 = mant >> 32;
+		const uint64_t p00 = m0 * m0, mid = (p00 >> 32) + 2 * m0 * m1;
+		uint64_t w[3] = { (mid << 32) | (p00 & 0xffffffffull), m1 * m1 + (mid >> 32), 0 };
+		int shift = 2 * e - 106;
+		for (; shift >= 64; shift -= 64) {
+			w[2] = w[1]; w[1] = w[0]; w[0] = 0;
+		}
+		for (; shift <= -64 && (w[0] | w[1] | w[2]) != 0; shift += 64) {
+			w[0] = w[1]; w[1] = w[2]; w[2] = 0;
+		}
+		if (shift > 0) {
+			w[2] = (w[2] << shift) | (w[1] >> (64 - shift));
+			w[1] = (w[1] << shift) | (w[0] >> (64 - shift));
+			w[0] <<= shift;
+		} else if (shift < 0 && shift > -64) {
+			w[0] = (w[0] >> -shift) | (w[1] << (64 + shift));
+			w[1] = (w[1] >> -shift) | (w[2] << (64 + shift));
+			w[2] >>= -shift;
+		}
+		b.digits[0] = w[0] & 0xffffffffull;
+		b.digits[1] = w[0] >> 32;
+		b.digits[2] = w[1] & 0xffffffffull;
+		b.digits[3] = (w[1] >> 32) | (w[2] << 32);
+		return b;
+	}
+private:
+	// Bounds nothing for a negative or NaN x, and everything for a large one
+	MatrixNormBound & Clamp(double x)
+	{
+		empty = !(x >= 0);
+		digits[0] = digits[1] = digits[2] = 0xffffffffull;
+		digits[3] = ~0ull;
+		return *this;
+	}
+	friend class MatrixNormSum;
+};
+
+// An exact sum of squares of integer entries, as limbs of weights 2^0, 2^32, 2^64 and 2^96 (see colnorm.inl), the
+// top one holding the rest of the at most 2^158 of a column
+class MatrixNormSum
+{
+private:
+	uint64_t limbs[4];
+public:
+	MatrixNormSum() :
+		limbs { 0, 0, 0, 0 }
+	{
+	}
+public:
+	// Adds the squares of n contiguous entries, which are taken as signed
+	template<typename T>
+	void AddSquares(const T * x, matdim_t n)
+	{
+		static_assert(std::is_integral<T>::value && sizeof(T) <= 8, "summing squares of non-integers");
+		for (matdim_t i = 0; i < n; i += std::min<matdim_t>(n - i, LATTICEZK_COLNORM_BLOCK)) {
+			Run(x + i, std::min<matdim_t>(n - i, LATTICEZK_COLNORM_BLOCK), limbs);
+			for (int k = 0; k < 3; k++) {
+				limbs[k + 1] += limbs[k] >> 32;
+				limbs[k] &= 0xffffffffull;
+			}
+		}
+	}
+	// Whether the sum is at most bound, exactly
+	bool AtMost(const MatrixNormBound & bound) const
+	{
+		if (bound.empty) {
+			return false;
+		}
+		for (int k = 3; k >= 0; k--) {
+			if (limbs[k] != bound.digits[k]) {
+				return limbs[k] < bound.digits[k];
+			}
+		}
+		return true;
+	}
+	double ToDouble() const
+	{
+		return ldexp((double)limbs[3], 96) + ldexp((double)limbs[2], 64) + ldexp((double)limbs[1], 32) + (double)limbs[0];
+	}
+private:
+	template<typename T>
+	static void Run(const T * x, matdim_t n, uint64_t * limbs)
+	{
+#define LATTICEZK_COLNORM_CASE(ns) return ns::ColumnNormKernel<T>::Run(x, n, limbs);
+		LATTICEZK_ISA_SWITCH_AVX2(LATTICEZK_COLNORM_CASE)
+#undef LATTICEZK_COLNORM_CASE
+	}
+};
+
+// Checks that the squared Euclidean norm of every column of z is at most bound, exactly, in a parallel loop over
+// the columns that stops at the first violation found. Returns false on a violation, setting col to a violating
+// column, not necessarily the first, and norm to its squared norm, rounded
+template<typename T>
+bool MatrixColumnsWithinNorm(const Matrix<T, ColumnMajorOrder> & z, const MatrixNormBound & bound, matdim_t & col, double & norm)
+{
+	struct Violation
+	{
+		matdim_t col;
+		double norm;
+	};
+	const matdim_t m = z.NumRows();
+	const T * data = z.Data();
+	std::atomic<bool> violated(false);
+	const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / std::max<matdim_t>(1, m));
+	const Violation first = Executor::Current().ParallelReduce(0, z.NumCols(), grain, Violation { -1, 0 },
+		[&](int64_t j0, int64_t j1) {
+			for (int64_t j = j0; j < j1 && !violated.load(std::memory_order_relaxed); j++) {
+				MatrixNormSum sum;
+				sum.AddSquares(data + j * m, m);
+				if (!sum.AtMost(bound)) {
+					violated = true;
+					return Violation { (matdim_t)j, sum.ToDouble() };
+				}
+			}
+			return Violation { -1, 0 };
+		}, [](const Violation & a, const Violation & b) { return a.col >= 0 ? a : b; });
+	col = first.col;
+	norm = first.norm;
+	return first.col < 0;
+}
+
+// Checks the columns of z against a bound given as a double, see above
+template<typename T>
+bool MatrixColumnsWithinNorm(const Matrix<T, ColumnMajorOrder> & z, double bound, matdim_t & col, double & norm)
+{
+	return MatrixColumnsWithinNorm(z, MatrixNormBound::Of(bound), col, norm);
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_MATRIXEXPR_HPP_
@@ -4,10 +4,23 @@
 // Matrix operations for CPU
 //   - copying a matrix to another of the same major-ordering
 //   - syncing a matrix after it has been modified
-//   - matrix multiplication in the form (RMO,CMO) -> CMO
+//   - matrix multiplication of any combination of RMO and CMO, and in the forms (RMO,bits) -> CMO and (CMO,bits) -> CMO
+//   - the same with a right or left operand, respectively, of narrower entries
+//   - the same of views of matrices and their submatrices (see matrixview.hpp)
+//   - batched multiplication of one RMO matrix by several CMO or bit matrices
+//   - checking A*Z = T*C + W for a challenge bit matrix C, without forming the products
+//   - computing B = S*C and Z = B + Y with <Z,B> and ||B||^2, in one pass over the output
+//   - the same multiplications and checking with a seeded left operand in place of an RMO one (see seededmatrix.hpp)
+//   - checking with a seeded challenge, generated a block of columns at a time
+//   - multiplication by, and of, file-backed matrices streamed from disk a tile at a time (see filematrix.hpp)
 // Different implementations of the same operations are available for GPU code
 
+#include <string.h>
+#include <vector>
 #include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/filematrix.hpp"
 
 namespace LatticeZK {
 
@@ -29,18 +42,32 @@ public:
 		if (src.NumRows() != dst.NumRows() || src.NumCols() != dst.NumCols()) {
 			return false;
 		}
-		data_t* dstdata = dst.Data();
-		const data_t* srcdata = src.Data();
-		matdim_t n = dst.NumCells();
-		matdim_t i;
-#if defined(_OPENMP)
-		#pragma omp parallel for if (n > LATTICEZK_MATDOT_THRESHOLD)
-#endif
-		for (i = 0; i < n; i++) {
-			dstdata[i] = srcdata[i];
-		}
+		// in the shares of the threads that first touched dst, as Matrix::Zero
+		char* dstdata = (char*)dst.Data();
+		const char* srcdata = (const char*)src.Data();
+		const int64_t grain = TuningProfile::Current().matdot_threshold * (int64_t)sizeof(data_t);
+		Executor::Current().ForEachThreadShare((int64_t)dst.NumCells() * (int64_t)sizeof(data_t), LATTICEZK_SHARE_ALIGN_BYTES, grain, [&](int64_t i0, int64_t i1) {
+			memcpy(dstdata + i0, srcdata + i0, (size_t)(i1 - i0));
+		});
 		return true;
     }
+	bool Copy(BitMatrix& dst, const BitMatrix& src)
+	{
+		if (src.NumRows() != dst.NumRows() || src.NumCols() != dst.NumCols()) {
+			return false;
+		}
+		memcpy(dst.Data(), src.Data(), dst.NumWords() * sizeof(BitMatrix::word_t));
+		return true;
+	}
+	// Copies the seed only
+	bool Copy(SeededMatrix<T>& dst, const SeededMatrix<T>& src)
+	{
+		if (src.NumRows() != dst.NumRows() || src.NumCols() != dst.NumCols()) {
+			return false;
+		}
+		dst.Reseed(src.Seed());
+		return true;
+	}
 	bool Sync(RowMajorMatrix & mat)
 	{
 		LATTICEZK_UNUSED(mat);
@@ -51,10 +78,114 @@ public:
 		LATTICEZK_UNUSED(mat);
 		return true;
 	}
-	bool Multiply(const RowMajorMatrix &a, const ColumnMajorMatrix &b, ColumnMajorMatrix &c)
+	bool Sync(BitMatrix & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	bool Sync(SeededMatrix<T> & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	template<typename S, typename Order>
+	bool Sync(Matrix<S, Order> & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	template<typename S>
+	bool Sync(FileMatrix<S> & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	template<typename S, typename OrderA, typename OrderB, typename OrderC>
+	bool Multiply(const Matrix<T, OrderA> &a, const Matrix<S, OrderB> &b, Matrix<T, OrderC> &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename S, typename OrderB, typename OrderC>
+	bool Multiply(const SeededMatrix<T> &a, const Matrix<S, OrderB> &b, Matrix<T, OrderC> &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename S, typename OrderA, typename OrderC>
+	bool Multiply(const Matrix<T, OrderA> &a, const FileMatrix<S> &b, Matrix<T, OrderC> &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename S, typename OrderC>
+	bool Multiply(const SeededMatrix<T> &a, const FileMatrix<S> &b, Matrix<T, OrderC> &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	// Multiplication of views, such as submatrices, which are host-only
+	template<typename A, typename B>
+	bool Multiply(MatrixView<A> a, MatrixView<B> b, MatrixView<T> c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename A>
+	bool Multiply(MatrixView<A> a, const BitMatrix &b, MatrixView<T> c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename S>
+	bool Multiply(const Matrix<S, RowMajorOrder> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename S>
+	bool Multiply(const Matrix<S, ColumnMajorOrder> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	template<typename S>
+	bool Multiply(const FileMatrix<S> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return MatrixMultiply(a, b, c);
+	}
+	// C*X for a seeded challenge C, counted from its columns as they are generated
+	bool Multiply(const SeededBitMatrix &a, const BitMatrix &b, ColumnMajorMatrix &c)
 	{
 		return MatrixMultiply(a, b, c);
 	}
+	bool MultiplyBatch(const RowMajorMatrix &a, const std::vector<const ColumnMajorMatrix *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		return MatrixMultiplyBatch(a, b, c);
+	}
+	template<typename S>
+	bool MultiplyBatch(const Matrix<S, RowMajorOrder> &a, const std::vector<const BitMatrix *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		return MatrixMultiplyBatch(a, b, c);
+	}
+	template<typename S>
+	bool MultiplyAdd(const Matrix<S, RowMajorOrder> &s, const BitMatrix &c, const ColumnMajorMatrix &y, ColumnMajorMatrix &b, ColumnMajorMatrix &z, double &ZB, double &BB)
+	{
+		return MatrixMultiplyAdd(s, c, y, b, z, ZB, BB);
+	}
+	template<typename S>
+	bool MultiplyAdd(const FileMatrix<S> &s, const BitMatrix &c, const ColumnMajorMatrix &y, ColumnMajorMatrix &b, ColumnMajorMatrix &z, double &ZB, double &BB)
+	{
+		return MatrixMultiplyAdd(s, c, y, b, z, ZB, BB);
+	}
+	bool CheckProducts(const RowMajorMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const BitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		return MatrixCheckProducts(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const RowMajorMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const SeededBitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		return MatrixCheckProducts(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const SeededMatrix<T> &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const SeededBitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		return MatrixCheckProducts(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const SeededMatrix<T> &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const BitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		return MatrixCheckProducts(a, z, t, c, w, equal);
+	}
 };
 
 } // namespace LatticeZK
@@ -0,0 +1,91 @@
+#ifndef __LATTICEZK_MATRIXVIEW_HPP_
+#define __LATTICEZK_MATRIXVIEW_HPP_
+
+// Non-owning views of matrices, supporting
+//   - any (row, column) stride, hence RMO, CMO and submatrices of either
+//   - slicing into submatrices and transposing, without copying
+//   - the matrix operations of matrix.hpp and bitmatrix.hpp, which take views as well as matrices
+// A view is valid as long as the storage it views. ConstMatrixView views read-only entries.
+
+#include <stddef.h>
+#include <type_traits>
+#include "latticezk/common.hpp"
+
+namespace LatticeZK {
+
+template<typename T>
+class MatrixView
+{
+public:
+	typedef T data_t;
+private:
+	T * data;
+	matdim_t n_rows, n_cols;
+	ptrdiff_t rs, cs;
+public:
+	// Views the n_rows-by-n_cols matrix with entry (i, j) at data[i*rs + j*cs]
+	MatrixView(T * data, matdim_t n_rows, matdim_t n_cols, ptrdiff_t rs, ptrdiff_t cs) :
+		data(data), n_rows(n_rows), n_cols(n_cols), rs(rs), cs(cs)
+	{
+	}
+	// A read-only view of the same entries
+	template<typename U = T, typename = typename std::enable_if<!std::is_const<U>::value>::type>
+	operator MatrixView<const U>() const
+	{
+		return MatrixView<const U>(data, n_rows, n_cols, rs, cs);
+	}
+public:
+	matdim_t NumRows() const
+	{
+		return n_rows;
+	}
+	matdim_t NumCols() const
+	{
+		return n_cols;
+	}
+	matdim_t NumCells() const
+	{
+		return n_rows * n_cols;
+	}
+	ptrdiff_t RowStride() const
+	{
+		return rs;
+	}
+	ptrdiff_t ColStride() const
+	{
+		return cs;
+	}
+	T * Data() const
+	{
+		return data;
+	}
+	inline T & operator()(matdim_t i, matdim_t j) const
+	{
+		return data[i * rs + j * cs];
+	}
+public:
+	// The m-by-n submatrix whose entry (0, 0) is entry (i0, j0)
+	MatrixView Block(matdim_t i0, matdim_t j0, matdim_t m, matdim_t n) const
+	{
+		return MatrixView(data + i0 * rs + j0 * cs, m, n, rs, cs);
+	}
+	MatrixView Rows(matdim_t i0, matdim_t m) const
+	{
+		return Block(i0, 0, m, n_cols);
+	}
+	MatrixView Cols(matdim_t j0, matdim_t n) const
+	{
+		return Block(0, j0, n_rows, n);
+	}
+	MatrixView Transposed() const
+	{
+		return MatrixView(data, n_cols, n_rows, cs, rs);
+	}
+};
+
+template<typename T>
+using ConstMatrixView = MatrixView<const T>;
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_MATRIXVIEW_HPP_
@@ -0,0 +1,842 @@
+#ifndef __LATTICEZK_NUMAMATRIXOPS_HPP_
+#define __LATTICEZK_NUMAMATRIXOPS_HPP_
+
+// Matrix operations for multi-socket CPUs, interchangeable with MatrixOps
+//   - the columns of the right operand and of the product are partitioned over the NUMA nodes, in proportion
+//     to their CPUs, and each partition is multiplied on an executor whose threads are pinned to the CPUs of
+//     its node; so are the columns of each item of a batch, and of Z, C and W in checking A*Z = T*C + W
+//   - each node multiplies by its own replica of the left operand, A or T, which is copied into memory bound
+//     to the node when first multiplied, and kept until the operand is synced, as a matrix is synced to the GPU
+//     for CudaMvOps once changed, or until too many others are; a seeded A is regenerated by each node instead
+//   - the left operand of a product by a bit matrix, the large S of computing Z = S*C + Y, is instead partitioned
+//     by its rows, as are B, Z and the product, so that no node copies it
+//   - a product of too few columns to be worth partitioning, such as by the test vectors of a Verifier, is that
+//     of MatrixOps, so its left operand, read once, is not replicated
+//   - a file-backed operand, S or T, is streamed a row tile at a time, once for all the nodes, each of which
+//     multiplies its partition of the columns by the tile, or by its replica of the tile for a left operand
+//   - each node runs its part of an operation on a thread pinned to its CPUs for the life of these operations,
+//     along with the workers of its executor, and operations run on the nodes one at a time
+//   - syncing a column-major matrix also migrates the pages of each partition of its columns to their node
+//   - the remaining operations, and all operations on a single node, are those of MatrixOps
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/filematrix.hpp"
+#include "latticezk/matrixops.hpp"
+#include "latticezk/gemm/batch.hpp"
+#include "latticezk/hugepage.hpp"
+#include "latticezk/util/executor.hpp"
+#if defined(__linux__)
+	#include <sched.h>
+#endif
+
+// Columns that partitions are rounded to, a multiple of the column panel of the GEMM kernels
+#define LATTICEZK_NUMA_COLUMN_ALIGN 16
+// Replicas of left operands that a node keeps at most, the least recently used being dropped first
+#define LATTICEZK_NUMA_REPLICAS 8
+// Columns of a product below which it is not partitioned over the nodes
+#define LATTICEZK_NUMA_MIN_COLUMNS 64
+
+namespace LatticeZK {
+
+// The NUMA nodes and their CPUs
+class NumaTopology
+{
+public:
+	struct Node
+	{
+		int id;
+		std::vector<int> cpus;
+	};
+private:
+	std::vector<Node> nodes;
+public:
+	NumaTopology(const std::vector<Node> & nodes) :
+		nodes(nodes)
+	{
+	}
+	// The nodes listed by Linux, or a single node of all CPUs elsewhere or if none are listed
+	static NumaTopology Discover()
+	{
+		std::vector<Node> nodes;
+#if defined(__linux__)
+		for (int id = 0; id < 64; id++) {
+			char path[64];
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+			FILE * f = fopen(path, "r");
+			if (f == nullptr) {
+				continue;
+			}
+			// a list of ranges such as 0-15,32-47
+			Node node { id, {} };
+			int lo, hi;
+			while (fscanf(f, "%d", &lo) == 1) {
+				hi = lo;
+				int c = fgetc(f);
+				if (c == '-' && fscanf(f, "%d", &hi) == 1) {
+					c = fgetc(f);
+				}
+				for (int cpu = lo; cpu <= hi; cpu++) {
+					node.cpus.push_back(cpu);
+				}
+				if (c != ',') {
+					break;
+				}
+			}
+			fclose(f);
+			if (!node.cpus.empty()) {
+				nodes.push_back(node);
+			}
+		}
+#endif
+		if (nodes.empty()) {
+			nodes.push_back(Node { 0, {} });
+			for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+				nodes[0].cpus.push_back(cpu);
+			}
+		}
+		return NumaTopology(nodes);
+	}
+public:
+	size_t NumNodes() const
+	{
+		return nodes.size();
+	}
+	const Node & operator[](size_t i) const
+	{
+		return nodes[i];
+	}
+	// First column of the partition of node i of n columns, in proportion to the CPUs of the nodes
+	matdim_t PartitionStart(size_t i, matdim_t n) const
+	{
+		size_t before = 0, total = 0;
+		for (size_t h = 0; h < nodes.size(); h++) {
+			before += h < i ? nodes[h].cpus.size() : 0;
+			total += nodes[h].cpus.size();
+		}
+		if (i >= nodes.size()) {
+			return n;
+		}
+		const matdim_t A = LATTICEZK_NUMA_COLUMN_ALIGN;
+		return std::min(n, (matdim_t)((double)n * before / total / A + 0.5) * A);
+	}
+};
+
+template<typename T>
+class NumaMatrixOps
+{
+public:
+	typedef T data_t;
+	typedef Matrix<T, RowMajorOrder> RowMajorMatrix;
+	typedef Matrix<T, ColumnMajorOrder> ColumnMajorMatrix;
+private:
+	// The replicas of a node are allocated from memory bound to it, and recycled, and its partitions are
+	// multiplied on its executor, by its thread, which runs the tasks handed to it one at a time
+	struct NodeMemory
+	{
+		// a replica of the cells of a left operand, by their address and size
+		struct Replica
+		{
+			const void * src;
+			size_t bytes;
+			void * data;
+			uint64_t used;
+		};
+		HugePageAllocator bound;
+		MatrixArena arena;
+		Executor executor;
+		std::vector<Replica> replicas;
+		uint64_t uses;
+		std::mutex mutex;
+		std::condition_variable handed, done;
+		std::function<bool()> task; // handed to the thread, and reset once run
+		bool success, stopping;
+		std::thread thread;
+		NodeMemory(const NumaTopology::Node & node, MatrixAllocator * upstream) :
+			bound(1 << 21, false, NumaPolicy::Bind, 1ul << node.id), arena(upstream != nullptr ? *upstream : bound), executor(std::max<size_t>(1, node.cpus.size()), node.cpus),
+			uses(0), success(true), stopping(false), thread([this, node]() { Loop(node); })
+		{
+		}
+		~NodeMemory()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			handed.notify_one();
+			thread.join();
+			for (const Replica & replica : replicas) {
+				arena.Free(replica.data, replica.bytes);
+			}
+		}
+		void Run(std::function<bool()> f)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				task = std::move(f);
+			}
+			handed.notify_one();
+		}
+		// Waits for the task handed to the thread, and returns whether it succeeded
+		bool Wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]() { return !task; });
+			return success;
+		}
+		// The replica of the bytes at src, copied on first use
+		const void * ReplicaOf(const void * src, size_t bytes)
+		{
+			uses++;
+			for (Replica & replica : replicas) {
+				if (replica.src == src && replica.bytes == bytes) {
+					replica.used = uses;
+					return replica.data;
+				}
+			}
+			if (replicas.size() >= LATTICEZK_NUMA_REPLICAS) {
+				auto lru = std::min_element(replicas.begin(), replicas.end(), [](const Replica & x, const Replica & y) { return x.used < y.used; });
+				arena.Free(lru->data, lru->bytes);
+				replicas.erase(lru);
+			}
+			void * data = arena.Allocate(bytes);
+			if (data == nullptr) {
+				return nullptr;
+			}
+			memcpy(data, src, bytes);
+			replicas.push_back(Replica { src, bytes, data, uses });
+			return data;
+		}
+		// Drops the replicas of the cells at src, which changed
+		void Drop(const void * src)
+		{
+			for (size_t h = replicas.size(); h-- > 0; ) {
+				if (replicas[h].src == src) {
+					arena.Free(replicas[h].data, replicas[h].bytes);
+					replicas.erase(replicas.begin() + h);
+				}
+			}
+		}
+	private:
+		void Loop(const NumaTopology::Node & node)
+		{
+#if defined(__linux__)
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			for (int cpu : node.cpus) {
+				CPU_SET(cpu, &cpus);
+			}
+			sched_setaffinity(0, sizeof(cpus), &cpus);
+#endif
+			ExecutorScope scope(executor);
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				handed.wait(lock, [this]() { return stopping || task; });
+				if (!task) {
+					return;
+				}
+				lock.unlock();
+				const bool task_success = task();
+				lock.lock();
+				success = task_success;
+				task = nullptr;
+				done.notify_one();
+			}
+		}
+	};
+	// shared by the copies of these operations, as the prover and the verifier keep their own
+	struct Nodes
+	{
+		std::vector<std::unique_ptr<NodeMemory>> memory;
+		std::mutex running; // held by the operation running on the nodes
+	};
+	MatrixOps<T> matops;
+	NumaTopology topology;
+	size_t tile_bytes; // of the row tiles streamed from file-backed operands
+	std::shared_ptr<Nodes> nodes;
+public:
+	// The memory of each node is bound to it, or comes from upstream if given, which must outlive these operations
+	NumaMatrixOps(const NumaTopology & topology = NumaTopology::Discover(), size_t tile_bytes = LATTICEZK_FILE_TILE_BYTES,
+		MatrixAllocator * upstream = nullptr) :
+		topology(topology), tile_bytes(tile_bytes), nodes(std::make_shared<Nodes>())
+	{
+		for (size_t i = 0; i < topology.NumNodes(); i++) {
+			nodes->memory.emplace_back(new NodeMemory(topology[i], upstream));
+		}
+	}
+public:
+	template<typename Order>
+	bool Copy(Matrix<T, Order>& dst, const Matrix<T, Order>& src)
+	{
+		DropReplicas(dst.Data());
+		return matops.Copy(dst, src);
+	}
+	bool Copy(BitMatrix& dst, const BitMatrix& src)
+	{
+		return matops.Copy(dst, src);
+	}
+	bool Copy(SeededMatrix<T>& dst, const SeededMatrix<T>& src)
+	{
+		return matops.Copy(dst, src);
+	}
+	// Drops the replicas of the matrix, which must be synced once changed before it is multiplied again, as
+	// must a matrix allocated where one multiplied before was
+	bool Sync(RowMajorMatrix & mat)
+	{
+		DropReplicas(mat.Data());
+		return true;
+	}
+	template<typename S, typename Order>
+	bool Sync(Matrix<S, Order> & mat)
+	{
+		DropReplicas(mat.Data());
+		return true;
+	}
+	// Also migrates the columns of each partition to its node, as far as the system does; the placement only
+	// affects performance, so a failure to migrate is logged rather than failing the sync
+	bool Sync(ColumnMajorMatrix & mat)
+	{
+		DropReplicas(mat.Data());
+#if defined(__linux__)
+		if (topology.NumNodes() > 1) {
+			const size_t page = LATTICEZK_BASE_PAGE_BYTES;
+			for (size_t i = 0; i < topology.NumNodes(); i++) {
+				const matdim_t j0 = topology.PartitionStart(i, mat.NumCols()), j1 = topology.PartitionStart(i + 1, mat.NumCols());
+				// the whole pages within the columns of the partition
+				uintptr_t begin = (uintptr_t)(mat.Data() + (size_t)j0 * mat.NumRows());
+				uintptr_t end = (uintptr_t)(mat.Data() + (size_t)j1 * mat.NumRows());
+				begin = (begin + page - 1) / page * page;
+				end = end / page * page;
+				if (begin < end) {
+					unsigned long nodemask = 1ul << topology[i].id;
+					if (syscall(SYS_mbind, (void *)begin, end - begin, MPOL_PREFERRED, &nodemask, 8 * sizeof(nodemask), MPOL_MF_MOVE) != 0) {
+						LATTICEZK_LOG("syncing to node " << topology[i].id << " failed: " << strerror(errno));
+					}
+				}
+			}
+		}
+#endif
+		return true;
+	}
+	bool Sync(BitMatrix & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	bool Sync(SeededMatrix<T> & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	// tiles of a file-backed matrix are replicated for the stream only
+	template<typename S>
+	bool Sync(FileMatrix<S> & mat)
+	{
+		LATTICEZK_UNUSED(mat);
+		return true;
+	}
+	template<typename S, typename OrderA, typename OrderB, typename OrderC>
+	bool Multiply(const Matrix<T, OrderA> &a, const Matrix<S, OrderB> &b, Matrix<T, OrderC> &c)
+	{
+		if (topology.NumNodes() == 1 || c.NumCols() < LATTICEZK_NUMA_MIN_COLUMNS) {
+			return matops.Multiply(a, b, c);
+		}
+		if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+			return false;
+		}
+		LATTICEZK_LOG("matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols() << " on " << topology.NumNodes() << " nodes");
+		return OnNodes(c.NumCols(), [&](size_t i, matdim_t j0, matdim_t nj) {
+			const ConstMatrixView<S> bj = b.View().Cols(j0, nj);
+			const MatrixView<T> cj = c.View().Cols(j0, nj);
+			const T * replica = ReplicaOf(i, a);
+			if (replica == nullptr) {
+				return false;
+			}
+			GemmStridedSource<T> asrc(replica, a.RowStride(), a.ColStride());
+			GemmStridedSource<S> bsrc(bj.Data(), bj.RowStride(), bj.ColStride());
+			return StrassenGemm<T>(a.NumRows(), nj, a.NumCols(), asrc, bsrc, cj.Data(), cj.RowStride(), cj.ColStride());
+		});
+	}
+	// A seeded matrix needs no replicas, as each node regenerates it from the seed
+	template<typename S, typename OrderB, typename OrderC>
+	bool Multiply(const SeededMatrix<T> &a, const Matrix<S, OrderB> &b, Matrix<T, OrderC> &c)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.Multiply(a, b, c);
+		}
+		if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+			return false;
+		}
+		LATTICEZK_LOG("seeded matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols() << " on " << topology.NumNodes() << " nodes");
+		return OnNodes(c.NumCols(), [&](size_t i, matdim_t j0, matdim_t nj) {
+			LATTICEZK_UNUSED(i);
+			const ConstMatrixView<S> bj = b.View().Cols(j0, nj);
+			const MatrixView<T> cj = c.View().Cols(j0, nj);
+			GemmSeededSource<T> asrc(a);
+			GemmStridedSource<S> bsrc(bj.Data(), bj.RowStride(), bj.ColStride());
+			return Gemm<T>(a.NumRows(), nj, a.NumCols(), asrc, bsrc, cj.Data(), cj.RowStride(), cj.ColStride());
+		});
+	}
+	// Each node multiplies its partition of the rows of A, read in place, by all of B
+	template<typename S, typename Order>
+	bool Multiply(const Matrix<S, Order> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		if (topology.NumNodes() == 1 || c.NumCols() < LATTICEZK_NUMA_MIN_COLUMNS) {
+			return matops.Multiply(a, b, c);
+		}
+		if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+			return false;
+		}
+		LATTICEZK_LOG("bit-matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols() << " on " << topology.NumNodes() << " nodes");
+		return OnNodes(c.NumRows(), [&](size_t i, matdim_t i0, matdim_t mi) {
+			LATTICEZK_UNUSED(i);
+			const ConstMatrixView<S> ai = a.View().Rows(i0, mi);
+			GemmStridedSource<S> asrc(ai.Data(), ai.RowStride(), ai.ColStride());
+			return BitGemm<T>(mi, c.NumCols(), a.NumCols(), asrc, b.Data(), b.ColumnWords(), c.Data() + i0, 1, c.NumRows());
+		});
+	}
+	// Each node multiplies its replica of the columns of A that a tile of B meets by its partition of the tile
+	template<typename S, typename OrderA, typename OrderC>
+	bool Multiply(const Matrix<T, OrderA> &a, const FileMatrix<S> &b, Matrix<T, OrderC> &c)
+	{
+		if (topology.NumNodes() == 1 || a.NumCols() == 0) {
+			return matops.Multiply(a, b, c);
+		}
+		if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+			return false;
+		}
+		LATTICEZK_LOG("file matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols() << " on " << topology.NumNodes() << " nodes");
+		return StreamOnNodes(b, c.NumCols(), false, [&](size_t i, matdim_t j0, matdim_t nj, matdim_t k0, matdim_t kt, const S * tile) {
+			const MatrixView<T> cj = c.View().Cols(j0, nj);
+			const T * replica = ReplicaOf(i, a);
+			if (replica == nullptr) {
+				return false;
+			}
+			GemmStridedSource<T> asrc(replica, a.RowStride(), a.ColStride());
+			GemmStridedSource<S> bsrc(tile + j0, b.NumCols(), 1);
+			GemmStridedUpdate<T> out(cj.Data(), cj.RowStride(), cj.ColStride(), k0 == 0);
+			return Gemm<T>(a.NumRows(), nj, kt, asrc.Block(0, k0), bsrc, out);
+		});
+	}
+	template<typename S, typename OrderC>
+	bool Multiply(const SeededMatrix<T> &a, const FileMatrix<S> &b, Matrix<T, OrderC> &c)
+	{
+		if (topology.NumNodes() == 1 || a.NumCols() == 0) {
+			return matops.Multiply(a, b, c);
+		}
+		if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+			return false;
+		}
+		LATTICEZK_LOG("seeded file matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols() << " on " << topology.NumNodes() << " nodes");
+		return StreamOnNodes(b, c.NumCols(), false, [&](size_t i, matdim_t j0, matdim_t nj, matdim_t k0, matdim_t kt, const S * tile) {
+			LATTICEZK_UNUSED(i);
+			const MatrixView<T> cj = c.View().Cols(j0, nj);
+			GemmSeededSource<T> asrc(a);
+			GemmStridedSource<S> bsrc(tile + j0, b.NumCols(), 1);
+			GemmStridedUpdate<T> out(cj.Data(), cj.RowStride(), cj.ColStride(), k0 == 0);
+			return Gemm<T>(a.NumRows(), nj, kt, asrc.Block(0, k0), bsrc, out);
+		});
+	}
+	// Each node multiplies its replica of a tile of the rows of A by its partition of the columns of B
+	template<typename S>
+	bool Multiply(const FileMatrix<S> &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.Multiply(a, b, c);
+		}
+		if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+			return false;
+		}
+		LATTICEZK_LOG("file bit-matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols() << " on " << topology.NumNodes() << " nodes");
+		return StreamOnNodes(a, c.NumCols(), true, [&](size_t i, matdim_t j0, matdim_t nj, matdim_t i0, matdim_t m, const S * tile) {
+			LATTICEZK_UNUSED(i);
+			GemmStridedSource<S> asrc(tile, a.NumCols(), 1);
+			return BitGemm<T>(m, nj, a.NumCols(), asrc, b.Data() + (size_t)j0 * b.ColumnWords(), b.ColumnWords(),
+				c.Data() + (size_t)j0 * c.NumRows() + i0, 1, c.NumRows());
+		});
+	}
+	// C*X for a seeded challenge C has as many columns as test vectors, too few to partition over the nodes
+	bool Multiply(const SeededBitMatrix &a, const BitMatrix &b, ColumnMajorMatrix &c)
+	{
+		return matops.Multiply(a, b, c);
+	}
+	template<typename A, typename B>
+	bool Multiply(MatrixView<A> a, MatrixView<B> b, MatrixView<T> c)
+	{
+		return matops.Multiply(a, b, c);
+	}
+	template<typename A>
+	bool Multiply(MatrixView<A> a, const BitMatrix &b, MatrixView<T> c)
+	{
+		return matops.Multiply(a, b, c);
+	}
+	// Each node multiplies its partition of the columns of every item, packing its replica of A once for them all
+	bool MultiplyBatch(const RowMajorMatrix &a, const std::vector<const ColumnMajorMatrix *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.MultiplyBatch(a, b, c);
+		}
+		if (!BatchFits(a, b, c)) {
+			return false;
+		}
+		LATTICEZK_LOG("matrix batch mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.size() << " items on " << topology.NumNodes() << " nodes");
+		return OnEachNode([&](size_t i) {
+			GemmBatchOperands<T, GemmStridedSource<T>> batch;
+			for (size_t h = 0; h < b.size(); h++) {
+				const matdim_t j0 = topology.PartitionStart(i, c[h]->NumCols()), j1 = topology.PartitionStart(i + 1, c[h]->NumCols());
+				const matdim_t k = b[h]->NumRows(), m = c[h]->NumRows();
+				if (j0 < j1) {
+					batch.Add(j1 - j0, GemmStridedSource<T>(b[h]->Data() + (size_t)j0 * k, 1, k), c[h]->Data() + (size_t)j0 * m, 1, m);
+				}
+			}
+			if (batch.NumItems() == 0) {
+				return true;
+			}
+			const T * replica = ReplicaOf(i, a);
+			if (replica == nullptr) {
+				return false;
+			}
+			GemmStridedSource<T> asrc(replica, a.NumCols(), 1);
+			return GemmBatch<T>(a.NumRows(), a.NumCols(), asrc, batch);
+		});
+	}
+	template<typename S>
+	bool MultiplyBatch(const Matrix<S, RowMajorOrder> &a, const std::vector<const BitMatrix *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.MultiplyBatch(a, b, c);
+		}
+		if (!BatchFits(a, b, c)) {
+			return false;
+		}
+		LATTICEZK_LOG("bit-matrix batch mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.size() << " items on " << topology.NumNodes() << " nodes");
+		return OnEachNode([&](size_t i) {
+			GemmBatchOperands<T, BitGemmColumns> batch;
+			for (size_t h = 0; h < b.size(); h++) {
+				const matdim_t j0 = topology.PartitionStart(i, c[h]->NumCols()), j1 = topology.PartitionStart(i + 1, c[h]->NumCols());
+				const matdim_t words = b[h]->ColumnWords(), m = c[h]->NumRows();
+				if (j0 < j1) {
+					batch.Add(j1 - j0, BitGemmColumns(b[h]->Data() + (size_t)j0 * words, words), c[h]->Data() + (size_t)j0 * m, 1, m);
+				}
+			}
+			if (batch.NumItems() == 0) {
+				return true;
+			}
+			const S * replica = ReplicaOf(i, a);
+			if (replica == nullptr) {
+				return false;
+			}
+			GemmStridedSource<S> asrc(replica, a.NumCols(), 1);
+			return BitGemmBatch<T>(a.NumRows(), a.NumCols(), asrc, batch);
+		});
+	}
+	// Each node computes its partition of the rows of B and Z, by the same rows of S, read in place, into an epilogue
+	// of its own, and the exact sums of the epilogues are combined in the order of the nodes
+	template<typename S>
+	bool MultiplyAdd(const Matrix<S, RowMajorOrder> &s, const BitMatrix &c, const ColumnMajorMatrix &y, ColumnMajorMatrix &b, ColumnMajorMatrix &z, double &ZB, double &BB)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.MultiplyAdd(s, c, y, b, z, ZB, BB);
+		}
+		const matdim_t m = b.NumRows(), n = b.NumCols();
+		if (s.NumRows() != m || s.NumCols() != c.NumRows() || c.NumCols() != n
+				|| y.NumRows() != m || y.NumCols() != n || z.NumRows() != m || z.NumCols() != n) {
+			return false;
+		}
+		LATTICEZK_LOG("bit-matrix mult-add size: " << m << " | " << s.NumCols() << " | " << n << " on " << topology.NumNodes() << " nodes");
+		std::vector<std::unique_ptr<BitGemmAddStats<T>>> epilogues(topology.NumNodes());
+		const bool success = OnNodes(m, [&](size_t i, matdim_t i0, matdim_t mi) {
+			epilogues[i].reset(new BitGemmAddStats<T>(b.Data(), z.Data(), y.Data(), m));
+			GemmStridedSource<S> ssrc(s.Data() + (size_t)i0 * s.NumCols(), s.NumCols(), 1);
+			BitGemmRowsAt<BitGemmAddStats<T>> rows(*epilogues[i], i0);
+			return BitGemm<T>(mi, n, s.NumCols(), ssrc, c.Data(), c.ColumnWords(), rows);
+		});
+		if (!success) {
+			return false;
+		}
+		MatrixDotSum<T> zbsum, bbsum;
+		for (const std::unique_ptr<BitGemmAddStats<T>> & epilogue : epilogues) {
+			if (epilogue != nullptr) {
+				epilogue->AddStats(zbsum, bbsum);
+			}
+		}
+		ZB = zbsum.ToDouble();
+		BB = bbsum.ToDouble();
+		return true;
+	}
+	// The same for a file-backed S, each node keeping its epilogue over all the tiles of the rows of S
+	template<typename S>
+	bool MultiplyAdd(const FileMatrix<S> &s, const BitMatrix &c, const ColumnMajorMatrix &y, ColumnMajorMatrix &b, ColumnMajorMatrix &z, double &ZB, double &BB)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.MultiplyAdd(s, c, y, b, z, ZB, BB);
+		}
+		const matdim_t m = b.NumRows(), n = b.NumCols();
+		if (s.NumRows() != m || s.NumCols() != c.NumRows() || c.NumCols() != n
+				|| y.NumRows() != m || y.NumCols() != n || z.NumRows() != m || z.NumCols() != n) {
+			return false;
+		}
+		LATTICEZK_LOG("file bit-matrix mult-add size: " << m << " | " << s.NumCols() << " | " << n << " on " << topology.NumNodes() << " nodes");
+		std::vector<std::unique_ptr<BitGemmAddStats<T>>> epilogues(topology.NumNodes());
+		for (size_t i = 0; i < topology.NumNodes(); i++) {
+			const size_t o = (size_t)topology.PartitionStart(i, n) * m;
+			epilogues[i].reset(new BitGemmAddStats<T>(b.Data() + o, z.Data() + o, y.Data() + o, m));
+		}
+		const bool success = StreamOnNodes(s, n, true, [&](size_t i, matdim_t j0, matdim_t nj, matdim_t i0, matdim_t mt, const S * tile) {
+			GemmStridedSource<S> ssrc(tile, s.NumCols(), 1);
+			BitGemmRowsAt<BitGemmAddStats<T>> rows(*epilogues[i], i0);
+			return BitGemm<T>(mt, nj, s.NumCols(), ssrc, c.Data() + (size_t)j0 * c.ColumnWords(), c.ColumnWords(), rows);
+		});
+		if (!success) {
+			return false;
+		}
+		MatrixDotSum<T> zbsum, bbsum;
+		for (const std::unique_ptr<BitGemmAddStats<T>> & epilogue : epilogues) {
+			epilogue->AddStats(zbsum, bbsum);
+		}
+		ZB = zbsum.ToDouble();
+		BB = bbsum.ToDouble();
+		return true;
+	}
+	bool CheckProducts(const RowMajorMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const BitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.CheckProducts(a, z, t, c, w, equal);
+		}
+		return CheckOnNodes(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const RowMajorMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const SeededBitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.CheckProducts(a, z, t, c, w, equal);
+		}
+		return CheckOnNodes(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const SeededMatrix<T> &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const SeededBitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.CheckProducts(a, z, t, c, w, equal);
+		}
+		return CheckOnNodes(a, z, t, c, w, equal);
+	}
+	bool CheckProducts(const SeededMatrix<T> &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const BitMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		if (topology.NumNodes() == 1) {
+			return matops.CheckProducts(a, z, t, c, w, equal);
+		}
+		return CheckOnNodes(a, z, t, c, w, equal);
+	}
+private:
+	template<typename A, typename B>
+	static bool BatchFits(const A &a, const std::vector<const B *> &b, const std::vector<ColumnMajorMatrix *> &c)
+	{
+		if (b.size() != c.size()) {
+			return false;
+		}
+		for (size_t h = 0; h < b.size(); h++) {
+			if (a.NumRows() != c[h]->NumRows() || b[h]->NumCols() != c[h]->NumCols() || a.NumCols() != b[h]->NumRows()) {
+				return false;
+			}
+		}
+		return true;
+	}
+	// Runs f on the source of A for node i, its replica of an in-memory A, or a seeded A, which needs none
+	template<typename F>
+	bool WithNodeSource(size_t i, const RowMajorMatrix &a, F f)
+	{
+		const T * replica = ReplicaOf(i, a);
+		return replica != nullptr && f(GemmStridedSource<T>(replica, a.NumCols(), 1));
+	}
+	template<typename F>
+	bool WithNodeSource(size_t i, const SeededMatrix<T> &a, F f)
+	{
+		LATTICEZK_UNUSED(i);
+		return f(GemmSeededSource<T>(a));
+	}
+	// Runs f on columns [j0, j0+n) of C, read a block at a time, and generated as read for a seeded C
+	template<typename F>
+	static bool WithColumns(const BitMatrix &c, matdim_t j0, matdim_t n, F f)
+	{
+		BitColumnsFrom<const BitMatrix> cols(c, j0, n);
+		return f(cols);
+	}
+	template<typename F>
+	static bool WithColumns(const SeededBitMatrix &c, matdim_t j0, matdim_t n, F f)
+	{
+		SeededBitColumns blocks(c);
+		BitColumnsFrom<SeededBitColumns> cols(blocks, j0, n);
+		return f(cols);
+	}
+	// Checks A*Z = T*C + W, each node checking its partition of the columns of Z, C and W by its replica of T
+	template<typename AMatrix, typename CMatrix>
+	bool CheckOnNodes(const AMatrix &a, const ColumnMajorMatrix &z, const RowMajorMatrix &t, const CMatrix &c, const ColumnMajorMatrix &w, bool &equal)
+	{
+		const matdim_t m = w.NumRows(), n = w.NumCols();
+		if (a.NumRows() != m || a.NumCols() != z.NumRows() || z.NumCols() != n
+				|| t.NumRows() != m || t.NumCols() != c.NumRows() || c.NumCols() != n) {
+			return false;
+		}
+		LATTICEZK_LOG("check products size: " << m << " | " << a.NumCols() << " + " << t.NumCols() << " | " << n << " on " << topology.NumNodes() << " nodes");
+		std::vector<char> equals(topology.NumNodes(), 1);
+		const bool success = OnNodes(n, [&](size_t i, matdim_t j0, matdim_t nj) {
+			const T * t_replica = ReplicaOf(i, t);
+			if (t_replica == nullptr) {
+				return false;
+			}
+			const ConstMatrixView<T> replica(t_replica, t.NumRows(), t.NumCols(), t.NumCols(), 1);
+			bool node_equal = true;
+			const bool node_success = WithNodeSource(i, a, [&](const auto &asrc) {
+				return WithColumns(c, j0, nj, [&](auto &cols) {
+					return MatrixCheckProductsBlocks(asrc, a.NumCols(), z.View().Cols(j0, nj), replica, cols, w.View().Cols(j0, nj), node_equal);
+				});
+			});
+			equals[i] = node_equal;
+			return node_success;
+		});
+		equal = std::all_of(equals.begin(), equals.end(), [](char e) { return e != 0; });
+		return success;
+	}
+	NodeMemory & Node(size_t i)
+	{
+		return *nodes->memory[i];
+	}
+	// The replica on node i of the cells of a left operand, to be called on the thread of the node, or nullptr if the
+	// memory of the node is exhausted
+	template<typename S, typename Order>
+	const S * ReplicaOf(size_t i, const Matrix<S, Order> & a)
+	{
+		return (const S *)Node(i).ReplicaOf(a.Data(), (size_t)a.NumCells() * sizeof(S));
+	}
+	void DropReplicas(const void * data)
+	{
+		std::lock_guard<std::mutex> lock(nodes->running);
+		for (size_t i = 0; i < topology.NumNodes(); i++) {
+			Node(i).Drop(data);
+		}
+	}
+	// Runs f(i) for each node i on the thread of the node, along with the workers of the executor of the node
+	template<typename F>
+	bool OnEachNode(F f)
+	{
+		std::lock_guard<std::mutex> lock(nodes->running);
+		for (size_t i = 0; i < topology.NumNodes(); i++) {
+			Node(i).Run([&f, i]() { return (bool)f(i); });
+		}
+		bool success = true;
+		for (size_t i = 0; i < topology.NumNodes(); i++) {
+			success = Node(i).Wait() && success;
+		}
+		return success;
+	}
+	// Runs f(i, j0, nj) for the partition [j0, j0+nj) of n columns, or rows, of each node i, as OnEachNode
+	template<typename F>
+	bool OnNodes(matdim_t n, F f)
+	{
+		return OnEachNode([&](size_t i) {
+			const matdim_t j0 = topology.PartitionStart(i, n), j1 = topology.PartitionStart(i + 1, n);
+			return j0 == j1 || f(i, j0, j1 - j0);
+		});
+	}
+	// Runs f(i, j0, nj, i0, m, tile) for the partition [j0, j0+nj) of n columns of each node i, as OnNodes, for each
+	// row tile of x, rows [i0, i0+m) in RMO, streamed once for all the nodes
+	//   - the thread of node 0 streams the tiles, handing each to the others, multiplying its own partition and
+	//     waiting for theirs before the next
+	//   - to replicate, each node copies the tile into a buffer of its own, allocated once for the whole stream,
+	//     and a node that cannot allocate it fails, stopping the stream
+	template<typename S, typename F>
+	bool StreamOnNodes(const FileMatrix<S> &x, matdim_t n, bool replicate, F f)
+	{
+		const size_t n_nodes = topology.NumNodes();
+		const matdim_t tile_rows = std::max<matdim_t>(1, std::min(x.TileRows(tile_bytes), x.NumRows()));
+		// the tile handed to the nodes, by its generation, how many nodes are still on it, and whether any failed
+		std::mutex mutex;
+		std::condition_variable handed, done;
+		size_t generation = 0, busy = 0;
+		matdim_t handed_i0 = 0, handed_m = 0;
+		const S * handed_tile = nullptr;
+		bool ended = false, failed = false;
+		return OnEachNode([&](size_t i) {
+			const matdim_t j0 = topology.PartitionStart(i, n), nj = topology.PartitionStart(i + 1, n) - j0;
+			std::unique_ptr<Matrix<S, RowMajorOrder>> replica;
+			bool allocated = true;
+			if (replicate && nj > 0) {
+				replica.reset(new Matrix<S, RowMajorOrder>(tile_rows, x.NumCols(), MatrixInit::Uninitialized, Node(i).arena));
+				// the memory of the node is exhausted, which stops the stream at the next tile
+				if (replica->Data() == nullptr) {
+					allocated = false;
+					std::lock_guard<std::mutex> lock(mutex);
+					failed = true;
+				}
+			}
+			auto multiply = [&](matdim_t i0, matdim_t m, const S * tile) {
+				if (nj == 0) {
+					return true;
+				}
+				if (!allocated) {
+					return false;
+				}
+				if (replica) {
+					memcpy(replica->Data(), tile, (size_t)m * x.NumCols() * sizeof(S));
+					tile = replica->Data();
+				}
+				return f(i, j0, nj, i0, m, tile);
+			};
+			if (i > 0) {
+				size_t seen = 0;
+				bool success = allocated;
+				std::unique_lock<std::mutex> lock(mutex);
+				while (true) {
+					handed.wait(lock, [&]() { return generation != seen || ended; });
+					if (generation == seen) {
+						return success;
+					}
+					seen = generation;
+					const matdim_t i0 = handed_i0, m = handed_m;
+					const S * tile = handed_tile;
+					lock.unlock();
+					success = success && multiply(i0, m, tile);
+					lock.lock();
+					failed = failed || !success;
+					if (--busy == 0) {
+						done.notify_one();
+					}
+				}
+			}
+			const bool streamed = allocated && FileMatrixStreamRows(x, tile_rows, [&](matdim_t i0, matdim_t m, const S * tile) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					handed_i0 = i0;
+					handed_m = m;
+					handed_tile = tile;
+					busy = n_nodes - 1;
+					generation++;
+				}
+				handed.notify_all();
+				const bool success = multiply(i0, m, tile);
+				std::unique_lock<std::mutex> lock(mutex);
+				done.wait(lock, [&]() { return busy == 0; });
+				return success && !failed;
+			});
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ended = true;
+			}
+			handed.notify_all();
+			return streamed;
+		});
+	}
+};
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_NUMAMATRIXOPS_HPP_
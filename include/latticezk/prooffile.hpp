@@ -0,0 +1,402 @@
+#ifndef __LATTICEZK_PROOFFILE_HPP_
+#define __LATTICEZK_PROOFFILE_HPP_
+
+// Binary container of a proof, for shipping proofs between processes and storing them
+//   - a header of the format version, the entry bytes of the ring, the dimensions r, v, l and n, the bound B and
+//     sigma, and the offset, bytes and checksum of each section
+//   - sections A, T, W and Z at offsets aligned to LATTICEZK_ALIGNMENT, each the storage of its matrix as is:
+//     A and T in RMO and W and Z in CMO, all in the byte order of the host; the challenge C is not stored, as the
+//     verifier rederives it from the Fiat-Shamir seed of A, T and W
+//   - a seeded A (see seededmatrix.hpp) is stored as its 16-byte seed, which the header flags, and is mapped
+//     back into a seeded matrix rather than handed out as storage
+//   - a compact file packs Z to the bit widths of its entries instead (see util/bitpack.hpp), which halves Z of
+//     Gaussian entries of sigma 2^31 and more; T and W, uniform modulo 2^w, would not shrink and are kept as is
+//   - the checksums, computed in parallel over blocks, catch corruption rather than forgery, which the proof
+//     itself guards against
+//
+// A ProofFile maps a file, checks it, and then serves as the allocator of the matrices of a proof (see
+// Proof::Map), handing out its sections in their order, so that the verifier reads the file directly with no
+// parsing or copying, but for packed sections, which are unpacked when the file is opened. Elsewhere than
+// Linux, the file is read into memory instead
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/allocator.hpp"
+#include "latticezk/matrix.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/util/bitpack.hpp"
+#include "latticezk/util/executor.hpp"
+#if defined(__linux__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#define LATTICEZK_PROOF_MAGIC "LZKPROOF"
+#define LATTICEZK_PROOF_VERSION 4
+// Written in the byte order of the host, so that a file written on a host of the other byte order, which reads
+// reversed, is rejected rather than swapped
+#define LATTICEZK_PROOF_BYTE_ORDER 0x01020304u
+// Sections A, T, W and Z
+#define LATTICEZK_PROOF_SECTIONS 4
+// Bits of the sections that a compact file packs, Z alone, and of those that may be packed
+#define LATTICEZK_PROOF_COMPACT_SECTIONS 0x8
+#define LATTICEZK_PROOF_PACKABLE_SECTIONS 0xf
+// Flag of a file whose section A is the seed of a seeded A
+#define LATTICEZK_PROOF_SEEDED_A 0x1
+#define LATTICEZK_PROOF_FLAGS 0x1
+// Bytes of a block of a section, whose hashes are combined into its checksum
+#define LATTICEZK_PROOF_CHECKSUM_BLOCK (1 << 16)
+
+namespace LatticeZK {
+
+struct ProofFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t entry_bytes;
+	int32_t r, v, l, n;
+	uint32_t packed; // a bit per section packed to the bit widths of its entries
+	double B, sigma;
+	uint64_t flags;
+	uint64_t offsets[LATTICEZK_PROOF_SECTIONS];
+	uint64_t bytes[LATTICEZK_PROOF_SECTIONS];
+	uint64_t checksums[LATTICEZK_PROOF_SECTIONS];
+	uint64_t checksum; // of the header up to here
+};
+
+static_assert(sizeof(ProofFileHeader) % 8 == 0, "the header must not have trailing padding");
+
+inline uint64_t ProofFileMix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+// The checksum of a buffer: the sum of the hashes of its blocks, each keyed by its index, so that the blocks are
+// hashed in parallel in four lanes of words
+inline uint64_t ProofFileChecksum(const void * data, size_t bytes)
+{
+	const uint8_t * p = (const uint8_t *)data;
+	const int64_t n_blocks = (int64_t)((bytes + LATTICEZK_PROOF_CHECKSUM_BLOCK - 1) / LATTICEZK_PROOF_CHECKSUM_BLOCK);
+	return Executor::Current().ParallelReduce(0, n_blocks, 1, ProofFileMix(bytes), [&](int64_t b0, int64_t b1) {
+		uint64_t sum = 0;
+		for (int64_t b = b0; b < b1; b++) {
+			const size_t begin = (size_t)b * LATTICEZK_PROOF_CHECKSUM_BLOCK;
+			const size_t end = std::min(bytes, begin + LATTICEZK_PROOF_CHECKSUM_BLOCK);
+			uint64_t h[4] = { (uint64_t)b, ~(uint64_t)b, (uint64_t)b << 32, ~((uint64_t)b << 32) };
+			size_t i = begin;
+			for (; i + 32 <= end; i += 32) {
+				for (int k = 0; k < 4; k++) {
+					uint64_t w;
+					memcpy(&w, p + i + 8 * k, 8);
+					h[k] = (h[k] ^ w) * 0x9e3779b97f4a7c15ull;
+					h[k] ^= h[k] >> 29;
+				}
+			}
+			// the tail, zero-padded to 32 bytes
+			uint8_t tail[32] = { 0 };
+			memcpy(tail, p + i, end - i);
+			for (int k = 0; k < 4; k++) {
+				uint64_t w;
+				memcpy(&w, tail + 8 * k, 8);
+				h[k] = (h[k] ^ w) * 0x9e3779b97f4a7c15ull;
+			}
+			sum += ProofFileMix(h[0] ^ ProofFileMix(h[1] ^ ProofFileMix(h[2] ^ ProofFileMix(h[3]))));
+		}
+		return sum;
+	}, [](uint64_t x, uint64_t y) { return x + y; });
+}
+
+// Section A of a proof file, the storage of A, and its bytes
+template<typename AMatrix>
+inline const void * ProofFileSectionA(const AMatrix & mat_A, uint64_t & bytes, uint64_t & flags)
+{
+	LATTICEZK_UNUSED(flags);
+	bytes = (uint64_t)mat_A.NumCells() * sizeof(*mat_A.Data());
+	return mat_A.Data();
+}
+// Section A of a proof file of a seeded A, its seed, and its bytes
+template<typename T>
+inline const void * ProofFileSectionA(const SeededMatrix<T> & mat_A, uint64_t & bytes, uint64_t & flags)
+{
+	bytes = 16;
+	flags |= LATTICEZK_PROOF_SEEDED_A;
+	return mat_A.Seed();
+}
+
+// Writes a proof of the given bound and sigma from the storage of its matrices, or the seed of a seeded A,
+// compact if packing Z
+template<typename AMatrix, typename RowMajorMatrix, typename ColumnMajorMatrix>
+bool ProofFileWrite(const std::string & path, double B, double sigma, const AMatrix & mat_A, const RowMajorMatrix & mat_T,
+	const ColumnMajorMatrix & mat_W, const ColumnMajorMatrix & mat_Z, bool compact = false)
+{
+	typedef typename std::remove_const<typename std::remove_reference<decltype(*mat_T.Data())>::type>::type T;
+	ProofFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LATTICEZK_PROOF_MAGIC, sizeof(header.magic));
+	header.version = LATTICEZK_PROOF_VERSION;
+	header.byte_order = LATTICEZK_PROOF_BYTE_ORDER;
+	header.entry_bytes = sizeof(T);
+	header.r = mat_A.NumRows();
+	header.v = mat_A.NumCols();
+	header.l = mat_T.NumCols();
+	header.n = mat_Z.NumCols();
+	header.B = B;
+	header.sigma = sigma;
+	header.packed = compact ? LATTICEZK_PROOF_COMPACT_SECTIONS : 0;
+	uint64_t bytes[LATTICEZK_PROOF_SECTIONS] = {
+		0, (uint64_t)mat_T.NumCells() * sizeof(T), (uint64_t)mat_W.NumCells() * sizeof(T), (uint64_t)mat_Z.NumCells() * sizeof(T) };
+	const void * sections[LATTICEZK_PROOF_SECTIONS] = {
+		ProofFileSectionA(mat_A, bytes[0], header.flags), mat_T.Data(), mat_W.Data(), mat_Z.Data() };
+	std::vector<uint64_t> packed[LATTICEZK_PROOF_SECTIONS];
+	for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+		if (header.packed & (1u << s)) {
+			const int64_t cells = (int64_t)(bytes[s] / sizeof(T));
+			packed[s].resize(BitPackMaxBytes<T>(cells) / sizeof(uint64_t));
+			bytes[s] = BitPack((const T *)sections[s], cells, (uint8_t *)packed[s].data());
+			sections[s] = packed[s].data();
+		}
+	}
+	uint64_t offset = MatrixAllocator::RoundUp(sizeof(header));
+	for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+		header.offsets[s] = offset;
+		header.bytes[s] = bytes[s];
+		header.checksums[s] = ProofFileChecksum(sections[s], bytes[s]);
+		offset += MatrixAllocator::RoundUp(bytes[s]);
+	}
+	header.checksum = ProofFileChecksum(&header, offsetof(ProofFileHeader, checksum));
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write((const char *)&header, sizeof(header));
+	static const char padding[LATTICEZK_ALIGNMENT] = { 0 };
+	uint64_t at = sizeof(header);
+	for (int s = 0; s < LATTICEZK_PROOF_SECTIONS && out; s++) {
+		out.write(padding, header.offsets[s] - at);
+		out.write((const char *)sections[s], bytes[s]);
+		at = header.offsets[s] + bytes[s];
+	}
+	out.write(padding, offset - at);
+	return !!out;
+}
+
+// A proof file mapped in memory, which hands out its sections as the storage of matrices, in order
+class ProofFile : public MatrixAllocator
+{
+private:
+	uint8_t * base;
+	size_t size;
+	bool mapped;
+	ProofFileHeader header;
+	// the storage of the matrices, in the file or unpacked, and its bytes
+	uint8_t * sections[LATTICEZK_PROOF_SECTIONS];
+	uint64_t section_bytes[LATTICEZK_PROOF_SECTIONS];
+	int n_taken;
+private:
+	ProofFile(const ProofFile & other) = delete;
+	ProofFile(const ProofFile && other) = delete;
+public:
+	ProofFile() :
+		base(nullptr), size(0), mapped(false), sections { nullptr }, section_bytes { 0 }, n_taken(0)
+	{
+		memset(&header, 0, sizeof(header));
+	}
+	~ProofFile()
+	{
+		Close();
+	}
+public:
+	// Maps a proof file, returning false if it is unreadable, of another format or version, or corrupt
+	bool Open(const std::string & path)
+	{
+		Close();
+		if (!Map(path) || size < sizeof(header)) {
+			Close();
+			return false;
+		}
+		memcpy(&header, base, sizeof(header));
+		if (!Check() || !Unpack()) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+	void Close()
+	{
+		for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+			if (base != nullptr && (header.packed & (1u << s)) && sections[s] != nullptr) {
+				MatrixAllocator::Default().Free(sections[s], section_bytes[s]);
+			}
+			sections[s] = nullptr;
+		}
+		if (base != nullptr) {
+#if defined(__linux__)
+			if (mapped) {
+				munmap(base, size);
+			} else
+#endif
+			{
+				LATTICEZK_ALIGNED_FREE(base);
+			}
+		}
+		base = nullptr;
+		size = 0;
+		mapped = false;
+		n_taken = 0;
+	}
+public:
+	// The header of the file, valid once open
+	const ProofFileHeader & Header() const
+	{
+		return header;
+	}
+	// Sections handed out so far
+	int NumTaken() const
+	{
+		return n_taken;
+	}
+	bool IsSeededA() const
+	{
+		return (header.flags & LATTICEZK_PROOF_SEEDED_A) != 0;
+	}
+	// Hands out the seed of A, if A is seeded and not yet handed out, and otherwise nullptr
+	const uint8_t * TakeSeedA()
+	{
+		if (base == nullptr || n_taken != 0 || !IsSeededA()) {
+			return nullptr;
+		}
+		return sections[n_taken++];
+	}
+public:
+	// Hands out the next section, if it has the given bytes and is not a seed, and otherwise nullptr
+	void * Allocate(size_t bytes) override
+	{
+		if (base == nullptr || n_taken >= LATTICEZK_PROOF_SECTIONS || section_bytes[n_taken] != bytes || (n_taken == 0 && IsSeededA())) {
+			return nullptr;
+		}
+		return sections[n_taken++];
+	}
+	// The sections are released with the file
+	void Free(void * p, size_t bytes) override
+	{
+		LATTICEZK_UNUSED(p);
+		LATTICEZK_UNUSED(bytes);
+	}
+private:
+	bool Map(const std::string & path)
+	{
+#if defined(__linux__)
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			close(fd);
+			return false;
+		}
+		size = (size_t)st.st_size;
+		// private and writable, so that an operation writing to a matrix copies only the pages it writes
+		void * p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED) {
+			size = 0;
+			return false;
+		}
+		base = (uint8_t *)p;
+		mapped = true;
+		return true;
+#else
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in || in.tellg() <= 0) {
+			return false;
+		}
+		size = (size_t)in.tellg();
+		base = (uint8_t *)LATTICEZK_ALIGNED_ALLOC(LATTICEZK_ALIGNMENT, MatrixAllocator::RoundUp(size));
+		in.seekg(0);
+		return base != nullptr && in.read((char *)base, size);
+#endif
+	}
+	bool Check()
+	{
+		if (memcmp(header.magic, LATTICEZK_PROOF_MAGIC, sizeof(header.magic)) != 0 || header.version != LATTICEZK_PROOF_VERSION
+				|| header.byte_order != LATTICEZK_PROOF_BYTE_ORDER
+				|| header.checksum != ProofFileChecksum(&header, offsetof(ProofFileHeader, checksum))) {
+			return false;
+		}
+		if (header.r <= 0 || header.v <= 0 || header.l <= 0 || header.n <= 0
+				|| (header.entry_bytes != 1 && header.entry_bytes != 2 && header.entry_bytes != 4 && header.entry_bytes != 8)
+				|| (header.packed & ~LATTICEZK_PROOF_PACKABLE_SECTIONS) != 0 || (header.flags & ~(uint64_t)LATTICEZK_PROOF_FLAGS) != 0
+				|| (IsSeededA() && (header.packed & 1u))) {
+			return false;
+		}
+		// the cells of each matrix must be counted in matdim_t
+		const int64_t cells[LATTICEZK_PROOF_SECTIONS] = {
+			(int64_t)header.r * header.v, (int64_t)header.r * header.l, (int64_t)header.r * header.n, (int64_t)header.v * header.n };
+		uint64_t end = sizeof(header);
+		for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+			section_bytes[s] = s == 0 && IsSeededA() ? 16 : (uint64_t)cells[s] * header.entry_bytes;
+			if (cells[s] > INT32_MAX || (!(header.packed & (1u << s)) && header.bytes[s] != section_bytes[s])
+					|| header.offsets[s] % LATTICEZK_ALIGNMENT != 0 || header.offsets[s] < end || header.offsets[s] > size
+					|| header.bytes[s] > size - header.offsets[s]) {
+				return false;
+			}
+			end = header.offsets[s] + header.bytes[s];
+		}
+		for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+			if (ProofFileChecksum(base + header.offsets[s], header.bytes[s]) != header.checksums[s]) {
+				return false;
+			}
+		}
+		for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+			sections[s] = (header.packed & (1u << s)) ? nullptr : base + header.offsets[s];
+		}
+		return true;
+	}
+	// Unpacks the packed sections into buffers of their own
+	bool Unpack()
+	{
+		for (int s = 0; s < LATTICEZK_PROOF_SECTIONS; s++) {
+			if (!(header.packed & (1u << s))) {
+				continue;
+			}
+			sections[s] = (uint8_t *)MatrixAllocator::Default().Allocate(section_bytes[s]);
+			if (sections[s] == nullptr || !Unpack(s)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	bool Unpack(int s)
+	{
+		const uint8_t * in = base + header.offsets[s];
+		const int64_t cells = (int64_t)(section_bytes[s] / header.entry_bytes);
+		switch (header.entry_bytes) {
+		case 1:
+			return BitUnpack(in, header.bytes[s], cells, (int8_t *)sections[s]);
+		case 2:
+			return BitUnpack(in, header.bytes[s], cells, (int16_t *)sections[s]);
+		case 4:
+			return BitUnpack(in, header.bytes[s], cells, (int32_t *)sections[s]);
+		default:
+			return BitUnpack(in, header.bytes[s], cells, (int64_t *)sections[s]);
+		}
+	}
+};
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_PROOFFILE_HPP_
@@ -1,15 +1,118 @@
 #ifndef __LATTICEZK_PROTOCOL_HPP
 #define __LATTICEZK_PROTOCOL_HPP
 
+#include <stdlib.h>
+#include <memory>
 #include "latticezk/prover.hpp"
+#include "latticezk/hugepage.hpp"
+#include "latticezk/prooffile.hpp"
 #include "latticezk/gaussian//facct.hpp"
 
 namespace LatticeZK {
 
+// Writes a proof to a proof file and maps it back, or returns nullptr if either fails
+template<typename T, typename MatOps, typename AMatrix>
+std::unique_ptr<Proof<T, MatOps, AMatrix>> SaveAndMapProof(const Proof<T, MatOps, AMatrix> & proof, const char * path, double sigma, bool compact,
+	ProofFile & file)
+{
+	if (!proof.Save(path, sigma, compact) || !file.Open(path)) {
+		return nullptr;
+	}
+	return Proof<T, MatOps, AMatrix>::Map(file);
+}
+
+// Proves and verifies with a prover keeping the secret in entries of type S, and A of type AMatrix, the secret
+// being of type SecretMatrix in the prover, into which it is narrowed, or the one given if already of that type
+template<typename S, typename MatOps, uint64_t sigma, typename AMatrix, typename SecretMatrix = Matrix<S, RowMajorOrder>, typename SMatrix>
+void run_protocol_with_secret(MatOps & matops, AES_Random & aes_rnd, AMatrix & matA, SMatrix & matS,
+	uint32_t lambda, double s, matdim_t n, double rho, MatrixAllocator & allocator)
+{
+	typedef typename MatOps::data_t data_t;
+	typedef Proof<data_t, MatOps, AMatrix> proof_t;
+
+	auto prover = Prover<data_t, FacctGaussianSampler<sigma>, MatOps, S, AMatrix, SecretMatrix>::Create(matops, matA, matS, lambda, s, n, rho, allocator);
+	if (prover == nullptr) {
+		std::cerr << "No prover" << std::endl;
+		return;
+	}
+	// the proof references the matrices of the prover, which is kept until the proof is verified
+	auto proof = prover->ReferencingProof();
+	uint64_t draws = 0;
+	LATTICEZK_TIMER_START("proving");
+	draws = prover->Prove(aes_rnd, proof);
+	LATTICEZK_TIMER_END;
+
+	// the proof goes through the file named by LATTICEZK_PROOF_FILE, if set, which the verifier reads in place,
+	// compact if LATTICEZK_PROOF_COMPACT is set too
+	ProofFile file;
+	std::unique_ptr<proof_t> mapped;
+	const char * path = getenv("LATTICEZK_PROOF_FILE");
+	if (path != nullptr) {
+		LATTICEZK_TIMER_START("saving and mapping proof");
+		mapped = SaveAndMapProof(proof, path, (double)sigma, getenv("LATTICEZK_PROOF_COMPACT") != nullptr, file);
+		LATTICEZK_TIMER_END;
+		if (mapped == nullptr) {
+			std::cerr << "No proof file " << path << std::endl;
+			delete prover;
+			return;
+		}
+	}
+
+	bool verified = false;
+	Verifier<data_t, MatOps, AMatrix> verifier(matops, proof.r, proof.v, proof.l, proof.n, proof.B, allocator);
+	LATTICEZK_TIMER_START("verifying");
+	verified = verifier.Verify(mapped != nullptr ? *mapped : proof);
+	LATTICEZK_TIMER_END;
+	LATTICEZK_LOG("draws=" << draws << " verified=" << verified);
+	delete prover;
+}
+
+// The same with the secret in memory, or, if LATTICEZK_SECRET_FILE is set, in the file it names, into which
+// the secret is narrowed and from which the prover streams it (see filematrix.hpp)
+template<typename S, typename MatOps, uint64_t sigma, typename AMatrix>
+void run_protocol_with_secret_in(MatOps & matops, AES_Random & aes_rnd, AMatrix & matA, typename MatOps::ColumnMajorMatrix & matS,
+	uint32_t lambda, double s, matdim_t n, double rho, MatrixAllocator & allocator)
+{
+#ifndef __CUDACC__
+	const char * path = getenv("LATTICEZK_SECRET_FILE");
+	if (path != nullptr) {
+		FileMatrix<S> fileS;
+		bool success = true;
+		LATTICEZK_TIME(success, fileS.Create(path, matS.NumRows(), matS.NumCols()) && MatrixNarrowToFile(matS, fileS), "writing S");
+		if (!success) {
+			std::cerr << "No secret file " << path << std::endl;
+			return;
+		}
+		run_protocol_with_secret<S, MatOps, sigma, AMatrix, FileMatrix<S>>(matops, aes_rnd, matA, fileS, lambda, s, n, rho, allocator);
+		return;
+	}
+#endif
+	run_protocol_with_secret<S, MatOps, sigma>(matops, aes_rnd, matA, matS, lambda, s, n, rho, allocator);
+}
+
+// Proves and verifies with a prover keeping the secret in the narrowest entries that hold s_bits
+template<typename MatOps, uint64_t sigma, typename AMatrix>
+void run_protocol_with_a(MatOps & matops, AES_Random & aes_rnd, AMatrix & matA, typename MatOps::ColumnMajorMatrix & matS,
+	int s_bits, uint32_t lambda, double s, matdim_t n, double rho, MatrixAllocator & allocator)
+{
+	typedef typename MatOps::data_t data_t;
+	if (s_bits <= 8) {
+		run_protocol_with_secret_in<int8_t, MatOps, sigma>(matops, aes_rnd, matA, matS, lambda, s, n, rho, allocator);
+	} else if (s_bits <= 16) {
+		run_protocol_with_secret_in<int16_t, MatOps, sigma>(matops, aes_rnd, matA, matS, lambda, s, n, rho, allocator);
+	} else {
+		run_protocol_with_secret_in<data_t, MatOps, sigma>(matops, aes_rnd, matA, matS, lambda, s, n, rho, allocator);
+	}
+}
+
 // Implementation of Lattice-based NIZK protocol:
 // 	   "Sub-Linear Lattice-Based Zero-Knowledge	Arguments for Arithmetic Circuits", Baum et al
 //     https://eprint.iacr.org/2018/560.pdf
 // Supports running matrix-multiplications in the GPU
+// The prover keeps the secret in the narrowest of 8-bit, 16-bit and data_t entries that holds s_bits
+// If LATTICEZK_SEEDED_A is set, A is represented by a seed and regenerated in the multiplications by it, on the
+// CPU only (see seededmatrix.hpp)
+// If LATTICEZK_SECRET_FILE is set, the prover streams the secret from the file it names, on the CPU only
 //
 // Parameters:
 //   matops	        defines how matrix operations are carried out
@@ -30,8 +133,22 @@ void run_protocol(MatOps & matops, int s_bits, uint32_t lambda, matdim_t n, doub
 	BitsSampler bsampler(aes_rnd, s_bits);
 	MatrixSampler<UIntSampler<data_t>> asampler(aes_rnd);
 	MatrixSampler<BitsSampler> ssampler(bsampler);
-	RowMajorMatrix matA(r,v);
-	ColumnMajorMatrix matS(v,l);
+	// the large matrices are mapped in huge pages, first touched by the threads that sample and multiply them
+	HugePageAllocator allocator;
+	ColumnMajorMatrix matS(v, l, MatrixInit::Uninitialized, allocator);
+#ifndef __CUDACC__
+	if (getenv("LATTICEZK_SEEDED_A") != nullptr) {
+		uint8_t seed[16];
+		aes_rnd.random_bytes(seed);
+		SeededMatrix<data_t> matA(r, v, seed);
+		LATTICEZK_TIMER_START("sampling S");
+		ssampler(matS);
+		LATTICEZK_TIMER_END;
+		run_protocol_with_a<MatOps, sigma>(matops, aes_rnd, matA, matS, s_bits, lambda, s, n, rho, allocator);
+		return;
+	}
+#endif
+	RowMajorMatrix matA(r, v, MatrixInit::Uninitialized, allocator);
 	LATTICEZK_TIMER_START("sampling A");
 	asampler(matA);
 	LATTICEZK_TIMER_END;
@@ -41,24 +158,7 @@ void run_protocol(MatOps & matops, int s_bits, uint32_t lambda, matdim_t n, doub
 #ifndef __CUDACC__
 	if (debug) LATTICEZK_LOG(matA << std::endl << std::endl << matS << std::endl);
 #endif
-	auto prover = Prover<data_t, FacctGaussianSampler<sigma>, MatOps>::Create(matops, matA, matS, lambda, s, n, rho);
-	if (prover == nullptr) {
-		std::cerr << "No prover" << std::endl;
-		return;
-	}
-	Proof<data_t, MatOps> proof(r, v, l, n, prover->GetB());
-	uint64_t draws = 0;
-	LATTICEZK_TIMER_START("proving");
-	draws = prover->Prove(aes_rnd, proof);
-	LATTICEZK_TIMER_END;
-	delete prover;
-
-	bool verified = false;
-	Verifier<data_t, MatOps> verifier(matops, proof.r, proof.v, proof.l, proof.n, proof.B);
-	LATTICEZK_TIMER_START("verifying");
-	verified = verifier.Verify(proof);
-	LATTICEZK_TIMER_END;
-	LATTICEZK_LOG("draws=" << draws << " verified=" << verified);
+	run_protocol_with_a<MatOps, sigma>(matops, aes_rnd, matA, matS, s_bits, lambda, s, n, rho, allocator);
 }
 
 } // namespace LatticeZK
@@ -3,13 +3,25 @@
 
 // the core implementation of the Lattice-based NIZK protocol
 
+#include <array>
 #include <cmath>
+#include <memory>
 #include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include "crypto/hasher/sha.h"
 #include "crypto/number.h"
 #include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
 #include "latticezk/gaussian/gsampler.hpp"
 #include "latticezk/log.hpp"
+#include "latticezk/prooffile.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/util/executor.hpp"
+
+// Cells of a matrix sampled from one AES stream when sampling in parallel
+#define LATTICEZK_SAMPLE_CHUNK (1 << 14)
 
 namespace LatticeZK
 {
@@ -30,11 +42,17 @@ public:
 	{
 		sha256.update(mat.Data(), mat.NumCells() * sizeof(T));
 	}
-	void Digest(AES_Random & aes_rnd)
+	// A seeded matrix is bound by its seed
+	template<typename T>
+	void Update(const SeededMatrix<T> & mat)
+	{
+		sha256.update(mat.Seed(), 16);
+	}
+	// Folds the digest into a 16-byte seed
+	void Digest(uint8_t seed[16])
 	{
 		crypto::Number<256, uint8_t> digest = sha256.digest();
 		uint8_t * data = digest.data();
-		uint8_t seed[16];
 		for (int i=0; i<16; i++) {
 			seed[i] = data[i];
 		}
@@ -42,6 +60,11 @@ public:
 		for (int i=0; i<16; i++) {
 			seed[i] ^= data[i];
 		}
+	}
+	void Digest(AES_Random & aes_rnd)
+	{
+		uint8_t seed[16];
+		Digest(seed);
 		aes_rnd.reseed(seed);
 	}
 };
@@ -110,13 +133,27 @@ public:
 	template<typename T, typename Order>
 	inline bool operator()(Matrix<T, Order> &mat)
 	{
-		matdim_t n = mat.NumCells();
-		T * data = mat.Data(); 
+		return (*this)(mat.Data(), mat.NumCells());
+	}
+	// samples n consecutive cells
+	template<typename T>
+	inline bool operator()(T * data, matdim_t n)
+	{
 		for (matdim_t i=0; i<n; i++) {
 			data[i] = (T)sampler();
 		}
 		return true;
 	}
+	// samples bits in the cell order of a column-major matrix
+	inline bool operator()(BitMatrix &mat)
+	{
+		for (matdim_t j=0; j<mat.NumCols(); j++) {
+			for (matdim_t i=0; i<mat.NumRows(); i++) {
+				mat.Set(i, j, (int)sampler());
+			}
+		}
+		return true;
+	}
 };
 
 // Check a matrix is consistent with a randomness source
@@ -147,6 +184,17 @@ public:
 		}
 		return true;
 	}
+	inline bool operator()(const BitMatrix &mat)
+	{
+		for (matdim_t j=0; j<mat.NumCols(); j++) {
+			for (matdim_t i=0; i<mat.NumRows(); i++) {
+				if (mat(i, j) != (int)sampler()) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
 };
 
 // Implementation of rejection sampling in the protocol
@@ -164,139 +212,301 @@ public:
 	template<typename T, typename Order>
 	bool operator()(Matrix<T, Order> & mat_Z, Matrix<T, Order> & mat_B)
 	{
-		double u = sampler(), ZB, BB;
-		return mat_Z.FrobeniusInnerProduct(mat_B, ZB) && mat_B.FrobeniusNorm(BB) && u <= exp( (-2 * ZB + BB) * inner_denom ) * outer_denom;
+		double ZB, BB;
+		return mat_Z.FrobeniusInnerProduct(mat_B, ZB) && mat_B.FrobeniusNorm(BB) && (*this)(ZB, BB);
+	}
+	// Decides from the Frobenius inner-product <Z,B> and norm ||B|| computed beforehand
+	bool operator()(double ZB, double BB)
+	{
+		double u = sampler();
+		return u <= exp( (-2 * ZB + BB) * inner_denom ) * outer_denom;
 	}
 };
 
-// Captures a proof in the protocol
-template<typename T, typename MatOps>
+// Captures a proof in the protocol: A, T, W and Z, from which the verifier rederives the challenge C
+// A proof either owns its matrices, into which the prover copies, or references those of the prover, which
+// then need no copying on every draw; a referencing proof is valid until the prover's next draw or deletion
+// A is an RMO matrix, or a SeededMatrix whose seed alone is copied and hashed (see seededmatrix.hpp)
+template<typename T, typename MatOps, typename AMatrix = typename MatOps::RowMajorMatrix>
 class Proof
 {
 public:
 	typedef T data_t;
 	typedef typename MatOps::RowMajorMatrix RowMajorMatrix;
 	typedef typename MatOps::ColumnMajorMatrix ColumnMajorMatrix;
+private:
+	// the storage of an owning proof, declared before the references to it
+	std::unique_ptr<AMatrix> own_A;
+	std::unique_ptr<RowMajorMatrix> own_T;
+	std::unique_ptr<ColumnMajorMatrix> own_W, own_Z;
 public:
 	const matdim_t r, v, l, n;
 	const double B;
-	RowMajorMatrix mat_A, mat_T;
-	ColumnMajorMatrix mat_W, mat_C, mat_Z;
+	AMatrix & mat_A;
+	RowMajorMatrix & mat_T;
+	ColumnMajorMatrix & mat_W, & mat_Z;
+private:
+	// the copy- and move-constructors are private to prevent passing-by-value
+	Proof(const Proof & other) = delete;
+	Proof(const Proof && other) = delete;
 public:
-	Proof(matdim_t r, matdim_t v, matdim_t l, matdim_t n, double B) :
+	// An owning proof, whose matrices are left uninitialized for the prover to copy into
+	Proof(matdim_t r, matdim_t v, matdim_t l, matdim_t n, double B, MatrixAllocator & allocator = MatrixAllocator::Default()) :
+		own_A(new AMatrix(r, v, MatrixInit::Uninitialized, allocator)), own_T(new RowMajorMatrix(r, l, MatrixInit::Uninitialized, allocator)),
+		own_W(new ColumnMajorMatrix(r, n, MatrixInit::Uninitialized, allocator)), own_Z(new ColumnMajorMatrix(v, n, MatrixInit::Uninitialized, allocator)),
 		r(r), v(v), l(l), n(n), B(B),
-		mat_A(r, v), mat_T(r, l), mat_W(r, n), mat_C(l, n), mat_Z(v, n)
+		mat_A(*own_A), mat_T(*own_T), mat_W(*own_W), mat_Z(*own_Z)
+	{
+	}
+	// A proof referencing the given matrices
+	Proof(double B, AMatrix & mat_A, RowMajorMatrix & mat_T, ColumnMajorMatrix & mat_W, ColumnMajorMatrix & mat_Z) :
+		r(mat_A.NumRows()), v(mat_A.NumCols()), l(mat_T.NumCols()), n(mat_Z.NumCols()), B(B),
+		mat_A(mat_A), mat_T(mat_T), mat_W(mat_W), mat_Z(mat_Z)
 	{
 	}
+public:
+	bool IsOwning() const
+	{
+		return own_A != nullptr;
+	}
+	// Writes the proof to a proof file, along with the sigma it was sampled with, compact if packing Z
+	// The file holds A in full, so A must be an RMO matrix, or the seed of a seeded A
+	bool Save(const std::string & path, double sigma, bool compact = false) const
+	{
+		return ProofFileWrite(path, B, sigma, mat_A, mat_T, mat_W, mat_Z, compact);
+	}
+	// A proof whose matrices are the sections of an open proof file, which must outlive it, or nullptr if the
+	// file holds a proof of other entries or was mapped before
+	static std::unique_ptr<Proof> Map(ProofFile & file)
+	{
+		const ProofFileHeader & header = file.Header();
+		if (header.entry_bytes != sizeof(T) || file.NumTaken() != 0 || file.IsSeededA() != std::is_same<AMatrix, SeededMatrix<T>>::value) {
+			return nullptr;
+		}
+		// the seed of a seeded A comes first, as A takes no storage of the file
+		const uint8_t * seed_A = file.TakeSeedA();
+		std::unique_ptr<Proof> proof(new Proof(header.r, header.v, header.l, header.n, header.B, file));
+		if (file.NumTaken() != LATTICEZK_PROOF_SECTIONS) {
+			return nullptr;
+		}
+		MapA(proof->mat_A, seed_A);
+		return proof;
+	}
+private:
+	static void MapA(SeededMatrix<T> & mat_A, const uint8_t * seed_A)
+	{
+		mat_A.Reseed(seed_A);
+	}
+	template<typename M>
+	static void MapA(M & mat_A, const uint8_t * seed_A)
+	{
+		LATTICEZK_UNUSED(mat_A);
+		LATTICEZK_UNUSED(seed_A);
+	}
+public:
 
-	bool seed(AES_Random& aes_rnd)
+	// The Fiat-Shamir seed of the challenge, hashed from A, T and W
+	bool seed(uint8_t seed[16])
 	{
 		MatrixHasher mathasher;
 		mathasher.Update(mat_A);
 		mathasher.Update(mat_T);
 		mathasher.Update(mat_W);
-		mathasher.Digest(aes_rnd);
+		mathasher.Digest(seed);
 		return true;
 	}
+	bool seed(AES_Random& aes_rnd)
+	{
+		uint8_t seed[16];
+		return this->seed(seed) && aes_rnd.reseed(seed);
+	}
 };
 
 // Implementation of the prover in the protocol
-template<typename T, typename G, typename MatOps>
+// The secret is kept in entries of type S, which may be narrower than T, and A is of type AMatrix, as in Proof
+// The secret is of type SecretMatrix: an RMO matrix, into which the prover narrows the given secret, or a
+// FileMatrix (see filematrix.hpp), which the prover references and streams from disk in A*S and S*C
+template<typename T, typename G, typename MatOps, typename S = T, typename AMatrix = typename MatOps::RowMajorMatrix,
+	typename SecretMatrix = Matrix<S, RowMajorOrder>>
 class Prover
 {
 public:
 	typedef T data_t;
 	typedef G gsampler_t;
-	typedef Proof<T, MatOps> proof_t;
+	typedef S secret_t;
+	typedef SecretMatrix secret_matrix_t;
+	typedef Proof<T, MatOps, AMatrix> proof_t;
 	typedef typename MatOps::RowMajorMatrix RowMajorMatrix;
 	typedef typename MatOps::ColumnMajorMatrix ColumnMajorMatrix;
-	typedef MatrixSampler<BitSampler> BinaryMatrixSampler;
 	typedef MatrixSampler<G> GaussianMatrixSampler;
 private:
 	MatOps matops;
 	matdim_t r, v, l, n;
 	double sigma, rho, B;
-	RowMajorMatrix mat_A;
-	ColumnMajorMatrix mat_S;
-	RowMajorMatrix lmat_S, lmat_T;
-	ColumnMajorMatrix mat_T, mat_Y, mat_W, mat_C, mat_B, mat_Z; // column-major-order fits right-multiplication and its result matrices
+	AMatrix mat_A; // as in the proof
+	RowMajorMatrix mat_T; // row-major-order as in the proof
+	std::unique_ptr<SecretMatrix> own_S; // the storage of a secret narrowed by the prover
+	SecretMatrix * mat_S; // row-major-order fits both right- and left-multiplication with narrow entries
+	ColumnMajorMatrix mat_Y, mat_W, mat_B, mat_Z; // column-major-order fits right-multiplication and its result matrices
+	BitMatrix mat_C; // the challenge, bit-packed for multiplication by additions only
+	double stat_ZB, stat_BB; // <Z,B> and ||B||^2 of the last response
 private:
 	// the copy- and move-constructors are private to prevent passing-by-value
 	Prover(const Prover & other) = delete;
 	Prover(const Prover && other) = delete;
 private:
 	// the main constructor is private so that parameter-checking can be enforced before it is invoked
-	Prover(MatOps & matops, RowMajorMatrix &matA, ColumnMajorMatrix &matS, matdim_t n, double rho, double B) :
-		matops(matops), r(matA.NumRows()), v(matA.NumCols()), l(matS.NumCols()), n(n), sigma(gsampler_t::sigma), rho(rho), B(B),
-		mat_A(r, v), mat_S(v, l), lmat_S(v, l), lmat_T(r, l), mat_T(r, l), mat_Y(v, n), mat_W(r, n), mat_C(l, n), mat_B(v, n), mat_Z(v, n)
+	// every matrix but the challenge is overwritten before it is read, hence left uninitialized
+	Prover(MatOps & matops, AMatrix &matA, matdim_t l, matdim_t n, double rho, double B, MatrixAllocator & allocator) :
+		matops(matops), r(matA.NumRows()), v(matA.NumCols()), l(l), n(n), sigma(gsampler_t::sigma), rho(rho), B(B),
+		mat_A(r, v, MatrixInit::Uninitialized, allocator), mat_T(r, l, MatrixInit::Uninitialized, allocator), mat_S(nullptr),
+		mat_Y(v, n, MatrixInit::Uninitialized, allocator), mat_W(r, n, MatrixInit::Uninitialized, allocator), mat_B(v, n, MatrixInit::Uninitialized, allocator), mat_Z(v, n, MatrixInit::Uninitialized, allocator),
+		mat_C(l, n, MatrixInit::Zero, allocator), stat_ZB(0), stat_BB(0)
 	{
 		bool success = true;
 		LATTICEZK_TIME(success, matops.Copy(mat_A, matA), "copying A");
-		LATTICEZK_TIME(success, matops.Copy(mat_S, matS), "copying S");
 		LATTICEZK_TIME(success, matops.Sync(mat_A), "syncing A");
-		LATTICEZK_TIME(success, matops.Sync(mat_S), "syncing S");
-		LATTICEZK_TIME(success, matops.Multiply(mat_A, mat_S, mat_T), "multiplying A*S");
-		LATTICEZK_TIME(success, MatrixToRowMajorOrder(mat_S, lmat_S), "reordering S");
-		LATTICEZK_TIME(success, matops.Sync(lmat_S), "syncing S");
-		LATTICEZK_TIME(success, MatrixToRowMajorOrder(mat_T, lmat_T), "reordering T");
-		LATTICEZK_TIME(success, matops.Sync(lmat_T), "syncing T");
+	}
+	// owning the given secret, narrowed by Create
+	Prover(MatOps & matops, AMatrix &matA, std::unique_ptr<SecretMatrix> &&matS, matdim_t n, double rho, double B, MatrixAllocator & allocator) :
+		Prover(matops, matA, matS->NumCols(), n, rho, B, allocator)
+	{
+		own_S = std::move(matS);
+		mat_S = own_S.get();
+		bool success = true;
+		LATTICEZK_TIME(success, matops.Sync(*mat_S), "syncing S");
+		LATTICEZK_TIME(success, matops.Multiply(mat_A, *mat_S, mat_T), "multiplying A*S");
+		LATTICEZK_TIME(success, matops.Sync(mat_T), "syncing T");
+	}
+	// referencing the given secret, such as a file-backed one, which must outlive the prover
+	Prover(MatOps & matops, AMatrix &matA, SecretMatrix &matS, matdim_t n, double rho, double B, MatrixAllocator & allocator) :
+		Prover(matops, matA, matS.NumCols(), n, rho, B, allocator)
+	{
+		mat_S = &matS;
+		bool success = true;
+		LATTICEZK_TIME(success, matops.Sync(*mat_S), "syncing S");
+		LATTICEZK_TIME(success, matops.Multiply(mat_A, *mat_S, mat_T), "multiplying A*S");
+		LATTICEZK_TIME(success, matops.Sync(mat_T), "syncing T");
 	}
 public:
 	// Create a prover with given parameters, but return nullptr if parameter-checking failed
-	static Prover * Create(MatOps & matops, RowMajorMatrix & matA, ColumnMajorMatrix & matS, uint32_t lambda, double s, matdim_t n, double rho)
+	// The matrices of the prover are allocated from the given allocator, such as an arena shared by successive provers
+	static Prover * Create(MatOps & matops, AMatrix & matA, ColumnMajorMatrix & matS, uint32_t lambda, double s, matdim_t n, double rho,
+		MatrixAllocator & allocator = MatrixAllocator::Default())
+	{
+		if (!CheckParameters(matA, matS, lambda, s, n, rho)) {
+			return nullptr;
+		}
+		std::unique_ptr<SecretMatrix> narrowS(new SecretMatrix(matS.NumRows(), matS.NumCols(), MatrixInit::Uninitialized, allocator));
+		bool success = true;
+		LATTICEZK_TIME(success, MatrixNarrowToRowMajorOrder(matS, *narrowS), "narrowing S");
+		if (!success) {
+			LATTICEZK_LOG("prover creation failed (3): S entries exceed " << (8 * sizeof(S)) << " bits");
+			return nullptr;
+		}
+		matdim_t v = matA.NumCols();
+		double B = sqrt(2*v) * gsampler_t::sigma;
+		return new Prover(matops, matA, std::move(narrowS), n, rho, B, allocator);
+	}
+	// The same for a secret already of the type of the prover, such as a file-backed one, which the prover
+	// references, and which must outlive it
+	static Prover * Create(MatOps & matops, AMatrix & matA, SecretMatrix & matS, uint32_t lambda, double s, matdim_t n, double rho,
+		MatrixAllocator & allocator = MatrixAllocator::Default())
+	{
+		if (!CheckParameters(matA, matS, lambda, s, n, rho)) {
+			return nullptr;
+		}
+		matdim_t v = matA.NumCols();
+		double B = sqrt(2*v) * gsampler_t::sigma;
+		return new Prover(matops, matA, matS, n, rho, B, allocator);
+	}
+private:
+	template<typename M>
+	static bool CheckParameters(AMatrix & matA, M & matS, uint32_t lambda, double s, matdim_t n, double rho)
 	{
 		if (matA.NumCols() != matS.NumRows() || n < 0 || (uint32_t)n < lambda + 2 || rho <= 1.0) {
 			LATTICEZK_LOG("prover creation failed (1): " << (matA.NumCols() != matS.NumRows()) << " " << (n < 0) << " " << ((uint32_t)n < lambda + 2) << " " << (rho <= 1.0));
-			return nullptr;
+			return false;
 		}
 		matdim_t l = matS.NumCols();
-		LATTICEZK_LOG("operator norm upper bound=" << matS.UpperBoundOnOperatorNorm() << " s=" << s);
-		LATTICEZK_LOG("sigma=" << gsampler_t::sigma << " required>=" << (12 / log(rho) * s * sqrt(l*n)));
+		// computed once, as a file-backed secret is read in full for it
 		double s1 = matS.UpperBoundOnOperatorNorm();
+		LATTICEZK_LOG("operator norm upper bound=" << s1 << " s=" << s);
+		LATTICEZK_LOG("sigma=" << gsampler_t::sigma << " required>=" << (12 / log(rho) * s * sqrt(l*n)));
 		if (s <= 0 || s1 > s || gsampler_t::sigma < 12 / log(rho) * s * sqrt(l*n)) {
 			LATTICEZK_LOG("prover creation failed (2): " << (s <= 0) << " " << (s1 > s) << " " << (gsampler_t::sigma < 12 / log(rho) * s * sqrt(l*n)));
-			return nullptr;
+			return false;
 		}
-		matdim_t v = matA.NumCols();
-		double B = sqrt(2*v) * gsampler_t::sigma;
-		return new Prover(matops, matA, matS, n, rho, B);
+		return true;
 	}
 public:
 	double GetB() const
 	{
 		return B;
 	}
+	// A proof referencing the matrices of this prover, into which Prove need not copy
+	proof_t ReferencingProof()
+	{
+		return proof_t(B, mat_A, mat_T, mat_W, mat_Z);
+	}
+private:
+	// Copies a matrix of this prover to the proof, unless the proof references it
+	template<typename M>
+	bool CopyToProof(M & dst, const M & src)
+	{
+		return &dst == &src || matops.Copy(dst, src);
+	}
+	// Samples the cells of a matrix in parallel, each chunk of them from its own AES stream, whose seed is
+	// drawn from aes_rnd in the order of the chunks, so that the matrix does not depend on the number of threads
+	bool SampleGaussian(AES_Random & aes_rnd, ColumnMajorMatrix & mat)
+	{
+		const int64_t n = mat.NumCells(), size = LATTICEZK_SAMPLE_CHUNK;
+		std::vector<std::array<uint8_t, 16>> seeds((size_t)((n + size - 1) / size));
+		for (std::array<uint8_t, 16> & seed : seeds) {
+			aes_rnd.random_bytes(seed.data());
+		}
+		data_t * data = mat.Data();
+		return Executor::Current().ParallelReduce(0, (int64_t)seeds.size(), 1, true, [&](int64_t c0, int64_t c1) {
+			bool success = true;
+			AES_Random chunk_rnd;
+			for (int64_t c = c0; c < c1; c++) {
+				chunk_rnd.reseed(seeds[c].data());
+				// a new sampler per chunk, as it buffers samples of the stream
+				BytesSampler bytes_sampler(chunk_rnd);
+				GaussianMatrixSampler gsampler(bytes_sampler);
+				success = success && gsampler(data + c * size, (matdim_t)std::min(size, n - c * size));
+			}
+			return success;
+		}, [](bool x, bool y) { return x && y; });
+	}
 public:
 	bool Commit(AES_Random & aes_rnd, proof_t &proof)
 	{
 		bool success = true;
-		BytesSampler bytes_sampler(aes_rnd);
-		GaussianMatrixSampler gsampler(bytes_sampler);
-		LATTICEZK_TIME(success, gsampler(mat_Y), "sampling Y");
+		LATTICEZK_TIME(success, SampleGaussian(aes_rnd, mat_Y), "sampling Y");
 		LATTICEZK_TIME(success, matops.Sync(mat_Y), "syncing Y");
 		LATTICEZK_TIME(success, matops.Multiply(mat_A, mat_Y, mat_W), "multiplying A*Y");
-		LATTICEZK_TIME(success, matops.Copy(proof.mat_A, mat_A), "copying A to proof");
-		LATTICEZK_TIME(success, matops.Copy(proof.mat_T, lmat_T), "copying T to proof");
-		LATTICEZK_TIME(success, matops.Copy(proof.mat_W, mat_W), "copying W to proof");
+		LATTICEZK_TIME(success, CopyToProof(proof.mat_A, mat_A), "copying A to proof");
+		LATTICEZK_TIME(success, CopyToProof(proof.mat_T, mat_T), "copying T to proof");
+		LATTICEZK_TIME(success, CopyToProof(proof.mat_W, mat_W), "copying W to proof");
 		return success;
 	}
 	bool Challenge(proof_t &proof)
 	{
 		bool success = true;
-		AES_Random aes_rnd;
-		LATTICEZK_TIME(success, proof.seed(aes_rnd), "seeding");
-		BinaryMatrixSampler bsampler(aes_rnd);
-		LATTICEZK_TIME(success, bsampler(mat_C), "sampling C");
+		uint8_t seed[16];
+		LATTICEZK_TIME(success, proof.seed(seed), "seeding");
+		// the bits a BitSampler would draw from the seeded stream, generated in parallel
+		SeededBitMatrix challenge(l, n, seed);
+		LATTICEZK_TIME(success, challenge.ToBitMatrix(mat_C), "sampling C");
 		LATTICEZK_TIME(success, matops.Sync(mat_C), "syncing C");
-		LATTICEZK_TIME(success, matops.Copy(proof.mat_C, mat_C), "copying C to proof");
 		return success;
 	}
 	bool Response(proof_t &proof)
 	{
 		bool success = true;
-		LATTICEZK_TIME(success, matops.Multiply(lmat_S, mat_C, mat_B), "multiplying S*C");
-		mat_Z.Add(mat_B, mat_Y);
-		LATTICEZK_TIME(success, matops.Copy(proof.mat_Z, mat_Z), "copying Z to proof");
+		LATTICEZK_TIME(success, matops.MultiplyAdd(*mat_S, mat_C, mat_Y, mat_B, mat_Z, stat_ZB, stat_BB), "multiplying S*C and adding Y");
+		LATTICEZK_TIME(success, CopyToProof(proof.mat_Z, mat_Z), "copying Z to proof");
 		return success;
 	}
 	uint64_t Prove(AES_Random & aes_rnd, proof_t &proof)
@@ -309,87 +519,126 @@ public:
 			Commit(aes_rnd, proof);
 			Challenge(proof);
 			Response(proof);
-		} while (reject(mat_Z, mat_B));
+		} while (reject(stat_ZB, sqrt(stat_BB)));
 		return draws;
 	}
 };
 
-// Implementation of the verifier in the protocol
-template<typename T, typename MatOps>
+// Implementation of the verifier in the protocol, of proofs whose A is of type AMatrix
+// The challenge C is regenerated from the Fiat-Shamir seed a block of columns at a time as T*C is computed, which
+// is why a proof carries no C. By default, A*Z = T*C + W is checked in full. Optionally, it is checked
+// Freivalds-style, by multiplying both sides by random binary test vectors: a nonzero matrix over Z_{2^w} maps
+// such a vector to zero with probability at most 1/2, so k vectors give a soundness error of at most 2^-k for
+// O(k*(v*n + r*v + r*l + r*n)) work, Z*X taking the v*n*k additions, and C*X some l*n*k/64 word operations
+template<typename T, typename MatOps, typename AMatrix = typename MatOps::RowMajorMatrix>
 class Verifier
 {
 public:
 	typedef T data_t;
-	typedef Proof<T, MatOps> proof_t;
+	typedef Proof<T, MatOps, AMatrix> proof_t;
 	typedef typename MatOps::RowMajorMatrix RowMajorMatrix;
 	typedef typename MatOps::ColumnMajorMatrix ColumnMajorMatrix;
-	typedef MatrixChecker<BitSampler> BinaryMatrixChecker;
 
 private:
 	MatOps & matops;
 	matdim_t r, v, l, n;
 	double B;
-	ColumnMajorMatrix mat_AZ, mat_TC, mat_TCpW; // column-major-order fits right-multiplication and its result matrices
-	Matrix<double> mat_Zcols;
+	AES_Random * test_rnd; // source of the test vectors, or nullptr for the full check
+	matdim_t n_tests;
+	MatrixAllocator & allocator; // of the temporary matrices of checking
 private:
 	// the copy- and move-constructors are private to prevent passing-by-value
 	Verifier(const Verifier & other) = delete;
 	Verifier(const Verifier && other) = delete;
 public:
-	Verifier(MatOps & matops, matdim_t r, matdim_t v, matdim_t l, matdim_t n, double B) :
-		matops(matops), r(r), v(v), l(l), n(n), B(B),
-		mat_AZ(r, n), mat_TC(r, n), mat_TCpW(r, n), mat_Zcols(1, n)
+	Verifier(MatOps & matops, matdim_t r, matdim_t v, matdim_t l, matdim_t n, double B, MatrixAllocator & allocator = MatrixAllocator::Default()) :
+		matops(matops), r(r), v(v), l(l), n(n), B(B), test_rnd(nullptr), n_tests(0), allocator(allocator)
+	{
+	}
+	// A verifier checking with n_tests test vectors sampled from test_rnd, which must be seeded independently of the
+	// proof, for a soundness error of at most 2^-n_tests; with no test vectors, it rejects every proof
+	Verifier(MatOps & matops, matdim_t r, matdim_t v, matdim_t l, matdim_t n, double B, AES_Random & test_rnd, matdim_t n_tests,
+		MatrixAllocator & allocator = MatrixAllocator::Default()) :
+		matops(matops), r(r), v(v), l(l), n(n), B(B), test_rnd(&test_rnd), n_tests(n_tests), allocator(allocator)
 	{
 	}
+private:
+	// Checks A*Z = T*C + W in full
+	bool Check(proof_t &proof, const SeededBitMatrix &mat_C, bool &equal)
+	{
+		return matops.CheckProducts(proof.mat_A, proof.mat_Z, proof.mat_T, mat_C, proof.mat_W, equal);
+	}
+	// Checks A*(Z*X) = T*(C*X) + W*X for a random binary X
+	bool CheckTests(proof_t &proof, const SeededBitMatrix &mat_C, bool &equal)
+	{
+		// every matrix but the test vectors is overwritten before it is read
+		const MatrixInit init = MatrixInit::Uninitialized;
+		BitMatrix mat_X(n, n_tests, MatrixInit::Zero, allocator);
+		ColumnMajorMatrix mat_ZX(v, n_tests, init, allocator), mat_CX(l, n_tests, init, allocator), mat_WX(r, n_tests, init, allocator);
+		ColumnMajorMatrix mat_AZ(r, n_tests, init, allocator), mat_TC(r, n_tests, init, allocator);
+		MatrixSampler<BitSampler> xsampler(*test_rnd);
+		// C*X is counted from the seeded columns of C, a block at a time, so C is never stored
+		if (!xsampler(mat_X)
+			|| !matops.Multiply(proof.mat_Z, mat_X, mat_ZX)
+			|| !matops.Multiply(proof.mat_A, mat_ZX, mat_AZ)
+			|| !matops.Multiply(mat_C, mat_X, mat_CX)
+			|| !matops.Multiply(proof.mat_T, mat_CX, mat_TC)
+			|| !matops.Multiply(proof.mat_W, mat_X, mat_WX))
+		{
+			return false;
+		}
+		// compared as summed, in one pass
+		equal = mat_AZ == mat_TC + mat_WX;
+		return true;
+	}
 public:
 	bool Verify(proof_t &proof)
 	{
+		// no test vectors would check nothing
+		if (test_rnd != nullptr && n_tests < 1) {
+			LATTICEZK_LOG("verification failed: no test vectors");
+			return false;
+		}
 		if (B < proof.B
 				|| proof.mat_A.NumRows() != r || proof.mat_A.NumCols() != v
 				|| proof.mat_Z.NumRows() != v || proof.mat_Z.NumCols() != n
 				|| proof.mat_W.NumRows() != r || proof.mat_W.NumCols() != n
-				|| proof.mat_T.NumRows() != r || proof.mat_T.NumCols() != l
-				|| proof.mat_C.NumRows() != l || proof.mat_C.NumCols() != n) {
+				|| proof.mat_T.NumRows() != r || proof.mat_T.NumCols() != l) {
 			LATTICEZK_LOG("verification failed: mismatching dimensions");
 			return false;
 		}
-		// TODO: sync A, Z, T, C
+		// the proof may hold new matrices where those of an earlier proof were, such as when proved into again
 		bool success = true;
-		AES_Random aes_rnd;
-		LATTICEZK_TIME(success, proof.seed(aes_rnd), "seeding");
+		LATTICEZK_TIME(success, matops.Sync(proof.mat_A) && matops.Sync(proof.mat_T), "syncing A and T");
+		LATTICEZK_TIME(success, matops.Sync(proof.mat_Z) && matops.Sync(proof.mat_W), "syncing Z and W");
 		if (!success) {
-			LATTICEZK_LOG("verification failed: seeding");
+			LATTICEZK_LOG("verification failed: syncing");
 			return false;
 		}
-		BinaryMatrixChecker bchecker(aes_rnd);
-		if (!bchecker(proof.mat_C)) {
-			LATTICEZK_LOG("verification failed: mismatching challenge matrix");
+		uint8_t seed[16];
+		LATTICEZK_TIME(success, proof.seed(seed), "seeding");
+		if (!success) {
+			LATTICEZK_LOG("verification failed: seeding");
 			return false;
 		}
-		LATTICEZK_LOG("multiplying A*Z and T*C");
-		if (!matops.Multiply(proof.mat_A, proof.mat_Z, mat_AZ)
-			|| !matops.Multiply(proof.mat_T, proof.mat_C, mat_TC)
-			|| !mat_TCpW.Add(mat_TC, proof.mat_W))
-		{
+		SeededBitMatrix mat_C(l, n, seed);
+		LATTICEZK_LOG("multiplying A*Z and T*C" << (test_rnd != nullptr ? " by test vectors" : ""));
+		bool equal = false;
+		if (!(test_rnd != nullptr ? CheckTests(proof, mat_C, equal) : Check(proof, mat_C, equal))) {
 			LATTICEZK_LOG("verification failed: calculating matrices");
 			return false;
 		}
-		if (mat_AZ != mat_TCpW) {
+		if (!equal) {
 			LATTICEZK_LOG("verification failed: A*Z = T*C + W");
 			return false;
 		}
-		mat_Zcols.Zero();
-		for (matdim_t i=0; i<v; i++) {
-			for (matdim_t j=0; j<n; j++) {
-				double z = (double)((proof.mat_Z)(i, j));
-				mat_Zcols(j) += z * z;
-			}
-		}
-		for (matdim_t j=0; j<n; j++) {
-			if (mat_Zcols(j) > B * B) {
-				LATTICEZK_LOG("verification failed: norm-bound exceeded: B^2=" << (B*B) << " ||z_j||_2^2=" << mat_Zcols(j) << " j=" << j);
-				return false;
-			}
+		// the squares of each column are summed exactly, and compared with the exact square of B, so that neither
+		// an entry nor the bound can round its way past the other
+		matdim_t j = 0;
+		double norm = 0;
+		if (!MatrixColumnsWithinNorm(proof.mat_Z, MatrixNormBound::Square(B), j, norm)) {
+			LATTICEZK_LOG("verification failed: norm-bound exceeded: B^2=" << (B*B) << " ||z_j||_2^2=" << norm << " j=" << j);
+			return false;
 		}
 		return true;
 	}
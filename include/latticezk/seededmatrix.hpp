@@ -0,0 +1,412 @@
+#ifndef __LATTICEZK_SEEDEDMATRIX_HPP_
+#define __LATTICEZK_SEEDEDMATRIX_HPP_
+
+// Uniform matrices represented by a 16-byte seed, such as the public matrix A of the protocol
+//   - entry (i, j) of an r-by-c seeded matrix is word i*c + j of the AES-128 CTR stream keyed by the seed, as
+//     an AES_Random reseeded by it generates, so it equals the RMO matrix sampled by UIntSampler from that stream
+//   - any run of entries is generated on its own, by encrypting only the counter blocks holding it
+//   - as a left operand of the blocked engine (see gemm/gemm.hpp) the panels are regenerated as they are
+//     packed, in parallel over the panels, so the matrix is never stored, copied or streamed from memory
+//   - copying, hashing and syncing it only touch the seed
+// The cost is the AES work of regenerating A once per block of the columns of the right operand
+//
+// Bit matrices represented by a seed, such as the challenge C, derived from the Fiat-Shamir seed
+//   - column j of an l-by-n seeded bit matrix is bits [j*l, (j+1)*l) of the stream keyed by the seed, bit b being
+//     bit b%64 of word b/64, so it equals the CMO bit matrix sampled by BitSampler from that stream
+//   - checking products regenerates a block of its columns at a time, right before multiplying by them, and so
+//     does multiplying it by bit matrices, such as the test vectors of the verifier
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/log.hpp"
+#include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/gemm/gemm.hpp"
+#include "latticezk/util/aes_rnd.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/util/tuning.hpp"
+
+// AES blocks encrypted at-a-time while generating entries, as many as AES_Random buffers
+#define LATTICEZK_SEEDED_BLOCKS 32
+
+namespace LatticeZK {
+
+template<typename T>
+class SeededMatrix
+{
+	static_assert(std::is_integral<T>::value && 16 % sizeof(T) == 0, "seeding non-integers");
+public:
+	typedef T data_t;
+	// Entries per AES block
+	LATTICEZK_CLASS_STATIC_CONSTEXPR int64_t EPB = 16 / sizeof(T);
+private:
+	matdim_t n_rows, n_cols;
+	uint8_t seed[16];
+	aes_round_keys_t rk;
+	aes_ctr_t aes_ctr;
+public:
+	SeededMatrix(matdim_t n_rows, matdim_t n_cols, const uint8_t seed[16]) :
+		n_rows(n_rows), n_cols(n_cols), aes_ctr(SelectAesCtr())
+	{
+		Reseed(seed);
+	}
+	// A matrix of the zero seed, to be reseeded, constructed like a Matrix for use in its place; it has no
+	// storage, so the allocator is not used
+	SeededMatrix(matdim_t n_rows, matdim_t n_cols, MatrixInit init = MatrixInit::Zero, MatrixAllocator & allocator = MatrixAllocator::Default()) :
+		n_rows(n_rows), n_cols(n_cols), aes_ctr(SelectAesCtr())
+	{
+		LATTICEZK_UNUSED(init);
+		LATTICEZK_UNUSED(allocator);
+		const uint8_t zero[16] = {};
+		Reseed(zero);
+	}
+public:
+	inline matdim_t NumRows() const
+	{
+		return n_rows;
+	}
+	inline matdim_t NumCols() const
+	{
+		return n_cols;
+	}
+	inline matdim_t NumCells() const
+	{
+		return n_rows * n_cols;
+	}
+	inline const uint8_t * Seed() const
+	{
+		return seed;
+	}
+	void Reseed(const uint8_t seed[16])
+	{
+		memcpy(this->seed, seed, sizeof(this->seed));
+		AesExpandKey(this->seed, rk);
+	}
+public:
+	// Generates n entries of row i from column j0 on, which may run into the rows after it, into out
+	template<typename U>
+	void Generate(matdim_t i, matdim_t j0, matdim_t n, U * out) const
+	{
+		LATTICEZK_ALIGN_DECLARATION(64, T buf[LATTICEZK_SEEDED_BLOCKS * EPB]);
+		const int64_t e0 = (int64_t)i * n_cols + j0;
+		int64_t block = e0 / EPB, skip = e0 % EPB;
+		while (n > 0) {
+			const int64_t nblocks = std::min<int64_t>(LATTICEZK_SEEDED_BLOCKS, (skip + n + EPB - 1) / EPB);
+			// block b of the stream is the encryption of counter b+1
+			uint64_t ctr[2] = { (uint64_t)block, 0 };
+			aes_ctr(rk, ctr, (uint8_t *)buf, (size_t)nblocks);
+			const matdim_t n1 = (matdim_t)std::min<int64_t>(n, nblocks * EPB - skip);
+			for (matdim_t k = 0; k < n1; k++) {
+				out[k] = (U)buf[skip + k];
+			}
+			out += n1;
+			n -= n1;
+			block += nblocks;
+			skip = 0;
+		}
+	}
+	inline T operator()(matdim_t i, matdim_t j) const
+	{
+		T x;
+		Generate(i, j, 1, &x);
+		return x;
+	}
+	// Materializes the matrix into an RMO matrix, in parallel
+	bool ToMatrix(Matrix<T, RowMajorOrder> & a) const
+	{
+		if (a.NumRows() != n_rows || a.NumCols() != n_cols) {
+			return false;
+		}
+		T * data = a.Data();
+		const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / std::max<matdim_t>(1, n_cols));
+		Executor::Current().ParallelFor(0, n_rows, grain, [&](int64_t i0, int64_t i1) {
+			for (int64_t i = i0; i < i1; i++) {
+				Generate((matdim_t)i, 0, n_cols, data + i * n_cols);
+			}
+		});
+		return true;
+	}
+};
+
+// A bit matrix whose columns are generated from a seed, packed as those of a BitMatrix
+class SeededBitMatrix
+{
+public:
+	typedef uint64_t word_t;
+private:
+	matdim_t n_rows, n_cols, n_words;
+	// the words of the stream, as a row
+	SeededMatrix<uint64_t> stream;
+public:
+	SeededBitMatrix(matdim_t n_rows, matdim_t n_cols, const uint8_t seed[16]) :
+		n_rows(n_rows), n_cols(n_cols), n_words((n_rows + 63) / 64), stream(1, (matdim_t)(((int64_t)n_rows * n_cols + 63) / 64), seed)
+	{
+	}
+public:
+	inline matdim_t NumRows() const
+	{
+		return n_rows;
+	}
+	inline matdim_t NumCols() const
+	{
+		return n_cols;
+	}
+	// Number of words per column
+	inline matdim_t ColumnWords() const
+	{
+		return n_words;
+	}
+	inline const uint8_t * Seed() const
+	{
+		return stream.Seed();
+	}
+public:
+	// Generates columns [j0, j0+n) into out, a column every ColumnWords() words, with zero padding bits
+	void Generate(matdim_t j0, matdim_t n, word_t * out) const
+	{
+		if (n <= 0 || n_words == 0) {
+			return;
+		}
+		// the columns are a run of the stream, read past its end as zero
+		const int64_t b0 = (int64_t)j0 * n_rows, b1 = (int64_t)(j0 + n) * n_rows;
+		const int64_t w0 = b0 / 64, nw = (b1 + 63) / 64 - w0;
+		std::vector<word_t> words((size_t)nw + 1, 0);
+		stream.Generate(0, (matdim_t)w0, (matdim_t)nw, words.data());
+		const int tail = n_rows & 63;
+		for (matdim_t j = 0; j < n; j++) {
+			const int64_t b = (int64_t)(j0 + j) * n_rows - w0 * 64;
+			const word_t * src = words.data() + b / 64;
+			const int sh = (int)(b & 63);
+			word_t * dst = out + (size_t)j * n_words;
+			for (matdim_t q = 0; q < n_words; q++) {
+				dst[q] = sh == 0 ? src[q] : (src[q] >> sh) | (src[q + 1] << (64 - sh));
+			}
+			if (tail != 0) {
+				dst[n_words - 1] &= ((word_t)1 << tail) - 1;
+			}
+		}
+	}
+	// Materializes the matrix into a bit matrix, in parallel
+	bool ToBitMatrix(BitMatrix & c) const
+	{
+		if (c.NumRows() != n_rows || c.NumCols() != n_cols) {
+			return false;
+		}
+		const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / std::max<matdim_t>(1, n_words));
+		Executor::Current().ParallelFor(0, n_cols, grain, [&](int64_t j0, int64_t j1) {
+			Generate((matdim_t)j0, (matdim_t)(j1 - j0), c.Column((matdim_t)j0));
+		});
+		return true;
+	}
+};
+
+// Reads a seeded bit matrix a block of columns at a time, as MatrixCheckProductsOf in bitmatrix.hpp does, generating
+// each block into a buffer reused for the next
+class SeededBitColumns
+{
+private:
+	const SeededBitMatrix & c;
+	std::vector<uint64_t> block;
+public:
+	SeededBitColumns(const SeededBitMatrix & c) :
+		c(c)
+	{
+	}
+public:
+	inline matdim_t NumRows() const
+	{
+		return c.NumRows();
+	}
+	inline matdim_t NumCols() const
+	{
+		return c.NumCols();
+	}
+	inline matdim_t ColumnWords() const
+	{
+		return c.ColumnWords();
+	}
+	const uint64_t * Columns(matdim_t j0, matdim_t n)
+	{
+		block.resize((size_t)std::max<matdim_t>(1, n * c.ColumnWords()));
+		c.Generate(j0, n, block.data());
+		return block.data();
+	}
+};
+
+// Computes CX = C*X for a seeded bit matrix C and a bit matrix X, such as test vectors, so that C is never stored:
+// entry (i, t) is the number of ones of row i of C AND column t of X. C is generated a block of columns at a time,
+// each group of 64 columns of which is transposed 64 rows at a time into words of row bits, to be ANDed with the
+// words of X and counted, in parallel over the rows
+template<typename T>
+bool MatrixMultiply(const SeededBitMatrix & c, const BitMatrix & x, Matrix<T, ColumnMajorOrder> & cx)
+{
+	typedef gemm_uint_t<T> U;
+	const matdim_t l = c.NumRows(), n = c.NumCols(), k = x.NumCols(), nw = c.ColumnWords();
+	if (x.NumRows() != n || cx.NumRows() != l || cx.NumCols() != k) {
+		return false;
+	}
+	LATTICEZK_LOG("seeded bit-matrix bits mult size: " << l << " | " << n << " | " << k);
+	cx.Zero();
+	if (l == 0 || n == 0) {
+		return true;
+	}
+	// a block of columns fills half of L2, in whole groups of 64
+	const matdim_t nb = std::min<matdim_t>((n + 63) & ~63,
+		std::max<matdim_t>(64, (matdim_t)(TuningProfile::Current().gemm_l2_bytes / 2 / (nw * sizeof(uint64_t))) & ~63));
+	std::vector<uint64_t> block((size_t)nb * nw);
+	Executor & executor = Executor::Current();
+	for (matdim_t j0 = 0; j0 < n; j0 += nb) {
+		const matdim_t nb1 = std::min(nb, n - j0), ngroups = (nb1 + 63) / 64;
+		executor.ParallelFor(0, ngroups, 1, [&](int64_t g0, int64_t g1) {
+			const matdim_t j1 = (matdim_t)g0 * 64;
+			c.Generate(j0 + j1, std::min(nb1, (matdim_t)g1 * 64) - j1, block.data() + (size_t)j1 * nw);
+		});
+		// X is aligned with the block, whose start is a whole number of words of its columns
+		const matdim_t xw0 = j0 / 64;
+		executor.ParallelFor(0, nw, 1, [&](int64_t q0, int64_t q1) {
+			uint64_t rows[64];
+			for (matdim_t q = (matdim_t)q0; q < q1; q++) {
+				const matdim_t i0 = q * 64, mi = std::min<matdim_t>(64, l - i0);
+				for (matdim_t g = 0; g < ngroups; g++) {
+					const matdim_t ng = std::min<matdim_t>(64, nb1 - g * 64);
+					for (matdim_t j = 0; j < 64; j++) {
+						rows[j] = j < ng ? block[(size_t)(g * 64 + j) * nw + q] : 0;
+					}
+					BitTranspose64(rows);
+					for (matdim_t t = 0; t < k; t++) {
+						const uint64_t xt = x.Column(t)[xw0 + g];
+						T * cxt = cx.Data() + (size_t)t * l + i0;
+						for (matdim_t i = 0; i < mi; i++) {
+							cxt[i] = (T)((U)cxt[i] + (U)BitCount(rows[i] & xt));
+						}
+					}
+				}
+			}
+		});
+	}
+	return true;
+}
+
+// A seeded matrix as an operand of the blocked engine, whose panels are generated as they are packed
+template<typename T>
+class GemmSeededSource
+{
+public:
+	typedef T source_t;
+private:
+	const SeededMatrix<T> & a;
+	matdim_t i0, j0;
+public:
+	GemmSeededSource(const SeededMatrix<T> & a, matdim_t i0 = 0, matdim_t j0 = 0) :
+		a(a), i0(i0), j0(j0)
+	{
+	}
+public:
+	inline T operator()(matdim_t i, matdim_t j) const
+	{
+		return a(i0 + i, j0 + j);
+	}
+	GemmSeededSource Block(matdim_t i1, matdim_t j1) const
+	{
+		return GemmSeededSource(a, i0 + i1, j0 + j1);
+	}
+	// Packs as GemmStridedSource does, generating each row of the panel in turn
+	template<matdim_t KU, typename U>
+	void PackRows(matdim_t i1, matdim_t m, matdim_t MR, matdim_t j1, matdim_t kc, U * dst) const
+	{
+		PackPanel<KU>(i1, j1, m, MR, kc, true, dst);
+	}
+	template<matdim_t KU, typename U>
+	void PackCols(matdim_t j1, matdim_t n, matdim_t NR, matdim_t i1, matdim_t kc, U * dst) const
+	{
+		PackPanel<KU>(i1, j1, n, NR, kc, false, dst);
+	}
+private:
+	// dst[(k/KU)*P*KU + p*KU + k%KU] is entry (p, k) of the panel for p < np, k < kc, and zero beyond them,
+	// where a row panel has p over the rows from i1 and k over the columns from j1, and a column panel the converse
+	template<matdim_t KU, typename U>
+	void PackPanel(matdim_t i1, matdim_t j1, matdim_t np, matdim_t P, matdim_t kc, bool rows, U * dst) const
+	{
+		LATTICEZK_ALIGN_DECLARATION(64, U buf[LATTICEZK_SEEDED_BLOCKS * SeededMatrix<T>::EPB]);
+		const matdim_t kcp = ((kc + KU - 1) / KU) * KU;
+		if (np < P || kcp > kc) {
+			memset(dst, 0, (size_t)P * kcp * sizeof(U));
+		}
+		if (rows) {
+			// each row of the panel is a run of the stream, generated a buffer at a time
+			const matdim_t nb = LATTICEZK_SEEDED_BLOCKS * SeededMatrix<T>::EPB;
+			for (matdim_t p = 0; p < np; p++) {
+				for (matdim_t k0 = 0; k0 < kc; k0 += nb) {
+					const matdim_t nk = std::min(nb, kc - k0);
+					a.Generate(i0 + i1 + p, j0 + j1 + k0, nk, buf);
+					for (matdim_t k = k0; k < k0 + nk; k++) {
+						dst[(k / KU) * P * KU + p * KU + k % KU] = buf[k - k0];
+					}
+				}
+			}
+		} else {
+			// each row of a column panel is a run of np <= NR entries
+			for (matdim_t k = 0; k < kc; k++) {
+				a.Generate(i0 + i1 + k, j0 + j1, np, buf);
+				for (matdim_t p = 0; p < np; p++) {
+					dst[(k / KU) * P * KU + p * KU + k % KU] = buf[p];
+				}
+			}
+		}
+	}
+};
+
+// Multiplication of a seeded matrix by a matrix of any strides, as MatrixMultiply of views in matrix.hpp
+// The blocked engine is used directly, as Strassen-Winograd levels would add blocks of A, which is regenerated
+template<typename B, typename T>
+bool MatrixMultiply(const SeededMatrix<T> & a, MatrixView<B> b, MatrixView<T> c)
+{
+	typedef typename std::remove_const<B>::type S;
+	if (a.NumRows() != c.NumRows() || b.NumCols() != c.NumCols() || a.NumCols() != b.NumRows()) {
+		return false;
+	}
+	LATTICEZK_LOG("seeded matrix mult size: " << a.NumRows() << " | " << a.NumCols() << " | " << b.NumCols());
+	GemmSeededSource<T> asrc(a);
+	GemmStridedSource<S> bsrc(b.Data(), b.RowStride(), b.ColStride());
+	return Gemm<T>(c.NumRows(), c.NumCols(), a.NumCols(), asrc, bsrc, c.Data(), c.RowStride(), c.ColStride());
+}
+
+template<typename T, typename S, typename OrderB, typename OrderC>
+bool MatrixMultiply(const SeededMatrix<T> & a, const Matrix<S, OrderB> & b, Matrix<T, OrderC> & c)
+{
+	return MatrixMultiply(a, b.View(), c.View());
+}
+
+// Checks A*Z = T*C + W for a seeded A, as MatrixCheckProducts in bitmatrix.hpp
+template<typename T>
+bool MatrixCheckProducts(const SeededMatrix<T> & a, const Matrix<T, ColumnMajorOrder> & z, const Matrix<T, RowMajorOrder> & t,
+	const BitMatrix & c, const Matrix<T, ColumnMajorOrder> & w, bool & equal)
+{
+	return MatrixCheckProductsOf(GemmSeededSource<T>(a), a.NumRows(), a.NumCols(), z, t, c, w, equal);
+}
+
+// Checks A*Z = T*C + W for a seeded C, which is generated a block of columns at a time and never stored in full
+template<typename T>
+bool MatrixCheckProducts(const Matrix<T, RowMajorOrder> & a, const Matrix<T, ColumnMajorOrder> & z, const Matrix<T, RowMajorOrder> & t,
+	const SeededBitMatrix & c, const Matrix<T, ColumnMajorOrder> & w, bool & equal)
+{
+	SeededBitColumns cols(c);
+	return MatrixCheckProductsOf(GemmStridedSource<T>(a.Data(), a.NumCols(), 1), a.NumRows(), a.NumCols(), z, t, cols, w, equal);
+}
+
+// Checks A*Z = T*C + W for a seeded A and a seeded C
+template<typename T>
+bool MatrixCheckProducts(const SeededMatrix<T> & a, const Matrix<T, ColumnMajorOrder> & z, const Matrix<T, RowMajorOrder> & t,
+	const SeededBitMatrix & c, const Matrix<T, ColumnMajorOrder> & w, bool & equal)
+{
+	SeededBitColumns cols(c);
+	return MatrixCheckProductsOf(GemmSeededSource<T>(a), a.NumRows(), a.NumCols(), z, t, cols, w, equal);
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_SEEDEDMATRIX_HPP_
@@ -4,43 +4,286 @@
 #ifndef __LATTICEZK_UTIL_AES_RND_H_
 #define __LATTICEZK_UTIL_AES_RND_H_
 
+// AES-128 in CTR-mode as a random generator
+//
+// Blocks are encrypted in bulk into a buffer, by the fastest implementation the CPU supports, selected at
+// run-time (see cpu.hpp):
+//   - VAES on 4 blocks per 512-bit register, for the AVX-512 levels
+//   - VAES on 2 blocks per 256-bit register, for the AVX2 level
+//   - AES-NI on 1 block per 128-bit register
+//   - portable code, for CPUs without AES-NI. It uses table lookups, so it is not constant-time
+// All of them produce the same stream
+
 #ifndef _WIN32
 	#include <unistd.h>
 	#include <fcntl.h>
 #endif
 #include <stdlib.h>     //for rand_r, rand_s (WIN32)
 #include <stdint.h>     //for int8_t
-#include <wmmintrin.h>  //for intrinsics for AES-NI
+#include <string.h>
+#include <immintrin.h>  //for intrinsics for AES-NI and VAES
+#include "latticezk/common.hpp"
+#include "latticezk/util/cpu.hpp"
+
+#if LATTICEZK_MULTIVERSION || defined(_MSC_VER) || defined(__AES__)
+	#define LATTICEZK_AES_NI 1
+#endif
+#if LATTICEZK_MULTIVERSION || (defined(__VAES__) && defined(__AVX2__))
+	#define LATTICEZK_AES_VAES256 1
+#endif
+#if LATTICEZK_MULTIVERSION || (defined(__VAES__) && defined(__AVX512F__))
+	#define LATTICEZK_AES_VAES512 1
+#endif
 
 namespace LatticeZK
 {
 
+// Round keys of AES-128
+typedef uint8_t aes_round_keys_t[11][16];
+
+// Encrypts the counter blocks ctr+1, ..., ctr+nblocks into out and advances the counter by nblocks
+// The counter is 128-bit little-endian, with its low half in ctr[0]
+typedef void (*aes_ctr_t)(const aes_round_keys_t & rk, uint64_t ctr[2], uint8_t * out, size_t nblocks);
+
+static const uint8_t aes_sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+// Multiplication by x in GF(2^8)
+inline uint8_t aes_xtime(uint8_t a)
+{
+	return (uint8_t)((a << 1) ^ ((a >> 7) * 0x1b));
+}
+
+inline void AesExpandKey(const uint8_t key[16], aes_round_keys_t & rk)
+{
+	uint8_t rcon = 1;
+	memcpy(rk[0], key, 16);
+	for (int r = 1; r <= 10; r++) {
+		const uint8_t * p = rk[r - 1];
+		uint8_t * q = rk[r];
+		q[0] = p[0] ^ aes_sbox[p[13]] ^ rcon;
+		q[1] = p[1] ^ aes_sbox[p[14]];
+		q[2] = p[2] ^ aes_sbox[p[15]];
+		q[3] = p[3] ^ aes_sbox[p[12]];
+		for (int i = 4; i < 16; i++) {
+			q[i] = p[i] ^ q[i - 4];
+		}
+		rcon = aes_xtime(rcon);
+	}
+}
+
+// Increments the counter and stores it as a block
+inline void aes_ctr_next(uint64_t ctr[2], uint64_t blk[2])
+{
+	blk[0] = ++ctr[0];
+	blk[1] = ctr[1] += !ctr[0];
+}
+
+inline void AesCtrPortable(const aes_round_keys_t & rk, uint64_t ctr[2], uint8_t * out, size_t nblocks)
+{
+	for (size_t b = 0; b < nblocks; b++, out += 16) {
+		uint64_t blk[2];
+		uint8_t s[16], t[16];
+		aes_ctr_next(ctr, blk);
+		memcpy(s, blk, 16);
+		for (int i = 0; i < 16; i++) {
+			s[i] ^= rk[0][i];
+		}
+		for (int r = 1; r <= 10; r++) {
+			// SubBytes and ShiftRows, where byte i is in row i%4 and column i/4
+			for (int i = 0; i < 16; i++) {
+				t[i] = aes_sbox[s[(i + 4 * (i & 3)) & 15]];
+			}
+			if (r < 10) {
+				// MixColumns
+				for (int c = 0; c < 16; c += 4) {
+					uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3], x = a0 ^ a1 ^ a2 ^ a3;
+					t[c] ^= x ^ aes_xtime(a0 ^ a1);
+					t[c + 1] ^= x ^ aes_xtime(a1 ^ a2);
+					t[c + 2] ^= x ^ aes_xtime(a2 ^ a3);
+					t[c + 3] ^= x ^ aes_xtime(a3 ^ a0);
+				}
+			}
+			for (int i = 0; i < 16; i++) {
+				s[i] = t[i] ^ rk[r][i];
+			}
+		}
+		memcpy(out, s, 16);
+	}
+}
+
+#ifdef LATTICEZK_AES_NI
+// 8 blocks are encrypted at-a-time to hide the latency of the AES instructions
+LATTICEZK_TARGET("aes")
+inline void AesCtrNi(const aes_round_keys_t & rk, uint64_t ctr[2], uint8_t * out, size_t nblocks)
+{
+	constexpr int W = 8;
+	__m128i k[11];
+	for (int r = 0; r <= 10; r++) {
+		k[r] = _mm_loadu_si128((const __m128i *)rk[r]);
+	}
+	LATTICEZK_ALIGN_DECLARATION(16, uint64_t blk[2 * W]);
+	size_t b = 0;
+	for (; b + W <= nblocks; b += W, out += 16 * W) {
+		__m128i m[W];
+		LATTICEZK_UNROLL
+		for (int j = 0; j < W; j++) {
+			aes_ctr_next(ctr, blk + 2 * j);
+			m[j] = _mm_xor_si128(_mm_load_si128((const __m128i *)(blk + 2 * j)), k[0]);
+		}
+		for (int r = 1; r < 10; r++) {
+			LATTICEZK_UNROLL
+			for (int j = 0; j < W; j++) {
+				m[j] = _mm_aesenc_si128(m[j], k[r]);
+			}
+		}
+		LATTICEZK_UNROLL
+		for (int j = 0; j < W; j++) {
+			_mm_storeu_si128((__m128i *)(out + 16 * j), _mm_aesenclast_si128(m[j], k[10]));
+		}
+	}
+	for (; b < nblocks; b++, out += 16) {
+		aes_ctr_next(ctr, blk);
+		__m128i m = _mm_xor_si128(_mm_load_si128((const __m128i *)blk), k[0]);
+		for (int r = 1; r < 10; r++) {
+			m = _mm_aesenc_si128(m, k[r]);
+		}
+		_mm_storeu_si128((__m128i *)out, _mm_aesenclast_si128(m, k[10]));
+	}
+}
+#endif
+
+#ifdef LATTICEZK_AES_VAES256
+// 4 registers of 2 blocks each are encrypted at-a-time, and remaining blocks by AES-NI
+LATTICEZK_TARGET("avx2,aes,vaes")
+inline void AesCtrVaes256(const aes_round_keys_t & rk, uint64_t ctr[2], uint8_t * out, size_t nblocks)
+{
+	constexpr int W = 4, L = 2;
+	__m256i k[11];
+	for (int r = 0; r <= 10; r++) {
+		k[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)rk[r]));
+	}
+	LATTICEZK_ALIGN_DECLARATION(32, uint64_t blk[2 * L * W]);
+	size_t b = 0;
+	for (; b + L * W <= nblocks; b += L * W, out += 16 * L * W) {
+		__m256i m[W];
+		LATTICEZK_UNROLL
+		for (int j = 0; j < W; j++) {
+			aes_ctr_next(ctr, blk + 2 * L * j);
+			aes_ctr_next(ctr, blk + 2 * L * j + 2);
+			m[j] = _mm256_xor_si256(_mm256_load_si256((const __m256i *)(blk + 2 * L * j)), k[0]);
+		}
+		for (int r = 1; r < 10; r++) {
+			LATTICEZK_UNROLL
+			for (int j = 0; j < W; j++) {
+				m[j] = _mm256_aesenc_epi128(m[j], k[r]);
+			}
+		}
+		LATTICEZK_UNROLL
+		for (int j = 0; j < W; j++) {
+			_mm256_storeu_si256((__m256i *)(out + 16 * L * j), _mm256_aesenclast_epi128(m[j], k[10]));
+		}
+	}
+	AesCtrNi(rk, ctr, out, nblocks - b);
+}
+#endif
+
+#ifdef LATTICEZK_AES_VAES512
+// 4 registers of 4 blocks each are encrypted at-a-time, and remaining blocks by AES-NI
+LATTICEZK_TARGET("avx512f,aes,vaes")
+inline void AesCtrVaes512(const aes_round_keys_t & rk, uint64_t ctr[2], uint8_t * out, size_t nblocks)
+{
+	constexpr int W = 4, L = 4;
+	__m512i k[11];
+	for (int r = 0; r <= 10; r++) {
+		k[r] = _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128((const __m128i *)rk[r]));
+	}
+	LATTICEZK_ALIGN_DECLARATION(64, uint64_t blk[2 * L * W]);
+	size_t b = 0;
+	for (; b + L * W <= nblocks; b += L * W, out += 16 * L * W) {
+		__m512i m[W];
+		LATTICEZK_UNROLL
+		for (int j = 0; j < W; j++) {
+			for (int l = 0; l < L; l++) {
+				aes_ctr_next(ctr, blk + 2 * (L * j + l));
+			}
+			m[j] = _mm512_xor_si512(_mm512_load_si512(blk + 2 * L * j), k[0]);
+		}
+		for (int r = 1; r < 10; r++) {
+			LATTICEZK_UNROLL
+			for (int j = 0; j < W; j++) {
+				m[j] = _mm512_aesenc_epi128(m[j], k[r]);
+			}
+		}
+		LATTICEZK_UNROLL
+		for (int j = 0; j < W; j++) {
+			_mm512_storeu_si512(out + 16 * L * j, _mm512_aesenclast_epi128(m[j], k[10]));
+		}
+	}
+	AesCtrNi(rk, ctr, out, nblocks - b);
+}
+#endif
+
+// The fastest implementation of AES in CTR-mode supported by the CPU and within the selected ISA level
+inline aes_ctr_t SelectAesCtr()
+{
+	const CpuFeatures & cpu = CpuFeatures::Get();
+	CpuIsa isa = GetCpuIsa();
+	LATTICEZK_UNUSED(isa);
+#ifdef LATTICEZK_AES_VAES512
+	if (cpu.aes && cpu.vaes && isa >= CpuIsa::Avx512) {
+		return &AesCtrVaes512;
+	}
+#endif
+#ifdef LATTICEZK_AES_VAES256
+	if (cpu.aes && cpu.vaes && isa >= CpuIsa::Avx2) {
+		return &AesCtrVaes256;
+	}
+#endif
+#ifdef LATTICEZK_AES_NI
+	if (cpu.aes) {
+		return &AesCtrNi;
+	}
+#endif
+	return &AesCtrPortable;
+}
+
 class AES_Random
 {
 private:
 	static constexpr int aes_buf_size = 512;
 private:
-	uint8_t aes_buf[aes_buf_size];
+	LATTICEZK_ALIGN_DECLARATION(64, uint8_t aes_buf[aes_buf_size]);
 	int32_t aes_buf_pointer;
-#ifdef _WIN32
-	int64_t ctr[2] = {0};
-#else
-	__extension__ __int128 ctr = 0;
-#endif
-	__m128i key_schedule[20] = {0};
+	uint64_t ctr[2] = {0};
+	aes_round_keys_t key_schedule = {{0}};
+	aes_ctr_t aes_ctr;
 public:
-	AES_Random()
+	AES_Random() :
+		aes_buf_pointer(aes_buf_size), aes_ctr(SelectAesCtr())
 	{
 	}
 public:
 	bool reseed(uint8_t seed[16])
 	{
 		load_key(seed);
-#ifdef _WIN32
 		ctr[0] = ctr[1] = 0;
-#else
-		ctr ^= ctr;
-#endif
 		aes_buf_pointer = aes_buf_size;
 		return true;
 	}
@@ -75,111 +318,34 @@ public:
 #endif
 		return reseed(seed);
 	}
+public:
+	inline void load_key(uint8_t *enc_key)
+	{
+		AesExpandKey(enc_key, key_schedule);
+	}
 private:
-	inline __m128i key_expansion(__m128i key, __m128i keygened) {
-	    keygened = _mm_shuffle_epi32(keygened, _MM_SHUFFLE(3,3,3,3));
-	    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
-	    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
-	    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
-	    return _mm_xor_si128(key, keygened);
-	}
-public:	
-
-#define AES_128_key_exp(k, rcon) key_expansion(k, _mm_aeskeygenassist_si128(k, rcon))
-
-	inline void load_key_enc_only(uint8_t *enc_key){
-	    key_schedule[0] = _mm_loadu_si128((const __m128i*) enc_key);
-	    key_schedule[1]  = AES_128_key_exp(key_schedule[0], 0x01);
-	    key_schedule[2]  = AES_128_key_exp(key_schedule[1], 0x02);
-	    key_schedule[3]  = AES_128_key_exp(key_schedule[2], 0x04);
-	    key_schedule[4]  = AES_128_key_exp(key_schedule[3], 0x08);
-	    key_schedule[5]  = AES_128_key_exp(key_schedule[4], 0x10);
-	    key_schedule[6]  = AES_128_key_exp(key_schedule[5], 0x20);
-	    key_schedule[7]  = AES_128_key_exp(key_schedule[6], 0x40);
-	    key_schedule[8]  = AES_128_key_exp(key_schedule[7], 0x80);
-	    key_schedule[9]  = AES_128_key_exp(key_schedule[8], 0x1B);
-	    key_schedule[10] = AES_128_key_exp(key_schedule[9], 0x36);
-	}
-
-#undef AES_128_key_exp
-	
-	inline void load_key(uint8_t *enc_key){
-	    load_key_enc_only(enc_key);
-	
-	    // generate decryption keys in reverse order.
-	    // k[10] is shared by last encryption and first decryption rounds
-	    // k[0] is shared by first encryption round and last decryption round (and is the original user key)
-	    // For some implementation reasons, decryption key schedule is NOT the encryption key schedule in reverse order
-	    key_schedule[11] = _mm_aesimc_si128(key_schedule[9]);
-	    key_schedule[12] = _mm_aesimc_si128(key_schedule[8]);
-	    key_schedule[13] = _mm_aesimc_si128(key_schedule[7]);
-	    key_schedule[14] = _mm_aesimc_si128(key_schedule[6]);
-	    key_schedule[15] = _mm_aesimc_si128(key_schedule[5]);
-	    key_schedule[16] = _mm_aesimc_si128(key_schedule[4]);
-	    key_schedule[17] = _mm_aesimc_si128(key_schedule[3]);
-	    key_schedule[18] = _mm_aesimc_si128(key_schedule[2]);
-	    key_schedule[19] = _mm_aesimc_si128(key_schedule[1]);
-	}
-
-#define AES_128_ENC_BLOCK(m,k) \
-    do{\
-	m = _mm_xor_si128       (m, k[ 0]); \
-	m = _mm_aesenc_si128    (m, k[ 1]); \
-	m = _mm_aesenc_si128    (m, k[ 2]); \
-	m = _mm_aesenc_si128    (m, k[ 3]); \
-	m = _mm_aesenc_si128    (m, k[ 4]); \
-	m = _mm_aesenc_si128    (m, k[ 5]); \
-	m = _mm_aesenc_si128    (m, k[ 6]); \
-	m = _mm_aesenc_si128    (m, k[ 7]); \
-	m = _mm_aesenc_si128    (m, k[ 8]); \
-	m = _mm_aesenc_si128    (m, k[ 9]); \
-	m = _mm_aesenclast_si128(m, k[10]);\
-    }while(0)
-
-	inline void enc(uint8_t *plainText,uint8_t *cipherText){
-	    __m128i m = _mm_loadu_si128((__m128i *) plainText);
-	
-	    AES_128_ENC_BLOCK(m,key_schedule);
-	
-	    _mm_storeu_si128((__m128i *) cipherText, m);
-	}
-
-#undef AES_128_ENC_BLOCK
-
-#define AES_128_DEC_BLOCK(m,k) \
-    do{\
-	m = _mm_xor_si128       (m, k[10+0]); \
-	m = _mm_aesdec_si128    (m, k[10+1]); \
-	m = _mm_aesdec_si128    (m, k[10+2]); \
-	m = _mm_aesdec_si128    (m, k[10+3]); \
-	m = _mm_aesdec_si128    (m, k[10+4]); \
-	m = _mm_aesdec_si128    (m, k[10+5]); \
-	m = _mm_aesdec_si128    (m, k[10+6]); \
-	m = _mm_aesdec_si128    (m, k[10+7]); \
-	m = _mm_aesdec_si128    (m, k[10+8]); \
-	m = _mm_aesdec_si128    (m, k[10+9]); \
-	m = _mm_aesdeclast_si128(m, k[0]);\
-    }while(0)
-
-	inline void dec(uint8_t *cipherText,uint8_t *plainText){
-	    __m128i m = _mm_loadu_si128((__m128i *) cipherText);
-	
-	    AES_128_DEC_BLOCK(m,key_schedule);
-	
-	    _mm_storeu_si128((__m128i *) plainText, m);
-	}
-
-#undef AES_128_DEC_BLOCK
-	
-	inline void random_bytes(uint8_t *data) {
-#ifdef _WIN32
-	    ++ctr[0];
-	    ctr[1] += !ctr[0];
-	    enc((uint8_t *)ctr, data);
-#else
-	    ++ctr;
-	    enc((uint8_t *)&ctr, data);
-#endif
+	inline void fill()
+	{
+		aes_ctr(key_schedule, ctr, aes_buf, aes_buf_size / 16);
+		aes_buf_pointer = 0;
+	}
+public:
+	// Generates the next 16 bytes of the stream
+	inline void random_bytes(uint8_t *data)
+	{
+		if (aes_buf_pointer == aes_buf_size) {
+			fill();
+		}
+		memcpy(data, aes_buf + aes_buf_pointer, 16);
+		aes_buf_pointer += 16;
+	}
+	// Generates the next 16*nblocks bytes of the stream, like as many calls to random_bytes
+	inline void random_blocks(uint8_t *data, size_t nblocks)
+	{
+		for (; nblocks > 0 && aes_buf_pointer < aes_buf_size; nblocks--, data += 16) {
+			random_bytes(data);
+		}
+		aes_ctr(key_schedule, ctr, data, nblocks);
 	}
 };
 
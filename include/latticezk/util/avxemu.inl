@@ -0,0 +1,169 @@
+// Portable emulation of the AVX2 types and functions used by the Facct sampler, for builds without AVX2
+// (see util/multiversion.inl). This is the host counterpart of cuda/cuavx.cuh
+//
+// The emulation matches the AVX2 functions bit-for-bit, including the fused multiply-add, so that the
+// emulated builds produce the same results as the AVX2 ones. It expects <math.h> to be included before
+//
+// GCC defines _mm256_floor_pd as a macro, which is pushed and undefined here, so the includer must restore
+// it with #pragma pop_macro("_mm256_floor_pd") after its last use of the emulation
+
+#pragma push_macro("_mm256_floor_pd")
+#undef _mm256_floor_pd
+
+#ifndef __LATTICEZK_UTIL_AVXEMU_INL_
+#define __LATTICEZK_UTIL_AVXEMU_INL_
+
+#define LATTICEZK_EMU_UVFUNC(fname, vtype, vfield, op) \
+	inline vtype fname(vtype a) \
+	{ \
+		vtype c; \
+		for (int i = 0; i < 4; i++) { \
+			c.vfield[i] = op(a.vfield[i]); \
+		} \
+		return c; \
+	}
+#define LATTICEZK_EMU_BVFUNC(fname, vtype, vfield, op) \
+	inline vtype fname(vtype a, vtype b) \
+	{ \
+		vtype c; \
+		for (int i = 0; i < 4; i++) { \
+			c.vfield[i] = a.vfield[i] op b.vfield[i]; \
+		} \
+		return c; \
+	}
+#define LATTICEZK_EMU_UCFUNC(fname, vtype, vfield, op, ctype) \
+	inline vtype fname(vtype a, ctype b) \
+	{ \
+		vtype c; \
+		for (int i = 0; i < 4; i++) { \
+			c.vfield[i] = b < 64 ? a.vfield[i] op b : 0; \
+		} \
+		return c; \
+	}
+
+struct alignas(32) __m256d {
+	double m256d_f64[4];
+};
+
+union alignas(32) __m256i {
+	int64_t init_i64[4]; // first member, for brace-initialization
+	int64_t m256i_i64[4];
+	uint64_t m256i_u64[4];
+	uint8_t m256i_u8[32];
+};
+
+// Bit-casts between double and 64-bit integer lanes
+union avxemu_lane_t {
+	double f64;
+	uint64_t u64;
+};
+
+inline __m256i _mm256_castpd_si256(__m256d a)
+{
+	__m256i c;
+	for (int i = 0; i < 4; i++) {
+		avxemu_lane_t l;
+		l.f64 = a.m256d_f64[i];
+		c.m256i_u64[i] = l.u64;
+	}
+	return c;
+}
+
+inline __m256d _mm256_castsi256_pd(__m256i a)
+{
+	__m256d c;
+	for (int i = 0; i < 4; i++) {
+		avxemu_lane_t l;
+		l.u64 = a.m256i_u64[i];
+		c.m256d_f64[i] = l.f64;
+	}
+	return c;
+}
+
+inline __m256i _mm256_loadu_si256(const __m256i * m)
+{
+	__m256i c;
+	const uint8_t * p = (const uint8_t *)m;
+	for (int i = 0; i < 32; i++) {
+		c.m256i_u8[i] = p[i];
+	}
+	return c;
+}
+
+inline __m256i _mm256_load_si256(const __m256i * m)
+{
+	return _mm256_loadu_si256(m);
+}
+
+inline void _mm256_store_si256(__m256i * m, __m256i a)
+{
+	uint8_t * p = (uint8_t *)m;
+	for (int i = 0; i < 32; i++) {
+		p[i] = a.m256i_u8[i];
+	}
+}
+
+inline __m256i _mm256_setzero_si256()
+{
+	__m256i c = { { 0, 0, 0, 0 } };
+	return c;
+}
+
+inline __m256i _mm256_set_epi64x(int64_t e3, int64_t e2, int64_t e1, int64_t e0)
+{
+	__m256i c = { { e0, e1, e2, e3 } };
+	return c;
+}
+
+inline __m256i _mm256_cmpeq_epi64(__m256i a, __m256i b)
+{
+	__m256i c;
+	for (int i = 0; i < 4; i++) {
+		c.m256i_u64[i] = a.m256i_u64[i] == b.m256i_u64[i] ? ~(uint64_t)0 : 0;
+	}
+	return c;
+}
+
+inline __m256i _mm256_mul_epu32(__m256i a, __m256i b)
+{
+	__m256i c;
+	for (int i = 0; i < 4; i++) {
+		c.m256i_u64[i] = (a.m256i_u64[i] & 0xffffffff) * (b.m256i_u64[i] & 0xffffffff);
+	}
+	return c;
+}
+
+inline __m256i _mm256_sllv_epi64(__m256i a, __m256i b)
+{
+	__m256i c;
+	for (int i = 0; i < 4; i++) {
+		c.m256i_u64[i] = b.m256i_u64[i] < 64 ? a.m256i_u64[i] << b.m256i_u64[i] : 0;
+	}
+	return c;
+}
+
+inline __m256d _mm256_fmadd_pd(__m256d a, __m256d b, __m256d c)
+{
+	__m256d d;
+	for (int i = 0; i < 4; i++) {
+		d.m256d_f64[i] = fma(a.m256d_f64[i], b.m256d_f64[i], c.m256d_f64[i]);
+	}
+	return d;
+}
+
+LATTICEZK_EMU_BVFUNC(_mm256_add_epi64, __m256i, m256i_u64, +)
+LATTICEZK_EMU_BVFUNC(_mm256_sub_epi64, __m256i, m256i_u64, -)
+LATTICEZK_EMU_BVFUNC(_mm256_and_si256, __m256i, m256i_u64, &)
+LATTICEZK_EMU_BVFUNC(_mm256_or_si256, __m256i, m256i_u64, |)
+LATTICEZK_EMU_UCFUNC(_mm256_slli_epi64, __m256i, m256i_u64, <<, unsigned)
+LATTICEZK_EMU_UCFUNC(_mm256_srli_epi64, __m256i, m256i_u64, >>, unsigned)
+LATTICEZK_EMU_BVFUNC(_mm256_add_pd, __m256d, m256d_f64, +)
+LATTICEZK_EMU_BVFUNC(_mm256_sub_pd, __m256d, m256d_f64, -)
+LATTICEZK_EMU_BVFUNC(_mm256_mul_pd, __m256d, m256d_f64, *)
+LATTICEZK_EMU_UVFUNC(_mm256_floor_pd, __m256d, m256d_f64, floor)
+
+#undef LATTICEZK_EMU_UVFUNC
+#undef LATTICEZK_EMU_BVFUNC
+#undef LATTICEZK_EMU_UCFUNC
+
+#endif // __LATTICEZK_UTIL_AVXEMU_INL_
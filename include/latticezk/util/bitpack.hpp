@@ -0,0 +1,264 @@
+#ifndef __LATTICEZK_UTIL_BITPACK_HPP_
+#define __LATTICEZK_UTIL_BITPACK_HPP_
+
+// Packing of integer entries to their bit widths, for compact proofs (see prooffile.hpp)
+//   - entries are taken as signed and zigzag-mapped, 0, -1, 1, -2, ... to 0, 1, 2, 3, ..., so that small
+//     magnitudes of either sign have few bits
+//   - they are packed in groups of LATTICEZK_BITPACK_GROUP, each to the width of its widest entry, so that a
+//     group of width w takes exactly w words, and outliers only widen their own group
+//   - the packed bytes are the widths of the groups, a byte each padded to whole words, and then the words of
+//     the groups in turn
+//   - the groups are packed and unpacked in parallel; a full group by code unrolled for its width, whose shifts
+//     and word offsets are constants, and the partial last group in a loop of shifts over its entries that loads
+//     and stores whole words
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/util/tuning.hpp"
+
+// Entries of a group packed to one width, as many as bits of a word
+#define LATTICEZK_BITPACK_GROUP 64
+
+namespace LatticeZK {
+
+template<typename T>
+inline uint64_t BitPackZigzag(T x)
+{
+	typedef typename std::make_signed<T>::type S;
+	typedef typename std::make_unsigned<T>::type U;
+	return (U)((U)((U)x << 1) ^ (U)((S)x >> (8 * sizeof(T) - 1)));
+}
+
+template<typename T>
+inline T BitUnpackZigzag(uint64_t u)
+{
+	typedef typename std::make_unsigned<T>::type U;
+	return (T)(U)((U)(u >> 1) ^ (U)(0 - (u & 1)));
+}
+
+// Bits of x up to its highest set one
+inline int BitWidth(uint64_t x)
+{
+#if defined(__GNUC__)
+	return x == 0 ? 0 : 64 - __builtin_clzll(x);
+#else
+	int w = 0;
+	for (; x != 0; x >>= 1) {
+		w++;
+	}
+	return w;
+#endif
+}
+
+// Bytes of the widths of the groups of n entries
+inline size_t BitPackWidthBytes(int64_t n)
+{
+	const int64_t n_groups = (n + LATTICEZK_BITPACK_GROUP - 1) / LATTICEZK_BITPACK_GROUP;
+	return (size_t)(n_groups + 7) / 8 * 8;
+}
+
+// Bytes that n entries pack to at most, all groups being of the full width
+template<typename T>
+inline size_t BitPackMaxBytes(int64_t n)
+{
+	const int64_t n_groups = (n + LATTICEZK_BITPACK_GROUP - 1) / LATTICEZK_BITPACK_GROUP;
+	return BitPackWidthBytes(n) + (size_t)n_groups * LATTICEZK_BITPACK_GROUP * sizeof(T);
+}
+
+// Packs a full group of zigzag-mapped entries of width W into its W words
+template<int W>
+void BitPackGroup(const uint64_t * u, uint64_t * out)
+{
+	uint64_t acc = 0;
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC unroll 64
+#endif
+	for (int i = 0; i < LATTICEZK_BITPACK_GROUP; i++) {
+		const int bit = i * W % 64;
+		acc |= u[i] << bit;
+		if (bit + W >= 64) {
+			out[i * W / 64] = acc;
+			acc = bit == 0 ? 0 : u[i] >> ((64 - bit) & 63);
+		}
+	}
+}
+
+// Unpacks a full group of width W from its W words into zigzag-mapped entries
+template<int W>
+void BitUnpackGroup(const uint64_t * in, uint64_t * u)
+{
+	const uint64_t mask = ~(uint64_t)0 >> (64 - W);
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC unroll 64
+#endif
+	for (int i = 0; i < LATTICEZK_BITPACK_GROUP; i++) {
+		const int bit = i * W % 64;
+		uint64_t x = in[i * W / 64] >> bit;
+		if (bit + W > 64) {
+			x |= in[i * W / 64 + 1] << ((64 - bit) & 63);
+		}
+		u[i] = x & mask;
+	}
+}
+
+typedef void (*BitPackGroupFunc)(const uint64_t * u, uint64_t * out);
+
+// The group kernels of widths 1 to 64, indexed by width less one
+template<size_t... W>
+const std::array<BitPackGroupFunc, sizeof...(W)> & BitPackGroups(std::index_sequence<W...>)
+{
+	static const std::array<BitPackGroupFunc, sizeof...(W)> funcs = {{ &BitPackGroup<(int)W + 1>... }};
+	return funcs;
+}
+
+template<size_t... W>
+const std::array<BitPackGroupFunc, sizeof...(W)> & BitUnpackGroups(std::index_sequence<W...>)
+{
+	static const std::array<BitPackGroupFunc, sizeof...(W)> funcs = {{ &BitUnpackGroup<(int)W + 1>... }};
+	return funcs;
+}
+
+// Packs n entries into out, which must have room for BitPackMaxBytes<T>(n) bytes aligned to words, and returns
+// the bytes packed
+template<typename T>
+size_t BitPack(const T * x, int64_t n, uint8_t * out)
+{
+	static_assert(std::is_integral<T>::value && sizeof(T) <= 8, "packing non-integers");
+	const int64_t n_groups = (n + LATTICEZK_BITPACK_GROUP - 1) / LATTICEZK_BITPACK_GROUP;
+	const size_t width_bytes = BitPackWidthBytes(n);
+	uint8_t * widths = out;
+	memset(widths, 0, width_bytes);
+	const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / LATTICEZK_BITPACK_GROUP);
+	Executor::Current().ParallelFor(0, n_groups, grain, [&](int64_t g0, int64_t g1) {
+		for (int64_t g = g0; g < g1; g++) {
+			const int64_t i0 = g * LATTICEZK_BITPACK_GROUP, i1 = std::min(n, i0 + LATTICEZK_BITPACK_GROUP);
+			uint64_t bits = 0;
+			for (int64_t i = i0; i < i1; i++) {
+				bits |= BitPackZigzag(x[i]);
+			}
+			widths[g] = (uint8_t)BitWidth(bits);
+		}
+	});
+	// the words of a group follow those of the groups before it
+	std::vector<int64_t> offsets(n_groups + 1, 0);
+	for (int64_t g = 0; g < n_groups; g++) {
+		offsets[g + 1] = offsets[g] + widths[g];
+	}
+	uint64_t * words = (uint64_t *)(out + width_bytes);
+	const std::array<BitPackGroupFunc, 64> & pack_groups = BitPackGroups(std::make_index_sequence<64>());
+	Executor::Current().ParallelFor(0, n_groups, grain, [&](int64_t g0, int64_t g1) {
+		uint64_t u[LATTICEZK_BITPACK_GROUP];
+		for (int64_t g = g0; g < g1; g++) {
+			const int w = widths[g];
+			uint64_t * gw = words + offsets[g];
+			if (w == 0) {
+				continue;
+			}
+			const int64_t i0 = g * LATTICEZK_BITPACK_GROUP, i1 = std::min(n, i0 + LATTICEZK_BITPACK_GROUP);
+			if (i1 - i0 == LATTICEZK_BITPACK_GROUP) {
+				for (int i = 0; i < LATTICEZK_BITPACK_GROUP; i++) {
+					u[i] = BitPackZigzag(x[i0 + i]);
+				}
+				pack_groups[w - 1](u, gw);
+				continue;
+			}
+			// the entries are shifted into a word, which is stored whole once full
+			uint64_t * out_w = gw;
+			uint64_t acc = 0;
+			int bits = 0;
+			for (int64_t i = i0; i < i1; i++) {
+				const uint64_t u = BitPackZigzag(x[i]);
+				acc |= u << bits;
+				bits += w;
+				if (bits >= 64) {
+					*out_w++ = acc;
+					bits -= 64;
+					acc = bits == 0 ? 0 : u >> (w - bits);
+				}
+			}
+			// the tail of a partial group
+			if (out_w < gw + w) {
+				*out_w++ = acc;
+				memset(out_w, 0, (gw + w - out_w) * sizeof(uint64_t));
+			}
+		}
+	});
+	return width_bytes + offsets[n_groups] * sizeof(uint64_t);
+}
+
+// Unpacks n entries from bytes packed by BitPack, returning false if they are malformed
+template<typename T>
+bool BitUnpack(const uint8_t * in, size_t bytes, int64_t n, T * x)
+{
+	static_assert(std::is_integral<T>::value && sizeof(T) <= 8, "unpacking non-integers");
+	const int64_t n_groups = (n + LATTICEZK_BITPACK_GROUP - 1) / LATTICEZK_BITPACK_GROUP;
+	const size_t width_bytes = BitPackWidthBytes(n);
+	if (bytes < width_bytes) {
+		return false;
+	}
+	const uint8_t * widths = in;
+	std::vector<int64_t> offsets(n_groups + 1, 0);
+	for (int64_t g = 0; g < n_groups; g++) {
+		if (widths[g] > 8 * sizeof(T)) {
+			return false;
+		}
+		offsets[g + 1] = offsets[g] + widths[g];
+	}
+	if (bytes != width_bytes + offsets[n_groups] * sizeof(uint64_t)) {
+		return false;
+	}
+	const uint64_t * words = (const uint64_t *)(in + width_bytes);
+	const int64_t grain = std::max<int64_t>(1, TuningProfile::Current().matdot_threshold / LATTICEZK_BITPACK_GROUP);
+	const std::array<BitPackGroupFunc, 64> & unpack_groups = BitUnpackGroups(std::make_index_sequence<64>());
+	Executor::Current().ParallelFor(0, n_groups, grain, [&](int64_t g0, int64_t g1) {
+		uint64_t u[LATTICEZK_BITPACK_GROUP];
+		for (int64_t g = g0; g < g1; g++) {
+			const int w = widths[g];
+			const uint64_t * gw = words + offsets[g];
+			const int64_t i0 = g * LATTICEZK_BITPACK_GROUP, i1 = std::min(n, i0 + LATTICEZK_BITPACK_GROUP);
+			if (w == 0) {
+				memset(x + i0, 0, (size_t)(i1 - i0) * sizeof(T));
+				continue;
+			}
+			if (i1 - i0 == LATTICEZK_BITPACK_GROUP) {
+				unpack_groups[w - 1](gw, u);
+				for (int i = 0; i < LATTICEZK_BITPACK_GROUP; i++) {
+					x[i0 + i] = BitUnpackZigzag<T>(u[i]);
+				}
+				continue;
+			}
+			// the entries are shifted out of a word, the next one loaded once it runs out
+			const uint64_t mask = w == 64 ? ~(uint64_t)0 : ((uint64_t)1 << w) - 1;
+			const uint64_t * in_w = gw;
+			uint64_t acc = 0;
+			int bits = 0;
+			for (int64_t i = i0; i < i1; i++) {
+				uint64_t u;
+				if (bits >= w) {
+					u = acc;
+					acc = w == 64 ? 0 : acc >> w;
+					bits -= w;
+				} else {
+					const uint64_t next = *in_w++;
+					u = bits == 0 ? next : acc | next << bits;
+					acc = bits == 0 ? (w == 64 ? 0 : next >> w) : next >> (w - bits);
+					bits += 64 - w;
+				}
+				x[i] = BitUnpackZigzag<T>(u & mask);
+			}
+		}
+	});
+	return true;
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_UTIL_BITPACK_HPP_
@@ -0,0 +1,226 @@
+#ifndef __LATTICEZK_UTIL_CPU_HPP_
+#define __LATTICEZK_UTIL_CPU_HPP_
+
+// Run-time CPU-feature detection and dispatch
+//
+// Performance-critical code is built once per instruction-set (ISA) level, into a namespace per level:
+//   - Scalar     : the baseline of the compile flags (x86-64 by default)
+//   - Avx2       : AVX2, FMA, BMI1/2 (Haswell and later)
+//   - Avx512     : AVX-512F/BW/DQ/VL/CD (Skylake-SP and later)
+//   - Avx512Vnni : AVX-512 with VNNI (Cascade Lake and later)
+// and the level of the running CPU is detected once, at first use, to select among these builds
+//
+// With GCC, each level is compiled via target pragmas regardless of the compile flags (see multiversion.inl),
+// so one binary runs at full speed on any x86-64 CPU. With other compilers, only the levels enabled by the
+// compile flags are built
+//
+// The environment variable LATTICEZK_ISA (scalar, avx2, avx512 or avx512vnni), or else the isa of the tuning
+// profile (see tuning.hpp), caps the selected level
+
+#include <stdlib.h>
+#include <string.h>
+#include "latticezk/util/tuning.hpp"
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+#define LATTICEZK_ISA_SCALAR 0
+#define LATTICEZK_ISA_AVX2 1
+#define LATTICEZK_ISA_AVX512 2
+#define LATTICEZK_ISA_AVX512VNNI 3
+
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+	#define LATTICEZK_MULTIVERSION 1
+#else
+	#define LATTICEZK_MULTIVERSION 0
+#endif
+
+// The highest ISA level built
+#if LATTICEZK_MULTIVERSION
+	#define LATTICEZK_ISA_MAX LATTICEZK_ISA_AVX512VNNI
+#elif defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__) && defined(__AVX512VL__) && defined(__AVX512VNNI__)
+	#define LATTICEZK_ISA_MAX LATTICEZK_ISA_AVX512VNNI
+#elif defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__) && defined(__AVX512VL__)
+	#define LATTICEZK_ISA_MAX LATTICEZK_ISA_AVX512
+#elif defined(__AVX2__)
+	#define LATTICEZK_ISA_MAX LATTICEZK_ISA_AVX2
+#else
+	#define LATTICEZK_ISA_MAX LATTICEZK_ISA_SCALAR
+#endif
+
+// Target options of each ISA level, for use with GCC's target pragma and attribute
+#define LATTICEZK_TARGET_AVX2 "avx2,fma,bmi,bmi2,popcnt"
+#define LATTICEZK_TARGET_AVX512 "avx2,fma,bmi,bmi2,popcnt,avx512f,avx512bw,avx512dq,avx512vl,avx512cd"
+#define LATTICEZK_TARGET_AVX512VNNI "avx2,fma,bmi,bmi2,popcnt,avx512f,avx512bw,avx512dq,avx512vl,avx512cd,avx512vnni"
+
+#define LATTICEZK_PRAGMA(x) _Pragma(#x)
+#if LATTICEZK_MULTIVERSION
+	// Compiles the following code, up to LATTICEZK_END_TARGET, for the given target options
+	#define LATTICEZK_BEGIN_TARGET(t) LATTICEZK_PRAGMA(GCC push_options) LATTICEZK_PRAGMA(GCC target(t))
+	#define LATTICEZK_END_TARGET LATTICEZK_PRAGMA(GCC pop_options)
+	// Compiles a function for the given target options
+	#define LATTICEZK_TARGET(t) __attribute__((target(t)))
+#else
+	#define LATTICEZK_BEGIN_TARGET(t)
+	#define LATTICEZK_END_TARGET
+	#define LATTICEZK_TARGET(t)
+#endif
+
+// Expands to a switch over the selected ISA level that runs CASE(ns) for the namespace ns of the level's build
+// CASE(ns) must return or break
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX2
+	#define LATTICEZK_ISA_CASE_AVX2(CASE) case ::LatticeZK::CpuIsa::Avx2: CASE(Avx2)
+#else
+	#define LATTICEZK_ISA_CASE_AVX2(CASE)
+#endif
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX512
+	#define LATTICEZK_ISA_CASE_AVX512(CASE) case ::LatticeZK::CpuIsa::Avx512: CASE(Avx512)
+#else
+	#define LATTICEZK_ISA_CASE_AVX512(CASE)
+#endif
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX512VNNI
+	#define LATTICEZK_ISA_CASE_AVX512VNNI(CASE) case ::LatticeZK::CpuIsa::Avx512Vnni: CASE(Avx512Vnni)
+#else
+	#define LATTICEZK_ISA_CASE_AVX512VNNI(CASE)
+#endif
+#define LATTICEZK_ISA_SWITCH(CASE) \
+	switch (::LatticeZK::GetCpuIsa()) { \
+	LATTICEZK_ISA_CASE_AVX512VNNI(CASE) \
+	LATTICEZK_ISA_CASE_AVX512(CASE) \
+	LATTICEZK_ISA_CASE_AVX2(CASE) \
+	default: CASE(Scalar) \
+	}
+// As LATTICEZK_ISA_SWITCH, for code built up to the AVX2 level (see LATTICEZK_MULTIVERSION_MAX in multiversion.inl)
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX2
+	#define LATTICEZK_ISA_SWITCH_AVX2(CASE) \
+		if (::LatticeZK::GetCpuIsa() >= ::LatticeZK::CpuIsa::Avx2) { CASE(Avx2) } \
+		CASE(Scalar)
+#else
+	#define LATTICEZK_ISA_SWITCH_AVX2(CASE) CASE(Scalar)
+#endif
+
+namespace LatticeZK {
+
+enum class CpuIsa : int
+{
+	Scalar = LATTICEZK_ISA_SCALAR,
+	Avx2 = LATTICEZK_ISA_AVX2,
+	Avx512 = LATTICEZK_ISA_AVX512,
+	Avx512Vnni = LATTICEZK_ISA_AVX512VNNI,
+};
+
+inline const char * CpuIsaName(CpuIsa isa)
+{
+	switch (isa) {
+	case CpuIsa::Avx2: return "avx2";
+	case CpuIsa::Avx512: return "avx512";
+	case CpuIsa::Avx512Vnni: return "avx512vnni";
+	default: return "scalar";
+	}
+}
+
+// Features of the running CPU, as far as supported by the operating system
+class CpuFeatures
+{
+public:
+	bool aes, vaes, avx2, fma, bmi2, avx512, avx512vnni;
+private:
+	CpuFeatures()
+	{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		aes = __builtin_cpu_supports("aes");
+		vaes = __builtin_cpu_supports("vaes");
+		avx2 = __builtin_cpu_supports("avx2");
+		fma = __builtin_cpu_supports("fma");
+		bmi2 = __builtin_cpu_supports("bmi2");
+		avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")
+			&& __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512cd");
+		avx512vnni = __builtin_cpu_supports("avx512vnni");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int r1[4], r7[4];
+		__cpuid(r1, 1);
+		__cpuidex(r7, 7, 0);
+		bool osxsave = (r1[2] >> 27) & 1;
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		bool ymm = (xcr0 & 0x06) == 0x06, zmm = (xcr0 & 0xe6) == 0xe6;
+		aes = (r1[2] >> 25) & 1;
+		vaes = ymm && ((r7[2] >> 9) & 1);
+		avx2 = ymm && ((r7[1] >> 5) & 1);
+		fma = ymm && ((r1[2] >> 12) & 1);
+		bmi2 = (r7[1] >> 8) & 1;
+		avx512 = zmm && ((r7[1] >> 16) & 1) && ((r7[1] >> 30) & 1) && ((r7[1] >> 17) & 1) && ((r7[1] >> 31) & 1) && ((r7[1] >> 28) & 1);
+		avx512vnni = zmm && ((r7[2] >> 11) & 1);
+#else
+		aes = vaes = avx2 = fma = bmi2 = avx512 = avx512vnni = false;
+#endif
+	}
+public:
+	static const CpuFeatures & Get()
+	{
+		static const CpuFeatures features;
+		return features;
+	}
+	// The highest ISA level supported by the CPU and built
+	CpuIsa Isa() const
+	{
+		int isa = LATTICEZK_ISA_SCALAR;
+		if (avx2 && fma && bmi2) {
+			isa = LATTICEZK_ISA_AVX2;
+			if (avx512) {
+				isa = avx512vnni ? LATTICEZK_ISA_AVX512VNNI : LATTICEZK_ISA_AVX512;
+			}
+		}
+		return (CpuIsa)(isa < LATTICEZK_ISA_MAX ? isa : LATTICEZK_ISA_MAX);
+	}
+};
+
+// Parses an ISA level name, returning false if it is unknown
+inline bool ParseCpuIsa(const char * name, CpuIsa & isa)
+{
+	for (int i = LATTICEZK_ISA_SCALAR; i <= LATTICEZK_ISA_AVX512VNNI; i++) {
+		if (strcmp(name, CpuIsaName((CpuIsa)i)) == 0) {
+			isa = (CpuIsa)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline CpuIsa & CpuIsaSelection()
+{
+	static CpuIsa isa = []() {
+		CpuIsa isa = CpuFeatures::Get().Isa(), env_isa;
+		const char * env = getenv("LATTICEZK_ISA");
+		if (env == nullptr && !TuningProfile::Current().isa.empty()) {
+			env = TuningProfile::Current().isa.c_str();
+		}
+		if (env != nullptr && ParseCpuIsa(env, env_isa) && env_isa < isa) {
+			isa = env_isa;
+		}
+		return isa;
+	}();
+	return isa;
+}
+
+// The ISA level whose builds are selected
+inline CpuIsa GetCpuIsa()
+{
+	return CpuIsaSelection();
+}
+
+// Selects the builds of the given ISA level, returning false if it is not supported by the CPU or not built
+// Dispatching objects, like samplers, resolve their builds at construction, so this should be called before
+// creating them and before starting threads
+inline bool SetCpuIsa(CpuIsa isa)
+{
+	if (isa > CpuFeatures::Get().Isa()) {
+		return false;
+	}
+	CpuIsaSelection() = isa;
+	return true;
+}
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_UTIL_CPU_HPP_
@@ -0,0 +1,464 @@
+#ifndef __LATTICEZK_UTIL_EXECUTOR_HPP_
+#define __LATTICEZK_UTIL_EXECUTOR_HPP_
+
+// A persistent pool of worker threads with work stealing, which runs all the parallel loops of the library
+//   - ParallelFor and ParallelReduce split a range into chunks of at least a grain, and run it on the calling
+//     thread alone when it is a single chunk, the pool has no workers or the nesting limit is reached, so
+//     small operations cost no more than a loop
+//   - ParallelReduce combines the results of its chunks in order, and its chunks do not depend on the number
+//     of threads, so its result does not either
+//   - ForEachThread runs a task on each thread by its index, for work that must be placed on a given thread,
+//     such as the first touch of memory; the task of a worker is pinned to it and never stolen
+//   - ForEachThreadShare splits a range statically over the threads that way, so that the memory a thread
+//     first touched is the memory it later zeroes or copies
+//   - a TaskGroup runs tasks and waits for them, the waiting thread running queued tasks meanwhile
+//   - each worker runs its own tasks last-in-first-out, and steals those of others first-in-first-out
+//   - the executor of a thread is the default one, unless an ExecutorScope sets another, such as one
+//     pinned to the CPUs of a NUMA node
+//
+// The environment variable LATTICEZK_THREADS, or else the threads of the tuning profile (see tuning.hpp), sets
+// the number of threads of the default executor, which is otherwise the number of CPUs
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "latticezk/util/tuning.hpp"
+#if defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+// Chunks per thread of a parallel loop, for balancing uneven chunks
+#define LATTICEZK_EXECUTOR_CHUNKS_PER_THREAD 4
+// Chunks of a parallel reduction at most
+#define LATTICEZK_EXECUTOR_REDUCE_CHUNKS 256
+// Times an idle worker looks for tasks before sleeping
+#define LATTICEZK_EXECUTOR_SPINS 1024
+
+namespace LatticeZK {
+
+class Executor
+{
+public:
+	typedef std::function<void()> Task;
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		// tasks that only the worker of the queue runs
+		std::deque<Task> pinned;
+		// the number of pinned tasks, which only wake the worker of the queue
+		std::atomic<int64_t> n_pinned { 0 };
+	};
+	// the executor, worker index and nesting depth of parallel loops of the current thread
+	struct ThreadState
+	{
+		Executor * current = nullptr;
+		Executor * owner = nullptr;
+		size_t index = 0;
+		int depth = 0;
+	};
+	static ThreadState & State()
+	{
+		static thread_local ThreadState state;
+		return state;
+	}
+private:
+	// a queue per worker, and a last one for the tasks of other threads
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	// the number of tasks any thread may run, not counting pinned ones
+	std::atomic<int64_t> queued;
+	std::atomic<bool> stopping;
+	int max_nesting;
+private:
+	Executor(const Executor & other) = delete;
+	Executor(const Executor && other) = delete;
+public:
+	// An executor of n_threads threads, the calling thread of a parallel loop being one of them, whose workers
+	// are pinned to the given CPUs in turn if any are given
+	// Parallel loops nested max_nesting deep in others run on the calling thread alone
+	Executor(size_t n_threads, const std::vector<int> & cpus = std::vector<int>(), int max_nesting = 1) :
+		queued(0), stopping(false), max_nesting(max_nesting)
+	{
+		const size_t n_workers = n_threads > 1 ? n_threads - 1 : 0;
+		for (size_t i = 0; i <= n_workers; i++) {
+			queues.emplace_back(new Queue());
+		}
+		for (size_t i = 0; i < n_workers; i++) {
+			workers.emplace_back([this, i, cpus]() {
+				Pin(cpus.empty() ? -1 : cpus[i % cpus.size()]);
+				ThreadState & state = State();
+				state.current = state.owner = this;
+				state.index = i;
+				WorkerLoop();
+			});
+		}
+	}
+	~Executor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread & worker : workers) {
+			worker.join();
+		}
+	}
+public:
+	// The executor of threads not given one
+	static Executor & Default()
+	{
+		static Executor executor(DefaultThreads());
+		return executor;
+	}
+	// The executor of the current thread
+	static Executor & Current()
+	{
+		Executor * current = State().current;
+		return current != nullptr ? *current : Default();
+	}
+	size_t NumThreads() const
+	{
+		return workers.size() + 1;
+	}
+public:
+	// Runs f(i0, i1) over chunks [i0, i1) covering [begin, end), each of at least grain indices but the last
+	template<typename F>
+	void ParallelFor(int64_t begin, int64_t end, int64_t grain, F f)
+	{
+		const int64_t n = end - begin;
+		if (n <= 0) {
+			return;
+		}
+		grain = std::max<int64_t>(1, grain);
+		const int64_t n_chunks = std::min<int64_t>((n + grain - 1) / grain, NumThreads() * LATTICEZK_EXECUTOR_CHUNKS_PER_THREAD);
+		ThreadState & state = State();
+		if (n_chunks <= 1 || workers.empty() || state.depth >= max_nesting) {
+			state.depth++;
+			f(begin, end);
+			state.depth--;
+			return;
+		}
+		const int64_t size = (n + n_chunks - 1) / n_chunks;
+		std::atomic<int64_t> next(0);
+		auto body = [&]() {
+			ThreadState & body_state = State();
+			body_state.depth++;
+			for (int64_t c = next++; c < n_chunks; c = next++) {
+				const int64_t i0 = begin + c * size;
+				if (i0 < end) {
+					f(i0, std::min(end, i0 + size));
+				}
+			}
+			body_state.depth--;
+		};
+		RunAndWait(std::min<int64_t>(n_chunks, NumThreads()) - 1, body);
+	}
+	// Returns the combination, in order, of map(i0, i1) over chunks [i0, i1) covering [begin, end), each of
+	// at least grain indices but the last, starting from identity
+	template<typename R, typename Map, typename Combine>
+	R ParallelReduce(int64_t begin, int64_t end, int64_t grain, R identity, Map map, Combine combine)
+	{
+		const int64_t n = end - begin;
+		if (n <= 0) {
+			return identity;
+		}
+		grain = std::max<int64_t>(1, grain);
+		const int64_t n_chunks = std::min<int64_t>((n + grain - 1) / grain, LATTICEZK_EXECUTOR_REDUCE_CHUNKS);
+		const int64_t size = (n + n_chunks - 1) / n_chunks;
+		// a result per chunk, wrapped so that bool results are not packed into shared words
+		struct Result
+		{
+			R value;
+		};
+		std::vector<Result> results(n_chunks, Result { identity });
+		ParallelFor(0, n_chunks, 1, [&](int64_t c0, int64_t c1) {
+			for (int64_t c = c0; c < c1; c++) {
+				const int64_t i0 = begin + c * size;
+				if (i0 < end) {
+					results[c].value = map(i0, std::min(end, i0 + size));
+				}
+			}
+		});
+		R r = identity;
+		for (const Result & result : results) {
+			r = combine(r, result.value);
+		}
+		return r;
+	}
+	// Runs f(t) on thread t for each t of [0, NumThreads()), the calling thread being the last, and waits for
+	// them; nested too deep, or with no workers, it runs them all on the calling thread instead
+	template<typename F>
+	void ForEachThread(F f)
+	{
+		ThreadState & state = State();
+		if (workers.empty() || state.depth >= max_nesting) {
+			state.depth++;
+			for (size_t t = 0; t < NumThreads(); t++) {
+				f(t);
+			}
+			state.depth--;
+			return;
+		}
+		std::atomic<int64_t> pending((int64_t)workers.size());
+		for (size_t t = 0; t < workers.size(); t++) {
+			Queue & queue = *queues[t];
+			{
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.pinned.push_back([&f, &pending, t]() {
+					ThreadState & worker_state = State();
+					worker_state.depth++;
+					f(t);
+					worker_state.depth--;
+					pending--;
+				});
+			}
+			{
+				std::lock_guard<std::mutex> lock(sleep_mutex);
+				queue.n_pinned++;
+			}
+		}
+		// every worker must wake for its own task
+		wake.notify_all();
+		state.depth++;
+		f(workers.size());
+		state.depth--;
+		while (pending > 0) {
+			if (!RunQueued()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+	// Runs f(i0, i1) on thread t, as ForEachThread, for the t-th of contiguous shares [i0, i1) of [0, n), split
+	// in proportion to the threads at multiples of align, so that the same share always falls to the same thread
+	// A range of no more than grain runs on the calling thread alone
+	template<typename F>
+	void ForEachThreadShare(int64_t n, int64_t align, int64_t grain, F f)
+	{
+		if (n <= 0) {
+			return;
+		}
+		if (n <= grain) {
+			ThreadState & state = State();
+			state.depth++;
+			f(0, n);
+			state.depth--;
+			return;
+		}
+		const int64_t units = n / std::max<int64_t>(1, align), n_threads = (int64_t)NumThreads();
+		ForEachThread([&](size_t t) {
+			const int64_t i0 = units * (int64_t)t / n_threads * align;
+			const int64_t i1 = (int64_t)t + 1 == n_threads ? n : units * ((int64_t)t + 1) / n_threads * align;
+			if (i0 < i1) {
+				f(i0, i1);
+			}
+		});
+	}
+	// Queues a task, which must not outlive what it references; see TaskGroup for waiting on tasks
+	void Submit(Task task)
+	{
+		if (workers.empty()) {
+			task();
+			return;
+		}
+		ThreadState & state = State();
+		Queue & queue = *queues[state.owner == this ? state.index : workers.size()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			queued++;
+		}
+		wake.notify_one();
+	}
+	// Runs a queued task, if any, on the current thread, preferring those it queued itself
+	bool RunQueued()
+	{
+		ThreadState & state = State();
+		const size_t self = state.owner == this ? state.index : workers.size();
+		Task task;
+		if (state.owner == this && PopPinned(self, task)) {
+			queues[self]->n_pinned--;
+			task();
+			return true;
+		}
+		if (!Pop(self, true, task)) {
+			bool found = false;
+			for (size_t h = 1; h < queues.size() && !found; h++) {
+				found = Pop((self + h) % queues.size(), false, task);
+			}
+			if (!found) {
+				return false;
+			}
+		}
+		queued--;
+		task();
+		return true;
+	}
+private:
+	static size_t DefaultThreads()
+	{
+		const char * env = getenv("LATTICEZK_THREADS");
+		if (env != nullptr && atoi(env) > 0) {
+			return (size_t)atoi(env);
+		}
+		if (TuningProfile::Current().threads > 0) {
+			return (size_t)TuningProfile::Current().threads;
+		}
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+	static void Pin(int cpu)
+	{
+#if defined(__linux__)
+		if (cpu >= 0) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(cpu, &cpus);
+			pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		}
+#else
+		(void)cpu;
+#endif
+	}
+	bool Pop(size_t q, bool back, Task & task)
+	{
+		Queue & queue = *queues[q];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) {
+			return false;
+		}
+		if (back) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		return true;
+	}
+	bool PopPinned(size_t q, Task & task)
+	{
+		Queue & queue = *queues[q];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.pinned.empty()) {
+			return false;
+		}
+		task = std::move(queue.pinned.front());
+		queue.pinned.pop_front();
+		return true;
+	}
+	// Runs body on the current thread and in n_tasks tasks, and waits for the tasks
+	template<typename F>
+	void RunAndWait(int64_t n_tasks, F & body)
+	{
+		std::atomic<int64_t> pending(n_tasks);
+		for (int64_t h = 0; h < n_tasks; h++) {
+			Submit([&body, &pending]() {
+				body();
+				pending--;
+			});
+		}
+		body();
+		while (pending > 0) {
+			if (!RunQueued()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+	void WorkerLoop()
+	{
+		Queue & own = *queues[State().index];
+		int spins = 0;
+		while (!stopping) {
+			if (RunQueued()) {
+				spins = 0;
+			} else if (++spins < LATTICEZK_EXECUTOR_SPINS) {
+				std::this_thread::yield();
+			} else {
+				std::unique_lock<std::mutex> lock(sleep_mutex);
+				wake.wait(lock, [this, &own]() { return stopping || queued > 0 || own.n_pinned > 0; });
+				spins = 0;
+			}
+		}
+	}
+	friend class ExecutorScope;
+	friend class TaskGroup;
+};
+
+// Runs tasks on an executor and waits for them
+class TaskGroup
+{
+private:
+	Executor & executor;
+	std::atomic<int64_t> pending;
+private:
+	TaskGroup(const TaskGroup & other) = delete;
+	TaskGroup(const TaskGroup && other) = delete;
+public:
+	TaskGroup(Executor & executor = Executor::Current()) :
+		executor(executor), pending(0)
+	{
+	}
+	~TaskGroup()
+	{
+		Wait();
+	}
+public:
+	template<typename F>
+	void Run(F f)
+	{
+		pending++;
+		executor.Submit([this, f]() {
+			Executor::ThreadState & state = Executor::State();
+			state.depth++;
+			f();
+			state.depth--;
+			pending--;
+		});
+	}
+	void Wait()
+	{
+		while (pending > 0) {
+			if (!executor.RunQueued()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+};
+
+// Sets the executor of the current thread while in scope
+class ExecutorScope
+{
+private:
+	Executor * previous;
+public:
+	ExecutorScope(Executor & executor) :
+		previous(Executor::State().current)
+	{
+		Executor::State().current = &executor;
+	}
+	~ExecutorScope()
+	{
+		Executor::State().current = previous;
+	}
+};
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_UTIL_EXECUTOR_HPP_
@@ -0,0 +1,61 @@
+// Code-generation of per-ISA builds, see cpu.hpp
+// The following macro must be defined before inclusion of this file:
+//   - LATTICEZK_MULTIVERSION_INCLUDE : the file to build for each ISA level
+// and the following macro may be defined:
+//   - LATTICEZK_MULTIVERSION_MAX : the highest ISA level to build, for code that does not benefit from higher ones
+//
+// The file is included into namespace LatticeZK::<level> for each level up to LATTICEZK_ISA_MAX, i.e.
+// Scalar, Avx2, Avx512 and Avx512Vnni, with LATTICEZK_ISA defined as the level and, with GCC, compiled for the
+// level's target options. The file must guard level-specific code by LATTICEZK_ISA rather than by __AVX2__ and
+// the like, which target pragmas do not define, and must not include headers, which should be included before
+//
+// This file can be included more than once, each time for a different LATTICEZK_MULTIVERSION_INCLUDE
+
+#if !defined(LATTICEZK_MULTIVERSION_INCLUDE)
+	#error "LATTICEZK_MULTIVERSION_INCLUDE macro must be defined"
+#endif
+
+#include "latticezk/util/cpu.hpp"
+
+#if !defined(LATTICEZK_MULTIVERSION_MAX)
+	#define LATTICEZK_MULTIVERSION_MAX LATTICEZK_ISA_MAX
+#endif
+
+namespace LatticeZK { namespace Scalar {
+#define LATTICEZK_ISA LATTICEZK_ISA_SCALAR
+#include LATTICEZK_MULTIVERSION_INCLUDE
+#undef LATTICEZK_ISA
+} } // namespace LatticeZK::Scalar
+
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX2 && LATTICEZK_MULTIVERSION_MAX >= LATTICEZK_ISA_AVX2
+LATTICEZK_BEGIN_TARGET(LATTICEZK_TARGET_AVX2)
+namespace LatticeZK { namespace Avx2 {
+#define LATTICEZK_ISA LATTICEZK_ISA_AVX2
+#include LATTICEZK_MULTIVERSION_INCLUDE
+#undef LATTICEZK_ISA
+} } // namespace LatticeZK::Avx2
+LATTICEZK_END_TARGET
+#endif
+
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX512 && LATTICEZK_MULTIVERSION_MAX >= LATTICEZK_ISA_AVX512
+LATTICEZK_BEGIN_TARGET(LATTICEZK_TARGET_AVX512)
+namespace LatticeZK { namespace Avx512 {
+#define LATTICEZK_ISA LATTICEZK_ISA_AVX512
+#include LATTICEZK_MULTIVERSION_INCLUDE
+#undef LATTICEZK_ISA
+} } // namespace LatticeZK::Avx512
+LATTICEZK_END_TARGET
+#endif
+
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX512VNNI && LATTICEZK_MULTIVERSION_MAX >= LATTICEZK_ISA_AVX512VNNI
+LATTICEZK_BEGIN_TARGET(LATTICEZK_TARGET_AVX512VNNI)
+namespace LatticeZK { namespace Avx512Vnni {
+#define LATTICEZK_ISA LATTICEZK_ISA_AVX512VNNI
+#include LATTICEZK_MULTIVERSION_INCLUDE
+#undef LATTICEZK_ISA
+} } // namespace LatticeZK::Avx512Vnni
+LATTICEZK_END_TARGET
+#endif
+
+#undef LATTICEZK_MULTIVERSION_INCLUDE
+#undef LATTICEZK_MULTIVERSION_MAX
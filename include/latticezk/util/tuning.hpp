@@ -0,0 +1,158 @@
+#ifndef __LATTICEZK_UTIL_TUNING_HPP_
+#define __LATTICEZK_UTIL_TUNING_HPP_
+
+// Tunable parameters of the matrix operations, with defaults that the tuning tool (src/tune.cpp) replaces by
+// values measured on the host, in a profile file
+//   - the cache budgets that the GEMM block sizes are derived from (see GemmBlocking)
+//   - the work and packing grains of the parallel loops of the GEMM engines, and the grain of the parallel
+//     loops over matrix entries
+//   - the Strassen-Winograd cutoff, and the columns from which the bit-GEMM uses groups of 8 bits
+//   - the number of threads of the default executor, and the ISA level that the kernels are capped to
+//
+// The profile is the file named by the environment variable LATTICEZK_PROFILE, loaded at first use. It has a
+// line "name value" per parameter, parameters it does not name keep their defaults, and # starts a comment.
+// The environment variables LATTICEZK_THREADS and LATTICEZK_ISA take precedence over it
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "latticezk/log.hpp"
+
+// The defaults of the parameters, which compile flags may override
+#ifndef LATTICEZK_GEMM_L1_BYTES
+#define LATTICEZK_GEMM_L1_BYTES (1 << 15)
+#endif
+#ifndef LATTICEZK_GEMM_L2_BYTES
+#define LATTICEZK_GEMM_L2_BYTES (1 << 18)
+#endif
+#ifndef LATTICEZK_GEMM_L3_BYTES
+#define LATTICEZK_GEMM_L3_BYTES (1 << 23)
+#endif
+// Multiply-adds of a chunk of tiles computed by one thread, and entries of a chunk of panels packed by one thread
+#ifndef LATTICEZK_GEMM_CHUNK_WORK
+#define LATTICEZK_GEMM_CHUNK_WORK (1 << 18)
+#endif
+#ifndef LATTICEZK_GEMM_CHUNK_PACK
+#define LATTICEZK_GEMM_CHUNK_PACK (1 << 14)
+#endif
+// Entries of a chunk of a parallel loop over matrix entries
+#ifndef LATTICEZK_MATDOT_THRESHOLD
+#define LATTICEZK_MATDOT_THRESHOLD (1 << 14)
+#endif
+// Smallest of m, n and k at or below which the blocked engine is used, for 64-bit entries
+#ifndef LATTICEZK_STRASSEN_CUTOFF
+#define LATTICEZK_STRASSEN_CUTOFF 512
+#endif
+// Columns of B above which the bit-GEMM uses groups of 8 rather than 4 bits
+#ifndef LATTICEZK_BITGEMM_WIDE_COLUMNS
+#define LATTICEZK_BITGEMM_WIDE_COLUMNS 224
+#endif
+
+namespace LatticeZK {
+
+class TuningProfile
+{
+public:
+	int64_t gemm_l1_bytes, gemm_l2_bytes, gemm_l3_bytes;
+	int64_t gemm_chunk_work, gemm_chunk_pack, matdot_threshold;
+	int64_t strassen_cutoff, bitgemm_wide_columns;
+	int64_t threads; // 0 for the number of CPUs
+	std::string isa; // empty for the highest level of the CPU
+public:
+	TuningProfile() :
+		gemm_l1_bytes(LATTICEZK_GEMM_L1_BYTES), gemm_l2_bytes(LATTICEZK_GEMM_L2_BYTES), gemm_l3_bytes(LATTICEZK_GEMM_L3_BYTES),
+		gemm_chunk_work(LATTICEZK_GEMM_CHUNK_WORK), gemm_chunk_pack(LATTICEZK_GEMM_CHUNK_PACK), matdot_threshold(LATTICEZK_MATDOT_THRESHOLD),
+		strassen_cutoff(LATTICEZK_STRASSEN_CUTOFF), bitgemm_wide_columns(LATTICEZK_BITGEMM_WIDE_COLUMNS), threads(0)
+	{
+	}
+public:
+	// The profile in use, which may be changed before starting the operations it affects
+	static TuningProfile & Current()
+	{
+		static TuningProfile profile = []() {
+			TuningProfile profile;
+			const char * path = getenv("LATTICEZK_PROFILE");
+			if (path != nullptr && !profile.Load(path)) {
+				LATTICEZK_LOG("tuning profile " << path << " not loaded, using the defaults");
+				profile = TuningProfile();
+			}
+			return profile;
+		}();
+		return profile;
+	}
+public:
+	// Reads the parameters a profile names, returning false if it is unreadable or malformed
+	bool Load(const std::string & path)
+	{
+		std::ifstream in(path);
+		if (!in) {
+			return false;
+		}
+		std::string line;
+		while (std::getline(in, line)) {
+			line = line.substr(0, line.find('#'));
+			std::istringstream fields(line);
+			std::string name, value;
+			if (!(fields >> name)) {
+				continue;
+			}
+			if (!(fields >> value) || !Set(name, value)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	// Writes all the parameters, returning false on failure
+	bool Save(const std::string & path) const
+	{
+		std::ofstream out(path);
+		out << "# LatticeZK tuning profile" << std::endl;
+		out << "gemm_l1_bytes " << gemm_l1_bytes << std::endl;
+		out << "gemm_l2_bytes " << gemm_l2_bytes << std::endl;
+		out << "gemm_l3_bytes " << gemm_l3_bytes << std::endl;
+		out << "gemm_chunk_work " << gemm_chunk_work << std::endl;
+		out << "gemm_chunk_pack " << gemm_chunk_pack << std::endl;
+		out << "matdot_threshold " << matdot_threshold << std::endl;
+		out << "strassen_cutoff " << strassen_cutoff << std::endl;
+		out << "bitgemm_wide_columns " << bitgemm_wide_columns << std::endl;
+		out << "threads " << threads << std::endl;
+		if (!isa.empty()) {
+			out << "isa " << isa << std::endl;
+		}
+		return !!out;
+	}
+	// Sets a parameter from its text, returning false if the name is unknown or the value invalid
+	bool Set(const std::string & name, const std::string & value)
+	{
+		if (name == "isa") {
+			isa = value;
+			return true;
+		}
+		char * end = nullptr;
+		const long long v = strtoll(value.c_str(), &end, 0);
+		if (end == value.c_str() || *end != '\0' || v < 0 || (v == 0 && name != "threads")) {
+			return false;
+		}
+		int64_t * p = name == "gemm_l1_bytes" ? &gemm_l1_bytes
+			: name == "gemm_l2_bytes" ? &gemm_l2_bytes
+			: name == "gemm_l3_bytes" ? &gemm_l3_bytes
+			: name == "gemm_chunk_work" ? &gemm_chunk_work
+			: name == "gemm_chunk_pack" ? &gemm_chunk_pack
+			: name == "matdot_threshold" ? &matdot_threshold
+			: name == "strassen_cutoff" ? &strassen_cutoff
+			: name == "bitgemm_wide_columns" ? &bitgemm_wide_columns
+			: name == "threads" ? &threads
+			: nullptr;
+		if (p == nullptr) {
+			return false;
+		}
+		*p = (int64_t)v;
+		return true;
+	}
+};
+
+} // namespace LatticeZK
+
+#endif // __LATTICEZK_UTIL_TUNING_HPP_
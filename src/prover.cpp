@@ -1,12 +1,14 @@
 #include <iostream>
 #include "latticezk/common.hpp"
 #include "latticezk/util/aes_rnd.hpp"
+#include "latticezk/util/cpu.hpp"
 #include "latticezk/util/cpucycles.hpp"
 #include "latticezk/prover.hpp"
 #ifdef __CUDACC__
 	#include "latticezk/cudamv/cudamatrix.hpp"
 #else
 	#include "latticezk/matrixops.hpp"
+	#include "latticezk/numamatrixops.hpp"
 	#include "latticezk/matrixext.hpp"
 #endif
 #include "latticezk/protocol.hpp"
@@ -20,7 +22,8 @@ namespace LatticeZK {
 	namespace Main {
 #endif
 
-// runs the protocol on the CPU or the GPU, depending on the compiler used during build
+// runs the protocol on the CPU or the GPU, depending on the compiler used during build, partitioning the
+// multiplications over the NUMA nodes of a CPU with several
 template<typename data_t, uint64_t sigma>
 void run_protocol(int s_bits, uint32_t lambda, matdim_t n, double rho, matdim_t r, matdim_t v, matdim_t l, bool debug=false)
 {
@@ -29,6 +32,12 @@ void run_protocol(int s_bits, uint32_t lambda, matdim_t n, double rho, matdim_t
 	CudaMvOps<data_t> matops(stream_set);
 	run_protocol<CudaMvOps<data_t>, sigma>(matops, s_bits, lambda, n, rho, r, v, l, debug);
 #else
+	NumaTopology topology = NumaTopology::Discover();
+	if (topology.NumNodes() > 1) {
+		NumaMatrixOps<data_t> matops(topology);
+		run_protocol<NumaMatrixOps<data_t>, sigma>(matops, s_bits, lambda, n, rho, r, v, l, debug);
+		return;
+	}
 	MatrixOps<data_t> matops;
 	run_protocol<MatrixOps<data_t>, sigma>(matops, s_bits, lambda, n, rho, r, v, l, debug);
 #endif
@@ -71,6 +80,7 @@ int main()
 	using namespace LatticeZK::Cuda;
 #else
 	using namespace LatticeZK::Main;
+	std::cerr << "Instruction set: " << CpuIsaName(GetCpuIsa()) << std::endl;
 #endif
 	run_protocol_default<int64_t>();
 #ifdef __CUDACC__
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latticezk/common.hpp"
+#include "latticezk/util/cpu.hpp"
+#include "latticezk/util/cpucycles.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/util/tuning.hpp"
+#include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/matrixops.hpp"
+
+using namespace LatticeZK;
+
+// Searches the tuning profile for the multiplications of the protocol on this host, and writes it
+//
+// Usage: tune [r v l n [profile]], by default 100 3000 3000 100 latticezk.profile
+//
+// The shapes timed are those of a proof: A*S (r-by-v by v-by-l), A*Y (r-by-v by v-by-n) and S*C with Z = B + Y
+// (v-by-l by the l-by-n challenge bits). Each parameter is searched in turn, the others staying at their best
+// values so far, and a setting costs the sum of the best of several runs of each shape.
+// Load the profile by setting the environment variable LATTICEZK_PROFILE to its path.
+
+namespace LatticeZK {
+	namespace Main {
+
+typedef int64_t data_t;
+typedef int8_t secret_t;
+
+// Times of each shape, the best of this many runs
+constexpr int TUNE_RUNS = 3;
+
+class Tuner
+{
+private:
+	MatrixOps<data_t> matops;
+	Matrix<data_t, RowMajorOrder> mat_A, mat_T;
+	Matrix<secret_t, RowMajorOrder> mat_S;
+	Matrix<data_t, ColumnMajorOrder> mat_Y, mat_W, mat_B, mat_Z;
+	BitMatrix mat_C;
+	size_t n_threads;
+public:
+	Tuner(matdim_t r, matdim_t v, matdim_t l, matdim_t n) :
+		mat_A(r, v, MatrixInit::Uninitialized), mat_T(r, l, MatrixInit::Uninitialized), mat_S(v, l, MatrixInit::Uninitialized),
+		mat_Y(v, n, MatrixInit::Uninitialized), mat_W(r, n, MatrixInit::Uninitialized), mat_B(v, n, MatrixInit::Uninitialized),
+		mat_Z(v, n, MatrixInit::Uninitialized), mat_C(l, n), n_threads(1)
+	{
+		uint64_t x = 88172645463325252ull;
+		auto next = [&x]() {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			return x;
+		};
+		for (matdim_t i = 0; i < mat_A.NumCells(); i++) {
+			mat_A.Data()[i] = (data_t)next();
+		}
+		for (matdim_t i = 0; i < mat_S.NumCells(); i++) {
+			mat_S.Data()[i] = (secret_t)((int)(next() % 128) - 64);
+		}
+		for (matdim_t i = 0; i < mat_Y.NumCells(); i++) {
+			mat_Y.Data()[i] = (data_t)(next() % 4096) - 2048;
+		}
+		for (matdim_t j = 0; j < mat_C.NumCols(); j++) {
+			for (matdim_t i = 0; i < mat_C.NumRows(); i++) {
+				mat_C.Set(i, j, (int)(next() & 1));
+			}
+		}
+	}
+public:
+	// Cycles of the shapes with the current profile, or 0 if a multiplication fails
+	uint64_t Measure()
+	{
+		Executor executor(n_threads);
+		ExecutorScope scope(executor);
+		uint64_t total = 0;
+		for (const std::function<bool()> & shape : {
+			std::function<bool()>([&]() { return matops.Multiply(mat_A, mat_S, mat_T); }),
+			std::function<bool()>([&]() { return matops.Multiply(mat_A, mat_Y, mat_W); }),
+			std::function<bool()>([&]() {
+				double ZB, BB;
+				return matops.MultiplyAdd(mat_S, mat_C, mat_Y, mat_B, mat_Z, ZB, BB);
+			}) }) {
+			uint64_t best = UINT64_MAX;
+			for (int run = 0; run < TUNE_RUNS; run++) {
+				uint64_t t0 = cpucycles();
+				if (!shape()) {
+					return 0;
+				}
+				best = std::min(best, cpucycles() - t0);
+			}
+			total += best;
+		}
+		return total;
+	}
+	// Sets each value of a parameter in turn and keeps the fastest, returning its cycles
+	template<typename V>
+	uint64_t Search(const char * name, const std::vector<V> & values, std::function<void(const V &)> set)
+	{
+		V best_value = values.front();
+		uint64_t best = 0;
+		for (const V & value : values) {
+			set(value);
+			uint64_t cycles = Measure();
+			std::cerr << name << "=" << value << " : cycles=" << cycles << std::endl;
+			if (cycles != 0 && (best == 0 || cycles < best)) {
+				best = cycles;
+				best_value = value;
+			}
+		}
+		set(best_value);
+		std::cerr << "best " << name << "=" << best_value << std::endl;
+		return best;
+	}
+	uint64_t Run()
+	{
+		TuningProfile & profile = TuningProfile::Current();
+		uint64_t best = 0;
+
+		std::vector<std::string> isas;
+		for (int i = LATTICEZK_ISA_SCALAR; i <= (int)CpuFeatures::Get().Isa(); i++) {
+			isas.push_back(CpuIsaName((CpuIsa)i));
+		}
+		best = Search<std::string>("isa", isas, [&](const std::string & isa) {
+			CpuIsa level = CpuIsa::Scalar;
+			ParseCpuIsa(isa.c_str(), level);
+			SetCpuIsa(level);
+			profile.isa = isa;
+		});
+
+		std::vector<int64_t> threads;
+		const int64_t n_cpus = std::max(1u, std::thread::hardware_concurrency());
+		for (int64_t t = 1; t < n_cpus; t *= 2) {
+			threads.push_back(t);
+		}
+		threads.push_back(n_cpus);
+		best = Search<int64_t>("threads", threads, [&](const int64_t & t) {
+			n_threads = (size_t)t;
+			profile.threads = t;
+		});
+
+		auto search = [&](const char * name, int64_t & param, const std::vector<int64_t> & values) {
+			best = Search<int64_t>(name, values, [&](const int64_t & value) { param = value; });
+		};
+		search("gemm_l1_bytes", profile.gemm_l1_bytes, { 1 << 14, 3 << 13, 1 << 15, 3 << 14, 1 << 16 });
+		search("gemm_l2_bytes", profile.gemm_l2_bytes, { 1 << 17, 1 << 18, 1 << 19, 1 << 20, 1 << 21 });
+		search("gemm_l3_bytes", profile.gemm_l3_bytes, { 1 << 21, 1 << 22, 1 << 23, 1 << 24, 1 << 25 });
+		search("strassen_cutoff", profile.strassen_cutoff, { 256, 512, 1024, 2048, 1 << 30 });
+		search("bitgemm_wide_columns", profile.bitgemm_wide_columns, { 64, 128, 224, 512, 1 << 30 });
+		search("gemm_chunk_work", profile.gemm_chunk_work, { 1 << 16, 1 << 17, 1 << 18, 1 << 19, 1 << 20 });
+		search("gemm_chunk_pack", profile.gemm_chunk_pack, { 1 << 12, 1 << 13, 1 << 14, 1 << 15, 1 << 16 });
+		search("matdot_threshold", profile.matdot_threshold, { 1 << 12, 1 << 13, 1 << 14, 1 << 15, 1 << 16 });
+		return best;
+	}
+};
+
+	} // namespace Main
+} // namespace LatticeZK
+
+int main(int argc, char * argv[])
+{
+	using namespace LatticeZK::Main;
+	matdim_t r = 100, v = 3000, l = 3000, n = 100;
+	std::string path = "latticezk.profile";
+	if (argc >= 5) {
+		r = atoi(argv[1]);
+		v = atoi(argv[2]);
+		l = atoi(argv[3]);
+		n = atoi(argv[4]);
+		if (argc >= 6) {
+			path = argv[5];
+		}
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " [r v l n [profile]]" << std::endl;
+		return 1;
+	}
+	if (r <= 0 || v <= 0 || l <= 0 || n <= 0) {
+		std::cerr << "Dimensions must be positive" << std::endl;
+		return 1;
+	}
+	std::cerr << "Tuning for r=" << r << " v=" << v << " l=" << l << " n=" << n << std::endl;
+	Tuner tuner(r, v, l, n);
+	uint64_t cycles = tuner.Run();
+	if (!TuningProfile::Current().Save(path)) {
+		std::cerr << "Failed writing " << path << std::endl;
+		return 1;
+	}
+	std::cerr << "Wrote " << path << " for cycles=" << cycles << std::endl;
+	return 0;
+}
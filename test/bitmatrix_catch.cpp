@@ -0,0 +1,282 @@
+#include <memory>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/uniform/usampler.hpp"
+#include "testcommon.h"
+
+namespace LatticeZK {
+
+// Checks A*C for a random A and a random bit matrix C against the reference multiplication of A by C's entries
+template<typename T, typename Order, typename S = T>
+void test_mxnxk_bitmatrix_vs_reference(matdim_t m, matdim_t n, matdim_t k, uint64_t seed) {
+	Matrix<S, Order> aM(m, k);
+	Matrix<T, RowMajorOrder> aX(m, k);
+	Matrix<T, ColumnMajorOrder> bX(k, n), cM(m, n), cX(m, n);
+	BitMatrix bM(k, n);
+	TestRandom rnd(seed);
+	rnd.Fill(aM, [](uint64_t x) { return (S)(x >> 32); });
+	for (matdim_t i=0; i<m; i++) {
+		for (matdim_t j=0; j<k; j++) {
+			aX(i, j) = aM(i, j);
+		}
+	}
+	rnd.FillBits(bM);
+	REQUIRE( bM.ToMatrix(bX) );
+	REQUIRE( MatrixMultiplyReference(aX, bX, cX) );
+	REQUIRE( MatrixMultiply(aM, bM, cM) );
+	REQUIRE( cM == cX );
+}
+
+TEST_CASE( "bit matrix round-trips through a matrix", "[latticezk]" ) {
+	Matrix<int32_t, ColumnMajorOrder> aM(70, 3), bM(70, 3);
+	BitMatrix cM(70, 3), dM(70, 3);
+	for (int i=0; i<70*3; i++) {
+		aM(i) = (i * 7 / 3) & 1;
+	}
+	REQUIRE( cM.FromMatrix(aM) );
+	REQUIRE( cM.ToMatrix(bM) );
+	REQUIRE( aM == bM );
+	REQUIRE( cM != dM );
+	REQUIRE( dM.FromMatrix(bM) );
+	REQUIRE( cM == dM );
+	REQUIRE( cM.Column(1)[1] >> 6 == 0 );
+	aM(5) = 2;
+	REQUIRE( !cM.FromMatrix(aM) );
+}
+
+TEST_CASE( "bit matrix multiplication matches the reference for all widths", "[latticezk]" ) {
+	int shapes[][3] = { {1, 1, 1}, {3, 5, 7}, {33, 17, 9}, {65, 100, 131}, {300, 250, 70}, {257, 3, 600} };
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		for (size_t i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+			CAPTURE( i );
+			test_mxnxk_bitmatrix_vs_reference<int8_t, RowMajorOrder>(shapes[i][0], shapes[i][1], shapes[i][2], i);
+			test_mxnxk_bitmatrix_vs_reference<int16_t, RowMajorOrder>(shapes[i][0], shapes[i][1], shapes[i][2], i);
+			test_mxnxk_bitmatrix_vs_reference<int32_t, RowMajorOrder>(shapes[i][0], shapes[i][1], shapes[i][2], i);
+			test_mxnxk_bitmatrix_vs_reference<int64_t, RowMajorOrder>(shapes[i][0], shapes[i][1], shapes[i][2], i);
+			test_mxnxk_bitmatrix_vs_reference<int64_t, ColumnMajorOrder>(shapes[i][0], shapes[i][1], shapes[i][2], i);
+			test_mxnxk_bitmatrix_vs_reference<int64_t, RowMajorOrder, int8_t>(shapes[i][0], shapes[i][1], shapes[i][2], i);
+		}
+	}
+	SetCpuIsa(isa0);
+}
+
+TEST_CASE( "batched bit-matrix multiplication matches single products", "[latticezk]" ) {
+	const matdim_t m = 301, k = 70;
+	const matdim_t ns[] = { 250, 1, 0, 63 };
+	Matrix<int16_t, RowMajorOrder> aM(m, k);
+	std::vector<std::unique_ptr<BitMatrix>> bM;
+	std::vector<std::unique_ptr<Matrix<int64_t, ColumnMajorOrder>>> cM;
+	std::vector<const BitMatrix *> bs;
+	std::vector<Matrix<int64_t, ColumnMajorOrder> *> cs;
+	TestRandom rnd(1);
+	rnd.Fill(aM, [](uint64_t x) { return (int16_t)(x >> 48); });
+	for (matdim_t n : ns) {
+		bM.emplace_back(new BitMatrix(k, n));
+		cM.emplace_back(new Matrix<int64_t, ColumnMajorOrder>(m, n));
+		rnd.FillBits(*bM.back());
+		bs.push_back(bM.back().get());
+		cs.push_back(cM.back().get());
+	}
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		REQUIRE( MatrixMultiplyBatch(aM, bs, cs) );
+		for (size_t i=0; i<bs.size(); i++) {
+			CAPTURE( i );
+			Matrix<int64_t, ColumnMajorOrder> cX(m, ns[i]);
+			REQUIRE( MatrixMultiply(aM, *bs[i], cX) );
+			REQUIRE( *cs[i] == cX );
+		}
+	}
+	SetCpuIsa(isa0);
+}
+
+TEST_CASE( "checking products finds every nonzero difference", "[latticezk]" ) {
+	const matdim_t m = 37, v = 29, l = 70, n = 300;
+	Matrix<int64_t, RowMajorOrder> aM(m, v), tM(m, l);
+	Matrix<int64_t, ColumnMajorOrder> zM(v, n), wM(m, n), azM(m, n), tcM(m, n);
+	BitMatrix cM(l, n);
+	TestRandom rnd(1);
+	rnd.Fill(aM, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(zM, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(tM, [](uint64_t x) { return (int64_t)x; });
+	rnd.FillBits(cM);
+	REQUIRE( MatrixMultiply(aM, zM, azM) );
+	REQUIRE( MatrixMultiply(tM, cM, tcM) );
+	for (matdim_t i=0; i<m*n; i++) {
+		wM(i) = (int64_t)((uint64_t)azM(i) - (uint64_t)tcM(i));
+	}
+	bool equal = false;
+	REQUIRE( MatrixCheckProducts(aM, zM, tM, cM, wM, equal) );
+	REQUIRE( equal );
+	for (matdim_t i : { (matdim_t)0, m * n / 2, m * n - 1 }) {
+		CAPTURE( i );
+		wM(i) ^= (int64_t)1 << 62;
+		REQUIRE( MatrixCheckProducts(aM, zM, tM, cM, wM, equal) );
+		REQUIRE( !equal );
+		wM(i) ^= (int64_t)1 << 62;
+	}
+	Matrix<int64_t, ColumnMajorOrder> w1M(m, n - 1);
+	REQUIRE( !MatrixCheckProducts(aM, zM, tM, cM, w1M, equal) );
+}
+
+TEST_CASE( "fused multiply-add matches separate passes", "[latticezk]" ) {
+	const matdim_t m = 301, k = 70, n = 250;
+	Matrix<int8_t, RowMajorOrder> sM(m, k);
+	Matrix<int64_t, ColumnMajorOrder> yM(m, n), bM(m, n), zM(m, n), bX(m, n), zX(m, n);
+	BitMatrix cM(k, n);
+	TestRandom rnd(1);
+	rnd.Fill(sM, [](uint64_t x) { return (int8_t)(x >> 56); });
+	rnd.Fill(yM, [](uint64_t x) { return (int64_t)(x >> 44) - (1 << 19); });
+	rnd.FillBits(cM);
+	double ZB, BB, ZBX, BBX;
+	REQUIRE( MatrixMultiplyAdd(sM, cM, yM, bM, zM, ZB, BB) );
+	REQUIRE( MatrixMultiply(sM, cM, bX) );
+	REQUIRE( zX.Add(bX, yM) );
+	REQUIRE( zX.FrobeniusInnerProduct(bX, ZBX) );
+	REQUIRE( bX.FrobeniusInnerProduct(bX, BBX) );
+	REQUIRE( bM == bX );
+	REQUIRE( zM == zX );
+	REQUIRE( ZB == ZBX );
+	REQUIRE( BB == BBX );
+}
+
+TEST_CASE( "products of few row panels are split over the columns too", "[latticezk]" ) {
+	// 4 panels of int64 rows for 8 threads, as T*C with the r rows of T
+	Executor executor(8);
+	ExecutorScope scope(executor);
+	REQUIRE( BitGemmPartColumns<int64_t>(100, 1000) == 500 );
+	REQUIRE( BitGemmPartColumns<int64_t>(100, 40) == 40 );
+	REQUIRE( BitGemmPartColumns<int64_t>(300, 1000) == 1000 );
+	// parts of groups of 8 bits, and of 4
+	test_mxnxk_bitmatrix_vs_reference<int64_t, RowMajorOrder>(100, 1000, 131, 1);
+	test_mxnxk_bitmatrix_vs_reference<int64_t, RowMajorOrder>(100, 300, 131, 2);
+	test_mxnxk_bitmatrix_vs_reference<int8_t, RowMajorOrder>(70, 333, 65, 3);
+	// the sums of the rows gather the parts of their columns
+	const matdim_t m = 70, k = 65, n = 1000;
+	Matrix<int8_t, RowMajorOrder> sM(m, k);
+	Matrix<int64_t, ColumnMajorOrder> yM(m, n), bM(m, n), zM(m, n), bX(m, n), zX(m, n);
+	BitMatrix cM(k, n);
+	TestRandom rnd(4);
+	rnd.Fill(sM, [](uint64_t x) { return (int8_t)(x >> 56); });
+	rnd.Fill(yM, [](uint64_t x) { return (int64_t)(x >> 44) - (1 << 19); });
+	rnd.FillBits(cM);
+	double ZB, BB, ZBX, BBX;
+	REQUIRE( MatrixMultiplyAdd(sM, cM, yM, bM, zM, ZB, BB) );
+	REQUIRE( MatrixMultiply(sM, cM, bX) );
+	REQUIRE( zX.Add(bX, yM) );
+	REQUIRE( zX.FrobeniusInnerProduct(bX, ZBX) );
+	REQUIRE( bX.FrobeniusInnerProduct(bX, BBX) );
+	REQUIRE( bM == bX );
+	REQUIRE( zM == zX );
+	REQUIRE( ZB == ZBX );
+	REQUIRE( BB == BBX );
+}
+
+TEST_CASE( "seeded challenges are the sampled ones, checked a block at a time", "[latticezk]" ) {
+	uint8_t seed[16];
+	for (int i=0; i<16; i++) {
+		seed[i] = (uint8_t)(250 - i * 3);
+	}
+	// rows that straddle words of the stream, that fill them, and fewer than one
+	for (matdim_t l : { 70, 128, 1, 191 }) {
+		CAPTURE( l );
+		const matdim_t n = 37;
+		AES_Random aes_rnd;
+		aes_rnd.reseed(seed);
+		BitSampler bsampler(aes_rnd);
+		BitMatrix cM(l, n), gM(l, n);
+		for (matdim_t j=0; j<n; j++) {
+			for (matdim_t i=0; i<l; i++) {
+				cM.Set(i, j, (int)bsampler());
+			}
+		}
+		SeededBitMatrix sC(l, n, seed);
+		REQUIRE( sC.ToBitMatrix(gM) );
+		REQUIRE( gM == cM );
+		std::vector<uint64_t> cols(3 * sC.ColumnWords());
+		sC.Generate(5, 3, cols.data());
+		REQUIRE( memcmp(cols.data(), cM.Column(5), cols.size() * sizeof(uint64_t)) == 0 );
+	}
+
+	const matdim_t m = 33, v = 40, l = 100, n = 300;
+	Matrix<int64_t, RowMajorOrder> aM(m, v), tM(m, l);
+	Matrix<int64_t, ColumnMajorOrder> zM(v, n), wM(m, n), azM(m, n), tcM(m, n);
+	BitMatrix cM(l, n);
+	SeededBitMatrix sC(l, n, seed);
+	REQUIRE( sC.ToBitMatrix(cM) );
+	TestRandom rnd(7);
+	rnd.Fill(aM, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(zM, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(tM, [](uint64_t x) { return (int64_t)x; });
+	REQUIRE( MatrixMultiply(aM, zM, azM) );
+	REQUIRE( MatrixMultiply(tM, cM, tcM) );
+	for (matdim_t i=0; i<m*n; i++) {
+		wM(i) = (int64_t)((uint64_t)azM(i) - (uint64_t)tcM(i));
+	}
+	bool equal = false;
+	REQUIRE( MatrixCheckProducts(aM, zM, tM, sC, wM, equal) );
+	REQUIRE( equal );
+	// any other challenge fails the check
+	uint8_t other[16];
+	memcpy(other, seed, 16);
+	other[0] ^= 1;
+	REQUIRE( MatrixCheckProducts(aM, zM, tM, SeededBitMatrix(l, n, other), wM, equal) );
+	REQUIRE( !equal );
+	wM(m * n - 1) ^= 1;
+	REQUIRE( MatrixCheckProducts(aM, zM, tM, sC, wM, equal) );
+	REQUIRE( !equal );
+}
+
+TEST_CASE( "seeded challenges times bit matrices count the common bits", "[latticezk]" ) {
+	TestRandom rnd(11);
+	uint64_t w[64], t[64];
+	for (int i=0; i<64; i++) {
+		w[i] = t[i] = rnd();
+	}
+	BitTranspose64(t);
+	for (int i=0; i<64; i++) {
+		for (int j=0; j<64; j++) {
+			REQUIRE( ((t[i] >> j) & 1) == ((w[j] >> i) & 1) );
+		}
+	}
+
+	uint8_t seed[16];
+	for (int i=0; i<16; i++) {
+		seed[i] = (uint8_t)(17 + i * 5);
+	}
+	// a small L2 splits the columns of C over several blocks
+	TuningProfile & profile = TuningProfile::Current();
+	const int64_t l2_bytes = profile.gemm_l2_bytes;
+	for (int64_t l2 : { l2_bytes, (int64_t)1024 }) {
+		profile.gemm_l2_bytes = l2;
+		for (matdim_t l : { 1, 64, 100 }) {
+			for (matdim_t n : { 37, 128, 300 }) {
+				CAPTURE( l2, l, n );
+				const matdim_t k = 5;
+				SeededBitMatrix sC(l, n, seed);
+				BitMatrix cM(l, n), xM(n, k);
+				REQUIRE( sC.ToBitMatrix(cM) );
+				for (matdim_t j=0; j<k; j++) {
+					for (matdim_t i=0; i<n; i++) {
+						xM.Set(i, j, (int)(rnd() & 1));
+					}
+				}
+				Matrix<int8_t, ColumnMajorOrder> c8M(l, n);
+				Matrix<int32_t, ColumnMajorOrder> cxM(l, k), rM(l, k);
+				REQUIRE( cM.ToMatrix(c8M) );
+				REQUIRE( MatrixMultiply(c8M, xM, rM) );
+				REQUIRE( MatrixMultiply(sC, xM, cxM) );
+				REQUIRE( cxM == rM );
+			}
+		}
+	}
+	profile.gemm_l2_bytes = l2_bytes;
+}
+
+} // namespace LatticeZK
@@ -0,0 +1,88 @@
+#include <vector>
+#include <string.h>
+#include <catch2/catch.hpp>
+#include "latticezk/util/cpu.hpp"
+#include "latticezk/util/aes_rnd.hpp"
+#include "latticezk/gaussian/gsampler.hpp"
+
+namespace LatticeZK {
+
+// Encrypts the FIPS-197 (appendix C.1) plaintext, as the block following the counter, and checks the ciphertext
+void test_aes_ctr_fips197(aes_ctr_t aes_ctr) {
+	const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	const uint8_t ct[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+	aes_round_keys_t rk;
+	AesExpandKey(key, rk);
+	uint64_t ctr[2] = { 0x77665544332210ffULL, 0xffeeddccbbaa9988ULL }; // the plaintext 00112233..ff minus one
+	uint8_t out[16];
+	aes_ctr(rk, ctr, out, 1);
+	REQUIRE( memcmp(out, ct, 16) == 0 );
+}
+
+// Checks the given implementation produces the same stream as the portable one, across a counter carry
+void test_aes_ctr_vs_portable(aes_ctr_t aes_ctr) {
+	const uint8_t key[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	aes_round_keys_t rk;
+	AesExpandKey(key, rk);
+	for (size_t nblocks : { 1, 7, 8, 9, 16, 31, 100 }) {
+		CAPTURE( nblocks );
+		uint64_t ctr[2] = { ~0ULL - 5, 1 }, ctrX[2] = { ~0ULL - 5, 1 };
+		std::vector<uint8_t> out(16 * nblocks), outX(16 * nblocks);
+		aes_ctr(rk, ctr, out.data(), nblocks);
+		AesCtrPortable(rk, ctrX, outX.data(), nblocks);
+		REQUIRE( out == outX );
+		REQUIRE( ctr[0] == ctrX[0] );
+		REQUIRE( ctr[1] == ctrX[1] );
+	}
+}
+
+TEST_CASE( "AES-CTR implementations match FIPS-197 and each other", "[latticezk]" ) {
+	const CpuFeatures & cpu = CpuFeatures::Get();
+	LATTICEZK_UNUSED(cpu);
+	test_aes_ctr_fips197(&AesCtrPortable);
+#ifdef LATTICEZK_AES_NI
+	if (cpu.aes) {
+		test_aes_ctr_fips197(&AesCtrNi);
+		test_aes_ctr_vs_portable(&AesCtrNi);
+	}
+#endif
+#ifdef LATTICEZK_AES_VAES256
+	if (cpu.aes && cpu.vaes && cpu.avx2) {
+		test_aes_ctr_fips197(&AesCtrVaes256);
+		test_aes_ctr_vs_portable(&AesCtrVaes256);
+	}
+#endif
+#ifdef LATTICEZK_AES_VAES512
+	if (cpu.aes && cpu.vaes && cpu.avx512) {
+		test_aes_ctr_fips197(&AesCtrVaes512);
+		test_aes_ctr_vs_portable(&AesCtrVaes512);
+	}
+#endif
+}
+
+template<typename HGSampler>
+std::vector<int> half_gaussian_samples(int n) {
+	AES_Random aes_rnd;
+	aes_rnd.reseed(1u);
+	HGSampler sampler(aes_rnd);
+	std::vector<int> samples(n);
+	for (int i = 0; i < n; i++) {
+		samples[i] = sampler();
+	}
+	return samples;
+}
+
+TEST_CASE( "half-Gaussian samplers produce the same samples at all ISA levels", "[latticezk]" ) {
+	CpuIsa isa0 = GetCpuIsa();
+	REQUIRE( SetCpuIsa(CpuIsa::Scalar) );
+	std::vector<int> s2X = half_gaussian_samples<HalfGaussianSampler_S2_N5>(5000);
+	std::vector<int> s215X = half_gaussian_samples<HalfGaussianSampler_S215_N10>(5000);
+	for (int isa = LATTICEZK_ISA_AVX2; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		REQUIRE( half_gaussian_samples<HalfGaussianSampler_S2_N5>(5000) == s2X );
+		REQUIRE( half_gaussian_samples<HalfGaussianSampler_S215_N10>(5000) == s215X );
+	}
+	SetCpuIsa(isa0);
+}
+
+} // namespace LatticeZK
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "latticezk/matrix.hpp"
+#include "latticezk/matrixops.hpp"
+#include "latticezk/util/executor.hpp"
+#include "latticezk/util/tuning.hpp"
+#include "testcommon.h"
+
+namespace LatticeZK {
+
+TEST_CASE( "executor loops cover their range once, nested loops included", "[latticezk]" ) {
+	Executor executor(4);
+	for (int64_t n : { 0, 1, 7, 1000, 100003 }) {
+		for (int64_t grain : { 1, 16, 4096 }) {
+			std::vector<std::atomic<int>> hits(n);
+			std::atomic<int> n_empty(0);
+			executor.ParallelFor(0, n, grain, [&](int64_t i0, int64_t i1) {
+				n_empty += i0 >= i1;
+				for (int64_t i = i0; i < i1; i++) {
+					hits[i]++;
+				}
+			});
+			REQUIRE( n_empty == 0 );
+			for (int64_t i = 0; i < n; i++) {
+				REQUIRE( hits[i] == 1 );
+			}
+		}
+	}
+	// the inner loops run on the thread of their outer chunk
+	std::vector<std::atomic<int>> hits(64 * 64);
+	executor.ParallelFor(0, 64, 1, [&](int64_t i0, int64_t i1) {
+		for (int64_t i = i0; i < i1; i++) {
+			executor.ParallelFor(0, 64, 1, [&](int64_t j0, int64_t j1) {
+				for (int64_t j = j0; j < j1; j++) {
+					hits[i * 64 + j]++;
+				}
+			});
+		}
+	});
+	for (std::atomic<int> & hit : hits) {
+		REQUIRE( hit == 1 );
+	}
+}
+
+TEST_CASE( "executor reductions do not depend on the number of threads", "[latticezk]" ) {
+	const int64_t n = 1000003;
+	std::vector<double> x(n);
+	for (int64_t i = 0; i < n; i++) {
+		x[i] = 1.0 / (double)(i + 1);
+	}
+	auto sum = [&](Executor & executor) {
+		return executor.ParallelReduce(0, n, 1000, 0.0, [&](int64_t i0, int64_t i1) {
+			double r = 0.0;
+			for (int64_t i = i0; i < i1; i++) {
+				r += x[i];
+			}
+			return r;
+		}, [](double a, double b) { return a + b; });
+	};
+	Executor one(1), four(4);
+	REQUIRE( sum(one) == sum(four) );
+	REQUIRE( sum(four) == Approx(14.3927).epsilon(1e-4) );
+	REQUIRE( four.ParallelReduce(0, 0, 1, 7, [](int64_t, int64_t) { return 0; }, [](int a, int b) { return a + b; }) == 7 );
+}
+
+TEST_CASE( "executor runs a task on each thread by its index", "[latticezk]" ) {
+	Executor executor(4);
+	for (int round = 0; round < 10; round++) {
+		std::vector<std::thread::id> ids(executor.NumThreads());
+		std::atomic<int> n_run(0);
+		executor.ForEachThread([&](size_t t) {
+			ids[t] = std::this_thread::get_id();
+			n_run++;
+		});
+		REQUIRE( n_run == 4 );
+		// the calling thread runs the last, and each worker its own
+		REQUIRE( ids[3] == std::this_thread::get_id() );
+		for (size_t t = 0; t < ids.size(); t++) {
+			for (size_t u = 0; u < t; u++) {
+				REQUIRE( ids[t] != ids[u] );
+			}
+		}
+	}
+	// nested in a parallel loop, they run on the thread of the outer chunk
+	std::vector<std::atomic<int>> hits(8 * 4);
+	executor.ParallelFor(0, 8, 1, [&](int64_t i0, int64_t i1) {
+		for (int64_t i = i0; i < i1; i++) {
+			const std::thread::id id = std::this_thread::get_id();
+			executor.ForEachThread([&](size_t t) {
+				hits[i * 4 + t] += std::this_thread::get_id() == id;
+			});
+		}
+	});
+	for (std::atomic<int> & hit : hits) {
+		REQUIRE( hit == 1 );
+	}
+}
+
+TEST_CASE( "thread shares are aligned, cover the range and fall to the same threads", "[latticezk]" ) {
+	Executor executor(4);
+	std::vector<std::thread::id> first;
+	for (int round = 0; round < 3; round++) {
+		std::mutex mutex;
+		std::vector<std::tuple<int64_t, int64_t, std::thread::id>> shares;
+		executor.ForEachThreadShare(1000, 16, 0, [&](int64_t i0, int64_t i1) {
+			std::lock_guard<std::mutex> lock(mutex);
+			shares.emplace_back(i0, i1, std::this_thread::get_id());
+		});
+		std::sort(shares.begin(), shares.end());
+		REQUIRE( shares.size() == 4 );
+		// 62 whole units of 16, split 15, 16, 15 and the rest
+		const int64_t starts[] = { 0, 240, 496, 736, 1000 };
+		std::vector<std::thread::id> ids;
+		for (size_t t = 0; t < shares.size(); t++) {
+			REQUIRE( std::get<0>(shares[t]) == starts[t] );
+			REQUIRE( std::get<1>(shares[t]) == starts[t + 1] );
+			ids.push_back(std::get<2>(shares[t]));
+		}
+		REQUIRE( ids[3] == std::this_thread::get_id() );
+		if (round == 0) {
+			first = ids;
+		}
+		REQUIRE( ids == first );
+	}
+	// a range within the grain runs on the calling thread
+	int64_t covered = 0;
+	executor.ForEachThreadShare(100, 16, 100, [&](int64_t i0, int64_t i1) {
+		REQUIRE( std::this_thread::get_id() == first[3] );
+		covered += i1 - i0;
+	});
+	REQUIRE( covered == 100 );
+}
+
+TEST_CASE( "task groups run all their tasks before waiting returns", "[latticezk]" ) {
+	Executor executor(4);
+	std::atomic<int> n_run(0);
+	{
+		TaskGroup group(executor);
+		for (int t = 0; t < 100; t++) {
+			group.Run([&]() {
+				n_run++;
+			});
+		}
+		group.Wait();
+		REQUIRE( n_run == 100 );
+	}
+	// the operations run on the executor of the scope
+	ExecutorScope scope(executor);
+	REQUIRE( &Executor::Current() == &executor );
+	Matrix<int64_t, ColumnMajorOrder> a(300, 200, MatrixInit::Uninitialized), b(300, 200);
+	for (matdim_t i = 0; i < a.NumCells(); i++) {
+		a.Data()[i] = i % 17 - 8;
+	}
+	MatrixOps<int64_t> matops;
+	REQUIRE( matops.Copy(b, a) );
+	REQUIRE( a == b );
+	double ab = 0;
+	REQUIRE( MatrixFrobeniusInnerProduct(a, b, ab) );
+	double expected = 0;
+	for (matdim_t i = 0; i < a.NumCells(); i++) {
+		expected += (double)a.Data()[i] * a.Data()[i];
+	}
+	REQUIRE( ab == expected );
+	b.Zero();
+	REQUIRE( b == Matrix<int64_t, ColumnMajorOrder>(300, 200) );
+}
+
+TEST_CASE( "tuning profiles are saved and loaded", "[latticezk]" ) {
+	TuningProfile profile;
+	profile.gemm_l2_bytes = 1 << 20;
+	profile.strassen_cutoff = 1024;
+	profile.threads = 3;
+	profile.isa = "avx2";
+	const std::string path = "latticezk_catch.profile";
+	REQUIRE( profile.Save(path) );
+	TuningProfile loaded;
+	REQUIRE( loaded.Load(path) );
+	REQUIRE( loaded.gemm_l2_bytes == 1 << 20 );
+	REQUIRE( loaded.strassen_cutoff == 1024 );
+	REQUIRE( loaded.threads == 3 );
+	REQUIRE( loaded.isa == "avx2" );
+	REQUIRE( loaded.gemm_l1_bytes == TuningProfile().gemm_l1_bytes );
+	REQUIRE( loaded.Set("gemm_chunk_work", "0x10000") );
+	REQUIRE( loaded.gemm_chunk_work == 1 << 16 );
+	REQUIRE_FALSE( loaded.Set("gemm_chunk_work", "0") );
+	REQUIRE_FALSE( loaded.Set("gemm_chunk_work", "4k") );
+	REQUIRE_FALSE( loaded.Set("no_such_parameter", "1") );
+	REQUIRE_FALSE( loaded.Load("no_such_directory/latticezk.profile") );
+	remove(path.c_str());
+}
+
+} // namespace LatticeZK
@@ -1,5 +1,11 @@
 #include <iostream>
+#include <memory>
 #include <catch2/catch.hpp>
+#include "latticezk/util/cpucycles.hpp"
+#include "latticezk/matrixops.hpp"
+#include "latticezk/prover.hpp"
+#include "latticezk/gaussian/facct.hpp"
+#include "latticezk/uniform/usampler.hpp"
 
 namespace LatticeZK {
 
@@ -8,4 +14,45 @@ TEST_CASE( "hello", "[latticezk]" ) {
 	std::cerr << "hello" << std::endl;
 }
 
+TEST_CASE( "test-vector verification accepts honest proofs only", "[latticezk]" ) {
+	typedef MatrixOps<int64_t> MatOps;
+	typedef Prover<int64_t, FacctGaussianSampler<2000000000>, MatOps> prover_t;
+	const int s_bits = 2;
+	const uint32_t lambda = 8;
+	const matdim_t n = 10, r = 8, v = 60, l = 20;
+	const double s = (double)l * (1 << (s_bits - 1)), rho = 2;
+	AES_Random aes_rnd;
+	aes_rnd.reseed(3u);
+	BitsSampler bsampler(aes_rnd, s_bits);
+	MatrixSampler<UIntSampler<int64_t>> asampler(aes_rnd);
+	MatrixSampler<BitsSampler> ssampler(bsampler);
+	MatOps matops;
+	MatOps::RowMajorMatrix matA(r, v);
+	MatOps::ColumnMajorMatrix matS(v, l);
+	REQUIRE( asampler(matA) );
+	REQUIRE( ssampler(matS) );
+	std::unique_ptr<prover_t> prover(prover_t::Create(matops, matA, matS, lambda, s, n, rho));
+	REQUIRE( prover != nullptr );
+	auto proof = prover->ReferencingProof();
+	REQUIRE( prover->Prove(aes_rnd, proof) > 0 );
+
+	AES_Random test_rnd;
+	test_rnd.reseed(5u);
+	Verifier<int64_t, MatOps> verifier(matops, r, v, l, n, proof.B, test_rnd, 32), full(matops, r, v, l, n, proof.B);
+	REQUIRE( verifier.Verify(proof) );
+	REQUIRE( full.Verify(proof) );
+	// a single flipped entry of W or of Z is caught by the test vectors
+	proof.mat_W(5) ^= 1;
+	REQUIRE_FALSE( verifier.Verify(proof) );
+	proof.mat_W(5) ^= 1;
+	proof.mat_Z(v * n - 1) ^= 2;
+	REQUIRE_FALSE( verifier.Verify(proof) );
+	REQUIRE_FALSE( full.Verify(proof) );
+	proof.mat_Z(v * n - 1) ^= 2;
+	REQUIRE( verifier.Verify(proof) );
+	// no test vectors check nothing, so nothing is accepted
+	Verifier<int64_t, MatOps> none(matops, r, v, l, n, proof.B, test_rnd, 0);
+	REQUIRE_FALSE( none.Verify(proof) );
+}
+
 } // namespace LatticeZK
@@ -1,9 +1,17 @@
+#include <stdio.h>
 #include <iostream>
 #include <iomanip>
 #include <stdlib.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
 #include <catch2/catch.hpp>
 #include "latticezk/matrix.hpp"
-#include "latticezk/matmult.hpp"
+#include "latticezk/hugepage.hpp"
+#include "latticezk/filematrix.hpp"
+#include "latticezk/matrixops.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/uniform/usampler.hpp"
 #include "testcommon.h"
 
 namespace LatticeZK {
@@ -141,6 +149,472 @@ TEST_CASE( "mxkxn matrix32s multiplication is sane", "[latticezk]" ) {
 	test_mxnxk_matrix32_multiplication(1000, 1000, 1000, 1);
 }
 
+template<typename T>
+void test_mxnxk_gemm_vs_reference(int m, int k, int n, unsigned int seed) {
+	srand(seed);
+	Matrix<T, RowMajorOrder> aM(m, k);
+	Matrix<T, ColumnMajorOrder> bM(k, n), cM(m, n), cX(m, n);
+	for (int i=0; i<m*k; i++) {
+		aM(i) = (T)rand();
+	}
+	for (int i=0; i<k*n; i++) {
+		bM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	REQUIRE( MatrixMultiplyReference(aM, bM, cX) );
+	REQUIRE( MatrixMultiply(aM, bM, cM) );
+	REQUIRE( cM == cX );
+}
+
+TEST_CASE( "blocked multiplication matches the reference for all widths", "[latticezk]" ) {
+	int shapes[][3] = { {1, 1, 1}, {3, 5, 7}, {33, 17, 9}, {65, 300, 31}, {100, 700, 101} };
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		for (size_t i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+			CAPTURE( i );
+			test_mxnxk_gemm_vs_reference<int8_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+			test_mxnxk_gemm_vs_reference<int16_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+			test_mxnxk_gemm_vs_reference<int32_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+			test_mxnxk_gemm_vs_reference<int64_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+		}
+	}
+	SetCpuIsa(isa0);
+}
+
+template<typename T, typename S>
+void test_mxnxk_widening_gemm_vs_reference(int m, int k, int n, unsigned int seed) {
+	srand(seed);
+	Matrix<T, RowMajorOrder> aM(m, k);
+	Matrix<S, RowMajorOrder> bM(k, n);
+	Matrix<T, ColumnMajorOrder> bX(k, n), cM(m, n), cX(m, n);
+	for (int i=0; i<m*k; i++) {
+		aM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	for (int i=0; i<k; i++) {
+		for (int j=0; j<n; j++) {
+			bM(i, j) = (S)rand();
+			bX(i, j) = bM(i, j);
+		}
+	}
+	REQUIRE( MatrixMultiplyReference(aM, bX, cX) );
+	REQUIRE( MatrixMultiply(aM, bM, cM) );
+	REQUIRE( cM == cX );
+}
+
+// Checks the products of the given kernel against those of the scalar kernel, over blocks small enough that
+// tiles, depth blocks and their KU-padding are all partial
+template<typename T, typename Kernel>
+void test_gemm_kernel_vs_scalar(int m, int k, int n, unsigned int seed) {
+	srand(seed);
+	Matrix<T, RowMajorOrder> aM(m, k);
+	Matrix<T, ColumnMajorOrder> bM(k, n), cM(m, n), cX(m, n);
+	for (int i=0; i<m*k; i++) {
+		aM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	for (int i=0; i<k*n; i++) {
+		bM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	GemmStridedSource<T> asrc(aM.Data(), k, 1), bsrc(bM.Data(), 1, k);
+	REQUIRE( GemmWithKernel<T, Scalar::GemmKernel<T>>(m, n, k, asrc, bsrc, cX.Data(), 1, m) );
+	GemmBlocking blocking(2 * Kernel::MR, 5, 2 * Kernel::NR);
+	REQUIRE( GemmWithKernel<T, Kernel>(m, n, k, asrc, bsrc, cM.Data(), 1, m, blocking) );
+	REQUIRE( cM == cX );
+	REQUIRE( GemmWithKernel<T, Kernel>(m, n, k, asrc, bsrc, cM.Data(), 1, m) );
+	REQUIRE( cM == cX );
+}
+
+TEST_CASE( "AVX-512 and VNNI kernels match the scalar kernel", "[latticezk]" ) {
+	int shapes[][3] = { {1, 1, 1}, {63, 7, 9}, {130, 33, 17}, {200, 301, 40} };
+	for (size_t i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+		CAPTURE( i );
+		const int m = shapes[i][0], k = shapes[i][1], n = shapes[i][2];
+		LATTICEZK_UNUSED(m);
+		LATTICEZK_UNUSED(k);
+		LATTICEZK_UNUSED(n);
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX512
+		if (GetCpuIsa() >= CpuIsa::Avx512) {
+			test_gemm_kernel_vs_scalar<int8_t, Avx512::GemmAvx512Kernel<int8_t>>(m, k, n, 1);
+			test_gemm_kernel_vs_scalar<int16_t, Avx512::GemmAvx512Kernel<int16_t>>(m, k, n, 1);
+			test_gemm_kernel_vs_scalar<int32_t, Avx512::GemmAvx512Kernel<int32_t>>(m, k, n, 1);
+			test_gemm_kernel_vs_scalar<int64_t, Avx512::GemmAvx512Kernel<int64_t>>(m, k, n, 1);
+		}
+#endif
+#if LATTICEZK_ISA_MAX >= LATTICEZK_ISA_AVX512VNNI
+		if (GetCpuIsa() >= CpuIsa::Avx512Vnni) {
+			test_gemm_kernel_vs_scalar<int8_t, Avx512Vnni::GemmVnniKernel<int8_t>>(m, k, n, 1);
+			test_gemm_kernel_vs_scalar<int16_t, Avx512Vnni::GemmVnniKernel<int16_t>>(m, k, n, 1);
+		}
+#endif
+	}
+}
+
+TEST_CASE( "blocked multiplication widens narrow entries", "[latticezk]" ) {
+	int shapes[][3] = { {1, 1, 1}, {33, 17, 9}, {100, 700, 101} };
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		for (size_t i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+			CAPTURE( i );
+			test_mxnxk_widening_gemm_vs_reference<int64_t, int8_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+			test_mxnxk_widening_gemm_vs_reference<int64_t, int16_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+			test_mxnxk_widening_gemm_vs_reference<int32_t, int8_t>(shapes[i][0], shapes[i][1], shapes[i][2], 1);
+		}
+	}
+	SetCpuIsa(isa0);
+}
+
+template<typename T, typename S, typename OrderA, typename OrderB, typename OrderC>
+void test_mxnxk_orders_vs_reference(int m, int k, int n) {
+	Matrix<T, OrderA> aM(m, k);
+	Matrix<S, OrderB> bM(k, n);
+	Matrix<T, OrderC> cM(m, n);
+	Matrix<T, RowMajorOrder> aX(m, k);
+	Matrix<T, ColumnMajorOrder> bX(k, n), cX(m, n);
+	for (int i=0; i<m; i++) {
+		for (int j=0; j<k; j++) {
+			aX(i, j) = aM(i, j) = (T)(((int64_t)rand() << 32) ^ rand());
+		}
+	}
+	for (int i=0; i<k; i++) {
+		for (int j=0; j<n; j++) {
+			bX(i, j) = bM(i, j) = (S)rand();
+		}
+	}
+	REQUIRE( MatrixMultiplyReference(aX, bX, cX) );
+	REQUIRE( MatrixMultiply(aM, bM, cM) );
+	for (int i=0; i<m; i++) {
+		for (int j=0; j<n; j++) {
+			REQUIRE( cM(i, j) == cX(i, j) );
+		}
+	}
+}
+
+TEST_CASE( "multiplication reads any combination of orders", "[latticezk]" ) {
+	typedef RowMajorOrder R;
+	typedef ColumnMajorOrder C;
+	srand(1);
+	for (int m : { 1, 33, 130 }) {
+		CAPTURE( m );
+		test_mxnxk_orders_vs_reference<int64_t, int64_t, R, R, R>(m, 97, 41);
+		test_mxnxk_orders_vs_reference<int64_t, int64_t, C, C, C>(m, 97, 41);
+		test_mxnxk_orders_vs_reference<int64_t, int64_t, C, R, C>(m, 97, 41);
+		test_mxnxk_orders_vs_reference<int32_t, int32_t, R, C, R>(m, 97, 41);
+		test_mxnxk_orders_vs_reference<int64_t, int8_t, R, R, R>(m, 97, 41);
+		test_mxnxk_orders_vs_reference<int64_t, int8_t, C, C, R>(m, 97, 41);
+	}
+	Matrix<int64_t, RowMajorOrder> aM(3, 2), bM(2, 4), cM(3, 5);
+	REQUIRE( !MatrixMultiply(aM, bM, cM) );
+}
+
+TEST_CASE( "views multiply, add and copy submatrices in place", "[latticezk]" ) {
+	srand(1);
+	Matrix<int64_t, RowMajorOrder> aM(50, 60), cM(40, 45);
+	Matrix<int64_t, ColumnMajorOrder> bM(60, 70), dM(30, 40);
+	for (int i=0; i<aM.NumCells(); i++) {
+		aM(i) = rand();
+	}
+	for (int i=0; i<bM.NumCells(); i++) {
+		bM(i) = rand();
+	}
+	for (int i=0; i<cM.NumCells(); i++) {
+		cM(i) = 0;
+	}
+	// C[10:30, 10:35] = A[3:23, 5:35] * B[5:35, 7:32]
+	REQUIRE( MatrixMultiply(aM.Block(3, 5, 20, 30), bM.Block(5, 7, 30, 25), cM.Block(10, 10, 20, 25)) );
+	for (int i=0; i<cM.NumRows(); i++) {
+		for (int j=0; j<cM.NumCols(); j++) {
+			int64_t x = 0;
+			if (i >= 10 && i < 30 && j >= 10 && j < 35) {
+				for (int h=0; h<30; h++) {
+					x += aM(3 + i - 10, 5 + h) * bM(5 + h, 7 + j - 10);
+				}
+			}
+			REQUIRE( cM(i, j) == x );
+		}
+	}
+	// a transposed view reads the same entries with the strides swapped
+	ConstMatrixView<int64_t> bT = bM.View().Transposed();
+	REQUIRE( bT.NumRows() == 70 );
+	REQUIRE( bT(3, 4) == bM(4, 3) );
+	MatrixView<int64_t> dV = dM.View();
+	REQUIRE( MatrixCopy(bT.Block(0, 0, 30, 40), dV) );
+	REQUIRE( MatrixAdd(dM.View(), bT.Block(0, 0, 30, 40), dV) );
+	double ip, ipX = 0;
+	REQUIRE( MatrixFrobeniusInnerProduct(dM.View(), bT.Block(0, 0, 30, 40), ip) );
+	for (int i=0; i<30; i++) {
+		for (int j=0; j<40; j++) {
+			REQUIRE( dM(i, j) == 2 * bM(j, i) );
+			ipX += (double)dM(i, j) * (double)bM(j, i);
+		}
+	}
+	REQUIRE( ip == Approx(ipX) );
+	REQUIRE( !MatrixMultiply(aM.Block(0, 0, 20, 30), bM.Block(0, 0, 31, 25), cM.Block(0, 0, 20, 25)) );
+
+	// submatrices of many lines are split among the threads, as whole matrices are
+	Executor executor(4);
+	ExecutorScope scope(executor);
+	Matrix<int64_t, RowMajorOrder> eM(700, 600), fM(500, 400), gM(500, 400);
+	for (int i=0; i<eM.NumCells(); i++) {
+		eM(i) = rand() - RAND_MAX / 2;
+	}
+	REQUIRE( MatrixCopy(eM.Block(100, 150, 500, 400), fM.View()) );
+	REQUIRE( MatrixAdd(eM.Block(100, 150, 500, 400), fM.View(), gM.View()) );
+	REQUIRE( gM == fM + fM );
+	double fg, fgX;
+	REQUIRE( MatrixFrobeniusInnerProduct(fM.View(), gM.View(), fg) );
+	REQUIRE( MatrixFrobeniusInnerProduct(fM, gM, fgX) );
+	REQUIRE( fg == fgX );
+}
+
+template<typename T>
+void test_batch_gemm_vs_reference(int m, int k, const std::vector<int> & ns, unsigned int seed) {
+	srand(seed);
+	Matrix<T, RowMajorOrder> aM(m, k);
+	std::vector<std::unique_ptr<Matrix<T, ColumnMajorOrder>>> bM, cM;
+	std::vector<const Matrix<T, ColumnMajorOrder> *> bs;
+	std::vector<Matrix<T, ColumnMajorOrder> *> cs;
+	for (int i=0; i<m*k; i++) {
+		aM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	for (int n : ns) {
+		bM.emplace_back(new Matrix<T, ColumnMajorOrder>(k, n));
+		cM.emplace_back(new Matrix<T, ColumnMajorOrder>(m, n));
+		for (int i=0; i<k*n; i++) {
+			(*bM.back())(i) = (T)(((int64_t)rand() << 32) ^ rand());
+		}
+		bs.push_back(bM.back().get());
+		cs.push_back(cM.back().get());
+	}
+	REQUIRE( MatrixMultiplyBatch(aM, bs, cs) );
+	for (size_t i=0; i<ns.size(); i++) {
+		CAPTURE( i );
+		Matrix<T, ColumnMajorOrder> cX(m, ns[i]);
+		REQUIRE( MatrixMultiplyReference(aM, *bs[i], cX) );
+		REQUIRE( *cs[i] == cX );
+	}
+}
+
+TEST_CASE( "matrices move and recycle storage through an arena", "[latticezk]" ) {
+	MatrixArena arena;
+	{
+		Matrix<int64_t, ColumnMajorOrder> aM(30, 20, MatrixInit::Zero, arena);
+		aM(3, 4) = 7;
+		const int64_t * data = aM.Data();
+		Matrix<int64_t, ColumnMajorOrder> bM(std::move(aM));
+		REQUIRE( bM.Data() == data );
+		REQUIRE( bM(3, 4) == 7 );
+		REQUIRE( aM.Data() == nullptr );
+		REQUIRE( aM.NumCells() == 0 );
+		Matrix<int64_t, ColumnMajorOrder> cM(2, 2);
+		cM = std::move(bM);
+		REQUIRE( cM.NumRows() == 30 );
+		REQUIRE( cM(3, 4) == 7 );
+	}
+	REQUIRE( arena.NumAllocated() == 1 );
+	{
+		// a product overwrites every entry of its uninitialized result
+		Matrix<int64_t, RowMajorOrder> aM(20, 15, MatrixInit::Zero, arena), bM(15, 30, MatrixInit::Zero, arena);
+		Matrix<int64_t, RowMajorOrder> cM(20, 30, MatrixInit::Uninitialized, arena);
+		for (int i=0; i<cM.NumCells(); i++) {
+			cM(i) = -1;
+		}
+		REQUIRE( MatrixMultiply(aM, bM, cM) );
+		for (int i=0; i<cM.NumCells(); i++) {
+			REQUIRE( cM(i) == 0 );
+		}
+	}
+	REQUIRE( arena.NumReused() == 1 );
+	REQUIRE( arena.NumAllocated() == 3 );
+}
+
+TEST_CASE( "huge-page allocation serves large and small matrices", "[latticezk]" ) {
+	HugePageAllocator hugepages;
+	MatrixArena arena(hugepages);
+	for (int round=0; round<2; round++) {
+		Matrix<int64_t, RowMajorOrder> aM(700, 600, MatrixInit::Uninitialized, arena), bM(10, 10, MatrixInit::Zero, arena);
+		REQUIRE( (uintptr_t)aM.Data() % LATTICEZK_ALIGNMENT == 0 );
+		REQUIRE( (uintptr_t)bM.Data() % LATTICEZK_ALIGNMENT == 0 );
+		for (int i=0; i<aM.NumCells(); i++) {
+			aM(i) = i;
+		}
+		REQUIRE( aM(699, 599) == 700 * 600 - 1 );
+		REQUIRE( bM(9, 9) == 0 );
+	}
+	REQUIRE( arena.NumAllocated() == 2 );
+	REQUIRE( arena.NumReused() == 2 );
+}
+
+#if defined(__linux__)
+TEST_CASE( "huge-page allocation bound to a missing node fails", "[latticezk]" ) {
+	// no system has node 63, so the binding cannot hold
+	HugePageAllocator bound(1 << 21, false, NumaPolicy::Bind, 1ul << 63);
+	const size_t bytes = LATTICEZK_HUGE_PAGE_THRESHOLD;
+	REQUIRE( bound.Allocate(bytes) == nullptr );
+	// smaller matrices are not bound
+	void * p = bound.Allocate(64);
+	REQUIRE( p != nullptr );
+	bound.Free(p, 64);
+}
+#endif
+
+TEST_CASE( "batched multiplication matches the reference", "[latticezk]" ) {
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		test_batch_gemm_vs_reference<int64_t>(37, 29, { 1, 23, 0, 8, 5 }, 1);
+		test_batch_gemm_vs_reference<int32_t>(100, 300, { 101, 3, 17 }, 1);
+		test_batch_gemm_vs_reference<int8_t>(65, 17, { 9, 0, 31 }, 1);
+		test_batch_gemm_vs_reference<int64_t>(5, 0, { 3, 4 }, 1);
+	}
+	SetCpuIsa(isa0);
+	Matrix<int64_t, RowMajorOrder> aM(3, 2);
+	Matrix<int64_t, ColumnMajorOrder> bM(2, 4), cM(3, 5);
+	REQUIRE( !MatrixMultiplyBatch<int64_t>(aM, { &bM }, { &cM }) );
+	REQUIRE( !MatrixMultiplyBatch<int64_t>(aM, { &bM }, {}) );
+}
+
+template<typename T, typename S>
+void test_mxnxk_strassen_vs_reference(int m, int k, int n, matdim_t cutoff, GemmWorkspace & ws) {
+	Matrix<T, RowMajorOrder> aM(m, k);
+	Matrix<S, ColumnMajorOrder> bM(k, n);
+	Matrix<T, ColumnMajorOrder> bX(k, n), cM(m, n), cX(m, n);
+	for (int i=0; i<m*k; i++) {
+		aM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	for (int i=0; i<k*n; i++) {
+		bM(i) = (S)(((int64_t)rand() << 32) ^ rand());
+		bX(i) = bM(i);
+	}
+	REQUIRE( MatrixMultiplyReference(aM, bX, cX) );
+	GemmStridedSource<T> asrc(aM.Data(), k, 1);
+	GemmStridedSource<S> bsrc(bM.Data(), 1, k);
+	REQUIRE( StrassenGemm<T>(m, n, k, asrc, bsrc, cM.Data(), 1, m, cutoff, ws) );
+	REQUIRE( cM == cX );
+}
+
+TEST_CASE( "Strassen-Winograd multiplication matches the reference", "[latticezk]" ) {
+	int shapes[][3] = { {16, 16, 16}, {17, 33, 9}, {40, 31, 75}, {63, 64, 65}, {130, 97, 41} };
+	GemmWorkspace ws;
+	srand(1);
+	for (size_t i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+		CAPTURE( i );
+		for (matdim_t cutoff : { 3, 8, 20 }) {
+			CAPTURE( cutoff );
+			test_mxnxk_strassen_vs_reference<int64_t, int64_t>(shapes[i][0], shapes[i][1], shapes[i][2], cutoff, ws);
+			test_mxnxk_strassen_vs_reference<int32_t, int32_t>(shapes[i][0], shapes[i][1], shapes[i][2], cutoff, ws);
+			test_mxnxk_strassen_vs_reference<int8_t, int8_t>(shapes[i][0], shapes[i][1], shapes[i][2], cutoff, ws);
+			test_mxnxk_strassen_vs_reference<int64_t, int8_t>(shapes[i][0], shapes[i][1], shapes[i][2], cutoff, ws);
+		}
+	}
+	REQUIRE( StrassenWorkspaceBytes<int64_t>(8, 8, 8, 8) == 0 );
+	REQUIRE( StrassenWorkspaceBytes<int64_t>(9, 9, 9, 4) > 0 );
+}
+
+TEST_CASE( "Strassen-Winograd multiplication falls back while its workspace is in use", "[latticezk]" ) {
+	GemmWorkspace ws;
+	srand(2);
+	REQUIRE( ws.Reserve(64) );
+	char * taken = ws.Take<char>(64);
+	REQUIRE( taken != nullptr );
+	REQUIRE( !ws.Reserve(StrassenWorkspaceBytes<int64_t>(40, 75, 31, 4)) );
+	// the blocked engine computes the product instead
+	test_mxnxk_strassen_vs_reference<int64_t, int64_t>(40, 31, 75, 4, ws);
+	REQUIRE( !ws.Trim() );
+	ws.Release(taken);
+	test_mxnxk_strassen_vs_reference<int64_t, int64_t>(40, 31, 75, 4, ws);
+	// what a multiplication reserves is kept up to the cap, and freed on demand
+	REQUIRE( ws.Reserved() >= StrassenWorkspaceBytes<int64_t>(40, 75, 31, 4) );
+	REQUIRE( !ws.Trim(ws.Reserved()) );
+	REQUIRE( ws.Trim() );
+	REQUIRE( ws.Reserved() == 0 );
+	test_mxnxk_strassen_vs_reference<int64_t, int64_t>(40, 31, 75, 4, ws);
+}
+
+template<typename T>
+void test_mxn_reordering(int m, int n) {
+	Matrix<T, RowMajorOrder> aM(m, n), cM(m, n);
+	Matrix<T, ColumnMajorOrder> bM(m, n);
+	for (int i=0; i<m*n; i++) {
+		aM(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	REQUIRE( MatrixToColumnMajorOrder(aM, bM) );
+	for (int i=0; i<m; i++) {
+		for (int j=0; j<n; j++) {
+			REQUIRE( bM(i, j) == aM(i, j) );
+		}
+	}
+	REQUIRE( MatrixToRowMajorOrder(bM, cM) );
+	REQUIRE( cM == aM );
+	if (m == n) {
+		REQUIRE( MatrixTransposeInPlace(cM) );
+		for (int i=0; i<m; i++) {
+			for (int j=0; j<n; j++) {
+				REQUIRE( cM(j, i) == aM(i, j) );
+			}
+		}
+	}
+}
+
+TEST_CASE( "reordering transposes for all widths", "[latticezk]" ) {
+	int shapes[][2] = { {1, 1}, {3, 5}, {8, 8}, {17, 33}, {64, 64}, {130, 130}, {300, 7}, {515, 261} };
+	CpuIsa isa0 = GetCpuIsa();
+	srand(1);
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		for (size_t i=0; i<sizeof(shapes)/sizeof(shapes[0]); i++) {
+			CAPTURE( i );
+			test_mxn_reordering<int8_t>(shapes[i][0], shapes[i][1]);
+			test_mxn_reordering<int16_t>(shapes[i][0], shapes[i][1]);
+			test_mxn_reordering<int32_t>(shapes[i][0], shapes[i][1]);
+			test_mxn_reordering<int64_t>(shapes[i][0], shapes[i][1]);
+		}
+	}
+	SetCpuIsa(isa0);
+	Matrix<int64_t, RowMajorOrder> aM(3, 2);
+	REQUIRE( !MatrixTransposeInPlace(aM) );
+}
+
+TEST_CASE( "narrowing checks entries fit", "[latticezk]" ) {
+	Matrix<int64_t, ColumnMajorOrder> aM(3, 2);
+	Matrix<int8_t, RowMajorOrder> bM(3, 2);
+	for (int i=0; i<6; i++) {
+		aM(i) = i % 2 ? -128 + i : 127 - i;
+	}
+	REQUIRE( MatrixNarrowToRowMajorOrder(aM, bM) );
+	for (int i=0; i<3; i++) {
+		for (int j=0; j<2; j++) {
+			REQUIRE( bM(i, j) == aM(i, j) );
+		}
+	}
+	aM(4) = 128;
+	REQUIRE( !MatrixNarrowToRowMajorOrder(aM, bM) );
+}
+
+template<typename Kernel>
+void test_gemm_partial_blocks() {
+	Matrix<int64_t, RowMajorOrder> aM(37, 29);
+	Matrix<int64_t, ColumnMajorOrder> bM(29, 23), cM(37, 23), cX(37, 23);
+	for (int i=0; i<37*29; i++) {
+		aM(i) = (int64_t)i * 0x9E3779B97F4A7C15LL;
+	}
+	for (int i=0; i<29*23; i++) {
+		bM(i) = (int64_t)i * 0xC2B2AE3D27D4EB4FLL;
+	}
+	REQUIRE( MatrixMultiplyReference(aM, bM, cX) );
+	GemmStridedSource<int64_t> asrc(aM.Data(), aM.NumCols(), 1), bsrc(bM.Data(), 1, bM.NumRows());
+	GemmBlocking blocking(Kernel::MR, 5, Kernel::NR);
+	REQUIRE( GemmWithKernel<int64_t, Kernel>(37, 23, 29, asrc, bsrc, cM.Data(), 1, 37, blocking) );
+	REQUIRE( cM == cX );
+}
+
+TEST_CASE( "blocked multiplication handles partial blocks", "[latticezk]" ) {
+	// the kernel dispatched for the CPU, whose edge tiles are partial, and the scalar kernel
+#define LATTICEZK_PARTIAL_BLOCKS_CASE(ns) test_gemm_partial_blocks<ns::GemmKernel<int64_t>>(); break;
+	LATTICEZK_ISA_SWITCH(LATTICEZK_PARTIAL_BLOCKS_CASE)
+#undef LATTICEZK_PARTIAL_BLOCKS_CASE
+	test_gemm_partial_blocks<Scalar::GemmKernel<int64_t>>();
+}
+
 void test_mxn_matrix32_addition(int m, int n, unsigned int seed) {
 	srand(seed);
 	Matrix32s aM(m, n), bM(m, n), cM(m, n), cX(m, n);
@@ -165,4 +639,366 @@ TEST_CASE( "m*n matrix32s addition is sane", "[latticezk]" ) {
 	test_mxn_matrix32_addition(100, 100, 1);
 }
 
+TEST_CASE( "expressions add, compare and sum products in one pass", "[latticezk]" ) {
+	const matdim_t m = 300, n = 200;
+	Matrix<int64_t, ColumnMajorOrder> a(m, n), b(m, n), c(m, n), d(m, n);
+	TestRandom rnd(7);
+	rnd.Fill(a, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(b, [](uint64_t x) { return (int64_t)(x >> 7) - (1ll << 55); });
+	REQUIRE( MatrixAssign(c, a + b - a) );
+	REQUIRE( c == b );
+	REQUIRE( MatrixAssign(d, a + b) );
+	REQUIRE( d == a + b );
+	REQUIRE( d - b == a );
+	REQUIRE( a + b != b );
+	d(m - 1, n - 1)++;
+	REQUIRE( d != a + b );
+	// mismatching dimensions compare unequal and do not evaluate
+	Matrix<int64_t, ColumnMajorOrder> e(m, n - 1);
+	REQUIRE( e != a );
+	REQUIRE_FALSE( MatrixAssign(e, a + b) );
+	REQUIRE_FALSE( MatrixAssign(c, a + e) );
+
+	// products of large entries would lose low bits in double sums, and cancel here to a small exact value
+	Matrix<int64_t, ColumnMajorOrder> f(1, 3), g(1, 3);
+	f(0) = (1ll << 62) + 1; g(0) = 3;
+	f(1) = 1ll << 62; g(1) = -3;
+	f(2) = 5; g(2) = 7;
+	MatrixDotSum<int64_t> fg;
+	REQUIRE( MatrixDot(f, g, fg) );
+	REQUIRE( fg.ToDouble() == 38.0 );
+	double fgX = 0;
+	for (matdim_t i = 0; i < 3; i++) {
+		fgX += (double)f(i) * (double)g(i);
+	}
+	REQUIRE( fgX != 38.0 );
+	MatrixDotSum<int64_t> ff;
+	REQUIRE( MatrixSquaredNorm(f - f, ff) );
+	REQUIRE( ff.ToDouble() == 0.0 );
+
+	// the exact sums agree across entry widths and with the member functions
+	Matrix<int8_t, ColumnMajorOrder> a8(m, n), b8(m, n);
+	Matrix<int64_t, ColumnMajorOrder> a64(m, n), b64(m, n);
+	for (matdim_t i = 0; i < a8.NumCells(); i++) {
+		a64(i) = a8(i) = (int8_t)(a(i) >> 3);
+		b64(i) = b8(i) = (int8_t)(b(i) >> 5);
+	}
+	MatrixDotSum<int8_t> ab8;
+	MatrixDotSum<int64_t> ab64;
+	REQUIRE( MatrixDot(a8, b8, ab8) );
+	REQUIRE( MatrixDot(a64, b64, ab64) );
+	double ab = 0;
+	REQUIRE( a64.FrobeniusInnerProduct(b64, ab) );
+	REQUIRE( ab8.ToDouble() == ab64.ToDouble() );
+	REQUIRE( ab == ab64.ToDouble() );
+
+	// full-range entries carry past 128 bits, and back when the signs of the products alternate
+	// with several chunks per thread, so that the partial sums of the threads are added too
+	const matdim_t len = 1 << 16;
+	Matrix<int64_t, ColumnMajorOrder> h(1, len), p(1, len);
+	for (matdim_t i = 0; i < len; i++) {
+		h(i) = INT64_MIN;
+		p(i) = i < len / 2 ? INT64_MIN : INT64_MAX;
+	}
+	MatrixDotSum<int64_t> hh, hp;
+	REQUIRE( MatrixSquaredNorm(h, hh) );
+	REQUIRE( hh.ToDouble() == ldexp((double)len, 126) );
+	// the halves sum to len/2*2^126 and -len/2*(2^126-2^63), leaving len/2*2^63
+	{
+		Executor executor(4);
+		ExecutorScope scope(executor);
+		REQUIRE( MatrixDot(h, p, hp) );
+	}
+	REQUIRE( hp.ToDouble() == ldexp((double)(len / 2), 63) );
+	MatrixDotSum<int64_t> hp1;
+	{
+		Executor executor(1);
+		ExecutorScope scope(executor);
+		REQUIRE( MatrixDot(h, p, hp1) );
+	}
+	REQUIRE( hp1.ToDouble() == hp.ToDouble() );
+	for (matdim_t i = 0; i < len; i++) {
+		p(i) = i % 3 == 0 ? INT64_MAX : i % 3 == 1 ? INT64_MIN : -(int64_t)i;
+	}
+	MatrixDotSum<int64_t> hq;
+	REQUIRE( MatrixDot(h, p, hq) );
+	double hqX = 0;
+	for (matdim_t i = 0; i < len; i++) {
+		hqX += (double)h(i) * (double)p(i);
+	}
+	REQUIRE( hq.ToDouble() == Approx(hqX) );
+}
+
+TEST_CASE( "column norms are checked exactly against a bound", "[latticezk]" ) {
+	// an odd number of rows leaves a tail to the vector kernel
+	const matdim_t m = 1001, n = 50;
+	Matrix<int64_t, ColumnMajorOrder> z(m, n);
+	TestRandom rnd(11);
+	rnd.Fill(z, [](uint64_t x) { return (int64_t)(x >> 28) - (1ll << 35); });
+	double max_norm = 0;
+	for (matdim_t j = 0; j < n; j++) {
+		double norm = 0;
+		for (matdim_t i = 0; i < m; i++) {
+			norm += (double)z(i, j) * (double)z(i, j);
+		}
+		max_norm = std::max(max_norm, norm);
+	}
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		matdim_t col = -1;
+		double norm = 0;
+		REQUIRE( MatrixColumnsWithinNorm(z, max_norm * 1.0001, col, norm) );
+		REQUIRE( col == -1 );
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(z, max_norm * 0.9999, col, norm) );
+		REQUIRE( col >= 0 );
+		REQUIRE( norm == Approx(max_norm).epsilon(1e-3) );
+
+		// 2^80 + 1 rounds to the bound 2^80 as a double, and exceeds it here
+		Matrix<int64_t, ColumnMajorOrder> y(3, 2);
+		y(0, 0) = 1ll << 40; y(1, 0) = 1;
+		y(0, 1) = -(1ll << 40);
+		REQUIRE( (double)(1ll << 40) * (double)(1ll << 40) + 1.0 == ldexp(1, 80) );
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(y, ldexp(1, 80), col, norm) );
+		REQUIRE( col == 0 );
+		y(1, 0) = 0;
+		REQUIRE( MatrixColumnsWithinNorm(y, ldexp(1, 80), col, norm) );
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(y, ldexp(1, 80) - ldexp(1, 28), col, norm) );
+		// the most negative entry squares to 2^126
+		y(2, 1) = INT64_MIN;
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(y, ldexp(1, 126), col, norm) );
+		REQUIRE( col == 1 );
+		REQUIRE( MatrixColumnsWithinNorm(y, ldexp(1, 126) + ldexp(1, 80), col, norm) );
+
+		// (2^52+1)^2 = 2^104+2^53+1 is within the exact square of the radius, and not within its square as a double
+		const double radius = ldexp(1, 52) + 1;
+		Matrix<int64_t, ColumnMajorOrder> x1(2, 1);
+		x1(0) = (1ll << 52) + 1;
+		REQUIRE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(radius), col, norm) );
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(x1, radius * radius, col, norm) );
+		x1(1) = 1;
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(radius), col, norm) );
+		// squares of fractional, tiny and huge radii are floored, and negative ones bound nothing
+		x1(0) = 2; x1(1) = 1;
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(2.2), col, norm) );
+		REQUIRE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(2.25), col, norm) );
+		x1(0) = 0; x1(1) = 0;
+		REQUIRE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(ldexp(1, -600)), col, norm) );
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(-1), col, norm) );
+		x1(0) = 1;
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(0.99), col, norm) );
+		x1(0) = INT64_MIN; x1(1) = INT64_MIN;
+		REQUIRE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(ldexp(1.5, 63)), col, norm) );
+		REQUIRE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(ldexp(1, 90)), col, norm) );
+		REQUIRE_FALSE( MatrixColumnsWithinNorm(x1, MatrixNormBound::Square(ldexp(1, 63)), col, norm) );
+
+		// narrow entries sum the same as wide ones
+		Matrix<int8_t, ColumnMajorOrder> z8(m, n);
+		Matrix<int64_t, ColumnMajorOrder> z64(m, n);
+		for (matdim_t i = 0; i < z8.NumCells(); i++) {
+			z64(i) = z8(i) = (int8_t)z(i);
+		}
+		for (double bound : { 1000.0 * m, 5000.0 * m, 16384.0 * m }) {
+			REQUIRE( MatrixColumnsWithinNorm(z8, bound, col, norm) == MatrixColumnsWithinNorm(z64, bound, col, norm) );
+		}
+		REQUIRE( MatrixColumnsWithinNorm(z8, 16384.0 * m, col, norm) );
+	}
+	SetCpuIsa(isa0);
+}
+
+template<typename T>
+void test_seeded_vs_sampled(matdim_t r, matdim_t v, matdim_t n) {
+	uint8_t seed[16];
+	for (int i=0; i<16; i++) {
+		seed[i] = (uint8_t)(i * 37 + 5);
+	}
+	// the seeded matrix is the one sampled from the stream of its seed
+	AES_Random aes_rnd;
+	aes_rnd.reseed(seed);
+	UIntSampler<T> usampler(aes_rnd);
+	Matrix<T, RowMajorOrder> aM(r, v), gM(r, v);
+	for (matdim_t i=0; i<aM.NumCells(); i++) {
+		aM(i) = usampler();
+	}
+	SeededMatrix<T> sA(r, v, seed);
+	REQUIRE( sA.ToMatrix(gM) );
+	REQUIRE( gM == aM );
+	REQUIRE( sA(r - 1, v - 1) == aM(r - 1, v - 1) );
+	REQUIRE( sA(r / 2, 1) == aM(r / 2, 1) );
+
+	// multiplied by narrow and wide operands of either order
+	Matrix<int8_t, RowMajorOrder> bM(v, n);
+	Matrix<T, ColumnMajorOrder> bX(v, n), cM(r, n), cX(r, n);
+	Matrix<T, RowMajorOrder> cR(r, n);
+	for (matdim_t i=0; i<bM.NumCells(); i++) {
+		bM(i) = (int8_t)rand();
+	}
+	for (matdim_t i=0; i<bX.NumCells(); i++) {
+		bX(i) = (T)(((int64_t)rand() << 32) ^ rand());
+	}
+	MatrixOps<T> matops;
+	REQUIRE( matops.Multiply(sA, bM, cM) );
+	REQUIRE( MatrixMultiply(aM, bM, cX) );
+	REQUIRE( cM == cX );
+	REQUIRE( matops.Multiply(sA, bX, cR) );
+	REQUIRE( MatrixMultiply(aM, bX, cX) );
+	REQUIRE( MatrixToColumnMajorOrder(cR, cM) );
+	REQUIRE( cM == cX );
+	// and as a right operand, in blocks
+	Matrix<T, ColumnMajorOrder> xM(n, r), dM(n, v), dX(n, v);
+	for (matdim_t i=0; i<xM.NumCells(); i++) {
+		xM(i) = (T)rand();
+	}
+	REQUIRE( Gemm<T>(n, v - 1, r - 1, GemmStridedSource<T>(xM.Data(), 1, n), GemmSeededSource<T>(sA).Block(1, 1), dM.Data(), 1, n) );
+	REQUIRE( MatrixMultiply(xM.View().Cols(0, r - 1), aM.View().Rows(1, r - 1).Cols(1, v - 1), dX.View().Cols(0, v - 1)) );
+	for (matdim_t i=0; i<n*(v - 1); i++) {
+		REQUIRE( dM(i) == dX(i) );
+	}
+
+	// checking products reads the seeded matrix as the sampled one
+	Matrix<T, RowMajorOrder> tM(r, 70);
+	Matrix<T, ColumnMajorOrder> tC(r, n), wM(r, n);
+	BitMatrix c(70, n);
+	for (matdim_t i=0; i<tM.NumCells(); i++) {
+		tM(i) = (T)rand();
+	}
+	for (matdim_t j=0; j<n; j++) {
+		for (matdim_t i=0; i<70; i++) {
+			c.Set(i, j, rand() & 1);
+		}
+	}
+	REQUIRE( MatrixMultiply(aM, bX, cX) );
+	REQUIRE( MatrixMultiply(tM, c, tC) );
+	for (matdim_t i=0; i<wM.NumCells(); i++) {
+		wM(i) = (T)((uint64_t)cX(i) - (uint64_t)tC(i));
+	}
+	bool equal = false;
+	REQUIRE( matops.CheckProducts(sA, bX, tM, c, wM, equal) );
+	REQUIRE( equal );
+	wM(wM.NumCells() - 1) ^= 1;
+	REQUIRE( matops.CheckProducts(sA, bX, tM, c, wM, equal) );
+	REQUIRE_FALSE( equal );
+
+	// copying copies the seed
+	SeededMatrix<T> sB(r, v);
+	REQUIRE( matops.Copy(sB, sA) );
+	REQUIRE( sB(0, 3) == aM(0, 3) );
+	Matrix<T, ColumnMajorOrder> cBad(r, n + 1);
+	REQUIRE( !matops.Multiply(sA, bX, cBad) );
+}
+
+TEST_CASE( "seeded matrices are regenerated in the multiplications by them", "[latticezk]" ) {
+	srand(5);
+	CpuIsa isa0 = GetCpuIsa();
+	for (int isa = LATTICEZK_ISA_SCALAR; SetCpuIsa((CpuIsa)isa); isa++) {
+		CAPTURE( CpuIsaName((CpuIsa)isa) );
+		test_seeded_vs_sampled<int64_t>(37, 301, 13);
+		test_seeded_vs_sampled<int32_t>(70, 1023, 5);
+		test_seeded_vs_sampled<int16_t>(3, 29, 40);
+	}
+	SetCpuIsa(isa0);
+}
+
+TEST_CASE( "file-backed matrices are streamed a tile at a time through the products", "[latticezk]" ) {
+	srand(11);
+	const matdim_t r = 33, v = 301, l = 70, n = 45;
+	Matrix<int64_t, RowMajorOrder> aM(r, v);
+	Matrix<int8_t, RowMajorOrder> sM(v, l);
+	Matrix<int64_t, ColumnMajorOrder> yM(v, n), bM(v, n), zM(v, n), bX(v, n), zX(v, n);
+	Matrix<int64_t, RowMajorOrder> tM(r, l), tX(r, l);
+	BitMatrix cM(l, n);
+	for (matdim_t i=0; i<aM.NumCells(); i++) {
+		aM(i) = ((int64_t)rand() << 32) ^ rand();
+	}
+	for (matdim_t i=0; i<sM.NumCells(); i++) {
+		sM(i) = (int8_t)rand();
+	}
+	for (matdim_t i=0; i<yM.NumCells(); i++) {
+		yM(i) = rand() - RAND_MAX / 2;
+	}
+	for (matdim_t j=0; j<n; j++) {
+		for (matdim_t i=0; i<l; i++) {
+			cM.Set(i, j, rand() & 1);
+		}
+	}
+	const std::string path = "latticezk_catch.matrix";
+	{
+		FileMatrix<int8_t> sF;
+		REQUIRE( sF.Create(path, v, l) );
+		// written in uneven tiles
+		REQUIRE( sF.WriteRows(0, 100, sM.Data()) );
+		REQUIRE( sF.WriteRows(100, v - 100, sM.Data() + 100 * l) );
+		REQUIRE( !sF.WriteRows(v - 1, 2, sM.Data()) );
+	}
+	FileMatrix<int8_t> sF;
+	REQUIRE( !sF.Open(path, v, l + 1) );
+	REQUIRE( sF.Open(path, v, l) );
+	// the tiles come in order, whole, and a failing tile stops the stream
+	matdim_t next_row = 0;
+	REQUIRE( FileMatrixStreamRows(sF, 7, [&](matdim_t i0, matdim_t m, const int8_t * tile) {
+		const bool whole = i0 == next_row && memcmp(tile, sM.Data() + (size_t)i0 * l, (size_t)m * l) == 0;
+		next_row += m;
+		return whole;
+	}) );
+	REQUIRE( next_row == v );
+	next_row = 0;
+	REQUIRE_FALSE( FileMatrixStreamRows(sF, 7, [&](matdim_t i0, matdim_t m, const int8_t * tile) {
+		LATTICEZK_UNUSED(tile);
+		next_row = i0 + m;
+		return i0 < 70;
+	}) );
+	REQUIRE( next_row == 77 );
+	REQUIRE( MatrixMultiply(aM, sM, tX) );
+	REQUIRE( MatrixMultiply(sM, cM, bX) );
+	// tiles of one row, of rows not dividing v, and of the whole matrix
+	for (matdim_t tile_rows : { 1, 64, v }) {
+		CAPTURE( tile_rows );
+		// the products overwrite what was there
+		for (matdim_t i=0; i<tM.NumCells(); i++) {
+			tM(i) = 5;
+		}
+		REQUIRE( MatrixMultiply(aM.View(), sF, tM.View(), tile_rows) );
+		REQUIRE( tM == tX );
+		for (matdim_t i=0; i<bM.NumCells(); i++) {
+			bM(i) = 5;
+		}
+		REQUIRE( MatrixMultiply(sF, cM, bM.View(), tile_rows) );
+		REQUIRE( bM == bX );
+	}
+
+	// a seeded A, and the fused multiply-add, through the matrix operations
+	MatrixOps<int64_t> matops;
+	uint8_t seed[16] = { 7 };
+	SeededMatrix<int64_t> sA(r, v, seed);
+	REQUIRE( sA.ToMatrix(aM) );
+	REQUIRE( MatrixMultiply(aM, sM, tX) );
+	REQUIRE( matops.Multiply(sA, sF, tM) );
+	REQUIRE( tM == tX );
+	double ZB, BB, ZBX, BBX;
+	REQUIRE( matops.MultiplyAdd(sF, cM, yM, bM, zM, ZB, BB) );
+	REQUIRE( MatrixMultiplyAdd(sM, cM, yM, bX, zX, ZBX, BBX) );
+	REQUIRE( bM == bX );
+	REQUIRE( zM == zX );
+	REQUIRE( ZB == ZBX );
+	REQUIRE( BB == BBX );
+	Matrix<int64_t, RowMajorOrder> tBad(r, l + 1);
+	REQUIRE( !matops.Multiply(aM, sF, tBad) );
+	REQUIRE( sF.UpperBoundOnOperatorNorm() == sM.UpperBoundOnOperatorNorm() );
+	// a wider matrix narrows into the file only if its entries fit
+	Matrix<int64_t, ColumnMajorOrder> wideM(v, l);
+	for (matdim_t i=0; i<v; i++) {
+		for (matdim_t j=0; j<l; j++) {
+			wideM(i, j) = sM(i, j);
+		}
+	}
+	REQUIRE( sF.Open(path, v, l, true) );
+	REQUIRE( MatrixNarrowToFile(wideM, sF) );
+	REQUIRE( matops.Multiply(aM, sF, tM) );
+	REQUIRE( tM == tX );
+	wideM(v - 1, 0) = 128;
+	REQUIRE( !MatrixNarrowToFile(wideM, sF) );
+	sF.Close();
+	REQUIRE( !matops.Multiply(aM, sF, tM) );
+	remove(path.c_str());
+}
+
 } // namespace LatticeZK
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "latticezk/util/cpucycles.hpp"
+#include "latticezk/matrix.hpp"
+#include "latticezk/bitmatrix.hpp"
+#include "latticezk/filematrix.hpp"
+#include "latticezk/matrixops.hpp"
+#include "latticezk/numamatrixops.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/prover.hpp"
+#include "latticezk/gaussian/facct.hpp"
+#include "latticezk/uniform/usampler.hpp"
+#include "testcommon.h"
+
+namespace LatticeZK {
+
+// Two nodes sharing the first CPU, so that the partitioning is exercised on any machine
+static NumaTopology two_node_topology()
+{
+	return NumaTopology({ { 0, { 0 } }, { 1, { 0 } } });
+}
+
+TEST_CASE( "NUMA partitions cover the columns in aligned parts", "[latticezk]" ) {
+	NumaTopology topology({ { 0, { 0, 1, 2 } }, { 1, { 3 } } });
+	REQUIRE( topology.PartitionStart(0, 100) == 0 );
+	REQUIRE( topology.PartitionStart(1, 100) % LATTICEZK_NUMA_COLUMN_ALIGN == 0 );
+	REQUIRE( topology.PartitionStart(1, 100) == 80 );
+	REQUIRE( topology.PartitionStart(2, 100) == 100 );
+	REQUIRE( topology.PartitionStart(1, 5) == 0 );
+	REQUIRE( NumaTopology::Discover().NumNodes() >= 1 );
+}
+
+TEST_CASE( "NUMA-partitioned multiplication matches MatrixOps", "[latticezk]" ) {
+	NumaMatrixOps<int64_t> numaops(two_node_topology());
+	MatrixOps<int64_t> matops;
+	TestRandom rnd(1);
+	for (matdim_t n : { 1, 40, 100 }) {
+		CAPTURE( n );
+		Matrix<int64_t, RowMajorOrder> aM(37, 120), tM(37, n), tX(37, n);
+		Matrix<int8_t, RowMajorOrder> sM(120, n);
+		Matrix<int64_t, ColumnMajorOrder> yM(120, n), wM(37, n), wX(37, n), zM(37, n), zX(37, n);
+		BitMatrix cM(120, n);
+		rnd.Fill(aM, [](uint64_t x) { return (int64_t)x; });
+		rnd.Fill(yM, [](uint64_t x) { return (int64_t)(x >> 20); });
+		rnd.Fill(sM, [](uint64_t x) { return (int8_t)(x >> 56); });
+		rnd.FillBits(cM);
+		// the left operands are new, perhaps where those of the last round were
+		REQUIRE( numaops.Sync(aM) );
+		REQUIRE( numaops.Sync(sM) );
+		REQUIRE( numaops.Sync(yM) );
+		REQUIRE( numaops.Multiply(aM, sM, tM) );
+		REQUIRE( matops.Multiply(aM, sM, tX) );
+		REQUIRE( tM == tX );
+		// the replicas of A are kept until A is synced
+		aM(0, 0) += 1;
+		REQUIRE( numaops.Sync(aM) );
+		REQUIRE( numaops.Multiply(aM, sM, tM) );
+		REQUIRE( matops.Multiply(aM, sM, tX) );
+		REQUIRE( tM == tX );
+		REQUIRE( numaops.Multiply(aM, yM, wM) );
+		REQUIRE( matops.Multiply(aM, yM, wX) );
+		REQUIRE( wM == wX );
+		REQUIRE( numaops.Multiply(aM, cM, zM) );
+		REQUIRE( matops.Multiply(aM, cM, zX) );
+		REQUIRE( zM == zX );
+	}
+	Matrix<int64_t, RowMajorOrder> aM(3, 2), bM(2, 4), cM(3, 5);
+	REQUIRE( !numaops.Multiply(aM, bM, cM) );
+}
+
+TEST_CASE( "NUMA-partitioned batches, S*C + Y and checks match MatrixOps", "[latticezk]" ) {
+	NumaMatrixOps<int64_t> numaops(two_node_topology());
+	MatrixOps<int64_t> matops;
+	TestRandom rnd(2);
+	const matdim_t r = 13, v = 37, l = 120;
+	const uint8_t seed[16] = { 5 };
+	for (matdim_t n : { 1, 40, 100 }) {
+		CAPTURE( n );
+		Matrix<int64_t, RowMajorOrder> aM(r, v), tM(r, l);
+		Matrix<int8_t, RowMajorOrder> sM(v, l);
+		Matrix<int64_t, ColumnMajorOrder> yM(v, n), bM(v, n), bX(v, n), zM(v, n), zX(v, n), wM(r, n);
+		BitMatrix cM(l, n);
+		rnd.Fill(aM, [](uint64_t x) { return (int64_t)x; });
+		rnd.Fill(sM, [](uint64_t x) { return (int8_t)(x >> 56); });
+		rnd.Fill(yM, [](uint64_t x) { return (int64_t)(x >> 44) - (1 << 19); });
+		rnd.FillBits(cM);
+		REQUIRE( numaops.Sync(aM) );
+		REQUIRE( numaops.Sync(sM) );
+		REQUIRE( numaops.Sync(tM) );
+
+		double ZB, BB, ZBX, BBX;
+		REQUIRE( numaops.MultiplyAdd(sM, cM, yM, bM, zM, ZB, BB) );
+		REQUIRE( matops.MultiplyAdd(sM, cM, yM, bX, zX, ZBX, BBX) );
+		REQUIRE( bM == bX );
+		REQUIRE( zM == zX );
+		REQUIRE( ZB == ZBX );
+		REQUIRE( BB == BBX );
+
+		// a batch of items of different widths, each partitioned over the nodes
+		Matrix<int64_t, ColumnMajorOrder> y2(v, n + 17), w2(r, n + 17), w2X(r, n + 17), wX(r, n), tcM(r, n);
+		BitMatrix c2(l, n + 17);
+		rnd.Fill(y2, [](uint64_t x) { return (int64_t)x; });
+		rnd.FillBits(c2);
+		const std::vector<const Matrix<int64_t, ColumnMajorOrder> *> ys { &yM, &y2 };
+		REQUIRE( numaops.MultiplyBatch(aM, ys, { &wM, &w2 }) );
+		REQUIRE( matops.Multiply(aM, yM, wX) );
+		REQUIRE( matops.Multiply(aM, y2, w2X) );
+		REQUIRE( wM == wX );
+		REQUIRE( w2 == w2X );
+		Matrix<int64_t, ColumnMajorOrder> tc2(r, n + 17), tc2X(r, n + 17);
+		const std::vector<const BitMatrix *> cs { &cM, &c2 };
+		REQUIRE( numaops.MultiplyBatch(tM, cs, { &tcM, &tc2 }) );
+		REQUIRE( matops.Multiply(tM, cM, wX) );
+		REQUIRE( matops.Multiply(tM, c2, tc2X) );
+		REQUIRE( tcM == wX );
+		REQUIRE( tc2 == tc2X );
+
+		// W = A*Z - T*C passes, and fails once an entry of any partition is off
+		rnd.Fill(tM, [](uint64_t x) { return (int64_t)x; });
+		REQUIRE( numaops.Sync(tM) );
+		REQUIRE( matops.Multiply(aM, zM, wM) );
+		REQUIRE( matops.Multiply(tM, cM, tcM) );
+		for (matdim_t i = 0; i < wM.NumCells(); i++) {
+			wM(i) -= tcM(i);
+		}
+		bool equal = false;
+		REQUIRE( numaops.CheckProducts(aM, zM, tM, cM, wM, equal) );
+		REQUIRE( equal );
+		wM(r - 1, n - 1) += 1;
+		REQUIRE( numaops.CheckProducts(aM, zM, tM, cM, wM, equal) );
+		REQUIRE( !equal );
+		wM(r - 1, n - 1) -= 1;
+
+		// and so for a seeded A and a seeded C
+		SeededMatrix<int64_t> aS(r, v, seed);
+		SeededBitMatrix cS(l, n, seed);
+		REQUIRE( cS.ToBitMatrix(cM) );
+		REQUIRE( matops.Multiply(aS, zM, wM) );
+		REQUIRE( matops.Multiply(tM, cM, tcM) );
+		for (matdim_t i = 0; i < wM.NumCells(); i++) {
+			wM(i) -= tcM(i);
+		}
+		REQUIRE( numaops.CheckProducts(aS, zM, tM, cS, wM, equal) );
+		REQUIRE( equal );
+		REQUIRE( numaops.CheckProducts(aS, zM, tM, cM, wM, equal) );
+		REQUIRE( equal );
+		wM(0, 0) += 1;
+		REQUIRE( numaops.CheckProducts(aS, zM, tM, cS, wM, equal) );
+		REQUIRE( !equal );
+
+		// C*X for the seeded C counts the bits it shares with each test vector
+		BitMatrix xM(n, 3);
+		rnd.FillBits(xM);
+		Matrix<int8_t, ColumnMajorOrder> c8(l, n);
+		Matrix<int64_t, ColumnMajorOrder> cxM(l, 3), cxX(l, 3);
+		REQUIRE( cM.ToMatrix(c8) );
+		REQUIRE( numaops.Multiply(cS, xM, cxM) );
+		REQUIRE( matops.Multiply(c8, xM, cxX) );
+		REQUIRE( cxM == cxX );
+	}
+	Matrix<int64_t, ColumnMajorOrder> zM(5, 3), wM(4, 3);
+	Matrix<int64_t, RowMajorOrder> aM(4, 5), tM(4, 6);
+	BitMatrix cM(7, 3);
+	bool equal;
+	REQUIRE( !numaops.CheckProducts(aM, zM, tM, cM, wM, equal) );
+}
+
+TEST_CASE( "NUMA-partitioned proofs proved into again verify with test vectors", "[latticezk]" ) {
+	typedef NumaMatrixOps<int64_t> MatOps;
+	typedef Prover<int64_t, FacctGaussianSampler<2000000000>, MatOps> prover_t;
+	const int s_bits = 2;
+	const uint32_t lambda = 8;
+	const matdim_t n = 10, r = 8, v = 60, l = 20;
+	const double s = (double)l * (1 << (s_bits - 1)), rho = 2;
+	AES_Random aes_rnd;
+	aes_rnd.reseed(3u);
+	BitsSampler bsampler(aes_rnd, s_bits);
+	MatrixSampler<UIntSampler<int64_t>> asampler(aes_rnd);
+	MatrixSampler<BitsSampler> ssampler(bsampler);
+	MatOps matops(two_node_topology());
+	MatOps::RowMajorMatrix matA(r, v);
+	MatOps::ColumnMajorMatrix matS(v, l);
+	REQUIRE( asampler(matA) );
+	REQUIRE( ssampler(matS) );
+	std::unique_ptr<prover_t> prover(prover_t::Create(matops, matA, matS, lambda, s, n, rho));
+	REQUIRE( prover != nullptr );
+	auto proof = prover->ReferencingProof();
+	AES_Random test_rnd;
+	test_rnd.reseed(5u);
+	// each proof is in the storage of the last, whose Z and W the verifier must not still hold
+	for (int round = 0; round < 3; round++) {
+		CAPTURE( round );
+		REQUIRE( prover->Prove(aes_rnd, proof) > 0 );
+		Verifier<int64_t, MatOps> verifier(matops, r, v, l, n, proof.B, test_rnd, 32), full(matops, r, v, l, n, proof.B);
+		REQUIRE( verifier.Verify(proof) );
+		REQUIRE( full.Verify(proof) );
+	}
+}
+
+TEST_CASE( "NUMA-partitioned products by file-backed matrices match MatrixOps", "[latticezk]" ) {
+	// tiles of 5 rows of S, so that the products span several
+	const matdim_t r = 13, v = 37, l = 120;
+	NumaMatrixOps<int64_t> numaops(two_node_topology(), 5 * l);
+	MatrixOps<int64_t> matops;
+	TestRandom rnd(3);
+	const uint8_t seed[16] = { 9 };
+	Matrix<int64_t, RowMajorOrder> aM(r, v), tM(r, l), tX(r, l);
+	Matrix<int8_t, RowMajorOrder> sM(v, l);
+	rnd.Fill(aM, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(sM, [](uint64_t x) { return (int8_t)(x >> 56); });
+	const std::string path = "latticezk_catch_numa.matrix";
+	FileMatrix<int8_t> sF;
+	REQUIRE( sF.Create(path, v, l) );
+	REQUIRE( sF.WriteRows(0, v, sM.Data()) );
+	REQUIRE( numaops.Multiply(aM, sF, tM) );
+	REQUIRE( matops.Multiply(aM, sM, tX) );
+	REQUIRE( tM == tX );
+	SeededMatrix<int64_t> aS(r, v, seed);
+	REQUIRE( numaops.Multiply(aS, sF, tM) );
+	REQUIRE( matops.Multiply(aS, sM, tX) );
+	REQUIRE( tM == tX );
+	for (matdim_t n : { 1, 40, 100 }) {
+		CAPTURE( n );
+		Matrix<int64_t, ColumnMajorOrder> yM(v, n), bM(v, n), bX(v, n), zM(v, n), zX(v, n);
+		BitMatrix cM(l, n);
+		rnd.Fill(yM, [](uint64_t x) { return (int64_t)(x >> 44) - (1 << 19); });
+		rnd.FillBits(cM);
+		REQUIRE( numaops.Multiply(sF, cM, bM) );
+		REQUIRE( matops.Multiply(sM, cM, bX) );
+		REQUIRE( bM == bX );
+		double ZB, BB, ZBX, BBX;
+		REQUIRE( numaops.MultiplyAdd(sF, cM, yM, bM, zM, ZB, BB) );
+		REQUIRE( matops.MultiplyAdd(sM, cM, yM, bX, zX, ZBX, BBX) );
+		REQUIRE( bM == bX );
+		REQUIRE( zM == zX );
+		REQUIRE( ZB == ZBX );
+		REQUIRE( BB == BBX );
+	}
+	Matrix<int64_t, RowMajorOrder> tY(r, l + 1);
+	REQUIRE( !numaops.Multiply(aM, sF, tY) );
+	sF.Close();
+	remove(path.c_str());
+}
+
+// Memory of no node at all
+class FailingAllocator : public MatrixAllocator
+{
+public:
+	void * Allocate(size_t bytes) override
+	{
+		LATTICEZK_UNUSED(bytes);
+		return nullptr;
+	}
+};
+
+TEST_CASE( "NUMA-partitioned products fail when the memory of the nodes is exhausted", "[latticezk]" ) {
+	const matdim_t r = 13, v = 37, l = 120, n = 100;
+	FailingAllocator failing;
+	NumaMatrixOps<int64_t> numaops(two_node_topology(), 5 * l, &failing);
+	TestRandom rnd(4);
+	Matrix<int64_t, RowMajorOrder> aM(r, v), tM(r, l);
+	Matrix<int8_t, RowMajorOrder> sM(v, l);
+	Matrix<int64_t, ColumnMajorOrder> yM(v, n), bM(v, n), zM(v, n), wM(r, n);
+	BitMatrix cM(l, n);
+	rnd.Fill(aM, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(sM, [](uint64_t x) { return (int8_t)(x >> 56); });
+	rnd.FillBits(cM);
+	const std::string path = "latticezk_catch_numa_failing.matrix";
+	FileMatrix<int8_t> sF;
+	REQUIRE( sF.Create(path, v, l) );
+	REQUIRE( sF.WriteRows(0, v, sM.Data()) );
+	// the replicas of the tiles of a file-backed S
+	double ZB, BB;
+	REQUIRE( !numaops.Multiply(sF, cM, bM) );
+	REQUIRE( !numaops.MultiplyAdd(sF, cM, yM, bM, zM, ZB, BB) );
+	// and of an in-memory A
+	REQUIRE( !numaops.Multiply(aM, sF, tM) );
+	REQUIRE( !numaops.Multiply(aM, yM, wM) );
+	// S*C + Y replicates nothing
+	REQUIRE( numaops.MultiplyAdd(sM, cM, yM, bM, zM, ZB, BB) );
+	sF.Close();
+	remove(path.c_str());
+}
+
+} // namespace LatticeZK
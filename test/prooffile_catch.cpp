@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "latticezk/matrix.hpp"
+#include "latticezk/prooffile.hpp"
+#include "latticezk/seededmatrix.hpp"
+#include "latticezk/util/bitpack.hpp"
+#include "testcommon.h"
+
+namespace LatticeZK {
+
+TEST_CASE( "proof files are mapped as the matrices they were written from", "[latticezk]" ) {
+	const matdim_t r = 7, v = 33, l = 70, n = 5;
+	Matrix<int64_t, RowMajorOrder> a(r, v), t(r, l);
+	Matrix<int64_t, ColumnMajorOrder> w(r, n), z(v, n);
+	TestRandom rnd(3);
+	rnd.Fill(a, [](uint64_t x) { return (int64_t)(x >> 11); });
+	rnd.Fill(t, [](uint64_t x) { return (int64_t)(x >> 11); });
+	rnd.Fill(w, [](uint64_t x) { return (int64_t)(x >> 11); });
+	rnd.Fill(z, [](uint64_t x) { return (int64_t)(x >> 11) % 1000; });
+	const std::string path = "latticezk_catch.proof";
+	REQUIRE( ProofFileWrite(path, 1234.5, 2e9, a, t, w, z) );
+
+	{
+		ProofFile file;
+		REQUIRE( file.Open(path) );
+		const ProofFileHeader & header = file.Header();
+		REQUIRE( header.r == r );
+		REQUIRE( header.v == v );
+		REQUIRE( header.l == l );
+		REQUIRE( header.n == n );
+		REQUIRE( header.entry_bytes == 8 );
+		REQUIRE( header.B == 1234.5 );
+		REQUIRE( header.sigma == 2e9 );
+		// the sections are handed out in order, aligned, and only for their own sizes
+		Matrix<int64_t, RowMajorOrder> fa(r, v, MatrixInit::Uninitialized, file);
+		REQUIRE( (uintptr_t)fa.Data() % LATTICEZK_ALIGNMENT == 0 );
+		REQUIRE( fa == a );
+		Matrix<int64_t, RowMajorOrder> fw(r, n, MatrixInit::Uninitialized, file);
+		REQUIRE( fw.Data() == nullptr );
+	}
+	{
+		ProofFile file;
+		REQUIRE( file.Open(path) );
+		Matrix<int64_t, RowMajorOrder> fa(r, v, MatrixInit::Uninitialized, file), ft(r, l, MatrixInit::Uninitialized, file);
+		Matrix<int64_t, ColumnMajorOrder> fw(r, n, MatrixInit::Uninitialized, file), fz(v, n, MatrixInit::Uninitialized, file);
+		REQUIRE( file.NumTaken() == LATTICEZK_PROOF_SECTIONS );
+		// the challenge is not stored
+		REQUIRE( file.Allocate(sizeof(uint64_t)) == nullptr );
+		REQUIRE( fa == a );
+		REQUIRE( ft == t );
+		REQUIRE( fw == w );
+		REQUIRE( fz == z );
+	}
+
+	// a flipped bit of any section or of the header fails the checksums
+	std::string image;
+	{
+		std::ifstream in(path, std::ios::binary);
+		image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	ProofFile file;
+	for (size_t at : { (size_t)8, sizeof(ProofFileHeader) + 100, image.size() - 100 }) {
+		std::string corrupt = image;
+		corrupt[at] ^= 4;
+		std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupt.data(), corrupt.size());
+		REQUIRE_FALSE( file.Open(path) );
+	}
+	std::ofstream(path, std::ios::binary | std::ios::trunc).write(image.data(), image.size() / 2);
+	REQUIRE_FALSE( file.Open(path) );
+	REQUIRE_FALSE( file.Open("no_such_directory/latticezk.proof") );
+	remove(path.c_str());
+}
+
+TEST_CASE( "entries are packed to their bit widths and back", "[latticezk]" ) {
+	TestRandom next(5);
+	for (int64_t n : { 0, 1, 63, 64, 65, 1000 }) {
+		for (int bits : { 0, 1, 7, 35, 64 }) {
+			std::vector<int64_t> a(n), b(n, 7);
+			for (int64_t i = 0; i < n; i++) {
+				a[i] = bits == 0 ? 0 : (int64_t)next() >> (64 - bits);
+			}
+			if (n > 100) {
+				a[n / 2] = INT64_MIN;
+			}
+			std::vector<uint64_t> packed(BitPackMaxBytes<int64_t>(n) / 8 + 1);
+			const size_t bytes = BitPack(a.data(), n, (uint8_t *)packed.data());
+			REQUIRE( bytes <= BitPackMaxBytes<int64_t>(n) );
+			REQUIRE( BitUnpack((const uint8_t *)packed.data(), bytes, n, b.data()) );
+			REQUIRE( a == b );
+			REQUIRE_FALSE( BitUnpack((const uint8_t *)packed.data(), bytes + 8, n, b.data()) );
+		}
+	}
+	// entries of 33 bits, as Gaussian ones of sigma 2^31, take a little over half of their 64
+	const int64_t n = 4096;
+	std::vector<int64_t> z(n);
+	for (int64_t i = 0; i < n; i++) {
+		z[i] = (int64_t)next() >> 31;
+	}
+	std::vector<uint64_t> packed(BitPackMaxBytes<int64_t>(n) / 8);
+	REQUIRE( BitPack(z.data(), n, (uint8_t *)packed.data()) == BitPackWidthBytes(n) + n * 33 / 8 );
+	std::vector<int8_t> c(100, -3), d(100);
+	REQUIRE( BitUnpack((const uint8_t *)packed.data(), BitPack(c.data(), 100, (uint8_t *)packed.data()), 100, d.data()) );
+	REQUIRE( c == d );
+}
+
+TEST_CASE( "compact proof files unpack to the matrices they were written from", "[latticezk]" ) {
+	const matdim_t r = 9, v = 100, l = 64, n = 3;
+	Matrix<int64_t, RowMajorOrder> a(r, v), t(r, l);
+	Matrix<int64_t, ColumnMajorOrder> w(r, n), z(v, n);
+	for (matdim_t i = 0; i < a.NumCells(); i++) a(i) = i * 0x9e3779b97f4a7c15ll;
+	for (matdim_t i = 0; i < t.NumCells(); i++) t(i) = i - 100;
+	for (matdim_t i = 0; i < z.NumCells(); i++) z(i) = (i % 2 == 0 ? 1 : -1) * (int64_t)i * 1000003;
+	const std::string path = "latticezk_catch_compact.proof";
+	REQUIRE( ProofFileWrite(path, 10.0, 2.0, a, t, w, z, true) );
+	ProofFile file;
+	REQUIRE( file.Open(path) );
+	REQUIRE( file.Header().packed == LATTICEZK_PROOF_COMPACT_SECTIONS );
+	// only Z is packed, A, T and W being kept as is
+	REQUIRE( file.Header().bytes[0] == a.NumCells() * sizeof(int64_t) );
+	REQUIRE( file.Header().bytes[1] == t.NumCells() * sizeof(int64_t) );
+	REQUIRE( file.Header().bytes[2] == w.NumCells() * sizeof(int64_t) );
+	REQUIRE( file.Header().bytes[3] < z.NumCells() * sizeof(int64_t) * 3 / 4 );
+	Matrix<int64_t, RowMajorOrder> fa(r, v, MatrixInit::Uninitialized, file), ft(r, l, MatrixInit::Uninitialized, file);
+	Matrix<int64_t, ColumnMajorOrder> fw(r, n, MatrixInit::Uninitialized, file), fz(v, n, MatrixInit::Uninitialized, file);
+	REQUIRE( file.NumTaken() == LATTICEZK_PROOF_SECTIONS );
+	REQUIRE( fa == a );
+	REQUIRE( ft == t );
+	REQUIRE( fw == w );
+	REQUIRE( fz == z );
+	remove(path.c_str());
+}
+
+TEST_CASE( "proof files of a seeded A hold its seed alone", "[latticezk]" ) {
+	const matdim_t r = 5, v = 40, l = 3, n = 4;
+	uint8_t seed[16];
+	for (int i = 0; i < 16; i++) {
+		seed[i] = (uint8_t)(i * 13 + 1);
+	}
+	SeededMatrix<int64_t> a(r, v, seed);
+	Matrix<int64_t, RowMajorOrder> t(r, l);
+	Matrix<int64_t, ColumnMajorOrder> w(r, n), z(v, n);
+	TestRandom rnd(9);
+	rnd.Fill(t, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(w, [](uint64_t x) { return (int64_t)x; });
+	rnd.Fill(z, [](uint64_t x) { return (int64_t)(x >> 40); });
+	const std::string path = "latticezk_catch_seeded.proof";
+	for (bool compact : { false, true }) {
+		CAPTURE( compact );
+		REQUIRE( ProofFileWrite(path, 10.0, 2.0, a, t, w, z, compact) );
+		ProofFile file;
+		REQUIRE( file.Open(path) );
+		REQUIRE( file.IsSeededA() );
+		REQUIRE( file.Header().bytes[0] == 16 );
+		// the seed is not handed out as storage, and only once
+		REQUIRE( file.Allocate(16) == nullptr );
+		const uint8_t * fseed = file.TakeSeedA();
+		REQUIRE( fseed != nullptr );
+		REQUIRE( memcmp(fseed, seed, 16) == 0 );
+		REQUIRE( file.TakeSeedA() == nullptr );
+		Matrix<int64_t, RowMajorOrder> ft(r, l, MatrixInit::Uninitialized, file);
+		Matrix<int64_t, ColumnMajorOrder> fw(r, n, MatrixInit::Uninitialized, file), fz(v, n, MatrixInit::Uninitialized, file);
+		REQUIRE( file.NumTaken() == LATTICEZK_PROOF_SECTIONS );
+		REQUIRE( ft == t );
+		REQUIRE( fw == w );
+		REQUIRE( fz == z );
+	}
+	// a file of a full A has no seed to hand out
+	Matrix<int64_t, RowMajorOrder> fullA(r, v);
+	REQUIRE( ProofFileWrite(path, 10.0, 2.0, fullA, t, w, z) );
+	ProofFile file;
+	REQUIRE( file.Open(path) );
+	REQUIRE_FALSE( file.IsSeededA() );
+	REQUIRE( file.TakeSeedA() == nullptr );
+	remove(path.c_str());
+}
+
+TEST_CASE( "proof files of a Gaussian Z round-trip, plain and compact", "[latticezk]" ) {
+	const matdim_t v = 300, n = 20;
+	Matrix<int64_t, RowMajorOrder> a(1, v), t(1, 1);
+	Matrix<int64_t, ColumnMajorOrder> w(1, n), z(v, n);
+	std::mt19937_64 gen(9);
+	std::normal_distribution<double> gaussian(0, ldexp(1, 31));
+	for (matdim_t i = 0; i < z.NumCells(); i++) {
+		z(i) = (int64_t)llround(gaussian(gen));
+	}
+	for (bool compact : { false, true }) {
+		CAPTURE( compact );
+		const std::string path = "latticezk_catch_gaussian.proof";
+		REQUIRE( ProofFileWrite(path, 10.0, ldexp(1, 31), a, t, w, z, compact) );
+		{
+			ProofFile file;
+			REQUIRE( file.Open(path) );
+			if (compact) {
+				// entries of sigma 2^31 take some 34 of their 64 bits
+				REQUIRE( file.Header().bytes[3] < z.NumCells() * sizeof(int64_t) * 35 / 64 );
+			} else {
+				REQUIRE( file.Header().bytes[3] == z.NumCells() * sizeof(int64_t) );
+			}
+			Matrix<int64_t, RowMajorOrder> fa(1, v, MatrixInit::Uninitialized, file), ft(1, 1, MatrixInit::Uninitialized, file);
+			Matrix<int64_t, ColumnMajorOrder> fw(1, n, MatrixInit::Uninitialized, file), fz(v, n, MatrixInit::Uninitialized, file);
+			REQUIRE( fz == z );
+		}
+		remove(path.c_str());
+	}
+}
+
+// Times packing and unpacking a Z of Gaussian entries of sigma 2^31 against writing and reading proof files of it,
+// plain and compact, in megabytes of Z per second; hidden from the default run, and run by its [benchmark] tag
+TEST_CASE( "packing Z is timed against writing and reading proof files", "[.][benchmark]" ) {
+	const matdim_t v = 3000, n = 1000;
+	Matrix<int64_t, RowMajorOrder> a(1, v), t(1, 1);
+	Matrix<int64_t, ColumnMajorOrder> w(1, n), z(v, n), y(v, n);
+	std::mt19937_64 gen(9);
+	std::normal_distribution<double> gaussian(0, ldexp(1, 31));
+	for (matdim_t i = 0; i < z.NumCells(); i++) {
+		z(i) = (int64_t)llround(gaussian(gen));
+	}
+	const double mb = z.NumCells() * sizeof(int64_t) / 1e6;
+	auto rate = [mb](std::chrono::steady_clock::time_point t0) {
+		return mb / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	};
+
+	std::vector<uint64_t> packed(BitPackMaxBytes<int64_t>(z.NumCells()) / sizeof(uint64_t));
+	auto t0 = std::chrono::steady_clock::now();
+	const size_t bytes = BitPack(z.Data(), z.NumCells(), (uint8_t *)packed.data());
+	const double pack = rate(t0);
+	t0 = std::chrono::steady_clock::now();
+	REQUIRE( BitUnpack((const uint8_t *)packed.data(), bytes, z.NumCells(), y.Data()) );
+	const double unpack = rate(t0);
+	REQUIRE( y == z );
+	REQUIRE( bytes < mb * 1e6 * 35 / 64 );
+	std::cerr << "Z " << v << "x" << n << " packed to " << bytes * 64 / (mb * 1e6) << " bits/entry, pack MB/s: " << pack
+		<< ", unpack MB/s: " << unpack << std::endl;
+
+	for (bool compact : { false, true }) {
+		const std::string path = "latticezk_catch_timed.proof";
+		t0 = std::chrono::steady_clock::now();
+		REQUIRE( ProofFileWrite(path, 10.0, ldexp(1, 31), a, t, w, z, compact) );
+		const double write = rate(t0);
+		{
+			ProofFile file;
+			t0 = std::chrono::steady_clock::now();
+			REQUIRE( file.Open(path) );
+			const double read = rate(t0);
+			Matrix<int64_t, RowMajorOrder> fa(1, v, MatrixInit::Uninitialized, file), ft(1, 1, MatrixInit::Uninitialized, file);
+			Matrix<int64_t, ColumnMajorOrder> fw(1, n, MatrixInit::Uninitialized, file), fz(v, n, MatrixInit::Uninitialized, file);
+			REQUIRE( fz == z );
+			std::cerr << (compact ? "compact" : "plain") << " proof file write MB/s: " << write << ", read MB/s: " << read << std::endl;
+		}
+		remove(path.c_str());
+	}
+}
+
+} // namespace LatticeZK
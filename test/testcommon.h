@@ -1,6 +1,8 @@
 #ifndef __LATTICEZK_TESTCOMMON_H_
 #define __LATTICEZK_TESTCOMMON_H_
 
+#include <stdint.h>
+
 //! \brief Measure RDTSC at start of segment
 //! \returns the RDTSC measurement
 inline uint64_t rdtsc_start() {
@@ -25,4 +27,34 @@ inline uint64_t rdtsc_stop() {
 		return (uint64_t)high << 32 | low;
 }
 
+//! \brief A seeded 64-bit LCG, for filling test matrices reproducibly
+class TestRandom {
+public:
+	explicit TestRandom(uint64_t seed) : x(seed) {
+	}
+	//! \returns the next state
+	uint64_t operator()() {
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+		return x;
+	}
+	//! \brief Fills the cells of a matrix, in storage order, with f of successive states
+	template<typename M, typename F>
+	void Fill(M & m, F f) {
+		for (int64_t i = 0; i < (int64_t)m.NumCells(); i++) {
+			m(i) = f((*this)());
+		}
+	}
+	//! \brief Fills a bit matrix, a column at a time, with the top bits of successive states
+	template<typename B>
+	void FillBits(B & b) {
+		for (int64_t j = 0; j < (int64_t)b.NumCols(); j++) {
+			for (int64_t i = 0; i < (int64_t)b.NumRows(); i++) {
+				b.Set(i, j, (int)((*this)() >> 63));
+			}
+		}
+	}
+private:
+	uint64_t x;
+};
+
 #endif /* __LATTICEZK_TESTCOMMON_H_ */